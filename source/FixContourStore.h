@@ -0,0 +1,63 @@
+//
+//  FixContourStore.h
+//  Giddy Machinist
+//
+//  Created by Dömötör Gulyás on 19.10.2026.
+//  Copyright (c) 2026 Dömötör Gulyás. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "VectorMath_fixp.h"
+
+@class FixPolygon, FixPolygonClosedSegment;
+
+/*!
+ @description Compact storage for the closed contours of a single sliced layer. All contours share one Z and fixed point shift, vertices are kept as packed x/y arrays. Contours are stored outline first, followed by their holes, recursively, and the hole table lists the direct children of each contour.
+ */
+@interface FixContourStore : NSObject
+
+- (instancetype) initWithOutlines: (NSArray*) outlines;
+
+@property(nonatomic, readonly) vmint_t z;
+@property(nonatomic, readonly) long shift;
+
+@property(nonatomic, readonly) size_t contourCount;
+@property(nonatomic, readonly) size_t vertexCount;
+
+@property(nonatomic, readonly) const vmint_t* xCoordinates;
+@property(nonatomic, readonly) const vmint_t* yCoordinates;
+
+- (size_t) vertexOffsetOfContour: (size_t) contour;
+- (size_t) vertexCountOfContour: (size_t) contour;
+
+- (long) parentOfContour: (size_t) contour;
+- (size_t) holeCountOfContour: (size_t) contour;
+- (size_t) holeAtIndex: (size_t) i ofContour: (size_t) contour;
+
+- (v3i_t) vertexAtIndex: (size_t) i ofContour: (size_t) contour;
+- (r3i_t) boundsOfContour: (size_t) contour;
+
+- (void) enumerateContoursUsingBlock: (void(^)(size_t contour, const vmint_t* xs, const vmint_t* ys, size_t count, BOOL* stop)) block;
+
+/*!
+ Materializes a contour as a segment, only the requested contour is expanded.
+ */
+- (FixPolygonClosedSegment*) segmentForContour: (size_t) contour;
+
+/*!
+ Recreates the tree of SlicedOutline objects the store was created from.
+ */
+- (NSArray*) outlines;
+
+- (FixPolygon*) polygon;
+
+@property(nonatomic, readonly) size_t byteSize;
+
+/*!
+ Flat binary form of the store, for scratch files of the same process, not as an interchange format. Returns nil on a malformed or truncated buffer.
+ */
+- (NSData*) serializedData;
+- (instancetype) initWithSerializedBytes: (const void*) bytes length: (size_t) length;
+
+@end
@@ -0,0 +1,330 @@
+//
+//  FixContourStore.m
+//  Giddy Machinist
+//
+//  Created by Dömötör Gulyás on 19.10.2026.
+//  Copyright (c) 2026 Dömötör Gulyás. All rights reserved.
+//
+
+#import "FixContourStore.h"
+
+#import "FixPolygon.h"
+#import "SlicedOutline.h"
+#import "FoundationExtensions.h"
+
+
+@implementation FixContourStore
+{
+	vmint_t*	xs;
+	vmint_t*	ys;
+
+	uint32_t*	contourStarts;	// contourCount+1 entries into xs/ys
+	int32_t*	contourParents;	// -1 for outer outlines
+	uint32_t*	holeStarts;		// contourCount+1 entries into holeIndices
+	uint32_t*	holeIndices;
+}
+
+@synthesize z, shift, contourCount, vertexCount;
+
+- (id) init
+{
+	[self doesNotRecognizeSelector: _cmd];
+	return nil;
+}
+
+static void _countOutlines(NSArray* outlines, size_t* numContours, size_t* numVertices)
+{
+	for (SlicedOutline* outline in outlines)
+	{
+		*numContours += 1;
+		*numVertices += outline.outline.vertexCount;
+		_countOutlines(outline.holes, numContours, numVertices);
+	}
+}
+
+- (size_t) storeOutline: (SlicedOutline*) outline parent: (long) parent atContour: (size_t) ci vertex: (size_t*) vi hole: (size_t*) hi
+{
+	FixPolygonClosedSegment* segment = outline.outline;
+	v3i_t* vs = segment.vertices;
+	size_t count = segment.vertexCount;
+
+	contourStarts[ci] = (uint32_t)*vi;
+	contourParents[ci] = (int32_t)parent;
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		assert((vs[i].z == z) && (vs[i].shift == shift));
+		xs[*vi] = vs[i].x;
+		ys[*vi] = vs[i].y;
+		*vi += 1;
+	}
+
+	// reserve hole slots first, so that each contour's holes are contiguous
+	size_t holeBase = *hi;
+	holeStarts[ci] = (uint32_t)holeBase;
+	*hi += outline.holes.count;
+
+	size_t next = ci+1;
+	size_t k = 0;
+	for (SlicedOutline* hole in outline.holes)
+	{
+		holeIndices[holeBase + k++] = (uint32_t)next;
+		next = [self storeOutline: hole parent: ci atContour: next vertex: vi hole: hi];
+	}
+
+	return next;
+}
+
+- (instancetype) initWithOutlines: (NSArray*) outlines
+{
+	if (!(self = [super init]))
+		return nil;
+
+	_countOutlines(outlines, &contourCount, &vertexCount);
+
+	SlicedOutline* firstOutline = outlines.firstObject;
+	if (firstOutline.outline.vertexCount)
+	{
+		z = firstOutline.outline.begin.z;
+		shift = firstOutline.outline.begin.shift;
+	}
+
+	xs = calloc(vertexCount, sizeof(*xs));
+	ys = calloc(vertexCount, sizeof(*ys));
+	contourStarts = calloc(contourCount+1, sizeof(*contourStarts));
+	contourParents = calloc(contourCount, sizeof(*contourParents));
+	holeStarts = calloc(contourCount+1, sizeof(*holeStarts));
+	holeIndices = calloc(contourCount, sizeof(*holeIndices));
+
+	size_t ci = 0, vi = 0, hi = 0;
+
+	for (SlicedOutline* outline in outlines)
+		ci = [self storeOutline: outline parent: -1 atContour: ci vertex: &vi hole: &hi];
+
+	assert(ci == contourCount);
+	assert(vi == vertexCount);
+
+	contourStarts[contourCount] = (uint32_t)vertexCount;
+	holeStarts[contourCount] = (uint32_t)hi;
+
+	return self;
+}
+
+typedef struct {
+	uint32_t	magic;
+	uint32_t	contourCount, vertexCount, holeCount;
+	vmint_t		z;
+	int32_t		shift;
+} _FixContourStoreHeader;
+
+#define FIXCONTOURSTORE_MAGIC 0x46435331 // 'FCS1'
+
+- (instancetype) initWithSerializedBytes: (const void*) bytes length: (size_t) length
+{
+	if (!(self = [super init]))
+		return nil;
+
+	_FixContourStoreHeader header;
+	if (length < sizeof(header))
+		return nil;
+	memcpy(&header, bytes, sizeof(header));
+
+	if (header.magic != FIXCONTOURSTORE_MAGIC)
+		return nil;
+
+	contourCount = header.contourCount;
+	vertexCount = header.vertexCount;
+	z = header.z;
+	shift = header.shift;
+
+	size_t expected = sizeof(header) + vertexCount*(sizeof(*xs) + sizeof(*ys)) + (contourCount+1)*(sizeof(*contourStarts) + sizeof(*holeStarts)) + contourCount*sizeof(*contourParents) + header.holeCount*sizeof(*holeIndices);
+	if ((length != expected) || (header.holeCount > contourCount))
+		return nil;
+
+	xs = calloc(vertexCount, sizeof(*xs));
+	ys = calloc(vertexCount, sizeof(*ys));
+	contourStarts = calloc(contourCount+1, sizeof(*contourStarts));
+	contourParents = calloc(contourCount, sizeof(*contourParents));
+	holeStarts = calloc(contourCount+1, sizeof(*holeStarts));
+	holeIndices = calloc(contourCount, sizeof(*holeIndices));
+
+	const char* p = (const char*)bytes + sizeof(header);
+	memcpy(xs, p, vertexCount*sizeof(*xs)); p += vertexCount*sizeof(*xs);
+	memcpy(ys, p, vertexCount*sizeof(*ys)); p += vertexCount*sizeof(*ys);
+	memcpy(contourStarts, p, (contourCount+1)*sizeof(*contourStarts)); p += (contourCount+1)*sizeof(*contourStarts);
+	memcpy(contourParents, p, contourCount*sizeof(*contourParents)); p += contourCount*sizeof(*contourParents);
+	memcpy(holeStarts, p, (contourCount+1)*sizeof(*holeStarts)); p += (contourCount+1)*sizeof(*holeStarts);
+	memcpy(holeIndices, p, header.holeCount*sizeof(*holeIndices));
+
+	if ((contourStarts[contourCount] != vertexCount) || (holeStarts[contourCount] != header.holeCount))
+		return nil;
+
+	return self;
+}
+
+- (NSData*) serializedData
+{
+	_FixContourStoreHeader header = {FIXCONTOURSTORE_MAGIC, (uint32_t)contourCount, (uint32_t)vertexCount, holeStarts[contourCount], z, (int32_t)shift};
+
+	NSMutableData* data = [NSMutableData dataWithCapacity: sizeof(header) + self.byteSize];
+	[data appendBytes: &header length: sizeof(header)];
+	[data appendBytes: xs length: vertexCount*sizeof(*xs)];
+	[data appendBytes: ys length: vertexCount*sizeof(*ys)];
+	[data appendBytes: contourStarts length: (contourCount+1)*sizeof(*contourStarts)];
+	[data appendBytes: contourParents length: contourCount*sizeof(*contourParents)];
+	[data appendBytes: holeStarts length: (contourCount+1)*sizeof(*holeStarts)];
+	[data appendBytes: holeIndices length: header.holeCount*sizeof(*holeIndices)];
+
+	return data;
+}
+
+- (void) dealloc
+{
+	free(xs);
+	free(ys);
+	free(contourStarts);
+	free(contourParents);
+	free(holeStarts);
+	free(holeIndices);
+}
+
+- (const vmint_t*) xCoordinates
+{
+	return xs;
+}
+
+- (const vmint_t*) yCoordinates
+{
+	return ys;
+}
+
+- (size_t) vertexOffsetOfContour: (size_t) contour
+{
+	assert(contour < contourCount);
+	return contourStarts[contour];
+}
+
+- (size_t) vertexCountOfContour: (size_t) contour
+{
+	assert(contour < contourCount);
+	return contourStarts[contour+1] - contourStarts[contour];
+}
+
+- (long) parentOfContour: (size_t) contour
+{
+	assert(contour < contourCount);
+	return contourParents[contour];
+}
+
+- (size_t) holeCountOfContour: (size_t) contour
+{
+	assert(contour < contourCount);
+	// hole slots are reserved before descending, so the next contour in preorder starts right after ours
+	return holeStarts[contour+1] - holeStarts[contour];
+}
+
+- (size_t) holeAtIndex: (size_t) i ofContour: (size_t) contour
+{
+	assert(i < [self holeCountOfContour: contour]);
+	return holeIndices[holeStarts[contour] + i];
+}
+
+- (v3i_t) vertexAtIndex: (size_t) i ofContour: (size_t) contour
+{
+	size_t k = contourStarts[contour] + i;
+	assert(k < contourStarts[contour+1]);
+	return v3iCreate(xs[k], ys[k], z, shift);
+}
+
+- (r3i_t) boundsOfContour: (size_t) contour
+{
+	r3i_t r = {v3iCreate(INT32_MAX, INT32_MAX, z, shift), v3iCreate(INT32_MIN, INT32_MIN, z, shift)};
+	for (size_t k = contourStarts[contour]; k < contourStarts[contour+1]; ++k)
+	{
+		r.min.x = MIN(r.min.x, xs[k]);
+		r.min.y = MIN(r.min.y, ys[k]);
+		r.max.x = MAX(r.max.x, xs[k]);
+		r.max.y = MAX(r.max.y, ys[k]);
+	}
+	return r;
+}
+
+- (void) enumerateContoursUsingBlock: (void(^)(size_t contour, const vmint_t* xs, const vmint_t* ys, size_t count, BOOL* stop)) block
+{
+	BOOL stop = NO;
+	for (size_t i = 0; i < contourCount; ++i)
+	{
+		size_t start = contourStarts[i];
+		block(i, xs + start, ys + start, contourStarts[i+1] - start, &stop);
+		if (stop)
+			break;
+	}
+}
+
+- (FixPolygonClosedSegment*) segmentForContour: (size_t) contour
+{
+	size_t count = [self vertexCountOfContour: contour];
+	size_t start = contourStarts[contour];
+
+	v3i_t* vs = calloc(count, sizeof(*vs));
+	for (size_t i = 0; i < count; ++i)
+		vs[i] = v3iCreate(xs[start+i], ys[start+i], z, shift);
+
+	FixPolygonClosedSegment* segment = [[FixPolygonClosedSegment alloc] init];
+	[segment addVertices: vs count: count];
+	[segment analyzeSegment];
+
+	free(vs);
+
+	return segment;
+}
+
+- (SlicedOutline*) outlineForContour: (size_t) contour
+{
+	SlicedOutline* outline = [[SlicedOutline alloc] init];
+	outline.outline = [self segmentForContour: contour];
+
+	size_t holeCount = [self holeCountOfContour: contour];
+	NSMutableArray* holes = [NSMutableArray arrayWithCapacity: holeCount];
+	for (size_t i = 0; i < holeCount; ++i)
+		[holes addObject: [self outlineForContour: [self holeAtIndex: i ofContour: contour]]];
+
+	outline.holes = holes;
+
+	return outline;
+}
+
+- (NSArray*) outlines
+{
+	NSMutableArray* outlines = [NSMutableArray array];
+
+	for (size_t i = 0; i < contourCount; ++i)
+		if (contourParents[i] < 0)
+			[outlines addObject: [self outlineForContour: i]];
+
+	return outlines;
+}
+
+- (FixPolygon*) polygon
+{
+	NSMutableArray* segments = [NSMutableArray arrayWithCapacity: contourCount];
+
+	for (size_t i = 0; i < contourCount; ++i)
+		[segments addObject: [self segmentForContour: i]];
+
+	FixPolygon* polygon = [[FixPolygon alloc] init];
+	polygon.segments = segments;
+	return polygon;
+}
+
+- (size_t) byteSize
+{
+	return vertexCount*(sizeof(*xs) + sizeof(*ys)) + (contourCount+1)*(sizeof(*contourStarts) + sizeof(*holeStarts)) + contourCount*(sizeof(*contourParents) + sizeof(*holeIndices));
+}
+
+- (id) description
+{
+	return [NSString stringWithFormat: @"%zu contours, %zu vertices, %zu bytes", contourCount, vertexCount, self.byteSize];
+}
+
+@end
@@ -31,8 +31,16 @@ typedef enum {
 
 @property(nonatomic, strong) NSArray* segments;
 
+/*!
+ Curves are flattened in fixed point, subdivided until they deviate no more than flatness from the chords, and subpaths are flattened in parallel. No global state is involved, so this may be called from any thread, as long as bpath is not being changed.
+ */
 + (FixPolygon*) polygonFromBezierPath: (NSBezierPath*) bpath withTransform: (NSAffineTransform*) transform flatness: (CGFloat) flatness;
 
+/*!
+ Copy with all vertices transformed and rounded back to fixed point. Nesting levels and display colors are kept, so that a rigid motion of a finished toolpath needs no further processing.
+ */
+- (FixPolygon*) polygonByApplyingAffineTransform: (NSAffineTransform*) transform;
+
 - (GfxMesh*) gfxMesh;
 - (GfxNode*) gfx;
 @property(nonatomic) vector_t openStartColor, openEndColor, ccwStartColor, ccwEndColor, cwStartColor, cwEndColor;
@@ -42,12 +50,25 @@ typedef enum {
 
 - (void) nestPolygonWithOptions: (PolygonNestingOptions) options;
 
+/*!
+ Reorders segments to reduce travel between them, starting from start, while keeping inner segments ahead of the closed segments enclosing them. Closed segments may be rotated to start at a different vertex and open segments reversed.
+ */
+- (void) optimizeSegmentOrderFrom: (v3i_t) start timeBudget: (double) seconds;
+
+/*!
+ Simplifies all closed segments so that no removed vertex deviates more than tolerance from the simplified outline. Segments are checked against each other to preserve topology.
+ */
+- (void) simplifyWithTolerance: (double) tolerance;
+
 @end
 
 
 
 
 
+/*!
+ @description A polyline of fixed point vertices. Segments may be queried from several threads at once, but must not be mutated while they are queried, by any thread. Every mutation drops cached geometry, such as the containment index of closed segments, which queries rebuild when next needed.
+ */
 @interface FixPolygonSegment : NSObject <NSCopying>
 
 @property(nonatomic,readonly) v3i_t* vertices;
@@ -70,6 +91,8 @@ typedef enum {
 
 - (void) reverse;
 
+- (void) applyAffineTransform: (NSAffineTransform*) transform;
+
 - (NSBezierPath*) bezierPath;
 
 
@@ -98,6 +121,7 @@ typedef enum {
 - (double) area;
 
 - (BOOL) containsPath: (FixPolygonSegment*) segment;
+- (BOOL) containsPoint: (v3i_t) point;
 
 - (void) analyzeSegment;
 
@@ -105,4 +129,11 @@ typedef enum {
 
 - (void) optimizeColinears: (vmlongfix_t) threshold;
 
+- (void) rotateToStartAtVertex: (size_t) index;
+
+/*!
+ Douglas-Peucker simplification with a guaranteed maximum deviation of tolerance. Simplified edges are rejected if they touch any of the obstacle segments, another part of self, or the simplified edges accepted so far, so that the result does not intersect itself and nesting with holes is preserved.
+ */
+- (void) simplifyWithTolerance: (vmintfix_t) tolerance avoidingSegments: (NSArray*) obstacles;
+
 @end
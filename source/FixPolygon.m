@@ -18,6 +18,8 @@
 @import AppKit;
 
 #import "FoundationExtensions.h"
+#import "ToolpathOrderOptimizer.h"
+#import "GMMetrics.h"
 
 
 @interface PolygonIntersection : NSObject
@@ -298,6 +300,28 @@
 	return poly;
 }
 
+- (FixPolygon*) polygonByApplyingAffineTransform: (NSAffineTransform*) transform
+{
+	FixPolygon* poly = [self copy];
+	
+	[poly.segments enumerateObjectsUsingBlock: ^(FixPolygonSegment* segment, NSUInteger idx, BOOL* stop) {
+		segment.nestingLevel = [[self.segments objectAtIndex: idx] nestingLevel];
+		[segment applyAffineTransform: transform];
+		if (segment.isClosed)
+			[(FixPolygonClosedSegment*)segment analyzeSegment];
+	}];
+	
+	poly.openStartColor = self.openStartColor;
+	poly.openEndColor = self.openEndColor;
+	poly.ccwStartColor = self.ccwStartColor;
+	poly.ccwEndColor = self.ccwEndColor;
+	poly.cwStartColor = self.cwStartColor;
+	poly.cwEndColor = self.cwEndColor;
+	poly.opacity = self.opacity;
+	
+	return poly;
+}
+
 - (void) nestPolygonWithOptions: (PolygonNestingOptions) options
 {
 	NSArray* polys = [FixPolygonRecursive recursivelySortSegments: self.segments];
@@ -324,91 +348,229 @@
 	}
 	
 	self.segments = allSegments;
+
+}
+
+- (void) optimizeSegmentOrderFrom: (v3i_t) start timeBudget: (double) seconds
+{
+	ToolpathOrderOptimizer* optimizer = [[ToolpathOrderOptimizer alloc] initWithSegments: self.segments];
+	optimizer.startPosition = start;
+	optimizer.timeBudget = seconds;
 	
+	self.segments = [optimizer optimizedSegments];
 }
 
+- (void) simplifyWithTolerance: (double) tolerance
+{
+	NSArray* closedSegments = [self.segments select: ^BOOL(FixPolygonSegment* obj) {
+		return obj.isClosed;
+	}];
+
+	vmintfix_t tol = iFixCreateFromFloat(tolerance, 16);
 
-+ (FixPolygon*) polygonFromBezierPath: (NSBezierPath*) bpath withTransform: (NSAffineTransform*) transform flatness: (CGFloat) flatness
+	for (FixPolygonClosedSegment* segment in closedSegments)
+		[segment simplifyWithTolerance: tol avoidingSegments: closedSegments];
+
+	gfxMeshCache = nil;
+}
+
+
+#define FLATTEN_MAX_DEPTH 16
+
+/*!
+ Path elements with their points already transformed and in fixed point, so that subpaths can be flattened without touching the NSBezierPath.
+ */
+typedef struct {
+	NSBezierPathElement	type;
+	v3i_t				points[3];
+} _FixPathElement;
+
+typedef struct {
+	v3i_t*	vertices;
+	size_t	count, capacity;
+} _FixVertexBuffer;
+
+static void _appendVertex(_FixVertexBuffer* buffer, v3i_t v)
 {
-	bpath = [bpath copy]; // copy path because we don't want to alter the original
-	if (transform)
-		[bpath transformUsingAffineTransform: transform];
-	
-	CGFloat oldFlatness = [NSBezierPath defaultFlatness];
-	
-	[NSBezierPath setDefaultFlatness: flatness];
-	[bpath setFlatness: flatness];
-	NSBezierPath* flatPath = [bpath bezierPathByFlatteningPath];
-	
-	[NSBezierPath setDefaultFlatness: oldFlatness];
+	if (buffer->count == buffer->capacity)
+	{
+		buffer->capacity = MAX(16, 2*buffer->capacity);
+		buffer->vertices = realloc(buffer->vertices, sizeof(*buffer->vertices)*buffer->capacity);
+	}
+	buffer->vertices[buffer->count++] = v;
+}
 
-	NSInteger count = flatPath.elementCount;
+/*!
+ Flattens a cubic bezier segment, appending all vertices but the first. Halves are split off until the curve deviates by no more than tolerance from the chord, using the bound of the distance from the chord given by the control points, max(ux², vx²) + max(uy², vy²) <= 16 tolerance². Gentle curves therefore get few vertices, regardless of their length.
+ 
+ Splitting is done in fixed point, midpoints round down, which drifts by less than a unit per level, the bound itself is evaluated in floating point, as its squares do not fit 64 bits.
+ */
+static void _flattenCubic(_FixVertexBuffer* buffer, const int64_t p[4][2], double toleranceSqr16, long shift, int depth)
+{
+	double ux = 3.0*p[1][0] - 2.0*p[0][0] - p[3][0];
+	double uy = 3.0*p[1][1] - 2.0*p[0][1] - p[3][1];
+	double vx = 3.0*p[2][0] - p[0][0] - 2.0*p[3][0];
+	double vy = 3.0*p[2][1] - p[0][1] - 2.0*p[3][1];
 	
-	FixPolygonOpenSegment* currentSegment = nil;
+	if ((depth >= FLATTEN_MAX_DEPTH) || (fmax(ux*ux, vx*vx) + fmax(uy*uy, vy*vy) <= toleranceSqr16))
+	{
+		v3i_t v = v3iCreate(p[3][0], p[3][1], 0, shift);
+		v3i_t last = buffer->vertices[buffer->count-1];
+		// degenerate curves and rounding may emit the same vertex twice
+		if ((v.x != last.x) || (v.y != last.y))
+			_appendVertex(buffer, v);
+		return;
+	}
 	
-	NSMutableArray* segments = [[NSMutableArray alloc] init];
+	int64_t left[4][2], right[4][2];
 	
-	id (^attemptClose)(id) = ^id(FixPolygonOpenSegment* segment){
+	for (int i = 0; i < 2; ++i)
+	{
+		int64_t p01 = (p[0][i] + p[1][i]) >> 1;
+		int64_t p12 = (p[1][i] + p[2][i]) >> 1;
+		int64_t p23 = (p[2][i] + p[3][i]) >> 1;
+		int64_t p012 = (p01 + p12) >> 1;
+		int64_t p123 = (p12 + p23) >> 1;
+		int64_t mid = (p012 + p123) >> 1;
+		
+		left[0][i] = p[0][i];
+		left[1][i] = p01;
+		left[2][i] = p012;
+		left[3][i] = mid;
+		right[0][i] = mid;
+		right[1][i] = p123;
+		right[2][i] = p23;
+		right[3][i] = p[3][i];
+	}
+	
+	_flattenCubic(buffer, left, toleranceSqr16, shift, depth+1);
+	_flattenCubic(buffer, right, toleranceSqr16, shift, depth+1);
+}
 
-		if (!segment.isClosed)
-		{
-			FixPolygonClosedSegment* csegment = [segment closePolygonByMergingEndpoints];
-			[csegment analyzeSegment];
-			
-			
-			if (csegment)
-			{
-				return csegment;
-			}
-		}
-		return segment;
-	};
+/*!
+ Turns a subpath, starting with its moveto, into a segment. Closepaths close the segment, as they did for the flattened NSBezierPath, anything following it up to the next moveto is dropped. Unclosed subpaths are left to the caller.
+ */
+static FixPolygonSegment* _segmentFromSubpath(const _FixPathElement* elements, size_t count, vmintfix_t tolerance)
+{
+	_FixVertexBuffer buffer = {NULL, 0, 0};
+	double toleranceSqr16 = 16.0*(double)tolerance*(double)tolerance;
+	BOOL closed = NO;
 	
-	for (NSInteger i = 0; i < count-1; ++i)
+	for (size_t i = 0; (i < count) && !closed; ++i)
 	{
-		NSPoint pa[3];
-		NSBezierPathElement element = [flatPath elementAtIndex: i associatedPoints: pa];
-		
-		switch (element) {
+		const _FixPathElement* element = elements + i;
+		switch (element->type)
+		{
 			case NSMoveToBezierPathElement:
-			{
-				if (currentSegment)
-				{
-					[segments addObject: attemptClose(currentSegment)];
-				}
-				currentSegment = [[FixPolygonOpenSegment alloc] init];
-				v3i_t v = v3iCreateFromFloat(pa[0].x, pa[0].y, 0.0, 16);
-				[currentSegment insertVertexAtEnd: v];
-				break;
-			}
 			case NSLineToBezierPathElement:
+				_appendVertex(&buffer, element->points[0]);
+				break;
+			case NSCurveToBezierPathElement:
 			{
-				v3i_t v = v3iCreateFromFloat(pa[0].x, pa[0].y, 0.0, 16);
-				[currentSegment insertVertexAtEnd: v];
+				v3i_t a = buffer.vertices[buffer.count-1];
+				int64_t p[4][2] = {
+					{a.x, a.y},
+					{element->points[0].x, element->points[0].y},
+					{element->points[1].x, element->points[1].y},
+					{element->points[2].x, element->points[2].y},
+				};
+				_flattenCubic(&buffer, p, toleranceSqr16, a.shift, 0);
 				break;
 			}
 			case NSClosePathBezierPathElement:
-			{
-				FixPolygonClosedSegment* cseg = [currentSegment closePolygonWithoutMergingEndpoints];
-
-				if (cseg)
-					[segments addObject: cseg];
-				currentSegment = nil;
+				closed = YES;
 				break;
-			}
 			default:
 				assert(0); // unsupported path element
 				break;
 		}
-		
 	}
 	
-	if (currentSegment)
+	// a lone moveto has nothing to draw
+	if (buffer.count < 2)
 	{
-		[currentSegment cleanupDoubleVertices];
-		[segments addObject: attemptClose(currentSegment)];
+		free(buffer.vertices);
+		return nil;
 	}
 	
+	FixPolygonOpenSegment* segment = [[FixPolygonOpenSegment alloc] init];
+	[segment addVertices: buffer.vertices count: buffer.count];
+	free(buffer.vertices);
+	
+	if (closed)
+		return [segment closePolygonWithoutMergingEndpoints];
+	
+	return segment;
+}
+
++ (FixPolygon*) polygonFromBezierPath: (NSBezierPath*) bpath withTransform: (NSAffineTransform*) transform flatness: (CGFloat) flatness
+{
+	NSInteger count = bpath.elementCount;
+	
+	// reading the path is kept serial, and leaves the path untouched, only plain arrays are handed to the workers
+	_FixPathElement* elements = calloc(MAX(count, 1), sizeof(*elements));
+	size_t* subpathStarts = calloc(count+1, sizeof(*subpathStarts));
+	size_t subpathCount = 0;
+	
+	for (NSInteger i = 0; i < count; ++i)
+	{
+		NSPoint pa[3];
+		NSBezierPathElement type = [bpath elementAtIndex: i associatedPoints: pa];
+		size_t pointCount = (type == NSCurveToBezierPathElement) ? 3 : ((type == NSClosePathBezierPathElement) ? 0 : 1);
+		
+		elements[i].type = type;
+		for (size_t j = 0; j < pointCount; ++j)
+		{
+			NSPoint p = transform ? [transform transformPoint: pa[j]] : pa[j];
+			elements[i].points[j] = v3iCreateFromFloat(p.x, p.y, 0.0, 16);
+		}
+		
+		if (type == NSMoveToBezierPathElement)
+			subpathStarts[subpathCount++] = i;
+	}
+	subpathStarts[subpathCount] = count;
+	
+	vmintfix_t tolerance = iFixCreateFromFloat(flatness, 16);
+	
+	NSMutableArray* results = [NSMutableArray arrayWithCapacity: subpathCount];
+	for (size_t i = 0; i < subpathCount; ++i)
+		[results addObject: [NSNull null]];
+	
+	dispatch_apply(subpathCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+		size_t start = subpathStarts[i];
+		FixPolygonSegment* segment = _segmentFromSubpath(elements + start, subpathStarts[i+1] - start, tolerance);
+		
+		// an unclosed subpath still becomes a closed segment if its ends meet
+		if (segment && !segment.isClosed)
+		{
+			FixPolygonOpenSegment* openSegment = (id)segment;
+			if (i+1 == subpathCount)
+				[openSegment cleanupDoubleVertices];
+			
+			FixPolygonClosedSegment* csegment = [openSegment closePolygonByMergingEndpoints];
+			[csegment analyzeSegment];
+			if (csegment)
+				segment = csegment;
+		}
+		
+		if (!segment)
+			return;
+		
+		@synchronized(results)
+		{
+			[results replaceObjectAtIndex: i withObject: segment];
+		}
+	});
+	
+	free(subpathStarts);
+	free(elements);
+	
+	NSArray* segments = [results select: ^BOOL(id obj) {
+		return ![obj isEqual: [NSNull null]];
+	}];
+	
+	GM_METRIC_COUNT("import.subpaths", subpathCount);
+	
 	FixPolygon* polygon = [[FixPolygon alloc] init];
 	polygon.segments = segments;
 	
@@ -576,13 +738,15 @@
 
 @property(nonatomic,strong) NSString* navLabel;
 
+- (void) invalidateVertexCaches;
+
 @end
 
 
 @implementation FixPolygonSegment
 {
 @public
-	size_t	vertexCount;
+	size_t	vertexCount, vertexCapacity;
 	v3i_t*	vertices;
 }
 
@@ -597,6 +761,11 @@
 	return self;
 }
 
+- (void) dealloc
+{
+	free(vertices);
+}
+
 - (instancetype) copyWithZone:(NSZone *)zone
 {
 	FixPolygonSegment* poly = [[[self class] alloc] init];
@@ -606,11 +775,21 @@
 	return poly;
 }
 
+- (void) invalidateVertexCaches
+{
+}
+
 - (void) expandVertexCount: (size_t) count
 {
 	size_t newCount = MAX(vertexCount, count);
-	vertices = realloc(vertices, sizeof(*vertices)*newCount);
+	// grow geometrically, segments are mostly built one vertex at a time
+	if (newCount > vertexCapacity)
+	{
+		vertexCapacity = MAX(newCount, 2*vertexCapacity);
+		vertices = realloc(vertices, sizeof(*vertices)*vertexCapacity);
+	}
 	vertexCount = newCount;
+	[self invalidateVertexCaches];
 }
 
 - (void) setBegin: (v3i_t) v
@@ -618,6 +797,7 @@
 	[self expandVertexCount: 1];
 	
 	vertices[0] = v;
+	[self invalidateVertexCaches];
 }
 
 - (void) setEnd: (v3i_t)v
@@ -626,6 +806,7 @@
 		[self expandVertexCount: 2];
 	
 	vertices[vertexCount-1] = v;
+	[self invalidateVertexCaches];
 }
 
 - (void) addVertices: (v3i_t*) v count: (size_t) count;
@@ -688,6 +869,20 @@
 }
 
 
+- (void) applyAffineTransform: (NSAffineTransform*) transform
+{
+	NSAffineTransformStruct t = transform.transformStruct;
+	
+	for (size_t i = 0; i < vertexCount; ++i)
+	{
+		vector_t v = v3iToFloat(vertices[i]);
+		double x = t.m11*v.farr[0] + t.m21*v.farr[1] + t.tX;
+		double y = t.m12*v.farr[0] + t.m22*v.farr[1] + t.tY;
+		vertices[i] = v3iCreateFromFloat(x, y, v.farr[2], vertices[i].shift);
+	}
+	[self invalidateVertexCaches];
+}
+
 - (void) reverse
 {
 	long areaPositive = self.area > 0;
@@ -698,6 +893,7 @@
 		vertices[i] = b;
 		vertices[vertexCount-i-1] = a;
 	}
+	[self invalidateVertexCaches];
 	long areaRev = self.area >= 0;
 	
 	assert(areaPositive != areaRev);
@@ -731,6 +927,7 @@
 		while (v3iEqual(self.begin, self.end))
 			--vertexCount;
 	
+	[self invalidateVertexCaches];
 }
 
 static NSString* _verticesToSVGPolygon(v3i_t* vertices, size_t numVertices)
@@ -941,11 +1138,193 @@ static NSString* _verticesToSVG(v3i_t* vertices, size_t numVertices)
 
 
 
+static long _orient2D(v3i_t a, v3i_t b, v3i_t c)
+{
+	vmlonger_t cross = (vmlonger_t)((vmlong_t)b.x - a.x)*((vmlong_t)c.y - a.y) - (vmlonger_t)((vmlong_t)b.y - a.y)*((vmlong_t)c.x - a.x);
+
+	return (cross > 0) - (cross < 0);
+}
+
+static BOOL _onSegmentBox(v3i_t a, v3i_t b, v3i_t x)
+{
+	return (MIN(a.x, b.x) <= x.x) && (x.x <= MAX(a.x, b.x)) && (MIN(a.y, b.y) <= x.y) && (x.y <= MAX(a.y, b.y));
+}
+
+/*
+ The containment index buckets the edges of a closed segment into uniform slabs along Y, so that a winding number query only has to look at the edges crossing the query point's slab. It is reference counted, so that invalidating it does not free it under a query still using it.
+ */
+typedef struct {
+	long		refCount;
+	vmint_t		minY, maxY, minX, maxX;
+	size_t		numSlabs;
+	size_t*		slabStarts;
+	uint32_t*	edgeIndices;
+} FixPolygonContainmentIndex;
+
+static const size_t kFixPolygonContainmentIndexMinVertices = 16;
+
+static FixPolygonContainmentIndex* _retainContainmentIndex(FixPolygonContainmentIndex* index)
+{
+	__atomic_add_fetch(&index->refCount, 1, __ATOMIC_RELAXED);
+	return index;
+}
+
+static void _releaseContainmentIndex(FixPolygonContainmentIndex* index)
+{
+	if (!index || (__atomic_sub_fetch(&index->refCount, 1, __ATOMIC_ACQ_REL) > 0))
+		return;
+	free(index->slabStarts);
+	free(index->edgeIndices);
+	free(index);
+}
+
+static inline size_t _containmentSlab(FixPolygonContainmentIndex* index, vmint_t y)
+{
+	vmlong_t dy = (vmlong_t)y - index->minY;
+	vmlong_t h = (vmlong_t)index->maxY - index->minY + 1;
+	return (size_t)((dy*(vmlong_t)index->numSlabs)/h);
+}
+
+static FixPolygonContainmentIndex* _createContainmentIndex(v3i_t* vertices, size_t vertexCount)
+{
+	FixPolygonContainmentIndex* index = calloc(1, sizeof(*index));
+	
+	index->refCount = 1;
+	index->minX = index->minY = INT32_MAX;
+	index->maxX = index->maxY = INT32_MIN;
+	for (size_t i = 0; i < vertexCount; ++i)
+	{
+		index->minX = MIN(index->minX, vertices[i].x);
+		index->maxX = MAX(index->maxX, vertices[i].x);
+		index->minY = MIN(index->minY, vertices[i].y);
+		index->maxY = MAX(index->maxY, vertices[i].y);
+	}
+	
+	index->numSlabs = MAX(1, vertexCount/2);
+	index->slabStarts = calloc(index->numSlabs+1, sizeof(*index->slabStarts));
+	
+	// count pass, then fill pass into the compacted array
+	for (size_t i = 0; i < vertexCount; ++i)
+	{
+		v3i_t p0 = vertices[i];
+		v3i_t p1 = vertices[(i+1) % vertexCount];
+		size_t s0 = _containmentSlab(index, MIN(p0.y, p1.y));
+		size_t s1 = _containmentSlab(index, MAX(p0.y, p1.y));
+		for (size_t s = s0; s <= s1; ++s)
+			index->slabStarts[s+1]++;
+	}
+	for (size_t s = 0; s < index->numSlabs; ++s)
+		index->slabStarts[s+1] += index->slabStarts[s];
+	
+	index->edgeIndices = calloc(index->slabStarts[index->numSlabs], sizeof(*index->edgeIndices));
+	
+	size_t* fill = calloc(index->numSlabs, sizeof(*fill));
+	for (size_t i = 0; i < vertexCount; ++i)
+	{
+		v3i_t p0 = vertices[i];
+		v3i_t p1 = vertices[(i+1) % vertexCount];
+		size_t s0 = _containmentSlab(index, MIN(p0.y, p1.y));
+		size_t s1 = _containmentSlab(index, MAX(p0.y, p1.y));
+		for (size_t s = s0; s <= s1; ++s)
+			index->edgeIndices[index->slabStarts[s] + fill[s]++] = (uint32_t)i;
+	}
+	free(fill);
+	
+	return index;
+}
+
+/*
+ Exact winding number of a point against the edges [start, end) of the edge list. Sets *onBoundary if the point lies on one of the edges.
+ */
+static long _windingNumber(v3i_t* vertices, size_t vertexCount, uint32_t* edges, size_t numEdges, v3i_t x, BOOL* onBoundary)
+{
+	long winding = 0;
+	
+	for (size_t k = 0; k < numEdges; ++k)
+	{
+		size_t i = edges ? edges[k] : k;
+		v3i_t p0 = vertices[i];
+		v3i_t p1 = vertices[(i+1) % vertexCount];
+		
+		long side = _orient2D(p0, p1, x);
+		
+		if (!side && _onSegmentBox(p0, p1, x))
+		{
+			*onBoundary = YES;
+			return 0;
+		}
+		
+		if (p0.y <= x.y)
+		{
+			if ((p1.y > x.y) && (side > 0))
+				++winding;
+		}
+		else if ((p1.y <= x.y) && (side < 0))
+			--winding;
+	}
+	return winding;
+}
+
 @implementation FixPolygonClosedSegment
 {
+	FixPolygonContainmentIndex* containmentIndex;
 }
 @synthesize isConvex;
 
+- (void) dealloc
+{
+	_releaseContainmentIndex(containmentIndex);
+}
+
+- (void) invalidateVertexCaches
+{
+	@synchronized(self) {
+		_releaseContainmentIndex(containmentIndex);
+		containmentIndex = NULL;
+	}
+}
+
+- (BOOL) containsPoint: (v3i_t) x
+{
+	if (vertexCount < 3)
+		return NO;
+	
+	BOOL onBoundary = NO;
+	long winding = 0;
+	
+	if (vertexCount < kFixPolygonContainmentIndexMinVertices)
+	{
+		winding = _windingNumber(vertices, vertexCount, NULL, vertexCount, x, &onBoundary);
+	}
+	else
+	{
+		FixPolygonContainmentIndex* index = NULL;
+		@synchronized(self) {
+			if (!containmentIndex)
+				containmentIndex = _createContainmentIndex(vertices, vertexCount);
+			index = _retainContainmentIndex(containmentIndex);
+		}
+		
+		if ((x.y < index->minY) || (x.y > index->maxY) || (x.x < index->minX) || (x.x > index->maxX))
+		{
+			_releaseContainmentIndex(index);
+			return NO;
+		}
+		
+		size_t slab = _containmentSlab(index, x.y);
+		size_t start = index->slabStarts[slab];
+		size_t end = index->slabStarts[slab+1];
+		
+		winding = _windingNumber(vertices, vertexCount, index->edgeIndices + start, end - start, x, &onBoundary);
+		
+		_releaseContainmentIndex(index);
+	}
+	
+	assert(ABS(winding) < 2);
+	
+	return !onBoundary && (winding != 0);
+}
+
 - (instancetype) copyWithZone:(NSZone *)zone
 {
 	FixPolygonClosedSegment* poly = [super copyWithZone: zone];
@@ -1014,6 +1393,21 @@ static NSString* _verticesToSVG(v3i_t* vertices, size_t numVertices)
 	
 }
 
+- (void) rotateToStartAtVertex: (size_t) index
+{
+	assert(index < vertexCount);
+	if (!index)
+		return;
+	
+	v3i_t* rotated = calloc(vertexCount, sizeof(*rotated));
+	memcpy(rotated, vertices + index, sizeof(*vertices)*(vertexCount-index));
+	memcpy(rotated + vertexCount - index, vertices, sizeof(*vertices)*index);
+	memcpy(vertices, rotated, sizeof(*vertices)*vertexCount);
+	free(rotated);
+	
+	[self invalidateVertexCaches];
+}
+
 - (void) optimizeColinears: (vmlongfix_t) threshold
 {
 	//	BOOL wasCCW = self.isCCW;
@@ -1048,10 +1442,234 @@ static NSString* _verticesToSVG(v3i_t* vertices, size_t numVertices)
 		}
 	}
 	
+	[self invalidateVertexCaches];
 	[self analyzeSegment];
 	//	assert(wasCCW == isCCW);
 }
 
+// exact test, touching counts as intersecting
+static BOOL _segmentsIntersect(v3i_t p0, v3i_t p1, v3i_t q0, v3i_t q1)
+{
+	long d0 = _orient2D(q0, q1, p0);
+	long d1 = _orient2D(q0, q1, p1);
+	long d2 = _orient2D(p0, p1, q0);
+	long d3 = _orient2D(p0, p1, q1);
+
+	if ((d0*d1 < 0) && (d2*d3 < 0))
+		return YES;
+
+	if (!d0 && _onSegmentBox(q0, q1, p0))
+		return YES;
+	if (!d1 && _onSegmentBox(q0, q1, p1))
+		return YES;
+	if (!d2 && _onSegmentBox(p0, p1, q0))
+		return YES;
+	if (!d3 && _onSegmentBox(p0, p1, q1))
+		return YES;
+
+	return NO;
+}
+
+/*
+ Returns YES if the segments from s to u and from s to w overlap, which segments sharing an end point only do if they are collinear and point the same way.
+ */
+static BOOL _segmentsFoldBack(v3i_t s, v3i_t u, v3i_t w)
+{
+	if (_orient2D(s, u, w))
+		return NO;
+
+	vmlonger_t dot = (vmlonger_t)((vmlong_t)u.x - s.x)*((vmlong_t)w.x - s.x) + (vmlonger_t)((vmlong_t)u.y - s.y)*((vmlong_t)w.y - s.y);
+	return dot > 0;
+}
+
+/*
+ Returns YES if x is further than sqrt(tolSqr) from the line segment [a,b]. Coordinate differences are assumed to fit into 31 bits, so that the squared cross product does not overflow 128 bits.
+ */
+static BOOL _exceedsSegmentDistance(v3i_t a, v3i_t b, v3i_t x, vmlonger_t tolSqr, vmlonger_t* crossSqrOut)
+{
+	vmlong_t ex = (vmlong_t)b.x - a.x, ey = (vmlong_t)b.y - a.y;
+	vmlong_t dx = (vmlong_t)x.x - a.x, dy = (vmlong_t)x.y - a.y;
+
+	vmlonger_t elen = (vmlonger_t)ex*ex + (vmlonger_t)ey*ey;
+	vmlonger_t dot = (vmlonger_t)ex*dx + (vmlonger_t)ey*dy;
+	vmlonger_t cross = (vmlonger_t)ex*dy - (vmlonger_t)ey*dx;
+
+	*crossSqrOut = cross*cross;
+
+	if ((dot <= 0) || (elen == 0))
+		return (vmlonger_t)dx*dx + (vmlonger_t)dy*dy > tolSqr;
+	else if (dot >= elen)
+	{
+		vmlong_t fx = (vmlong_t)x.x - b.x, fy = (vmlong_t)x.y - b.y;
+		return (vmlonger_t)fx*fx + (vmlonger_t)fy*fy > tolSqr;
+	}
+	else
+		return cross*cross > tolSqr*elen;
+}
+
+static BOOL _chordIntersectsRing(v3i_t a, v3i_t b, v3i_t* vs, size_t count, size_t start, size_t end)
+{
+	r3i_t rc = riCreateFromVectors(a, b);
+
+	for (size_t m = start; m < end; ++m)
+	{
+		v3i_t q0 = vs[m % count];
+		v3i_t q1 = vs[(m+1) % count];
+
+		if (!riCheckIntersection2D(rc, riCreateFromVectors(q0, q1)))
+			continue;
+
+		if (_segmentsIntersect(a, b, q0, q1))
+			return YES;
+	}
+	return NO;
+}
+
+- (void) simplifyWithTolerance: (vmintfix_t) tolerance avoidingSegments: (NSArray*) obstacles
+{
+	size_t count = vertexCount;
+
+	if (count < 4)
+		return;
+
+	// bring tolerance to the same fixed point scale as the vertices
+	long ds = vertices[0].shift - tolerance.shift;
+	vmlong_t tol = (ds >= 0) ? ((vmlong_t)tolerance.x << ds) : ((vmlong_t)tolerance.x >> -ds);
+
+	vmlonger_t tolSqr = (vmlonger_t)tol*tol;
+
+	obstacles = [obstacles select: ^BOOL(FixPolygonSegment* obj) {
+		return (obj != self) && obj.isClosed && (obj.vertexCount > 1);
+	}];
+
+	r3i_t* obstacleBounds = calloc(obstacles.count+1, sizeof(*obstacleBounds));
+	for (size_t i = 0; i < obstacles.count; ++i)
+		obstacleBounds[i] = [[obstacles objectAtIndex: i] bounds];
+
+	// anchor the ring at vertex 0 and the vertex furthest from it
+	size_t far = 0;
+	vmlong_t farDist = -1;
+	for (size_t i = 1; i < count; ++i)
+	{
+		vmlong_t dist = v3iDot(v3iSub(vertices[i], vertices[0]), v3iSub(vertices[i], vertices[0])).x;
+		if (dist > farDist)
+		{
+			farDist = dist;
+			far = i;
+		}
+	}
+
+	BOOL* keep = calloc(count, sizeof(*keep));
+	size_t* spans = calloc(2*count, sizeof(*spans));
+	size_t numSpans = 0;
+	// chords replacing spans of the ring so far, as pairs of vertex indices
+	size_t* chords = calloc(2*count, sizeof(*chords));
+	size_t numChords = 0;
+
+	keep[0] = YES;
+	keep[far] = YES;
+
+	spans[numSpans++] = 0;
+	spans[numSpans++] = far;
+	spans[numSpans++] = far;
+	spans[numSpans++] = count;
+
+	while (numSpans)
+	{
+		size_t j = spans[--numSpans];
+		size_t i = spans[--numSpans];
+
+		if (j - i < 2)
+			continue;
+
+		v3i_t a = vertices[i];
+		v3i_t b = vertices[j % count];
+
+		size_t split = NSNotFound;
+		size_t firstExceeding = NSNotFound;
+		vmlonger_t maxCrossSqr = 0;
+
+		for (size_t k = i+1; k < j; ++k)
+		{
+			vmlonger_t crossSqr = 0;
+			if (_exceedsSegmentDistance(a, b, vertices[k], tolSqr, &crossSqr) && (firstExceeding == NSNotFound))
+				firstExceeding = k;
+			if (crossSqr > maxCrossSqr)
+			{
+				maxCrossSqr = crossSqr;
+				split = k;
+			}
+		}
+
+		if (firstExceeding == NSNotFound)
+		{
+			// chord is within tolerance, but it must not change topology, neither crossing the original ring outside the span, nor chords replacing other spans
+			BOOL intersects = _chordIntersectsRing(a, b, vertices, count, j+1, i+count-1);
+
+			for (size_t m = 0; !intersects && (m < numChords); m += 2)
+			{
+				size_t p = chords[m], q = chords[m+1];
+				// neighbouring chords share an end point, which only matters if they fold back onto each other
+				if (p == j % count)
+					intersects = _segmentsFoldBack(b, a, vertices[q]);
+				else if (q == i)
+					intersects = _segmentsFoldBack(a, b, vertices[p]);
+				else
+					intersects = _segmentsIntersect(a, b, vertices[p], vertices[q]);
+			}
+
+			r3i_t rc = riCreateFromVectors(a, b);
+			for (size_t m = 0; !intersects && (m < obstacles.count); ++m)
+			{
+				if (!riCheckIntersection2D(rc, obstacleBounds[m]))
+					continue;
+				FixPolygonSegment* obstacle = [obstacles objectAtIndex: m];
+				intersects = _chordIntersectsRing(a, b, obstacle.vertices, obstacle.vertexCount, 0, obstacle.vertexCount);
+			}
+
+			if (!intersects)
+			{
+				chords[numChords++] = i;
+				chords[numChords++] = j % count;
+				continue;
+			}
+		}
+
+		if (split == NSNotFound)
+			split = (firstExceeding != NSNotFound) ? firstExceeding : (i+j)/2;
+
+		keep[split] = YES;
+
+		spans[numSpans++] = i;
+		spans[numSpans++] = split;
+		spans[numSpans++] = split;
+		spans[numSpans++] = j;
+	}
+
+	size_t newCount = 0;
+	for (size_t i = 0; i < count; ++i)
+		newCount += keep[i];
+
+	// slivers thinner than the tolerance collapse to a line, keep those as they are
+	if (newCount >= 3)
+	{
+		size_t k = 0;
+		for (size_t i = 0; i < count; ++i)
+			if (keep[i])
+				vertices[k++] = vertices[i];
+
+		vertexCount = newCount;
+		[self invalidateVertexCaches];
+	}
+
+	free(chords);
+	free(spans);
+	free(keep);
+	free(obstacleBounds);
+
+	[self analyzeSegment];
+}
+
 static long _mpLocationOnEdge_boxTest(v3i_t a, v3i_t b, MPVector2D* X)
 {
 	MPVector2D* A = [MPVector2D vectorWith3i: a];
@@ -1195,82 +1813,15 @@ static MPVector2D* _checkIntersection(v3i_t p0, v3i_t p1, v3i_t q0, v3i_t q1)
 }
 
 
-/*! Checks via ray casting if a single vertex of self is contained in segment.
+/*! Checks if the first vertex of segment is contained in self, by its winding number. Segments with many vertices build an edge index on first use, so repeated queries against the same outline are cheap.
  
  */
 - (BOOL) containsPath: (FixPolygonSegment*) segment
 {
-	//assert(isCCW && segment.isCCW); // FIXME: assertion no longer necessary?
-	
-	v3i_t sc = segment.begin;
-	MPVector2D* SC = [MPVector2D vectorWith3i: sc];
-
-	r3i_t bounds = self.bounds;
-	
-	if (vertexCount < 3)
-		return NO;
-	
-	//	if (!rRangeContainsPointXYInclusiveMinExclusiveMax(bounds, sc))
-	//		return NO;
-	
-	// ray is going along X
-	v3i_t ray = v3iCreate(bounds.max.x+1, 0, 0, bounds.max.shift);
-	v3i_t se = v3iAdd(sc, ray);
-	
-	r3i_t rr = riCreateFromVectors(sc, se);
-	
-	long windingCounter = 0;
-	
-	for (long i = 0; i < vertexCount; ++i)
-	{
-		v3i_t p0 = vertices[i];
-		v3i_t p1 = vertices[(i+1) % vertexCount];
-		
-		r3i_t rp = riCreateFromVectors(p0, p1);
-		
-		if (!riCheckIntersection2D(rr, rp))
-			continue;
-		
-		MPVector2D* X = _checkIntersection(p0, p1, sc, se);
-		
-		if (!X)
-			continue;
-		
-		//v3i_t x = [X toVectorWithShift: 16];
-		
-		MPVector2D* P0 = [MPVector2D vectorWith3i: p0];
-		MPVector2D* P1 = [MPVector2D vectorWith3i: p1];
-		
-		
-		MPVector2D* E = [P1 sub: P0];
-		
-		// as the test ray propagates in +X
-		// for edges going +Y, [0,den) is valid
-		// for edges going -Y, (0, den] is valid
-		
-		BOOL goingY = E.y.isPositive;
-		
-		if (goingY && [P0 isEqualToVector: X])
-			continue;
-		else if (!goingY && [P1 isEqualToVector: X])
-			continue;
-		
-		MPVector2D* D = [SC sub: X];
-		
-		if (D.x.isZero && D.y.isZero)
-			continue;
-		
-		NSComparisonResult fs = [E cross: D].compareToZero;
-		
-		assert(fs != 0);
-		windingCounter += fs;
-	}
-	assert(ABS(windingCounter) < 2);
-	if (windingCounter != 0)
-		return self.isCCW ? windingCounter > 0 : windingCounter < 0;
-	else
+	if (!segment.vertexCount)
 		return NO;
 	
+	return [self containsPoint: segment.begin];
 }
 
 
@@ -31,6 +31,8 @@
 
 @property(nonatomic) double layerHeight;
 @property(nonatomic) long numPerimeters;
+@property(nonatomic) double infillDensity;		// 0.0 to 1.0, fraction of the area inside the perimeters
+@property(nonatomic) double infillAngle;		// degrees, alternating by 90° between layers
 
 - (double) extrusionWidthForExtruder: (long) extruderIndex;
 
@@ -49,6 +49,8 @@
 	
 	settings.layerHeight = 0.0002;
 	settings.numPerimeters = 3;
+	settings.infillDensity = 0.2;
+	settings.infillAngle = 45.0;
 	
 	settings.printerDescription = [GM3DPrinterDescription defaultPrinterDescription];
 	
@@ -0,0 +1,39 @@
+//
+//  GMBenchmark.h
+//  Giddy Machinist
+//
+//  Created by Dömötör Gulyás on 19.10.2026.
+//  Copyright (c) 2026 Dömötör Gulyás. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/*!
+ @description Stage-level benchmark of the slicing pipeline, run from the command line instead of the application:
+
+ Giddy\ Machinist --benchmark <STL directory> <results.json> [baseline.json] [--pitches=0.2,0.5,1.0]
+
+ Every model in the directory is loaded, sliced at each layer pitch, and the outlines of each layer are skeletized with the perimeter emission times of the default print settings. The infill boundaries emitted inside the last perimeter are then filled, all layers in parallel. Wall time, heap allocations and the peak heap above the level before loading the model are recorded per stage, and written as JSON. Given a baseline written by an earlier run, the change in time and allocations per stage is reported.
+
+ Allocations are counted by wrapping the functions of all registered malloc zones, so they include those of Foundation.
+ */
+@interface GMBenchmark : NSObject
+
+/*!
+ Takes the arguments following --benchmark, returns the process exit status.
+ */
++ (int) runWithArguments: (NSArray*) arguments;
+
+/*!
+ Takes the arguments following --benchmark-scaling:
+
+ Giddy\ Machinist --benchmark-scaling <results.json> [--max-vertices=100000] [--time-limit=60] [--families=star,noisyCircle,comb,nestedHoles,nearParallel]
+
+ Skeletizes generated polygons of each family, without emission, at three sizes per decade from 10 vertices up, and fits time, allocations and peak heap against the vertex count on a log-log scale. The exponents show how the skeletizer scales, and the local exponents between neighbouring sizes where it stops scaling well. A family stops growing once a size takes longer than the time limit.
+ */
++ (int) runScalingWithArguments: (NSArray*) arguments;
+
+- (NSDictionary*) benchmarkSTLAtPath: (NSString*) path layerPitch: (double) pitch;
+- (NSDictionary*) benchmarkSkeletonOfLoops: (NSArray*) loops;
+
+@end
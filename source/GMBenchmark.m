@@ -0,0 +1,824 @@
+//
+//  GMBenchmark.m
+//  Giddy Machinist
+//
+//  Created by Dömötör Gulyás on 19.10.2026.
+//  Copyright (c) 2026 Dömötör Gulyás. All rights reserved.
+//
+
+#import "GMBenchmark.h"
+
+#import "STLFile.h"
+#import "Slicer.h"
+#import "SlicedOutline.h"
+#import "FixPolygon.h"
+#import "PolygonSkeletizer.h"
+#import "PolygonSkeletizerObjects.h"
+#import "PSWaveFrontSnapshot.h"
+#import "GM3DPrinterDescription.h"
+#import "ScanlineInfill.h"
+#import "MPInteger.h"
+#import "FoundationExtensions.h"
+#import "GMMetrics.h"
+
+#import <malloc/malloc.h>
+#import <mach/mach.h>
+
+
+#define BENCHMARK_MAX_ZONES 16
+#define BENCHMARK_REGRESSION_THRESHOLD 0.1 // relative change reported as a regression
+#define BENCHMARK_MIN_REPORTED_TIME 0.001
+
+typedef enum {
+	GMBenchmarkStageLoad,
+	GMBenchmarkStageSlicing,
+	GMBenchmarkStageJoining,
+	GMBenchmarkStageNesting,
+	GMBenchmarkStageMotorcycles,
+	GMBenchmarkStageWaveFronts,
+	GMBenchmarkStageEmission,
+	GMBenchmarkStageInfill,
+	GMBenchmarkStageCount
+} GMBenchmarkStage;
+
+static NSString* const _stageNames[GMBenchmarkStageCount] = {
+	@"stlLoad",
+	@"layerSlicing",
+	@"segmentJoining",
+	@"nesting",
+	@"motorcyclePhase",
+	@"waveFrontPhase",
+	@"offsetEmission",
+	@"infill",
+};
+
+
+#pragma mark Allocation Counting
+
+typedef struct {
+	malloc_zone_t*	zone;
+	malloc_zone_t	original;
+} _CountedZone;
+
+static _CountedZone _countedZones[BENCHMARK_MAX_ZONES];
+static size_t _countedZoneCount = 0;
+
+static uint64_t _allocationCount = 0;
+static int64_t _liveBytes = 0, _peakBytes = 0;
+
+static const malloc_zone_t* _originalZone(malloc_zone_t* zone)
+{
+	for (size_t i = 0; i < _countedZoneCount; ++i)
+		if (_countedZones[i].zone == zone)
+			return &_countedZones[i].original;
+	abort();
+}
+
+static void _addLiveBytes(int64_t bytes)
+{
+	int64_t live = __atomic_add_fetch(&_liveBytes, bytes, __ATOMIC_RELAXED);
+	int64_t peak = __atomic_load_n(&_peakBytes, __ATOMIC_RELAXED);
+	while ((live > peak) && !__atomic_compare_exchange_n(&_peakBytes, &peak, live, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+static void* _countAllocation(malloc_zone_t* zone, const malloc_zone_t* original, void* ptr)
+{
+	if (ptr)
+	{
+		__atomic_add_fetch(&_allocationCount, 1, __ATOMIC_RELAXED);
+		_addLiveBytes(original->size(zone, ptr));
+	}
+	return ptr;
+}
+
+static void* _countingMalloc(malloc_zone_t* zone, size_t size)
+{
+	const malloc_zone_t* original = _originalZone(zone);
+	return _countAllocation(zone, original, original->malloc(zone, size));
+}
+
+static void* _countingCalloc(malloc_zone_t* zone, size_t count, size_t size)
+{
+	const malloc_zone_t* original = _originalZone(zone);
+	return _countAllocation(zone, original, original->calloc(zone, count, size));
+}
+
+static void* _countingValloc(malloc_zone_t* zone, size_t size)
+{
+	const malloc_zone_t* original = _originalZone(zone);
+	return _countAllocation(zone, original, original->valloc(zone, size));
+}
+
+static void* _countingMemalign(malloc_zone_t* zone, size_t alignment, size_t size)
+{
+	const malloc_zone_t* original = _originalZone(zone);
+	return _countAllocation(zone, original, original->memalign(zone, alignment, size));
+}
+
+static void* _countingRealloc(malloc_zone_t* zone, void* ptr, size_t size)
+{
+	const malloc_zone_t* original = _originalZone(zone);
+	size_t oldSize = ptr ? original->size(zone, ptr) : 0;
+	void* result = original->realloc(zone, ptr, size);
+	if (result)
+	{
+		_addLiveBytes(-(int64_t)oldSize);
+		_countAllocation(zone, original, result);
+	}
+	return result;
+}
+
+static void _countingFree(malloc_zone_t* zone, void* ptr)
+{
+	const malloc_zone_t* original = _originalZone(zone);
+	if (ptr)
+		_addLiveBytes(-(int64_t)original->size(zone, ptr));
+	original->free(zone, ptr);
+}
+
+static void _countingFreeDefiniteSize(malloc_zone_t* zone, void* ptr, size_t size)
+{
+	const malloc_zone_t* original = _originalZone(zone);
+	if (ptr)
+		_addLiveBytes(-(int64_t)original->size(zone, ptr));
+	original->free_definite_size(zone, ptr, size);
+}
+
+/*!
+ Wraps the allocation functions of all registered zones. Zone structures are write protected, so their pages are made writable while patching.
+ */
+static void _installAllocationCounting(void)
+{
+	if (_countedZoneCount)
+		return;
+
+	vm_address_t* zones = NULL;
+	unsigned zoneCount = 0;
+	if (malloc_get_all_zones(mach_task_self(), NULL, &zones, &zoneCount) != KERN_SUCCESS)
+		return;
+
+	for (unsigned i = 0; (i < zoneCount) && (_countedZoneCount < BENCHMARK_MAX_ZONES); ++i)
+	{
+		malloc_zone_t* zone = (malloc_zone_t*)zones[i];
+
+		vm_address_t page = trunc_page((vm_address_t)zone);
+		vm_size_t size = round_page((vm_address_t)zone + sizeof(*zone)) - page;
+		if (vm_protect(mach_task_self(), page, size, 0, VM_PROT_READ | VM_PROT_WRITE) != KERN_SUCCESS)
+			continue;
+
+		_countedZones[_countedZoneCount] = (_CountedZone){zone, *zone};
+		__atomic_store_n(&_countedZoneCount, _countedZoneCount+1, __ATOMIC_RELEASE);
+
+		zone->malloc = _countingMalloc;
+		zone->calloc = _countingCalloc;
+		zone->valloc = _countingValloc;
+		zone->realloc = _countingRealloc;
+		zone->free = _countingFree;
+		if ((zone->version >= 5) && zone->memalign)
+			zone->memalign = _countingMemalign;
+		if ((zone->version >= 6) && zone->free_definite_size)
+			zone->free_definite_size = _countingFreeDefiniteSize;
+
+		vm_protect(mach_task_self(), page, size, 0, VM_PROT_READ);
+	}
+}
+
+
+#pragma mark Stage Accounting
+
+typedef struct {
+	double		time;
+	uint64_t	allocations;
+	int64_t		peakBytes;
+} _StageTotals;
+
+typedef struct {
+	_StageTotals	stages[GMBenchmarkStageCount];
+	long			stage;				// current stage, or -1
+	double			segmentStart;
+	uint64_t		segmentAllocations;
+	int64_t			baselineBytes;		// live heap before the run
+} _BenchmarkRun;
+
+static void _switchStage(_BenchmarkRun* run, long stage)
+{
+	double now = [NSDate timeIntervalSinceReferenceDate];
+	uint64_t allocations = __atomic_load_n(&_allocationCount, __ATOMIC_RELAXED);
+	int64_t peak = __atomic_load_n(&_peakBytes, __ATOMIC_RELAXED);
+
+	if (run->stage >= 0)
+	{
+		_StageTotals* totals = run->stages + run->stage;
+		totals->time += now - run->segmentStart;
+		totals->allocations += allocations - run->segmentAllocations;
+		totals->peakBytes = MAX(totals->peakBytes, peak - run->baselineBytes);
+	}
+
+	run->stage = stage;
+	run->segmentStart = now;
+	run->segmentAllocations = allocations;
+	__atomic_store_n(&_peakBytes, __atomic_load_n(&_liveBytes, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+}
+
+static void _beginRun(_BenchmarkRun* run)
+{
+	memset(run, 0, sizeof(*run));
+	run->stage = -1;
+	run->baselineBytes = __atomic_load_n(&_liveBytes, __ATOMIC_RELAXED);
+}
+
+static NSDictionary* _stageDictionary(_BenchmarkRun* run)
+{
+	NSMutableDictionary* stages = [NSMutableDictionary dictionary];
+	for (long i = 0; i < GMBenchmarkStageCount; ++i)
+	{
+		[stages setObject: @{
+			@"wallTime" : [NSNumber numberWithDouble: run->stages[i].time],
+			@"allocations" : [NSNumber numberWithUnsignedLongLong: run->stages[i].allocations],
+			@"peakBytes" : [NSNumber numberWithLongLong: MAX(0, run->stages[i].peakBytes)],
+		} forKey: _stageNames[i]];
+	}
+	return stages;
+}
+
+
+#pragma mark Polygon Families
+
+/*
+ Generators for the scaling benchmark. Each returns loops of about n vertices as NSData of v3i_t, outlines counterclockwise and holes clockwise, sized so that edges stay around SCALING_EDGE_LENGTH long.
+ */
+
+#define SCALING_EDGE_LENGTH 0.5
+#define SCALING_NOISE 0.02
+#define SCALING_NEAR_PARALLEL_OFFSET 4 // fixed point units
+
+static NSData* _loopData(const double* xy, size_t count)
+{
+	NSMutableData* data = [NSMutableData dataWithLength: count*sizeof(v3i_t)];
+	v3i_t* vertices = data.mutableBytes;
+	for (size_t i = 0; i < count; ++i)
+		vertices[i] = v3iCreateFromFloat(xy[2*i], xy[2*i+1], 0.0, 16);
+	return data;
+}
+
+static NSArray* _starPolygon(size_t n)
+{
+	n = MAX(6, n & ~1ul);
+	double R = MAX(10.0, n*SCALING_EDGE_LENGTH/(2.0*M_PI));
+	double* xy = calloc(2*n, sizeof(*xy));
+	for (size_t i = 0; i < n; ++i)
+	{
+		double r = (i % 2) ? 0.5*R : R;
+		double a = 2.0*M_PI*i/n;
+		xy[2*i] = r*cos(a);
+		xy[2*i+1] = r*sin(a);
+	}
+	NSData* loop = _loopData(xy, n);
+	free(xy);
+	return @[loop];
+}
+
+static NSArray* _noisyCircle(size_t n)
+{
+	n = MAX(3, n);
+	double R = MAX(10.0, n*SCALING_EDGE_LENGTH/(2.0*M_PI));
+	double* xy = calloc(2*n, sizeof(*xy));
+	uint32_t seed = 12345;
+	for (size_t i = 0; i < n; ++i)
+	{
+		seed = seed*1664525u + 1013904223u;
+		double noise = ((double)seed/UINT32_MAX - 0.5)*2.0*SCALING_NOISE;
+		double a = 2.0*M_PI*i/n;
+		xy[2*i] = R*(1.0 + noise)*cos(a);
+		xy[2*i+1] = R*(1.0 + noise)*sin(a);
+	}
+	NSData* loop = _loopData(xy, n);
+	free(xy);
+	return @[loop];
+}
+
+static NSArray* _comb(size_t n)
+{
+	size_t teeth = MAX(2, n/4);
+	double toothWidth = SCALING_EDGE_LENGTH, toothLength = 10.0*SCALING_EDGE_LENGTH, base = 5.0*SCALING_EDGE_LENGTH;
+	double* xy = calloc(2*4*teeth, sizeof(*xy));
+	size_t k = 0;
+	// along the base, then up and down each tooth from right to left, tooth j spans [2j, 2j+1] tooth widths
+	xy[2*k] = 0.0; xy[2*k+1] = 0.0; ++k;
+	xy[2*k] = (2.0*teeth - 1.0)*toothWidth; xy[2*k+1] = 0.0; ++k;
+	for (size_t j = teeth; j > 0; --j)
+	{
+		double x0 = 2.0*(j-1)*toothWidth, x1 = x0 + toothWidth;
+		xy[2*k] = x1; xy[2*k+1] = base + toothLength; ++k;
+		xy[2*k] = x0; xy[2*k+1] = base + toothLength; ++k;
+		if (j > 1)
+		{
+			xy[2*k] = x0; xy[2*k+1] = base; ++k;
+			xy[2*k] = x0 - toothWidth; xy[2*k+1] = base; ++k;
+		}
+	}
+	NSData* loop = _loopData(xy, k);
+	free(xy);
+	return @[loop];
+}
+
+static NSArray* _nestedHoles(size_t n)
+{
+	size_t grid = MAX(1, (size_t)sqrt(MAX(4, n) - 4)/2);
+	double cell = 4.0*SCALING_EDGE_LENGTH, hole = 2.0*SCALING_EDGE_LENGTH;
+	double size = grid*cell;
+	double outer[8] = {0.0, 0.0, size, 0.0, size, size, 0.0, size};
+	NSMutableArray* loops = [NSMutableArray arrayWithObject: _loopData(outer, 4)];
+	for (size_t i = 0; i < grid; ++i)
+		for (size_t j = 0; j < grid; ++j)
+		{
+			double x = i*cell + 0.5*(cell - hole), y = j*cell + 0.5*(cell - hole);
+			double xy[8] = {x, y, x, y + hole, x + hole, y + hole, x + hole, y};
+			[loops addObject: _loopData(xy, 4)];
+		}
+	return loops;
+}
+
+static NSArray* _nearParallel(size_t n)
+{
+	size_t side = MAX(2, n/2);
+	double length = side*SCALING_EDGE_LENGTH, width = 4.0*SCALING_EDGE_LENGTH;
+	double offset = SCALING_NEAR_PARALLEL_OFFSET/65536.0;
+	double* xy = calloc(4*side, sizeof(*xy));
+	size_t k = 0;
+	for (size_t i = 0; i < side; ++i, ++k)
+	{
+		xy[2*k] = i*length/(side-1);
+		xy[2*k+1] = (i % 2) ? offset : 0.0;
+	}
+	for (size_t i = side; i > 0; --i, ++k)
+	{
+		xy[2*k] = (i-1)*length/(side-1);
+		xy[2*k+1] = width + (((i-1) % 2) ? 0.0 : offset);
+	}
+	NSData* loop = _loopData(xy, k);
+	free(xy);
+	return @[loop];
+}
+
+typedef struct {
+	const char*	name;
+	NSArray*	(*generator)(size_t n);
+} _PolygonFamily;
+
+static const _PolygonFamily _polygonFamilies[] = {
+	{"star", _starPolygon},
+	{"noisyCircle", _noisyCircle},
+	{"comb", _comb},
+	{"nestedHoles", _nestedHoles},
+	{"nearParallel", _nearParallel},
+};
+
+/*!
+ Least squares slope of log y over log x, ignoring non-positive values.
+ */
+static double _logLogSlope(const double* x, const double* y, size_t count)
+{
+	double sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0;
+	size_t k = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		if ((x[i] <= 0.0) || (y[i] <= 0.0))
+			continue;
+		double lx = log(x[i]), ly = log(y[i]);
+		sx += lx; sy += ly; sxx += lx*lx; sxy += lx*ly;
+		++k;
+	}
+	double den = k*sxx - sx*sx;
+	return (k > 1) && (den > 0.0) ? (k*sxy - sx*sy)/den : NAN;
+}
+
+
+@implementation GMBenchmark
+
+- (NSArray*) emissionTimes
+{
+	GM3DPrintSettings* settings = [GM3DPrintSettings defaultPrintSettings];
+	double extrusionWidth_m = [settings extrusionWidthForExtruder: 0];
+
+	NSMutableArray* emissionTimes = [NSMutableArray arrayWithCapacity: settings.numPerimeters];
+	for (long i = 0; i < settings.numPerimeters; ++i)
+		[emissionTimes addObject: [NSNumber numberWithDouble: (0.5 + i)*extrusionWidth_m*1000.0]]; // scale m -> mm
+
+	// the inner edge of the last perimeter bounds the infill
+	if (settings.infillDensity > 0.0)
+		[emissionTimes addObject: [NSNumber numberWithDouble: [self infillEmissionTime]]];
+
+	return emissionTimes;
+}
+
+- (double) infillEmissionTime
+{
+	GM3DPrintSettings* settings = [GM3DPrintSettings defaultPrintSettings];
+	return settings.numPerimeters*[settings extrusionWidthForExtruder: 0]*1000.0;
+}
+
+- (NSDictionary*) benchmarkSTLAtPath: (NSString*) path layerPitch: (double) pitch
+{
+	_BenchmarkRun run;
+	_BenchmarkRun* runp = &run;
+	_beginRun(&run);
+
+	long layerCount = 0, outlineCount = 0, failureCount = 0, infillLineCount = 0;
+
+	_switchStage(&run, GMBenchmarkStageLoad);
+
+	NSData* data = [NSData dataWithContentsOfFile: path];
+	if (!data)
+		return nil;
+
+	STLFile* stl = [[STLFile alloc] initWithData: data scale: 16 transform: mIdentity()];
+	if (!stl)
+		return nil;
+	range3d_t bounds = [stl vertexBounds];
+
+	Slicer* slicer = [[Slicer alloc] init];
+	NSArray* emissionTimes = [self emissionTimes];
+	double infillTime = [self infillEmissionTime];
+
+	// one polygon per layer, of the infill boundaries of all its outlines, which do not overlap
+	NSMutableArray* infillBoundaries = [NSMutableArray array];
+
+	for (double height = bounds.minv.farr[2] + 0.5*pitch; height < bounds.maxv.farr[2]; height += pitch)
+	{
+		@autoreleasepool {
+			_switchStage(&run, GMBenchmarkStageSlicing);
+
+			vmint_t fixheight = height*(1 << stl.scaleShift);
+			v3i_t zOffset = v3iCreate(0, 0, fixheight, stl.scaleShift);
+
+			NSArray* segments = [[stl lineSegmentsIntersectingZLayer: zOffset] map: ^id(NSArray* obj) {
+				STLVertex* v0 = [obj objectAtIndex: 0];
+				STLVertex* v1 = [obj objectAtIndex: 1];
+				v3i_t v[2] = {v0.position, v1.position};
+
+				FixPolygonOpenSegment* segment = [[FixPolygonOpenSegment alloc] init];
+				[segment addVertices: v count: 2];
+				return segment;
+			}];
+
+			_switchStage(&run, GMBenchmarkStageJoining);
+
+			SlicedLayer* layer = [slicer connectSegments: segments];
+			layer.layerZ = height;
+			layer.mergeThreshold = slicer.mergeThreshold;
+
+			_switchStage(&run, GMBenchmarkStageNesting);
+
+			layer = [slicer nestPaths: layer];
+			++layerCount;
+
+			NSMutableArray* infillSegments = [NSMutableArray array];
+
+			for (SlicedOutline* outline in layer.outlinePaths)
+			{
+				_switchStage(&run, GMBenchmarkStageMotorcycles);
+
+				PolygonSkeletizer* skeletizer = [[PolygonSkeletizer alloc] init];
+				skeletizer.mergeThreshold = 0.5*slicer.mergeThreshold;
+				skeletizer.emissionTimes = emissionTimes;
+				[outline addPathsToSkeletizer: skeletizer];
+
+				// the first step runs the motorcycles, emission is bracketed by its event and the emit callback
+				__block long steps = 0;
+				skeletizer.eventCallback = ^(PolygonSkeletizer* skeletizer, id event) {
+					if ([event isKindOfClass: [PSEmitEvent class]])
+						_switchStage(runp, GMBenchmarkStageEmission);
+					else if (runp->stage == GMBenchmarkStageEmission)
+						_switchStage(runp, GMBenchmarkStageWaveFronts);
+				};
+				skeletizer.emitCallback = ^(PolygonSkeletizer* skeletizer, PSWaveFrontSnapshot* snapshot) {
+					FixPolygon* polygon = [snapshot waveFrontPolygon];
+					if (fabs([snapshot.time toDouble] - infillTime) < 1e-3)
+						[infillSegments addObjectsFromArray: polygon.segments];
+					_switchStage(runp, GMBenchmarkStageWaveFronts);
+				};
+
+				@try {
+					[skeletizer generateSkeletonWithCancellationCheck: ^BOOL{
+						if (steps++ == 1)
+							_switchStage(runp, GMBenchmarkStageWaveFronts);
+						return NO;
+					}];
+				}
+				@catch (NSException* exception) {
+					++failureCount;
+				}
+				++outlineCount;
+			}
+
+			FixPolygon* boundary = [[FixPolygon alloc] init];
+			boundary.segments = infillSegments;
+			[infillBoundaries addObject: infillSegments.count ? boundary : [NSNull null]];
+		}
+	}
+
+	GM3DPrintSettings* settings = [GM3DPrintSettings defaultPrintSettings];
+	if (settings.infillDensity > 0.0)
+	{
+		_switchStage(&run, GMBenchmarkStageInfill);
+
+		ScanlineInfill* infill = [[ScanlineInfill alloc] init];
+		infill.spacing = [settings extrusionWidthForExtruder: 0]*1e3/settings.infillDensity;
+		infill.angle = settings.infillAngle;
+
+		for (FixPolygon* polygon in [infill infillLayerPolygons: infillBoundaries])
+			if (![polygon isEqual: [NSNull null]])
+				infillLineCount += polygon.segments.count;
+	}
+
+	_switchStage(&run, -1);
+
+	return @{
+		@"model" : [path lastPathComponent],
+		@"layerPitch" : [NSNumber numberWithDouble: pitch],
+		@"layers" : [NSNumber numberWithLong: layerCount],
+		@"outlines" : [NSNumber numberWithLong: outlineCount],
+		@"failures" : [NSNumber numberWithLong: failureCount],
+		@"infillLines" : [NSNumber numberWithLong: infillLineCount],
+		@"stages" : _stageDictionary(&run),
+	};
+}
+
++ (void) compareResults: (NSArray*) results withBaseline: (NSArray*) baseline
+{
+	NSMutableDictionary* baselineByKey = [NSMutableDictionary dictionary];
+	for (NSDictionary* result in baseline)
+		[baselineByKey setObject: result forKey: [NSString stringWithFormat: @"%@ @ %@", [result objectForKey: @"model"], [result objectForKey: @"layerPitch"]]];
+
+	for (NSDictionary* result in results)
+	{
+		NSString* key = [NSString stringWithFormat: @"%@ @ %@", [result objectForKey: @"model"], [result objectForKey: @"layerPitch"]];
+		NSDictionary* old = [baselineByKey objectForKey: key];
+		if (!old)
+			continue;
+
+		for (long i = 0; i < GMBenchmarkStageCount; ++i)
+		{
+			NSDictionary* stage = [[result objectForKey: @"stages"] objectForKey: _stageNames[i]];
+			NSDictionary* oldStage = [[old objectForKey: @"stages"] objectForKey: _stageNames[i]];
+			double time = [[stage objectForKey: @"wallTime"] doubleValue];
+			double oldTime = [[oldStage objectForKey: @"wallTime"] doubleValue];
+			double allocations = [[stage objectForKey: @"allocations"] doubleValue];
+			double oldAllocations = [[oldStage objectForKey: @"allocations"] doubleValue];
+			if (MAX(time, oldTime) < BENCHMARK_MIN_REPORTED_TIME)
+				continue;
+
+			double timeChange = oldTime > 0.0 ? time/oldTime - 1.0 : 0.0;
+			double allocationChange = oldAllocations > 0.0 ? allocations/oldAllocations - 1.0 : 0.0;
+			BOOL regression = (timeChange > BENCHMARK_REGRESSION_THRESHOLD) || (allocationChange > BENCHMARK_REGRESSION_THRESHOLD);
+
+			printf("%s %s %s: %.3f s -> %.3f s (%+.1f%%), %.0f -> %.0f allocations (%+.1f%%)\n", regression ? "!" : " ", key.UTF8String, _stageNames[i].UTF8String, oldTime, time, 100.0*timeChange, oldAllocations, allocations, 100.0*allocationChange);
+		}
+	}
+}
+
++ (int) runWithArguments: (NSArray*) arguments
+{
+	NSArray* pitches = @[@0.2, @0.5, @1.0];
+	NSMutableArray* paths = [NSMutableArray array];
+
+	for (NSString* argument in arguments)
+	{
+		if ([argument hasPrefix: @"--pitches="])
+		{
+			pitches = [[[argument substringFromIndex: [@"--pitches=" length]] componentsSeparatedByString: @","] map: ^id(NSString* obj) {
+				return [NSNumber numberWithDouble: [obj doubleValue]];
+			}];
+		}
+		else
+			[paths addObject: argument];
+	}
+
+	if (paths.count < 2)
+	{
+		fprintf(stderr, "usage: --benchmark <STL directory> <results.json> [baseline.json] [--pitches=0.2,0.5,1.0]\n");
+		return 1;
+	}
+
+	NSString* modelDirectory = [paths objectAtIndex: 0];
+	NSArray* models = [[[NSFileManager defaultManager] contentsOfDirectoryAtPath: modelDirectory error: NULL] select: ^BOOL(NSString* name) {
+		return [[[name pathExtension] lowercaseString] isEqualToString: @"stl"];
+	}];
+	models = [models sortedArrayUsingSelector: @selector(compare:)];
+
+	_installAllocationCounting();
+	GMMetricsReset();
+
+	GMBenchmark* benchmark = [[GMBenchmark alloc] init];
+	NSMutableArray* results = [NSMutableArray array];
+
+	for (NSString* model in models)
+	{
+		for (NSNumber* pitch in pitches)
+		{
+			@autoreleasepool {
+				NSDictionary* result = [benchmark benchmarkSTLAtPath: [modelDirectory stringByAppendingPathComponent: model] layerPitch: [pitch doubleValue]];
+				if (!result)
+				{
+					fprintf(stderr, "failed to load %s\n", model.UTF8String);
+					continue;
+				}
+				[results addObject: result];
+				printf("%s @ %g mm: %ld layers, %ld outlines, %ld failures\n", model.UTF8String, [pitch doubleValue], [[result objectForKey: @"layers"] longValue], [[result objectForKey: @"outlines"] longValue], [[result objectForKey: @"failures"] longValue]);
+			}
+		}
+	}
+
+	NSDictionary* report = @{
+		@"date" : [[NSDate date] description],
+		@"host" : [[NSProcessInfo processInfo] hostName],
+		@"processorCount" : [NSNumber numberWithUnsignedInteger: [[NSProcessInfo processInfo] activeProcessorCount]],
+		@"allocationCounting" : [NSNumber numberWithBool: _countedZoneCount > 0],
+		@"metrics" : GMMetricsSnapshot(),
+		@"results" : results,
+	};
+
+	NSError* error = nil;
+	NSData* json = [NSJSONSerialization dataWithJSONObject: report options: NSJSONWritingPrettyPrinted error: &error];
+	if (!json || ![json writeToFile: [paths objectAtIndex: 1] options: NSDataWritingAtomic error: &error])
+	{
+		fprintf(stderr, "failed to write results: %s\n", error.localizedDescription.UTF8String);
+		return 1;
+	}
+
+	if (paths.count > 2)
+	{
+		NSData* baselineData = [NSData dataWithContentsOfFile: [paths objectAtIndex: 2]];
+		NSDictionary* baseline = baselineData ? [NSJSONSerialization JSONObjectWithData: baselineData options: 0 error: NULL] : nil;
+		if (!baseline)
+		{
+			fprintf(stderr, "failed to read baseline\n");
+			return 1;
+		}
+		[self compareResults: results withBaseline: [baseline objectForKey: @"results"]];
+	}
+
+	return 0;
+}
+
+- (NSDictionary*) benchmarkSkeletonOfLoops: (NSArray*) loops
+{
+	_BenchmarkRun run;
+	_BenchmarkRun* runp = &run;
+	_beginRun(&run);
+
+	size_t vertexCount = 0;
+	BOOL failed = NO;
+
+	@autoreleasepool {
+		_switchStage(&run, GMBenchmarkStageMotorcycles);
+
+		PolygonSkeletizer* skeletizer = [[PolygonSkeletizer alloc] init];
+		for (NSData* loop in loops)
+		{
+			[skeletizer addClosedPolygonWithVertices: (v3i_t*)loop.bytes count: loop.length/sizeof(v3i_t)];
+			vertexCount += loop.length/sizeof(v3i_t);
+		}
+
+		__block long steps = 0;
+		@try {
+			[skeletizer generateSkeletonWithCancellationCheck: ^BOOL{
+				if (steps++ == 1)
+					_switchStage(runp, GMBenchmarkStageWaveFronts);
+				return NO;
+			}];
+		}
+		@catch (NSException* exception) {
+			failed = YES;
+		}
+
+		skeletizer = nil;
+	}
+
+	_switchStage(&run, -1);
+
+	_StageTotals motorcycles = run.stages[GMBenchmarkStageMotorcycles];
+	_StageTotals waveFronts = run.stages[GMBenchmarkStageWaveFronts];
+
+	return @{
+		@"vertices" : [NSNumber numberWithUnsignedLong: vertexCount],
+		@"failed" : [NSNumber numberWithBool: failed],
+		@"wallTime" : [NSNumber numberWithDouble: motorcycles.time + waveFronts.time],
+		@"motorcycleTime" : [NSNumber numberWithDouble: motorcycles.time],
+		@"waveFrontTime" : [NSNumber numberWithDouble: waveFronts.time],
+		@"allocations" : [NSNumber numberWithUnsignedLongLong: motorcycles.allocations + waveFronts.allocations],
+		@"peakBytes" : [NSNumber numberWithLongLong: MAX(0, MAX(motorcycles.peakBytes, waveFronts.peakBytes))],
+	};
+}
+
++ (int) runScalingWithArguments: (NSArray*) arguments
+{
+	size_t maxVertices = 100000;
+	double timeLimit = 60.0;
+	NSArray* familyNames = nil;
+	NSString* outputPath = nil;
+
+	for (NSString* argument in arguments)
+	{
+		if ([argument hasPrefix: @"--max-vertices="])
+			maxVertices = [[argument substringFromIndex: [@"--max-vertices=" length]] longLongValue];
+		else if ([argument hasPrefix: @"--time-limit="])
+			timeLimit = [[argument substringFromIndex: [@"--time-limit=" length]] doubleValue];
+		else if ([argument hasPrefix: @"--families="])
+			familyNames = [[argument substringFromIndex: [@"--families=" length]] componentsSeparatedByString: @","];
+		else
+			outputPath = argument;
+	}
+
+	if (!outputPath)
+	{
+		fprintf(stderr, "usage: --benchmark-scaling <results.json> [--max-vertices=100000] [--time-limit=60] [--families=star,noisyCircle,comb,nestedHoles,nearParallel]\n");
+		return 1;
+	}
+
+	_installAllocationCounting();
+	GMMetricsReset();
+
+	GMBenchmark* benchmark = [[GMBenchmark alloc] init];
+	NSMutableArray* results = [NSMutableArray array];
+
+	for (size_t f = 0; f < sizeof(_polygonFamilies)/sizeof(*_polygonFamilies); ++f)
+	{
+		_PolygonFamily family = _polygonFamilies[f];
+		NSString* familyName = [NSString stringWithUTF8String: family.name];
+		if (familyNames && ![familyNames containsObject: familyName])
+			continue;
+
+		NSMutableArray* runs = [NSMutableArray array];
+		double ns[64], times[64], allocations[64], peaks[64];
+		size_t count = 0;
+
+		// three sizes per decade, stopping once a size takes longer than the limit, as larger ones take longer still
+		// sizes are counted by exponent, repeated multiplication drifts past maxVertices and skips the last one
+		long lastStep = lround(floor(3.0*log10(maxVertices/10.0) + 1e-9));
+		for (long step = 0; (step <= lastStep) && (count < 64); ++step)
+		{
+			double size = 10.0*pow(10.0, step/3.0);
+			NSDictionary* run = nil;
+			@autoreleasepool {
+				run = [benchmark benchmarkSkeletonOfLoops: family.generator((size_t)round(size))];
+			}
+			[runs addObject: run];
+
+			ns[count] = [[run objectForKey: @"vertices"] doubleValue];
+			times[count] = [[run objectForKey: @"wallTime"] doubleValue];
+			allocations[count] = [[run objectForKey: @"allocations"] doubleValue];
+			peaks[count] = [[run objectForKey: @"peakBytes"] doubleValue];
+			++count;
+
+			printf("%s n = %.0f: %.3f s, %.0f allocations, %.0f bytes peak%s\n", family.name, ns[count-1], times[count-1], allocations[count-1], peaks[count-1], [[run objectForKey: @"failed"] boolValue] ? ", failed" : "");
+
+			if (times[count-1] > timeLimit)
+				break;
+		}
+
+		// local slopes between neighbouring sizes show where superlinear behaviour sets in
+		NSMutableArray* localTimeExponents = [NSMutableArray array];
+		for (size_t i = 0; i+1 < count; ++i)
+		{
+			double slope = _logLogSlope(ns + i, times + i, 2);
+			[localTimeExponents addObject: isnan(slope) ? [NSNull null] : [NSNumber numberWithDouble: slope]];
+		}
+
+		double timeExponent = _logLogSlope(ns, times, count);
+		double allocationExponent = _logLogSlope(ns, allocations, count);
+		double peakExponent = _logLogSlope(ns, peaks, count);
+
+		printf("%s: time ~ n^%.2f, allocations ~ n^%.2f, peak heap ~ n^%.2f\n", family.name, timeExponent, allocationExponent, peakExponent);
+
+		[results addObject: @{
+			@"family" : familyName,
+			@"runs" : runs,
+			@"timeExponent" : isnan(timeExponent) ? [NSNull null] : [NSNumber numberWithDouble: timeExponent],
+			@"allocationExponent" : isnan(allocationExponent) ? [NSNull null] : [NSNumber numberWithDouble: allocationExponent],
+			@"peakBytesExponent" : isnan(peakExponent) ? [NSNull null] : [NSNumber numberWithDouble: peakExponent],
+			@"localTimeExponents" : localTimeExponents,
+		}];
+	}
+
+	NSDictionary* report = @{
+		@"date" : [[NSDate date] description],
+		@"host" : [[NSProcessInfo processInfo] hostName],
+		@"allocationCounting" : [NSNumber numberWithBool: _countedZoneCount > 0],
+		@"metrics" : GMMetricsSnapshot(),
+		@"families" : results,
+	};
+
+	NSError* error = nil;
+	NSData* json = [NSJSONSerialization dataWithJSONObject: report options: NSJSONWritingPrettyPrinted error: &error];
+	if (!json || ![json writeToFile: outputPath options: NSDataWritingAtomic error: &error])
+	{
+		fprintf(stderr, "failed to write results: %s\n", error.localizedDescription.UTF8String);
+		return 1;
+	}
+
+	return 0;
+}
+
+@end
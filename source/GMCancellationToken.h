@@ -0,0 +1,44 @@
+//
+//  GMCancellationToken.h
+//  Giddy Machinist
+//
+//  Created by Dömötör Gulyás on 19.10.2026.
+//  Copyright (c) 2026 Dömötör Gulyás. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/*!
+ @description Shared between whoever starts a long geometry job and the code doing the work, to cancel it cooperatively, report its progress, and wait for it to stop.
+
+ Workers poll isCancelled in their inner loops, which is a single atomic load, and return early when it is set. Cancelling does not interrupt anything by itself, and the partial results of cancelled work are to be thrown away.
+
+ Progress is counted in units of work, which workers may add as they discover more of it, so the fraction completed can step back.
+
+ Work started on other threads is bracketed by beginWork and endWork, so that cancelAndWait blocks until all of it has returned, instead of polling. A token stays cancelled, a fresh one is needed for the next job.
+ */
+@interface GMCancellationToken : NSObject
+
+- (void) cancel;
+@property(nonatomic, readonly, getter=isCancelled) BOOL cancelled;
+
+/*!
+ For the APIs taking a cancellation check block.
+ */
+- (BOOL(^)(void)) cancellationCheck;
+
+- (void) addUnitsOfWork: (int64_t) units;
+- (void) completeUnitsOfWork: (int64_t) units;
+@property(nonatomic, readonly) double fractionCompleted;
+
+/*!
+ Called on the main queue when the progress changes, coalesced to at most one pending call.
+ */
+@property(atomic, copy) void (^progressHandler)(double fractionCompleted);
+
+- (void) beginWork;
+- (void) endWork;
+- (void) waitUntilIdle;
+- (void) cancelAndWait;
+
+@end
@@ -0,0 +1,110 @@
+//
+//  GMCancellationToken.m
+//  Giddy Machinist
+//
+//  Created by Dömötör Gulyás on 19.10.2026.
+//  Copyright (c) 2026 Dömötör Gulyás. All rights reserved.
+//
+
+#import "GMCancellationToken.h"
+
+@implementation GMCancellationToken
+{
+	long			cancelled;
+	int64_t			totalUnits, completedUnits;
+	long			progressPending;
+	dispatch_group_t	workGroup;
+}
+
+@synthesize progressHandler;
+
+- (id) init
+{
+	if (!(self = [super init]))
+		return nil;
+
+	workGroup = dispatch_group_create();
+
+	return self;
+}
+
+- (void) cancel
+{
+	__atomic_store_n(&cancelled, 1, __ATOMIC_RELEASE);
+}
+
+- (BOOL) isCancelled
+{
+	return __atomic_load_n(&cancelled, __ATOMIC_ACQUIRE) != 0;
+}
+
+- (BOOL(^)(void)) cancellationCheck
+{
+	__weak GMCancellationToken* token = self;
+	return ^BOOL{
+		return token.isCancelled;
+	};
+}
+
+- (void) notifyProgress
+{
+	if (!self.progressHandler)
+		return;
+
+	// one pending notification at a time, it picks up whatever has changed until it runs
+	if (__atomic_exchange_n(&progressPending, 1, __ATOMIC_ACQ_REL))
+		return;
+
+	dispatch_async(dispatch_get_main_queue(), ^{
+		__atomic_store_n(&progressPending, 0, __ATOMIC_RELEASE);
+		void (^handler)(double) = self.progressHandler;
+		if (handler)
+			handler(self.fractionCompleted);
+	});
+}
+
+- (void) addUnitsOfWork: (int64_t) units
+{
+	__atomic_add_fetch(&totalUnits, units, __ATOMIC_RELAXED);
+	[self notifyProgress];
+}
+
+- (void) completeUnitsOfWork: (int64_t) units
+{
+	__atomic_add_fetch(&completedUnits, units, __ATOMIC_RELAXED);
+	[self notifyProgress];
+}
+
+- (double) fractionCompleted
+{
+	int64_t total = __atomic_load_n(&totalUnits, __ATOMIC_RELAXED);
+	int64_t completed = __atomic_load_n(&completedUnits, __ATOMIC_RELAXED);
+
+	if (total <= 0)
+		return 0.0;
+
+	return fmin(1.0, (double)completed/total);
+}
+
+- (void) beginWork
+{
+	dispatch_group_enter(workGroup);
+}
+
+- (void) endWork
+{
+	dispatch_group_leave(workGroup);
+}
+
+- (void) waitUntilIdle
+{
+	dispatch_group_wait(workGroup, DISPATCH_TIME_FOREVER);
+}
+
+- (void) cancelAndWait
+{
+	[self cancel];
+	[self waitUntilIdle];
+}
+
+@end
@@ -10,7 +10,7 @@
 
 const NSString* GMDocumentObjectChangedNotification;
 
-@class GMDocumentWindowController,GM3DPrintSettings;
+@class GMDocumentWindowController,GM3DPrintSettings,SlicedLayerStore,MotionPlanner;
 
 @interface GMDocument : NSDocument
 
@@ -20,11 +20,19 @@ const NSString* GMDocumentObjectChangedNotification;
 
 - (void) modelObjectChanged: (id) object;
 
-@property(nonatomic, strong, readonly) NSArray* slicedLayers;
+/*!
+ Sliced layers by Z, kept out of core beyond a working set.
+ */
+@property(nonatomic, strong, readonly) SlicedLayerStore* layerStore;
 //@property(nonatomic, strong, readonly) NSArray* contourPolygons;
 
 @property(nonatomic, strong) GM3DPrintSettings* printSettings;
 
+/*!
+ The machine jobs of the document are for, its limits and arc tolerance, set up from the MachineSettings user default as described at -[MotionPlanner takeSettingsFromDictionary:]. Only read for its configuration, simulations and exports plan with their own planners.
+ */
+@property(nonatomic, strong, readonly) MotionPlanner* machine;
+
 - (IBAction) importGCode: (id) sender;
 
 @end
@@ -14,9 +14,11 @@
 #import "RS274Interpreter.h"
 #import "PathView2D.h"
 #import "ModelView3D.h"
+#import "MovePathMeshBuilder.h"
 #import "MachineSimulator.h"
 #import "gfx.h"
 #import "Slicer.h"
+#import "SlicedLayerStore.h"
 #import "SlicedOutline.h"
 #import "PolygonSkeletizer.h"
 
@@ -26,22 +28,26 @@
 #import "FixPolygon.h"
 #import "PolygonContour.h"
 #import "ModelObject.h"
+#import "GMCancellationToken.h"
+#import "GMPlateScheduler.h"
 
 const NSString* GMDocumentObjectChangedNotification = @"GMDocumentObjectChangedNotification";
 
 
 @implementation GMDocument
 {
-	NSArray* machineCommands;
+	GMachineMoveBuffer* machineMoves;
 	
-	NSArray* slicedLayers;
+	SlicedLayerStore* layerStore;
 	
 	NSArray* objects;
 	
 	dispatch_queue_t processingQueue;
+	
+	GMCancellationToken* slicingToken;
 }
 
-@synthesize mainWindowController, slicedLayers, objects;
+@synthesize mainWindowController, layerStore, objects, machine;
 
 - (id)init
 {
@@ -50,8 +56,10 @@ const NSString* GMDocumentObjectChangedNotification = @"GMDocumentObjectChangedN
 
 	processingQueue = dispatch_queue_create("gmdocument.processing", DISPATCH_QUEUE_SERIAL);
 	
-	slicedLayers = @[];
-	machineCommands = @[];
+	layerStore = [[SlicedLayerStore alloc] init];
+	machineMoves = [[GMachineMoveBuffer alloc] init];
+	machine = [[MotionPlanner alloc] init];
+	[machine takeSettingsFromDictionary: [[NSUserDefaults standardUserDefaults] dictionaryForKey: @"MachineSettings"]];
 	objects = @[];
 	
 	return self;
@@ -62,6 +70,14 @@ const NSString* GMDocumentObjectChangedNotification = @"GMDocumentObjectChangedN
 	dispatch_release(processingQueue);
 }
 
+- (void) close
+{
+	// layers still being sliced have nowhere to go, and those not started yet make way for other documents
+	[[GMPlateScheduler sharedScheduler] cancelJobsWithToken: slicingToken];
+	
+	[super close];
+}
+
 - (void) makeWindowControllers
 {
 	mainWindowController = [[GMDocumentWindowController alloc] initWithWindowNibName: @"GMDocument"];
@@ -117,30 +133,63 @@ const NSString* GMDocumentObjectChangedNotification = @"GMDocumentObjectChangedN
 }
 
 
-- (void) loadGCodeAtPath: (NSString*) path
+- (void) showMachineMoves: (GMachineMoveBuffer*) moves movePath: (MovePathMeshBuilder*) movePath
 {
-	NSString* fileContent = [NSString stringWithContentsOfFile: path encoding: NSASCIIStringEncoding error: nil];
-	
-	RS274Parser* parser = [[RS274Parser alloc] init];
-	[parser parseString: fileContent named: path];
-	
-	RS274Interpreter* interpreter = [[RS274Interpreter alloc] init];
-	
-	NSArray* results = [parser.commandBlocks map:^id(id obj) {
-		return [interpreter interpretCommandBlock: obj];
-	}];
-	
-	machineCommands = interpreter.machineCommands;
+	machineMoves = moves;
 	
 	[self.mainWindowController.pathView resetPaths];
-	[self.mainWindowController.pathView generatePathsWithMachineCommands: machineCommands];
-	
-	[self.mainWindowController.modelView generateMovePathWithMachineCommands: machineCommands];
-	
-	[[self.mainWindowController.statusTextView.textStorage mutableString] appendString: [results description]];
-	
+	[self.mainWindowController.pathView generatePathsWithMoves: machineMoves];
 	
+	[self.mainWindowController.modelView showMovePath: movePath];
+}
 
+- (void) loadGCodeAtPath: (NSString*) path
+{
+	dispatch_async(processingQueue, ^{
+		RS274Parser* parser = [[RS274Parser alloc] init];
+		RS274Interpreter* interpreter = [[RS274Interpreter alloc] init];
+		interpreter.arcTolerance = machine.autoArcTolerance;
+		MovePathMeshBuilder* movePath = [[MovePathMeshBuilder alloc] init];
+		NSError* error = nil;
+		
+		// blocks are interpreted as soon as they are parsed, and the partial program is previewed every so often
+		__block NSTimeInterval lastPreview = [NSDate timeIntervalSinceReferenceDate];
+		
+		BOOL success = [parser parseFileAtPath: path error: &error blockHandler: ^(const RS274Block* block, const RS274Word* words, BOOL* stop) {
+			[interpreter interpretBlock: block words: words];
+			
+			NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+			if (now - lastPreview > 1.0)
+			{
+				lastPreview = now;
+				GMachineMoveBuffer* preview = [interpreter.moves copy];
+				// only the moves since the last preview are turned into path chunks
+				[movePath appendMovesFromBuffer: preview];
+				dispatch_async(dispatch_get_main_queue(), ^{
+					[self showMachineMoves: preview movePath: movePath];
+				});
+			}
+		}];
+		
+		GMachineMoveBuffer* moves = interpreter.moves;
+		[movePath appendMovesFromBuffer: moves];
+		
+		dispatch_async(dispatch_get_main_queue(), ^{
+			NSMutableString* status = [self.mainWindowController.statusTextView.textStorage mutableString];
+			
+			if (!success && !parser.blockCount)
+			{
+				[status appendFormat: @"failed to load G-code: %@\n", error.localizedDescription];
+				return;
+			}
+			
+			[self showMachineMoves: moves movePath: movePath];
+			
+			[status appendFormat: @"%@: %zu blocks, %zu words, %zu errors\n", path.lastPathComponent, parser.blockCount, parser.wordCount, parser.errorCount];
+			for (NSError* parseError in parser.errors)
+				[status appendFormat: @"%@\n", parseError.localizedDescription];
+		});
+	});
 }
 
 - (IBAction) importGCode:(id)sender
@@ -181,6 +230,15 @@ const NSString* GMDocumentObjectChangedNotification = @"GMDocumentObjectChangedN
 	
 }
 
+- (void) layersChanged
+{
+	for (id wc in self.windowControllers)
+	{
+		if ([wc respondsToSelector: @selector(layersChanged)])
+			[wc layersChanged];
+	}
+}
+
 - (void) modelObjectChanged: (id) object;
 {
 	for (id wc in self.windowControllers)
@@ -193,19 +251,21 @@ const NSString* GMDocumentObjectChangedNotification = @"GMDocumentObjectChangedN
 
 - (void) loadEPSFromData: (NSData*) data named: (NSString*) name
 {
-	NSBezierPath* bpath = [ShapeUtilities createBezierPathFromData: data];
+	// parsing and flattening no longer touch global drawing state, so large artwork is imported off the main queue, its subpaths flattened in parallel
+	dispatch_async(processingQueue, ^{
+		NSBezierPath* bpath = [ShapeUtilities createBezierPathFromData: data];
 		
-	[self willChangeValueForKey: @"objects"];
-	
-	ModelObject2D* obj = [[ModelObject2D alloc] initWithBezierPath: bpath name: name];
-	obj.document = self;
+		ModelObject2D* obj = [[ModelObject2D alloc] initWithBezierPath: bpath name: name];
 		
-	
-	
-	
-	objects = [objects arrayByAddingObject: obj];
-
-	[self didChangeValueForKey: @"objects"];
+		dispatch_async(dispatch_get_main_queue(), ^{
+			[self willChangeValueForKey: @"objects"];
+			
+			obj.document = self;
+			objects = [objects arrayByAddingObject: obj];
+			
+			[self didChangeValueForKey: @"objects"];
+		});
+	});
 }
 
 - (void) loadSTLFromData: (NSData*) data named: (NSString*) dataName
@@ -220,6 +280,10 @@ const NSString* GMDocumentObjectChangedNotification = @"GMDocumentObjectChangedN
 	
 	Slicer* slicer = [[Slicer alloc] init];
 	
+	if (!slicingToken)
+		slicingToken = [[GMCancellationToken alloc] init];
+	slicer.cancellationToken = slicingToken;
+	
 	NSMutableArray* heights = [NSMutableArray array];
 	
 	range3d_t bounds = [mesh vertexBounds];
@@ -230,8 +294,14 @@ const NSString* GMDocumentObjectChangedNotification = @"GMDocumentObjectChangedN
 	}
 	
 	[slicer asyncSliceSTL: stl intoLayers: heights layersWithCallbackOnQueue: dispatch_get_main_queue() block: ^(SlicedLayer* layer) {
-		slicedLayers = [slicedLayers arrayByAddingObject: layer];
 		[self layerDidLoad: layer];
+		// the preview mesh has been built, outlines are only needed again on demand, and writing the layer out stays off the main queue
+		dispatch_async(processingQueue, ^{
+			[layerStore addLayer: layer];
+			dispatch_async(dispatch_get_main_queue(), ^{
+				[self layersChanged];
+			});
+		});
 	}];
 	
 	/*
@@ -293,9 +363,11 @@ const NSString* GMDocumentObjectChangedNotification = @"GMDocumentObjectChangedN
 
 - (IBAction) runSimulation:(id)sender
 {
-	MachineSimulator* machineSim = [[MachineSimulator alloc] init];
-	
+	MachineSimulator* machineSim = [[MachineSimulator alloc] initWithMachine: machine];
 	
+	[machineSim simulateMovesAsync: machineMoves completion: ^(GMachineSimulationReport* report) {
+		[[self.mainWindowController.statusTextView.textStorage mutableString] appendFormat: @"simulated %@\n", report];
+	}];
 }
 
 
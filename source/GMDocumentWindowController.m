@@ -19,10 +19,15 @@
 #import "GM3DPrinterDescription.h"
 #import "PSWaveFrontSnapshot.h"
 #import "MPVector2D.h"
+#import "MPInteger.h"
 #import "PolySkelVideoGenerator.h"
 #import "FixPolygon.h"
 #import "PolygonContour.h"
 #import "ModelObject.h"
+#import "ScanlineInfill.h"
+#import "SlicedLayerStore.h"
+#import "GMPlateScheduler.h"
+#import "PSThinWallExtractor.h"
 
 #import "FoundationExtensions.h"
 
@@ -38,6 +43,7 @@
 @implementation GMDocumentWindowController
 {
 	PolygonSkeletizer* skeletizer;
+	double infillEmissionTime; // NAN when no infill boundary is emitted
 }
 
 @dynamic document;
@@ -135,23 +141,21 @@
 - (void) layerDidLoad: (SlicedLayer*) layer
 {
 	self.modelView.layers = [self.modelView.layers dictionaryBySettingObject: [layer gfxMesh] forKey: [NSNumber numberWithDouble: layer.layerZ]];
-	[self layersChanged];
 
 }
 
 
 - (void) layersChanged
 {
-	NSArray* layers = [self.document slicedLayers];
-	NSArray* keys = [layers map:^id(SlicedLayer* obj) {
-		return [NSNumber numberWithDouble: obj.layerZ];
-	}];
-	
-	keys = [keys sortedArrayUsingSelector: @selector(compare:)];
+	// only the heights are needed, which does not load any layers from the store
+	SlicedLayerStore* store = [self.document layerStore];
+	NSMutableArray* titles = [NSMutableArray arrayWithCapacity: store.layerCount];
+	for (size_t i = 0; i < store.layerCount; ++i)
+		[titles addObject: [NSString stringWithFormat:@"%.3f mm", [store layerZAtIndex: i]]];
 	
 	[self.layerSelector removeAllItems];
-	[self.layerSelector addItemsWithTitles: [keys map:^id(id obj) { return [NSString stringWithFormat:@"%.3f mm", [obj doubleValue]]; }]];
-	if (keys.count)
+	[self.layerSelector addItemsWithTitles: titles];
+	if (titles.count)
 		[self.layerSelector selectItemAtIndex: 0];
 	
 	
@@ -162,16 +166,12 @@
 
 - (SlicedLayer*) currentLayer
 {
-	NSArray* layers = [self.document slicedLayers];
-	if (!layers.count)
+	SlicedLayerStore* store = [self.document layerStore];
+	if (!store.layerCount)
 		return nil;
-	layers = [layers sortedArrayUsingComparator:^NSComparisonResult(SlicedLayer* obj1, SlicedLayer* obj2) {
-		float f = obj2.layerZ - obj1.layerZ;
-		return f > 0.0 ? NSOrderedAscending : f < 0.0 ? NSOrderedDescending : NSOrderedSame;
-	}];
-	
 	
-	return [layers objectAtIndex: self.layerSelector.indexOfSelectedItem];
+	// the store keeps layers sorted by Z, as listed in the selector
+	return [store layerAtIndex: self.layerSelector.indexOfSelectedItem];
 	
 }
 
@@ -214,9 +214,18 @@
 	
 
 	skeletizer.mergeThreshold = slice.mergeThreshold;
+	infillEmissionTime = NAN;
 	NSString* extensionString = [self.extensionLimitField stringValue];
 	if (!extensionString.length)
+	{
+		// the infill boundary is the inner edge of the last perimeter, not its centreline
+		if (settings.infillDensity > 0.0)
+		{
+			infillEmissionTime = settings.numPerimeters*extrusionWidth_m*1000.0;
+			[emissionTimes addObject: [NSNumber numberWithDouble: infillEmissionTime]];
+		}
 		skeletizer.emissionTimes = emissionTimes;
+	}
 	else
 	{
 		double limit = [self.extensionLimitField doubleValue];
@@ -255,13 +264,20 @@
 	NSMutableArray* cyclePaths = [NSMutableArray array];
 	NSMutableArray* spokePaths = [NSMutableArray array];
 	NSMutableArray* snapshots = [NSMutableArray array];
-	NSMutableArray* overfillPaths = [NSMutableArray array];
 	NSMutableArray* underfillPaths = [NSMutableArray array];
 	
 	
 	__block BOOL isBoundary = NO;
+	__block PSWaveFrontSnapshot* infillSnapshot = nil;
+	double infillTime = infillEmissionTime;
 	skeletizer.emitCallback = ^(PolygonSkeletizer* skeletizer, PSWaveFrontSnapshot* snapshot)
 	{
+		// outlines collapsing before the infill boundary have no infill
+		if (fabs([snapshot.time toDouble] - infillTime) < 1e-3)
+		{
+			infillSnapshot = snapshot;
+			return;
+		}
 		[snapshots addObject: snapshot];
 		id bpath = [snapshot waveFrontPath];
 		if (isBoundary)
@@ -283,17 +299,22 @@
 	[spokePaths addObjectsFromArray: [skeletizer spokeDisplayPaths]];
 	[cyclePaths addObjectsFromArray: [skeletizer motorcycleDisplayPaths]];
 	
-	isBoundary = NO;
+	PSThinWallExtractor* thinWalls = [[PSThinWallExtractor alloc] initWithSkeleton: skeletizer];
+	thinWalls.extrusionWidth = extrusionWidth_m*1e3;
+	thinWalls.perimeterCount = settings.numPerimeters;
+	thinWalls.minimumWidth = 0.25*extrusionWidth_m*1e3;
 	
-	
-	for (PSWaveFrontSnapshot* snapshot in snapshots)
+	for (PSThinWallToolpath* toolpath in [thinWalls thinWallToolpaths])
+		[underfillPaths addObject: [toolpath areaPath]];
+
+	// infill inside the innermost perimeter, alternating direction by layer
+	FixPolygon* infillPolygon = nil;
+	if (infillSnapshot)
 	{
-		//[thinWallPaths addObjectsFromArray: [skeletizer waveFrontOutlinesTerminatedAfter:snapshot.time - 0.5*extrusionWidth_m*1e3 upTo: snapshot.time + 0.5*extrusionWidth_m*1e3]];
-		if (isBoundary)
-			[overfillPaths addObject: [snapshot thinWallAreaLessThanWidth: 0.5*extrusionWidth_m*1e3 + 0.01]];
-		else
-			[underfillPaths addObject: [snapshot thinWallAreaLessThanWidth: 0.5*extrusionWidth_m*1e3 + 0.01]];
-		isBoundary = !isBoundary;
+		ScanlineInfill* infill = [[ScanlineInfill alloc] init];
+		infill.spacing = extrusionWidth_m*1e3/settings.infillDensity;
+		infill.angle = settings.infillAngle;
+		infillPolygon = [infill infillPolygon: [infillSnapshot waveFrontPolygon] layerIndex: self.layerSelector.indexOfSelectedItem];
 	}
 
 	layerView.motorcyclePaths = cyclePaths;
@@ -301,7 +322,10 @@
 	layerView.terminatedSpokePaths = spokePaths;
 	layerView.outlinePaths = outlinePaths;
 	layerView.underfillPaths = underfillPaths;
-	layerView.overfillPaths	= overfillPaths;
+	layerView.overfillPaths	= @[];
+	layerView.infillPaths = [infillPolygon.segments map: ^id(FixPolygonSegment* segment) {
+		return [segment bezierPath];
+	}];
 	
 }
 
@@ -338,6 +362,10 @@
 
 - (IBAction) layerSelected:(NSPopUpButton*)sender
 {
+	// layers still slicing near the one looked at are done first
+	SlicedLayerStore* store = [self.document layerStore];
+	if (store.layerCount && (sender.indexOfSelectedItem >= 0))
+		[GMPlateScheduler sharedScheduler].focusZ = [store layerZAtIndex: sender.indexOfSelectedItem];
 	
 	self.layerView.slice = [self currentLayer];
 	
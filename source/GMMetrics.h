@@ -0,0 +1,113 @@
+//
+//  GMMetrics.h
+//  Giddy Machinist
+//
+//  Created by Dömötör Gulyás on 19.10.2026.
+//  Copyright (c) 2026 Dömötör Gulyás. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#include <mach/mach_time.h>
+
+/*!
+ @description Process wide registry of named counters, gauges, timers and histograms, for seeing what the slicing and G-code pipelines spend their work on in production, not only under the profiler.
+
+ A metric is registered the first time its name is used, and lives until the process exits. The GM_METRIC macros look it up once per call site, so that updating it afterwards is a single relaxed atomic operation, cheap enough to leave on.
+
+ Counters add up events, gauges keep the last and the largest value set, timers accumulate the count, total and longest of their intervals, and histograms count values in power of two buckets, besides their count, sum and maximum. Names are dotted, with the module first, eg. "skeleton.events.split".
+
+ Setting the GM_METRICS_PATH environment variable writes the metrics as JSON to that path when the process exits, and whenever it receives SIGUSR1.
+ */
+
+typedef enum {
+	GMMetricKindCounter,
+	GMMetricKindGauge,
+	GMMetricKindTimer,
+	GMMetricKindHistogram,
+} GMMetricKind;
+
+typedef struct GMMetric GMMetric;
+
+#define GMMETRICS_BUCKET_COUNT 65 // zero, and one per bit length of a 64bit value
+
+/*!
+ Histogram values collected without touching the shared metric, for code too hot to update it on every value. Record values with GMMetricHistogramBufferRecord(), and merge them with GMMetricMergeHistogram() once in a while.
+ */
+typedef struct {
+	uint64_t	count, total, max;
+	uint64_t	buckets[GMMETRICS_BUCKET_COUNT];
+} GMMetricHistogramBuffer;
+
+static inline void GMMetricHistogramBufferRecord(GMMetricHistogramBuffer* buffer, uint64_t value)
+{
+	buffer->count += 1;
+	buffer->total += value;
+	buffer->buckets[value ? 64 - __builtin_clzll(value) : 0] += 1;
+	if (value > buffer->max)
+		buffer->max = value;
+}
+
+/*!
+ Returns the metric of that name, registering it if necessary. The same name always returns the same metric, asking for it as a different kind is a programming error.
+ */
+extern GMMetric* GMMetricNamed(const char* name, GMMetricKind kind);
+
+extern void GMMetricAdd(GMMetric* counter, int64_t delta);
+extern void GMMetricSet(GMMetric* gauge, double value);
+extern void GMMetricRecordTicks(GMMetric* timer, uint64_t ticks);
+extern void GMMetricRecordValue(GMMetric* histogram, uint64_t value);
+/*!
+ Adds the values of the buffer to the histogram, the buffer is left as it is.
+ */
+extern void GMMetricMergeHistogram(GMMetric* histogram, const GMMetricHistogramBuffer* buffer);
+
+/*!
+ Metrics are enabled by default, when disabled, updates return without touching the metric.
+ */
+extern void GMMetricsSetEnabled(BOOL enabled);
+extern BOOL GMMetricsEnabled(void);
+
+/*!
+ Zeroes all metrics. Updates racing with the reset may be partially lost.
+ */
+extern void GMMetricsReset(void);
+
+/*!
+ The metrics by name, each a dictionary with its kind and values. Timer values are in seconds.
+ */
+extern NSDictionary* GMMetricsSnapshot(void);
+extern NSData* GMMetricsJSONData(void);
+extern BOOL GMMetricsWriteJSONToPath(NSString* path, NSError** error);
+
+/*!
+ Installs the exit and SIGUSR1 handlers if GM_METRICS_PATH is set, called from main().
+ */
+extern void GMMetricsInstallExportHandlers(void);
+
+
+#define GM_METRIC(NAME, KIND) ({ \
+	static GMMetric* _gmCachedMetric = NULL; \
+	GMMetric* _gmMetric = __atomic_load_n(&_gmCachedMetric, __ATOMIC_ACQUIRE); \
+	if (!_gmMetric) \
+	{ \
+		_gmMetric = GMMetricNamed(NAME, KIND); \
+		__atomic_store_n(&_gmCachedMetric, _gmMetric, __ATOMIC_RELEASE); \
+	} \
+	_gmMetric; \
+})
+
+#define GM_METRIC_COUNT(NAME, DELTA) GMMetricAdd(GM_METRIC(NAME, GMMetricKindCounter), (DELTA))
+#define GM_METRIC_GAUGE(NAME, VALUE) GMMetricSet(GM_METRIC(NAME, GMMetricKindGauge), (VALUE))
+#define GM_METRIC_HISTOGRAM(NAME, VALUE) GMMetricRecordValue(GM_METRIC(NAME, GMMetricKindHistogram), (VALUE))
+
+/*!
+ Timers count in mach absolute time, so that starting and stopping them is cheap:
+
+ uint64_t start = GM_METRIC_TIMER_START();
+ ...
+ GM_METRIC_TIMER_STOP("slicer.layerTime", start);
+ */
+#define GM_METRIC_TIMER_START() mach_absolute_time()
+#define GM_METRIC_TIMER_STOP(NAME, START) GMMetricRecordTicks(GM_METRIC(NAME, GMMetricKindTimer), mach_absolute_time() - (START))
+
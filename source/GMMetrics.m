@@ -0,0 +1,260 @@
+//
+//  GMMetrics.m
+//  Giddy Machinist
+//
+//  Created by Dömötör Gulyás on 19.10.2026.
+//  Copyright (c) 2026 Dömötör Gulyás. All rights reserved.
+//
+
+#import "GMMetrics.h"
+
+#include <pthread.h>
+#include <signal.h>
+
+
+
+struct GMMetric {
+	GMMetric*		next;
+	GMMetricKind	kind;
+	char*			name;
+
+	int64_t			count;		// counter value, or number of timer intervals or histogram values
+	uint64_t		total;		// timer ticks, or sum of histogram values
+	uint64_t		max;		// longest timer interval, or largest histogram value
+	double			value, maxValue;	// gauge
+	uint64_t*		buckets;	// histogram
+};
+
+static pthread_mutex_t _registryLock = PTHREAD_MUTEX_INITIALIZER;
+static GMMetric* _registry = NULL;
+static BOOL _enabled = YES;
+
+static NSString* _exportPath = nil;
+static dispatch_source_t _exportSignalSource = nil;
+
+
+GMMetric* GMMetricNamed(const char* name, GMMetricKind kind)
+{
+	pthread_mutex_lock(&_registryLock);
+
+	GMMetric* metric = _registry;
+	while (metric && (strcmp(metric->name, name) != 0))
+		metric = metric->next;
+
+	if (!metric)
+	{
+		metric = calloc(1, sizeof(*metric));
+		metric->kind = kind;
+		metric->name = strdup(name);
+		if (kind == GMMetricKindHistogram)
+			metric->buckets = calloc(GMMETRICS_BUCKET_COUNT, sizeof(*metric->buckets));
+		metric->next = _registry;
+		// published after initialization, for readers not taking the lock
+		__atomic_store_n(&_registry, metric, __ATOMIC_RELEASE);
+	}
+
+	pthread_mutex_unlock(&_registryLock);
+
+	assert(metric->kind == kind);
+
+	return metric;
+}
+
+void GMMetricsSetEnabled(BOOL enabled)
+{
+	__atomic_store_n(&_enabled, enabled, __ATOMIC_RELAXED);
+}
+
+BOOL GMMetricsEnabled(void)
+{
+	return __atomic_load_n(&_enabled, __ATOMIC_RELAXED);
+}
+
+static void _atomicMax(uint64_t* target, uint64_t value)
+{
+	uint64_t current = __atomic_load_n(target, __ATOMIC_RELAXED);
+	while ((value > current) && !__atomic_compare_exchange_n(target, &current, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+void GMMetricAdd(GMMetric* counter, int64_t delta)
+{
+	if (!GMMetricsEnabled())
+		return;
+
+	__atomic_add_fetch(&counter->count, delta, __ATOMIC_RELAXED);
+}
+
+void GMMetricSet(GMMetric* gauge, double value)
+{
+	if (!GMMetricsEnabled())
+		return;
+
+	__atomic_store(&gauge->value, &value, __ATOMIC_RELAXED);
+
+	double current;
+	__atomic_load(&gauge->maxValue, &current, __ATOMIC_RELAXED);
+	while ((value > current) && !__atomic_compare_exchange(&gauge->maxValue, &current, &value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+void GMMetricRecordTicks(GMMetric* timer, uint64_t ticks)
+{
+	if (!GMMetricsEnabled())
+		return;
+
+	__atomic_add_fetch(&timer->count, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&timer->total, ticks, __ATOMIC_RELAXED);
+	_atomicMax(&timer->max, ticks);
+}
+
+void GMMetricRecordValue(GMMetric* histogram, uint64_t value)
+{
+	if (!GMMetricsEnabled())
+		return;
+
+	size_t bucket = value ? 64 - __builtin_clzll(value) : 0;
+
+	__atomic_add_fetch(&histogram->count, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&histogram->total, value, __ATOMIC_RELAXED);
+	__atomic_add_fetch(histogram->buckets + bucket, 1, __ATOMIC_RELAXED);
+	_atomicMax(&histogram->max, value);
+}
+
+void GMMetricMergeHistogram(GMMetric* histogram, const GMMetricHistogramBuffer* buffer)
+{
+	if (!GMMetricsEnabled() || !buffer->count)
+		return;
+
+	__atomic_add_fetch(&histogram->count, buffer->count, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&histogram->total, buffer->total, __ATOMIC_RELAXED);
+	for (size_t i = 0; i < GMMETRICS_BUCKET_COUNT; ++i)
+		if (buffer->buckets[i])
+			__atomic_add_fetch(histogram->buckets + i, buffer->buckets[i], __ATOMIC_RELAXED);
+	_atomicMax(&histogram->max, buffer->max);
+}
+
+void GMMetricsReset(void)
+{
+	pthread_mutex_lock(&_registryLock);
+
+	for (GMMetric* metric = _registry; metric; metric = metric->next)
+	{
+		double zero = 0.0;
+		__atomic_store_n(&metric->count, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&metric->total, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&metric->max, 0, __ATOMIC_RELAXED);
+		__atomic_store(&metric->value, &zero, __ATOMIC_RELAXED);
+		__atomic_store(&metric->maxValue, &zero, __ATOMIC_RELAXED);
+		if (metric->buckets)
+			for (size_t i = 0; i < GMMETRICS_BUCKET_COUNT; ++i)
+				__atomic_store_n(metric->buckets + i, 0, __ATOMIC_RELAXED);
+	}
+
+	pthread_mutex_unlock(&_registryLock);
+}
+
+static double _ticksToSeconds(uint64_t ticks)
+{
+	static mach_timebase_info_data_t timebase;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		mach_timebase_info(&timebase);
+	});
+
+	return 1e-9*(double)ticks*timebase.numer/timebase.denom;
+}
+
+static NSDictionary* _metricDictionary(GMMetric* metric)
+{
+	int64_t count = __atomic_load_n(&metric->count, __ATOMIC_RELAXED);
+	uint64_t total = __atomic_load_n(&metric->total, __ATOMIC_RELAXED);
+	uint64_t max = __atomic_load_n(&metric->max, __ATOMIC_RELAXED);
+
+	switch (metric->kind)
+	{
+		case GMMetricKindCounter:
+			return @{@"kind" : @"counter", @"value" : [NSNumber numberWithLongLong: count]};
+		case GMMetricKindGauge:
+		{
+			double value, maxValue;
+			__atomic_load(&metric->value, &value, __ATOMIC_RELAXED);
+			__atomic_load(&metric->maxValue, &maxValue, __ATOMIC_RELAXED);
+			return @{@"kind" : @"gauge", @"value" : [NSNumber numberWithDouble: value], @"max" : [NSNumber numberWithDouble: maxValue]};
+		}
+		case GMMetricKindTimer:
+			return @{
+				@"kind" : @"timer",
+				@"count" : [NSNumber numberWithLongLong: count],
+				@"total" : [NSNumber numberWithDouble: _ticksToSeconds(total)],
+				@"mean" : [NSNumber numberWithDouble: count ? _ticksToSeconds(total)/count : 0.0],
+				@"max" : [NSNumber numberWithDouble: _ticksToSeconds(max)],
+			};
+		case GMMetricKindHistogram:
+		{
+			// buckets as [lower bound, count] pairs, empty ones left out
+			NSMutableArray* buckets = [NSMutableArray array];
+			for (size_t i = 0; i < GMMETRICS_BUCKET_COUNT; ++i)
+			{
+				uint64_t n = __atomic_load_n(metric->buckets + i, __ATOMIC_RELAXED);
+				if (n)
+					[buckets addObject: @[[NSNumber numberWithUnsignedLongLong: i ? 1ULL << (i-1) : 0], [NSNumber numberWithUnsignedLongLong: n]]];
+			}
+			return @{
+				@"kind" : @"histogram",
+				@"count" : [NSNumber numberWithLongLong: count],
+				@"sum" : [NSNumber numberWithUnsignedLongLong: total],
+				@"mean" : [NSNumber numberWithDouble: count ? (double)total/count : 0.0],
+				@"max" : [NSNumber numberWithUnsignedLongLong: max],
+				@"buckets" : buckets,
+			};
+		}
+	}
+	return nil;
+}
+
+NSDictionary* GMMetricsSnapshot(void)
+{
+	NSMutableDictionary* snapshot = [NSMutableDictionary dictionary];
+
+	for (GMMetric* metric = __atomic_load_n(&_registry, __ATOMIC_ACQUIRE); metric; metric = metric->next)
+		[snapshot setObject: _metricDictionary(metric) forKey: [NSString stringWithUTF8String: metric->name]];
+
+	return snapshot;
+}
+
+NSData* GMMetricsJSONData(void)
+{
+	return [NSJSONSerialization dataWithJSONObject: GMMetricsSnapshot() options: NSJSONWritingPrettyPrinted | NSJSONWritingSortedKeys error: NULL];
+}
+
+BOOL GMMetricsWriteJSONToPath(NSString* path, NSError** error)
+{
+	return [GMMetricsJSONData() writeToFile: path options: NSDataWritingAtomic error: error];
+}
+
+static void _exportMetrics(void)
+{
+	@autoreleasepool {
+		NSError* error = nil;
+		if (!GMMetricsWriteJSONToPath(_exportPath, &error))
+			NSLog(@"failed to write metrics to %@: %@", _exportPath, error);
+	}
+}
+
+void GMMetricsInstallExportHandlers(void)
+{
+	const char* path = getenv("GM_METRICS_PATH");
+	if (!path || !*path || _exportPath)
+		return;
+
+	_exportPath = [[NSFileManager defaultManager] stringWithFileSystemRepresentation: path length: strlen(path)];
+
+	atexit(_exportMetrics);
+
+	signal(SIGUSR1, SIG_IGN);
+	_exportSignalSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_SIGNAL, SIGUSR1, 0, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0));
+	dispatch_source_set_event_handler(_exportSignalSource, ^{
+		_exportMetrics();
+	});
+	dispatch_resume(_exportSignalSource);
+}
+
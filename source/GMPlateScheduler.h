@@ -0,0 +1,71 @@
+//
+//  GMPlateScheduler.h
+//  Giddy Machinist
+//
+//  Created by Dömötör Gulyás on 19.10.2026.
+//  Copyright (c) 2026 Dömötör Gulyás. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class GMCancellationToken;
+
+/*!
+ Later stages are run first among otherwise equal jobs, so that work already started on a part is finished before more is started.
+ */
+typedef enum {
+	GMPlateStageSlice = 0,
+	GMPlateStageSkeleton,
+	GMPlateStageGCode,
+	GMPlateStageCount
+} GMPlateStage;
+
+/*!
+ @description One pool of workers for the geometry jobs of all parts on the build plate, instead of a queue per part, sized to the number of cores.
+
+ Pending jobs are ordered by priority: jobs of the focused owner come first, then jobs closest to the focused Z, then later stages, then the order of submission. The focus follows what the user is looking at, and changing it reorders what has not started yet.
+
+ Jobs submitted with equal keys are run once, identical parts on the plate share the result. A job already pending or running collects further submissions, and finished results are kept in a cache bounded by their byteSize, if they respond to it. Results are shared, and must be treated as read-only, or copied.
+
+ Each submission brackets its cancellation token with beginWork and endWork, until its completion has returned or it has been dropped. Submissions whose token is cancelled are dropped instead of run, if the token of a running job is cancelled, the job is run again for the next submission still wanting it.
+ */
+@interface GMPlateScheduler : NSObject
+
++ (instancetype) sharedScheduler;
+
+/*!
+ Number of jobs run concurrently, the number of active cores by default.
+ */
+@property(nonatomic) NSUInteger maxConcurrentJobs;
+
+/*!
+ Pointer identity only, the owner is not retained.
+ */
+@property(nonatomic, weak) id focusOwner;
+
+/*!
+ NAN for none.
+ */
+@property(nonatomic) double focusZ;
+
+/*!
+ Work is called on a worker, with the token of the submission it is run for. Completion is called on a worker, for every submission sharing the job, with the one result. Owner and key may be nil, z NAN for jobs not belonging to a layer.
+ */
+- (void) addJobForStage: (GMPlateStage) stage owner: (id) owner z: (double) z key: (id<NSCopying>) key cancellationToken: (GMCancellationToken*) token work: (id (^)(GMCancellationToken* token)) work completion: (void (^)(id result)) completion;
+
+/*!
+ Cancels the token, and drops its pending submissions right away, instead of when a worker gets to them, so that waiting for the token afterwards only waits for running jobs.
+ */
+- (void) cancelJobsWithToken: (GMCancellationToken*) token;
+
+@property(nonatomic, readonly) NSUInteger pendingJobCount;
+
+- (void) removeAllCachedResults;
+
+@end
+
+
+/*!
+ A job key for jobs depending on content, by its digest, and on some parameters. The key is a single NSData starting with the digest, as the hash of an NSData covers its leading bytes, while the hash of an NSArray is only its count, which would make all keys of one kind collide.
+ */
+NSData* GMPlateJobKey(NSData* digest, const double* parameters, size_t count);
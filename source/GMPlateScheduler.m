@@ -0,0 +1,399 @@
+//
+//  GMPlateScheduler.m
+//  Giddy Machinist
+//
+//  Created by Dömötör Gulyás on 19.10.2026.
+//  Copyright (c) 2026 Dömötör Gulyás. All rights reserved.
+//
+
+#import "GMPlateScheduler.h"
+
+#import "GMCancellationToken.h"
+#import "GMMetrics.h"
+
+
+#define PLATESCHEDULER_CACHE_BYTES (64*1024*1024)
+#define PLATESCHEDULER_CACHE_COUNT 4096
+
+
+NSData* GMPlateJobKey(NSData* digest, const double* parameters, size_t count)
+{
+	NSMutableData* key = [NSMutableData dataWithCapacity: digest.length + count*sizeof(*parameters)];
+	[key appendData: digest];
+	[key appendBytes: parameters length: count*sizeof(*parameters)];
+	return key;
+}
+
+
+@protocol _GMPlateResultSize
+- (size_t) byteSize;
+@end
+
+
+@interface _GMPlateSubmission : NSObject
+{
+@public
+	GMCancellationToken*	token;
+	void					(^completion)(id result);
+}
+@end
+
+@implementation _GMPlateSubmission
+@end
+
+
+@interface _GMPlateJob : NSObject
+{
+@public
+	GMPlateStage		stage;
+	const void*			owner;
+	double				z;
+	uint64_t			sequence;
+	id<NSCopying>		key;
+	id					(^work)(GMCancellationToken* token);
+	NSMutableArray*		submissions;	// the job is run for the first one
+}
+@end
+
+@implementation _GMPlateJob
+@end
+
+
+@implementation GMPlateScheduler
+{
+	NSMutableArray*			pendingJobs;	// by priority, best first
+	NSMutableDictionary*	jobsByKey;		// pending and running
+	NSMutableSet*			runningJobs;
+	NSCache*				results;
+
+	NSUInteger				runningWorkers;
+	uint64_t				nextSequence;
+	const void*				focusOwnerKey;
+}
+
+@synthesize maxConcurrentJobs, focusOwner, focusZ;
+
++ (instancetype) sharedScheduler
+{
+	static GMPlateScheduler* scheduler = nil;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		scheduler = [[GMPlateScheduler alloc] init];
+	});
+	return scheduler;
+}
+
+- (instancetype) init
+{
+	if (!(self = [super init]))
+		return nil;
+
+	maxConcurrentJobs = MAX(1, [[NSProcessInfo processInfo] activeProcessorCount]);
+	focusZ = NAN;
+
+	pendingJobs = [NSMutableArray array];
+	jobsByKey = [NSMutableDictionary dictionary];
+	runningJobs = [NSMutableSet set];
+
+	results = [[NSCache alloc] init];
+	results.totalCostLimit = PLATESCHEDULER_CACHE_BYTES;
+	results.countLimit = PLATESCHEDULER_CACHE_COUNT;
+
+	return self;
+}
+
+- (NSComparator) jobComparator
+{
+	const void* owner = focusOwnerKey;
+	double fz = focusZ;
+
+	return ^NSComparisonResult(_GMPlateJob* a, _GMPlateJob* b) {
+		if (owner)
+		{
+			BOOL fa = (a->owner == owner), fb = (b->owner == owner);
+			if (fa != fb)
+				return fa ? NSOrderedAscending : NSOrderedDescending;
+		}
+
+		// jobs not on a layer are not held back by the Z focus
+		if (!isnan(fz))
+		{
+			double da = isnan(a->z) ? 0.0 : fabs(a->z - fz);
+			double db = isnan(b->z) ? 0.0 : fabs(b->z - fz);
+			if (da != db)
+				return (da < db) ? NSOrderedAscending : NSOrderedDescending;
+		}
+
+		if (a->stage != b->stage)
+			return (a->stage > b->stage) ? NSOrderedAscending : NSOrderedDescending;
+
+		if (a->sequence != b->sequence)
+			return (a->sequence < b->sequence) ? NSOrderedAscending : NSOrderedDescending;
+
+		return NSOrderedSame;
+	};
+}
+
+- (void) resortPendingJobs
+{
+	[pendingJobs sortUsingComparator: [self jobComparator]];
+}
+
+- (void) setFocusOwner: (id) owner
+{
+	@synchronized(self) {
+		focusOwner = owner;
+		focusOwnerKey = (__bridge const void*)owner;
+		[self resortPendingJobs];
+	}
+}
+
+- (void) setFocusZ: (double) z
+{
+	@synchronized(self) {
+		focusZ = z;
+		[self resortPendingJobs];
+	}
+}
+
+- (void) setMaxConcurrentJobs: (NSUInteger) count
+{
+	@synchronized(self) {
+		maxConcurrentJobs = MAX(1, count);
+		[self spawnWorkers];
+	}
+}
+
+- (NSUInteger) pendingJobCount
+{
+	@synchronized(self) {
+		return pendingJobs.count;
+	}
+}
+
+- (void) removeAllCachedResults
+{
+	[results removeAllObjects];
+}
+
+/*!
+ Drops the submissions of cancelled tokens, from index first on, returns whether any are left.
+ */
+static BOOL _pruneCancelledSubmissions(_GMPlateJob* job, NSUInteger first)
+{
+	NSMutableIndexSet* cancelled = [NSMutableIndexSet indexSet];
+
+	[job->submissions enumerateObjectsUsingBlock: ^(_GMPlateSubmission* submission, NSUInteger i, BOOL* stop) {
+		if ((i >= first) && submission->token.isCancelled)
+		{
+			[cancelled addIndex: i];
+			[submission->token endWork];
+		}
+	}];
+
+	[job->submissions removeObjectsAtIndexes: cancelled];
+
+	return job->submissions.count > 0;
+}
+
+- (void) enqueueJob: (_GMPlateJob*) job
+{
+	NSUInteger index = [pendingJobs indexOfObject: job inSortedRange: NSMakeRange(0, pendingJobs.count) options: NSBinarySearchingInsertionIndex | NSBinarySearchingLastEqual usingComparator: [self jobComparator]];
+	[pendingJobs insertObject: job atIndex: index];
+
+	GM_METRIC_GAUGE("plate.pendingJobs", pendingJobs.count);
+}
+
+- (void) removeJob: (_GMPlateJob*) job
+{
+	if (job->key && ([jobsByKey objectForKey: job->key] == job))
+		[jobsByKey removeObjectForKey: job->key];
+}
+
+- (void) spawnWorkers
+{
+	while ((runningWorkers < maxConcurrentJobs) && (runningWorkers < pendingJobs.count))
+	{
+		runningWorkers++;
+		dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+			[self runWorker];
+		});
+	}
+
+	GM_METRIC_GAUGE("plate.workers", runningWorkers);
+}
+
+- (void) addJobForStage: (GMPlateStage) stage owner: (id) owner z: (double) z key: (id<NSCopying>) key cancellationToken: (GMCancellationToken*) token work: (id (^)(GMCancellationToken* token)) work completion: (void (^)(id result)) completion
+{
+	_GMPlateSubmission* submission = [[_GMPlateSubmission alloc] init];
+	submission->token = token;
+	submission->completion = [completion copy];
+
+	[token beginWork];
+
+	GM_METRIC_COUNT("plate.submissions", 1);
+
+	id cached = key ? [results objectForKey: key] : nil;
+	if (cached)
+	{
+		GM_METRIC_COUNT("plate.cacheHits", 1);
+
+		dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+			@autoreleasepool {
+				if (!token.isCancelled && completion)
+					completion(cached == [NSNull null] ? nil : cached);
+				[token endWork];
+			}
+		});
+		return;
+	}
+
+	@synchronized(self) {
+		_GMPlateJob* job = key ? [jobsByKey objectForKey: key] : nil;
+		if (job)
+		{
+			GM_METRIC_COUNT("plate.sharedJobs", 1);
+			[job->submissions addObject: submission];
+			return;
+		}
+
+		job = [[_GMPlateJob alloc] init];
+		job->stage = stage;
+		job->owner = (__bridge const void*)owner;
+		job->z = z;
+		job->sequence = nextSequence++;
+		job->key = [(id)key copy];
+		job->work = [work copy];
+		job->submissions = [NSMutableArray arrayWithObject: submission];
+
+		if (job->key)
+			[jobsByKey setObject: job forKey: job->key];
+
+		[self enqueueJob: job];
+		[self spawnWorkers];
+	}
+}
+
+- (_GMPlateJob*) dequeueJob
+{
+	while (pendingJobs.count)
+	{
+		_GMPlateJob* job = [pendingJobs objectAtIndex: 0];
+		[pendingJobs removeObjectAtIndex: 0];
+
+		if (_pruneCancelledSubmissions(job, 0))
+			return job;
+
+		[self removeJob: job];
+		GM_METRIC_COUNT("plate.droppedJobs", 1);
+	}
+	return nil;
+}
+
+- (void) finishJob: (_GMPlateJob*) job result: (id) result token: (GMCancellationToken*) token
+{
+	NSArray* submissions = nil;
+
+	@synchronized(self) {
+		[runningJobs removeObject: job];
+		
+		// partial results of a cancelled run are useless, but other submissions may still want the job
+		if (token.isCancelled)
+		{
+			if (_pruneCancelledSubmissions(job, 0))
+			{
+				[self enqueueJob: job];
+				GM_METRIC_COUNT("plate.rerunJobs", 1);
+			}
+			else
+				[self removeJob: job];
+			return;
+		}
+
+		[self removeJob: job];
+		submissions = job->submissions;
+		job->submissions = nil;
+
+		if (job->key)
+		{
+			NSUInteger cost = [result respondsToSelector: @selector(byteSize)] ? [(id<_GMPlateResultSize>)result byteSize] : 0;
+			[results setObject: result ? result : [NSNull null] forKey: job->key cost: cost];
+		}
+	}
+
+	for (_GMPlateSubmission* submission in submissions)
+	{
+		@autoreleasepool {
+			if (!submission->token.isCancelled && submission->completion)
+				submission->completion(result);
+			[submission->token endWork];
+		}
+	}
+}
+
+- (void) runWorker
+{
+	for (;;)
+	{
+		@autoreleasepool {
+			_GMPlateJob* job = nil;
+			GMCancellationToken* token = nil;
+
+			@synchronized(self) {
+				job = [self dequeueJob];
+				if (!job)
+				{
+					runningWorkers--;
+					GM_METRIC_GAUGE("plate.workers", runningWorkers);
+					return;
+				}
+				token = ((_GMPlateSubmission*)[job->submissions objectAtIndex: 0])->token;
+				[runningJobs addObject: job];
+			}
+
+			uint64_t jobStart = GM_METRIC_TIMER_START();
+			id result = job->work(token);
+			GM_METRIC_TIMER_STOP("plate.jobTime", jobStart);
+			GM_METRIC_COUNT("plate.jobs", 1);
+
+			[self finishJob: job result: result token: token];
+
+			// a lowered limit takes effect as workers finish their jobs
+			@synchronized(self) {
+				if (runningWorkers > maxConcurrentJobs)
+				{
+					runningWorkers--;
+					return;
+				}
+			}
+		}
+	}
+}
+
+- (void) cancelJobsWithToken: (GMCancellationToken*) token
+{
+	[token cancel];
+
+	@synchronized(self) {
+		NSMutableIndexSet* dropped = [NSMutableIndexSet indexSet];
+
+		[pendingJobs enumerateObjectsUsingBlock: ^(_GMPlateJob* job, NSUInteger i, BOOL* stop) {
+			if (!_pruneCancelledSubmissions(job, 0))
+			{
+				[dropped addIndex: i];
+				[self removeJob: job];
+			}
+		}];
+
+		[pendingJobs removeObjectsAtIndexes: dropped];
+
+		// submissions sharing a running job need not wait for it, the one it runs for notices the cancellation itself
+		for (_GMPlateJob* job in runningJobs)
+			_pruneCancelledSubmissions(job, 1);
+
+		GM_METRIC_COUNT("plate.droppedJobs", dropped.count);
+		GM_METRIC_GAUGE("plate.pendingJobs", pendingJobs.count);
+	}
+}
+
+@end
@@ -24,6 +24,7 @@
 //@property(nonatomic, strong) NSArray* thinWallPaths;
 @property(nonatomic, strong) NSArray* overfillPaths;
 @property(nonatomic, strong) NSArray* underfillPaths;
+@property(nonatomic, strong) NSArray* infillPaths;
 @property(nonatomic) CGPoint cursor, mouseDragLocationInSlice, mouseDownLocationInSlice, mouseUpLocationInSlice;
 
 - (void) addOffsetOutlinePath: (NSBezierPath*) bpath;
@@ -26,7 +26,7 @@
 //	CGPoint mouseDownLocationInLayer, mouseDragLocationInLayer, mouseUpLocationInSlice;
 }
 
-@synthesize slice, indexOfSelectedOutline, motorcyclePaths, activeSpokePaths, terminatedSpokePaths, outlinePaths, overfillPaths, underfillPaths, mouseDownLocationInSlice, mouseDragLocationInSlice, mouseUpLocationInSlice, clippingOutline, markerPaths;
+@synthesize slice, indexOfSelectedOutline, motorcyclePaths, activeSpokePaths, terminatedSpokePaths, outlinePaths, overfillPaths, underfillPaths, infillPaths, mouseDownLocationInSlice, mouseDragLocationInSlice, mouseUpLocationInSlice, clippingOutline, markerPaths;
 
 - (id)initWithFrame:(NSRect)frame
 {
@@ -86,6 +86,7 @@
 	terminatedSpokePaths = @[];
 	overfillPaths = @[];
 	underfillPaths = @[];
+	infillPaths = @[];
 	
 	for (SlicedOutline* path in slice.outlinePaths)
 	{
@@ -287,6 +288,14 @@
 	}
 	
 	
+	for (NSBezierPath* path in infillPaths)
+	{
+		[[[NSColor cyanColor] colorWithAlphaComponent: 0.8] set];
+		
+		[path setLineWidth: 1.0/scale];
+		[path stroke];
+	}
+	
 	for (NSBezierPath* path in markerPaths)
 	{
 		[[[NSColor whiteColor] colorWithAlphaComponent: 1.0] set];
@@ -8,6 +8,11 @@
 
 #import <Foundation/Foundation.h>
 
+/*!
+ Operation counts are gathered per thread, and added to the process wide metrics every few thousand operations, or when this is called, at the end of longer computations.
+ */
+extern void MPIntegerFlushMetrics(void);
+
 @interface MPInteger : NSObject <NSCopying>
 
 - (instancetype) initWithInt64: (int64_t) i;
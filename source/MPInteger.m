@@ -9,6 +9,7 @@
 #import "MPInteger.h"
 
 #import "tommath.h"
+#import "GMMetrics.h"
 
 #define PRECISION DBL_MANT_DIG
 
@@ -37,6 +38,56 @@ static double mp_get_double(mp_int *a)
 }
 
 
+#define MPINTEGER_METRICS_FLUSH_INTERVAL 4096
+
+typedef enum {
+	_MPOperationAdd,
+	_MPOperationSub,
+	_MPOperationMul,
+	_MPOperationDiv,
+	_MPOperationSqrt,
+	_MPOperationCount
+} _MPOperation;
+
+/*!
+ Operations are counted per thread, as the skeletizers running in parallel would otherwise all contend for the same metrics on every operation.
+ */
+typedef struct {
+	uint64_t					operations[_MPOperationCount];
+	GMMetricHistogramBuffer		resultBits;
+	uint64_t					pending;
+} _MPMetricsBuffer;
+
+static __thread _MPMetricsBuffer _metricsBuffer;
+
+void MPIntegerFlushMetrics(void)
+{
+	_MPMetricsBuffer* buffer = &_metricsBuffer;
+	if (!buffer->pending)
+		return;
+
+	GM_METRIC_COUNT("mp.add", buffer->operations[_MPOperationAdd]);
+	GM_METRIC_COUNT("mp.sub", buffer->operations[_MPOperationSub]);
+	GM_METRIC_COUNT("mp.mul", buffer->operations[_MPOperationMul]);
+	GM_METRIC_COUNT("mp.div", buffer->operations[_MPOperationDiv]);
+	GM_METRIC_COUNT("mp.sqrt", buffer->operations[_MPOperationSqrt]);
+	GMMetricMergeHistogram(GM_METRIC("mp.resultBits", GMMetricKindHistogram), &buffer->resultBits);
+
+	memset(buffer, 0, sizeof(*buffer));
+}
+
+static inline void _recordOperation(_MPOperation operation, mp_int* result)
+{
+	_MPMetricsBuffer* buffer = &_metricsBuffer;
+
+	buffer->operations[operation] += 1;
+	GMMetricHistogramBufferRecord(&buffer->resultBits, mp_count_bits(result));
+
+	if (++buffer->pending >= MPINTEGER_METRICS_FLUSH_INTERVAL)
+		MPIntegerFlushMetrics();
+}
+
+
 @implementation MPInteger
 {
 @public
@@ -133,6 +184,8 @@ static double mp_get_double(mp_int *a)
 	
 	mp_add(&mpint, &mpi->mpint, &r);
 	
+	_recordOperation(_MPOperationAdd, &r);
+
 	return [[MPInteger alloc] initWithMPInt: r];
 }
 
@@ -143,6 +196,8 @@ static double mp_get_double(mp_int *a)
 	
 	mp_sub(&mpint, &mpi->mpint, &r);
 	
+	_recordOperation(_MPOperationSub, &r);
+
 	return [[MPInteger alloc] initWithMPInt: r];
 }
 
@@ -153,6 +208,8 @@ static double mp_get_double(mp_int *a)
 	
 	mp_mul(&mpint, &mpi->mpint, &r);
 	
+	_recordOperation(_MPOperationMul, &r);
+
 	return [[MPInteger alloc] initWithMPInt: r];
 }
 
@@ -163,6 +220,8 @@ static double mp_get_double(mp_int *a)
 	
 	mp_div(&mpint, &mpi->mpint, &r, NULL);
 	
+	_recordOperation(_MPOperationDiv, &r);
+
 	return [[MPInteger alloc] initWithMPInt: r];
 }
 
@@ -207,6 +266,8 @@ static double mp_get_double(mp_int *a)
 	
 	mp_sqrt(&mpint, &r);
 	
+	_recordOperation(_MPOperationSqrt, &r);
+
 	return [[MPInteger alloc] initWithMPInt: r];
 
 }
@@ -566,6 +627,8 @@ double mp_get_double2(mp_int *a) {
 	mp_clear(&a);
 	mp_clear(&b);
 
+	_recordOperation(_MPOperationAdd, &r);
+
 	return [[MPDecimal alloc] initWithMPInt: r shift: MAX(decimalShift, mpi->decimalShift)];
 }
 
@@ -587,6 +650,8 @@ double mp_get_double2(mp_int *a) {
 	mp_clear(&b);
 
 	
+	_recordOperation(_MPOperationSub, &r);
+
 	return [[MPDecimal alloc] initWithMPInt: r shift: MAX(decimalShift, mpi->decimalShift)];
 }
 
@@ -602,6 +667,8 @@ double mp_get_double2(mp_int *a) {
 	mp_clear(&a);
 	mp_clear(&b);
 	
+	_recordOperation(_MPOperationMul, &r);
+
 	return [[MPDecimal alloc] initWithMPInt: r shift: decimalShift + mpi->decimalShift];
 }
 
@@ -622,6 +689,8 @@ double mp_get_double2(mp_int *a) {
 	mp_clear(&a);
 	mp_clear(&b);
 
+	_recordOperation(_MPOperationDiv, &r);
+
 	return [[MPDecimal alloc] initWithMPInt: r shift: decimalShift];
 }
 
@@ -634,6 +703,8 @@ double mp_get_double2(mp_int *a) {
 		
 	mp_div(&mpint, &mpi->mpint, &r, NULL);
 		
+	_recordOperation(_MPOperationDiv, &r);
+
 	return [[MPDecimal alloc] initWithMPInt: r shift: decimalShift-shift];
 }
 
@@ -647,6 +718,8 @@ double mp_get_double2(mp_int *a) {
 	mp_mul_2d(&r, decimalShift, &r);
 	mp_sqrt(&r, &r);
 	
+	_recordOperation(_MPOperationSqrt, &r);
+
 	return [[MPDecimal alloc] initWithMPInt: r shift: decimalShift];
 	
 }
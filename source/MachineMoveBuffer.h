@@ -0,0 +1,64 @@
+//
+//  MachineMoveBuffer.h
+//  Giddy Machinist
+//
+//  Created by Dömötör Gulyás on 19.10.2026.
+//  Copyright (c) 2026 Dömötör Gulyás. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+typedef enum {
+	GMachineMoveRapid = 0,
+	GMachineMoveFeed = 1,
+} GMachineMoveType;
+
+typedef enum {
+	GMachineAxisX = 0,
+	GMachineAxisY,
+	GMachineAxisZ,
+	GMachineAxisA,
+	GMachineAxisB,
+	GMachineAxisC,
+	GMachineAxisCount
+} GMachineAxis;
+
+typedef struct {
+	double		target[GMachineAxisCount];
+	double		feed;
+	uint32_t	line;
+	uint8_t		type;
+} GMachineMove;
+
+/*!
+ A run of consecutive moves, as parallel arrays.
+ */
+typedef struct {
+	const double*	axes[GMachineAxisCount];
+	const float*	feed;
+	const uint32_t*	line;
+	const uint8_t*	type;
+	size_t			count;
+} GMachineMoveRun;
+
+/*!
+ @description Interpreted moves in structure-of-arrays form, stored in fixed size chunks so that appending never moves existing moves. Targets are in millimeters, feeds are zero for rapids.
+
+ Copies are cheap snapshots that share the chunks with the original, a copy taken while moves are being appended sees only the moves appended before it was taken, and may be read concurrently with further appends.
+ */
+@interface GMachineMoveBuffer : NSObject <NSCopying>
+
+- (void) appendMove: (GMachineMoveType) type target: (const double*) target feed: (double) feed line: (uint32_t) line;
+
+@property(nonatomic, readonly) size_t count;
+
+- (GMachineMove) moveAtIndex: (size_t) index;
+
+/*!
+ Calls block with runs covering all moves in order, firstIndex is the index of the first move in a run.
+ */
+- (void) enumerateRunsUsingBlock: (void(^)(const GMachineMoveRun* run, size_t firstIndex, BOOL* stop)) block;
+
+@property(nonatomic, readonly) size_t byteSize;
+
+@end
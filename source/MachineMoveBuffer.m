@@ -0,0 +1,146 @@
+//
+//  MachineMoveBuffer.m
+//  Giddy Machinist
+//
+//  Created by Dömötör Gulyás on 19.10.2026.
+//  Copyright (c) 2026 Dömötör Gulyás. All rights reserved.
+//
+
+#import "MachineMoveBuffer.h"
+
+#define GMACHINE_MOVES_PER_CHUNK 4096
+
+typedef struct {
+	double		axes[GMachineAxisCount][GMACHINE_MOVES_PER_CHUNK];
+	float		feed[GMACHINE_MOVES_PER_CHUNK];
+	uint32_t	line[GMACHINE_MOVES_PER_CHUNK];
+	uint8_t		type[GMACHINE_MOVES_PER_CHUNK];
+} _GMachineMoveChunkData;
+
+/*!
+ Chunks are only ever appended to, and shared between a buffer and its snapshots, the object just manages the lifetime of the data.
+ */
+@interface _GMachineMoveChunk : NSObject
+{
+@public
+	_GMachineMoveChunkData* data;
+}
+@end
+
+@implementation _GMachineMoveChunk
+
+- (id) init
+{
+	if (!(self = [super init]))
+		return nil;
+
+	data = malloc(sizeof(*data));
+
+	return self;
+}
+
+- (void) dealloc
+{
+	free(data);
+}
+
+@end
+
+
+@implementation GMachineMoveBuffer
+{
+	NSMutableArray*		chunks;
+	size_t				count;
+}
+
+@synthesize count;
+
+- (id) init
+{
+	if (!(self = [super init]))
+		return nil;
+
+	chunks = [NSMutableArray array];
+
+	return self;
+}
+
+- (id) copyWithZone: (NSZone*) zone
+{
+	GMachineMoveBuffer* copy = [[GMachineMoveBuffer alloc] init];
+	copy->chunks = [chunks mutableCopy];
+	copy->count = count;
+
+	// the copy must not append into a chunk it shares with the original
+	if (count % GMACHINE_MOVES_PER_CHUNK)
+	{
+		_GMachineMoveChunk* last = copy->chunks.lastObject;
+		_GMachineMoveChunk* chunk = [[_GMachineMoveChunk alloc] init];
+		memcpy(chunk->data, last->data, sizeof(*chunk->data));
+		[copy->chunks replaceObjectAtIndex: copy->chunks.count-1 withObject: chunk];
+	}
+
+	return copy;
+}
+
+- (void) appendMove: (GMachineMoveType) type target: (const double*) target feed: (double) feed line: (uint32_t) line
+{
+	size_t k = count % GMACHINE_MOVES_PER_CHUNK;
+	if (!k)
+		[chunks addObject: [[_GMachineMoveChunk alloc] init]];
+
+	_GMachineMoveChunkData* data = ((_GMachineMoveChunk*)chunks.lastObject)->data;
+
+	for (size_t i = 0; i < GMachineAxisCount; ++i)
+		data->axes[i][k] = target[i];
+	data->feed[k] = (type == GMachineMoveRapid) ? 0.0f : feed;
+	data->line[k] = line;
+	data->type[k] = type;
+
+	count++;
+}
+
+- (GMachineMove) moveAtIndex: (size_t) index
+{
+	assert(index < count);
+
+	_GMachineMoveChunkData* data = ((_GMachineMoveChunk*)[chunks objectAtIndex: index / GMACHINE_MOVES_PER_CHUNK])->data;
+	size_t k = index % GMACHINE_MOVES_PER_CHUNK;
+
+	GMachineMove move = {.feed = data->feed[k], .line = data->line[k], .type = data->type[k]};
+	for (size_t i = 0; i < GMachineAxisCount; ++i)
+		move.target[i] = data->axes[i][k];
+
+	return move;
+}
+
+- (void) enumerateRunsUsingBlock: (void(^)(const GMachineMoveRun* run, size_t firstIndex, BOOL* stop)) block
+{
+	size_t first = 0;
+	BOOL stop = NO;
+
+	for (_GMachineMoveChunk* chunk in [chunks copy])
+	{
+		if (first >= count)
+			break;
+
+		_GMachineMoveChunkData* data = chunk->data;
+		GMachineMoveRun run = {.feed = data->feed, .line = data->line, .type = data->type, .count = MIN(count - first, GMACHINE_MOVES_PER_CHUNK)};
+		for (size_t i = 0; i < GMachineAxisCount; ++i)
+			run.axes[i] = data->axes[i];
+
+		block(&run, first, &stop);
+
+		if (stop)
+			break;
+
+		first += run.count;
+	}
+}
+
+- (size_t) byteSize
+{
+	return chunks.count*sizeof(_GMachineMoveChunkData);
+}
+
+@end
@@ -8,8 +8,74 @@
 
 #import <Foundation/Foundation.h>
 
+#import "MotionPlanner.h"
+
+typedef struct {
+	double		z;
+	double		time;
+	uint32_t	firstLine;
+} GMachineLayerTiming;
+
+/*!
+ A move that took longer than it would have at its nominal speed, loss is the extra time.
+ */
+typedef struct {
+	double		loss;
+	double		time;
+	double		peakSpeed, nominalSpeed;
+	uint32_t	line;
+} GMachineBottleneck;
+
+@interface GMachineSimulationReport : NSObject
+
+@property(nonatomic, readonly) double totalTime;
+@property(nonatomic, readonly) double accelerationLimitedTime;	// speeding up or slowing down
+@property(nonatomic, readonly) double feedLimitedTime;			// cruising at the programmed feed
+@property(nonatomic, readonly) double axisSpeedLimitedTime;		// cruising at an axis speed limit
+@property(nonatomic, readonly) double rapidTime;
+@property(nonatomic, readonly) double totalDistance;
+@property(nonatomic, readonly) size_t segmentCount;
+
+/*!
+ A layer starts whenever a cutting move is at a new Z height. Moves before the first cutting move are accounted to the first layer.
+ */
+@property(nonatomic, readonly) size_t layerCount;
+- (GMachineLayerTiming) layerTimingAtIndex: (size_t) index;
+
+/*!
+ Worst bottlenecks, by loss, highest first.
+ */
+@property(nonatomic, readonly) size_t bottleneckCount;
+- (GMachineBottleneck) bottleneckAtIndex: (size_t) index;
+
+@end
+
+
+/*!
+ @description Runs planned motion in batch mode, evaluating the velocity profiles of the planner analytically instead of stepping through time, so that job times can be estimated far faster than real time.
+ */
 @interface MachineSimulator : NSObject
 
-- (void) executeCommandsAsync: (NSArray*) commands;
+/*!
+ Plans with the limits and settings of machine, which is only read, so that one planner can describe the machine of a document while simulations run.
+ */
+- (instancetype) initWithMachine: (MotionPlanner*) machine;
+
+@property(nonatomic, readonly) MotionPlanner* planner;
+@property(nonatomic) size_t maxBottleneckCount;
+
+- (GMachineSimulationReport*) simulateMoves: (GMachineMoveBuffer*) moves;
+
+/*!
+ Also samples the tool position every sampleInterval seconds of machine time.
+ */
+- (GMachineSimulationReport*) simulateMoves: (GMachineMoveBuffer*) moves sampleInterval: (double) sampleInterval sampleHandler: (void(^)(double time, const double* position)) sampleHandler;
+
+/*!
+ Streams the planned segments through the step queue to a step generator on a simulated stepper interrupt thread, which ticks as fast as it can instead of in real time. Only one simulated stepper interrupt can run at a time. Returns the number of ticks, stepPositions receives the final step counts of the axes, including backlash compensation.
+ */
+- (uint64_t) generateStepsForMoves: (GMachineMoveBuffer*) moves finalStepPositions: (int64_t*) stepPositions;
+
+- (void) simulateMovesAsync: (GMachineMoveBuffer*) moves completion: (void(^)(GMachineSimulationReport* report)) completion;
 
 @end
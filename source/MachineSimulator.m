@@ -9,39 +9,299 @@
 #import "MachineSimulator.h"
 #import "MotionPlanner.h"
 
+/*
+ The stepper interrupt is simulated by a thread that ticks as fast as it can while enabled, and sleeps on the wakeup semaphore otherwise.
+ */
+static int32_t _stepperInterruptEnabled = 0;
+static dispatch_semaphore_t _stepperInterruptWakeup = NULL;
+
 void ResumeStepperInterrupt(void)
 {
-	
+	if (!__atomic_exchange_n(&_stepperInterruptEnabled, 1, __ATOMIC_ACQ_REL))
+		dispatch_semaphore_signal(_stepperInterruptWakeup);
 }
 
 void SuspendStepperInterrupt(void)
 {
-	
+	__atomic_store_n(&_stepperInterruptEnabled, 0, __ATOMIC_RELEASE);
+}
+
+
+@implementation GMachineSimulationReport
+{
+	double			totalTime, accelerationLimitedTime, feedLimitedTime, axisSpeedLimitedTime, rapidTime, totalDistance;
+	size_t			segmentCount;
+
+	NSMutableData*	layers;
+	double			pendingLayerTime;
+
+	GMachineBottleneck*	bottlenecks;
+	size_t			bottleneckCount, maxBottleneckCount;
+}
+
+@synthesize totalTime, accelerationLimitedTime, feedLimitedTime, axisSpeedLimitedTime, rapidTime, totalDistance, segmentCount, bottleneckCount;
+
+- (instancetype) initWithMaxBottleneckCount: (size_t) maxCount
+{
+	if (!(self = [super init]))
+		return nil;
+
+	layers = [NSMutableData data];
+	maxBottleneckCount = maxCount;
+	bottlenecks = calloc(MAX(1, maxCount), sizeof(*bottlenecks));
+
+	return self;
+}
+
+- (void) dealloc
+{
+	free(bottlenecks);
+}
+
+- (size_t) layerCount
+{
+	return layers.length/sizeof(GMachineLayerTiming);
+}
+
+- (GMachineLayerTiming) layerTimingAtIndex: (size_t) index
+{
+	assert(index < self.layerCount);
+	return ((const GMachineLayerTiming*)layers.bytes)[index];
+}
+
+- (GMachineBottleneck) bottleneckAtIndex: (size_t) index
+{
+	assert(index < bottleneckCount);
+	return bottlenecks[index];
+}
+
+- (void) addBottleneck: (GMachineBottleneck) bottleneck
+{
+	if (!maxBottleneckCount || (bottleneck.loss <= 0.0))
+		return;
+	if ((bottleneckCount == maxBottleneckCount) && (bottleneck.loss <= bottlenecks[bottleneckCount-1].loss))
+		return;
+
+	// insertion into the short sorted list
+	size_t i = MIN(bottleneckCount, maxBottleneckCount-1);
+	while ((i > 0) && (bottlenecks[i-1].loss < bottleneck.loss))
+	{
+		bottlenecks[i] = bottlenecks[i-1];
+		--i;
+	}
+	bottlenecks[i] = bottleneck;
+	bottleneckCount = MIN(bottleneckCount+1, maxBottleneckCount);
+}
+
+- (void) addSegment: (const GMotionSegment*) segment
+{
+	double rampTime = segment->accelerateTime + segment->decelerateTime;
+	double duration = rampTime + segment->cruiseTime;
+
+	totalTime += duration;
+	totalDistance += segment->length;
+	accelerationLimitedTime += rampTime;
+	if (segment->speedLimit == GMotionLimitAxisSpeed)
+		axisSpeedLimitedTime += segment->cruiseTime;
+	else
+		feedLimitedTime += segment->cruiseTime;
+	if (segment->type == GMachineMoveRapid)
+		rapidTime += duration;
+	segmentCount++;
+
+	BOOL isCut = (segment->type == GMachineMoveFeed) && ((segment->delta[GMachineAxisX] != 0.0) || (segment->delta[GMachineAxisY] != 0.0));
+	double z = segment->start[GMachineAxisZ] + segment->delta[GMachineAxisZ];
+	size_t numLayers = self.layerCount;
+	GMachineLayerTiming* layer = numLayers ? (GMachineLayerTiming*)layers.mutableBytes + numLayers - 1 : NULL;
+
+	if (isCut && (!layer || (fabs(layer->z - z) > 1e-6)))
+	{
+		GMachineLayerTiming newLayer = {.z = z, .time = pendingLayerTime, .firstLine = segment->line};
+		pendingLayerTime = 0.0;
+		[layers appendBytes: &newLayer length: sizeof(newLayer)];
+		layer = (GMachineLayerTiming*)layers.mutableBytes + numLayers;
+	}
+	if (layer)
+		layer->time += duration;
+	else
+		pendingLayerTime += duration;
+
+	if (segment->nominalSpeed > 0.0)
+	{
+		double idealTime = segment->length/segment->nominalSpeed;
+		[self addBottleneck: (GMachineBottleneck){.loss = duration - idealTime, .time = duration, .peakSpeed = segment->peakSpeed, .nominalSpeed = segment->nominalSpeed, .line = segment->line}];
+	}
+}
+
+- (NSString*) description
+{
+	NSMutableString* str = [NSMutableString stringWithFormat: @"%zu moves, %.1f mm, %.1f s total: %.1f s accelerating, %.1f s at feed, %.1f s at axis limits, %.1f s rapids, %zu layers", segmentCount, totalDistance, totalTime, accelerationLimitedTime, feedLimitedTime, axisSpeedLimitedTime, rapidTime, self.layerCount];
+
+	for (size_t i = 0; i < bottleneckCount; ++i)
+		[str appendFormat: @"\n  line %u: %.3f s, %.3f s lost, peak %.1f of %.1f mm/s", bottlenecks[i].line, bottlenecks[i].time, bottlenecks[i].loss, bottlenecks[i].peakSpeed, bottlenecks[i].nominalSpeed];
+
+	return str;
 }
 
+@end
+
 
 @implementation MachineSimulator
 {
 	MotionPlanner* planner;
 }
 
+@synthesize planner, maxBottleneckCount;
+
 - (id) init
 {
 	if (!(self = [super init]))
 		return nil;
-	
+
 	planner = [[MotionPlanner alloc] init];
-	
+	maxBottleneckCount = 10;
+
 	return self;
 }
 
-- (void) update:(double)dt
+- (instancetype) initWithMachine: (MotionPlanner*) machine
+{
+	if (!(self = [self init]))
+		return nil;
+
+	planner.accelerationLimitTable = machine.accelerationLimitTable;
+	planner.speedLimitTable = machine.speedLimitTable;
+	planner.stepsPerUnitTable = machine.stepsPerUnitTable;
+	planner.backlashTable = machine.backlashTable;
+	planner.autoArcLimitSteps = machine.autoArcLimitSteps;
+	planner.ticksPerSecond = machine.ticksPerSecond;
+	planner.junctionDeviation = machine.junctionDeviation;
+	planner.jerkLimit = machine.jerkLimit;
+	planner.lookAheadWindow = machine.lookAheadWindow;
+	[planner reset];
+
+	return self;
+}
+
+- (GMachineSimulationReport*) simulateMoves: (GMachineMoveBuffer*) moves
+{
+	return [self simulateMoves: moves sampleInterval: 0.0 sampleHandler: nil];
+}
+
+- (GMachineSimulationReport*) simulateMoves: (GMachineMoveBuffer*) moves sampleInterval: (double) sampleInterval sampleHandler: (void(^)(double time, const double* position)) sampleHandler
+{
+	GMachineSimulationReport* report = [[GMachineSimulationReport alloc] initWithMaxBottleneckCount: maxBottleneckCount];
+
+	__block double segmentStartTime = 0.0;
+	__block double nextSampleTime = 0.0;
+	BOOL sample = sampleHandler && (sampleInterval > 0.0);
+
+	planner.segmentHandler = ^(const GMotionSegment* segment) {
+		double duration = GMotionSegmentDuration(segment);
+
+		if (sample)
+		{
+			double position[GMachineAxisCount];
+			while (nextSampleTime <= segmentStartTime + duration)
+			{
+				GMotionSegmentPositionAtTime(segment, nextSampleTime - segmentStartTime, position);
+				sampleHandler(nextSampleTime, position);
+				nextSampleTime += sampleInterval;
+			}
+		}
+
+		[report addSegment: segment];
+		segmentStartTime += duration;
+	};
+
+	[planner processMoves: moves];
+
+	planner.segmentHandler = nil;
+
+	return report;
+}
+
+- (uint64_t) generateStepsForMoves: (GMachineMoveBuffer*) moves finalStepPositions: (int64_t*) stepPositions
 {
-	
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		_stepperInterruptWakeup = dispatch_semaphore_create(0);
+	});
+
+	StepperQueue* queue = calloc(1, sizeof(*queue));
+	StepGenerator* generator = calloc(1, sizeof(*generator));
+	StepperQueueInit(queue);
+	StepGeneratorInit(generator);
+
+	__block uint64_t numTicks = 0;
+	__block int32_t producerDone = 0;
+	dispatch_semaphore_t stepperDone = dispatch_semaphore_create(0);
+
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^{
+		while (1)
+		{
+			if (!__atomic_load_n(&_stepperInterruptEnabled, __ATOMIC_ACQUIRE))
+			{
+				if (__atomic_load_n(&producerDone, __ATOMIC_ACQUIRE) && StepGeneratorIsIdle(generator) && !StepperQueueCount(queue))
+					break;
+				dispatch_semaphore_wait(_stepperInterruptWakeup, dispatch_time(DISPATCH_TIME_NOW, NSEC_PER_MSEC));
+				continue;
+			}
+
+			// the interrupt handler proper
+			StepGeneratorTick(generator, queue);
+			numTicks++;
+
+			if (StepGeneratorIsIdle(generator) && !StepperQueueCount(queue))
+			{
+				SuspendStepperInterrupt();
+				// a segment pushed just before suspending would otherwise wait for the next push
+				if (StepperQueueCount(queue))
+					ResumeStepperInterrupt();
+			}
+		}
+		dispatch_semaphore_signal(stepperDone);
+	});
+
+	long ticksPerSecond = planner.ticksPerSecond;
+
+	planner.segmentHandler = ^(const GMotionSegment* segment) {
+		StepperSegment stepperSegment;
+		GMotionSegmentToStepperSegment(segment, ticksPerSecond, &stepperSegment);
+
+		while (!StepperQueuePush(queue, &stepperSegment))
+		{
+			ResumeStepperInterrupt();
+			usleep(100);
+		}
+		ResumeStepperInterrupt();
+	};
+
+	[planner processMoves: moves];
+
+	planner.segmentHandler = nil;
+
+	__atomic_store_n(&producerDone, 1, __ATOMIC_RELEASE);
+	ResumeStepperInterrupt();
+	dispatch_semaphore_wait(stepperDone, DISPATCH_TIME_FOREVER);
+
+	if (stepPositions)
+		memcpy(stepPositions, generator->position, sizeof(generator->position));
+
+	free(generator);
+	free(queue);
+
+	return numTicks;
 }
 
-- (void) executeCommandsAsync: (NSArray*) commands
+- (void) simulateMovesAsync: (GMachineMoveBuffer*) moves completion: (void(^)(GMachineSimulationReport* report)) completion
 {
-	
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		GMachineSimulationReport* report = [self simulateMoves: moves];
+		dispatch_async(dispatch_get_main_queue(), ^{
+			completion(report);
+		});
+	});
 }
+
 @end
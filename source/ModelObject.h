@@ -56,6 +56,11 @@
 @property(nonatomic, strong) FixPolygon* sourcePolygon;
 @property(nonatomic, strong) FixPolygon* toolpathPolygon;
 
+/*!
+ Takes a toolpath generated from the current source polygon, so that it follows rotations and translations of the object like the toolpaths generated by the object itself.
+ */
+- (void) adoptToolpathPolygon: (FixPolygon*) toolpath;
+
 @end
 
 
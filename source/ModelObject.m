@@ -9,12 +9,17 @@
 #import "ModelObject.h"
 #import "NSString+MathAndUnits.h"
 #import "PolygonContour.h"
+#import "GMCancellationToken.h"
+#import "GMPlateScheduler.h"
 #import "GMDocument.h"
 #import "gfx.h"
 #import "FixPolygon.h"
 #import "FoundationExtensions.h"
+#import "RS274Writer.h"
+#import "MotionPlanner.h"
 
 #import <AppKit/AppKit.h>
+#import <CommonCrypto/CommonDigest.h>
 
 @implementation ModelObject
 {
@@ -62,10 +67,23 @@
 		[self navView]; // call accessor to make sure view is loaded
 		assert(progressIndicator);
 		
+		progressIndicator.indeterminate = YES;
 		progressIndicator.hidden = NO;
 		[progressIndicator startAnimation: self];
-		progressCounter++;
 	}
+	progressCounter++;
+}
+
+- (void) asyncProcessProgress: (double) fractionCompleted
+{
+	assert(dispatch_get_current_queue() == dispatch_get_main_queue());
+	
+	if (!progressCounter)
+		return;
+	
+	progressIndicator.indeterminate = NO;
+	progressIndicator.maxValue = 1.0;
+	progressIndicator.doubleValue = fractionCompleted;
 }
 
 - (void) asyncProcessStopped
@@ -143,8 +161,12 @@
 	ModelObjectGCodeGenerator* gcodeProxy;
 	
 	dispatch_source_t editCoalesceSource;
-	long toolpathInProgress;
+	GMCancellationToken* toolpathToken;
 	
+	// polygons as computed for referenceTransform, rigid motions from there are applied to copies of them
+	matrix_t referenceTransform;
+	FixPolygon* referenceSourcePolygon;
+	FixPolygon* referenceToolpath;
 }
 
 @synthesize sourcePolygon, toolpathPolygon, navSelection;
@@ -170,7 +192,7 @@
 	
 	self.name = name;
 	self.sourceBezierPath = bpath;
-	self.sourcePolygon = [FixPolygon polygonFromBezierPath: bpath withTransform: mToAffineTransform(self.objectTransform) flatness: 0.1];
+	[self updateReferencePolygon];
 		
 	{
 		transformProxy = [[ModelObjectTransformProxy alloc] init];
@@ -198,23 +220,52 @@
 	navSelection = sel;
 	[self.document modelObjectChanged: self];
 	
+	// the part being looked at gets its toolpath first
+	if (sel)
+		[GMPlateScheduler sharedScheduler].focusOwner = self;
+	
 	[self didChangeValueForKey: @"navSelection"];
 }
 
 - (void) cancelToolpathCreation
 {
-	if (!toolpathInProgress)
-		return;
+	// the skeletizer checks the token in its inner loops, so this returns within milliseconds, and jobs not yet started are dropped right away
+	[[GMPlateScheduler sharedScheduler] cancelJobsWithToken: toolpathToken];
+	[toolpathToken waitUntilIdle];
+	toolpathToken = nil;
+}
+
+/*!
+ Equal for polygons with the same segments, so that toolpaths of identical parts are generated once.
+ */
+static NSData* _polygonDigest(FixPolygon* polygon)
+{
+	CC_SHA256_CTX ctx;
+	unsigned char digest[CC_SHA256_DIGEST_LENGTH];
+	CC_SHA256_Init(&ctx);
+	
+	for (FixPolygonSegment* segment in polygon.segments)
+	{
+		uint64_t header[2] = {segment.vertexCount, segment.isClosed};
+		CC_SHA256_Update(&ctx, header, sizeof(header));
+		CC_SHA256_Update(&ctx, segment.vertices, (CC_LONG)(segment.vertexCount*sizeof(v3i_t)));
+	}
 	
-	toolpathInProgress = -1;
-	while (toolpathInProgress)
-		usleep(10);
+	CC_SHA256_Final(digest, &ctx);
+	return [NSData dataWithBytes: digest length: sizeof(digest)];
 }
 
 - (void) recreateToolpathAsync
 {
+	GMCancellationToken* token = [[GMCancellationToken alloc] init];
+	toolpathToken = token;
+	
+
+	// the toolpath is generated for the reference, and moved into place when done
+	FixPolygon* reference = referenceSourcePolygon;
+	
 	PolygonContour* contour = [[PolygonContour alloc] init];
-	contour.polygon = self.sourcePolygon.copy;
+	contour.polygon = reference.copy;
 	
 	for (FixPolygonSegment* segment in contour.polygon.segments)
 		[segment cleanupDoubleVertices];
@@ -222,45 +273,66 @@
 	double toolOffset = createContourProxy.toolOffset;
 
 	[self asyncProcessStarted];
+	
+	__weak ModelObject2D* weakSelf = self;
+	__weak GMCancellationToken* weakToken = token;
+	token.progressHandler = ^(double fractionCompleted) {
+		if (!weakToken.isCancelled)
+			[weakSelf asyncProcessProgress: fractionCompleted];
+	};
 
-	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+	NSData* key = GMPlateJobKey(_polygonDigest(reference), &toolOffset, 1);
+	
+	[[GMPlateScheduler sharedScheduler] addJobForStage: GMPlateStageSkeleton owner: self z: NAN key: key cancellationToken: token work: ^id(GMCancellationToken* jobToken) {
 		
-		[contour generateToolpathWithOffset: toolOffset cancellationCheck: ^BOOL {
-			return toolpathInProgress > 0;
-		}];
+		[contour generateToolpathWithOffset: toolOffset cancellationToken: jobToken];
+		return contour.toolpath;
+		
+	} completion: ^(FixPolygon* sharedToolpath) {
 		
-		toolpathInProgress = 0;
+		// the result may be shared with identical parts, and is changed below
+		FixPolygon* toolpath = [sharedToolpath polygonByApplyingAffineTransform: [NSAffineTransform transform]];
 		
 		dispatch_async(dispatch_get_main_queue(), ^{
 			
-			for (FixPolygonClosedSegment* cseg in contour.toolpath.segments)
+			if (token.isCancelled || (reference != referenceSourcePolygon) || !toolpath)
+			{
+				[self asyncProcessStopped];
+				return;
+			}
+			
+			for (FixPolygonClosedSegment* cseg in toolpath.segments)
 			{
 				[cseg cleanupDoubleVertices];
 				if (cseg.isClosed)
 					[cseg reverse];
 			}
 			
-			//contour.toolpath.segments = contour.toolpath.segments.reverseObjectEnumerator.allObjects;
+			//toolpath.segments = toolpath.segments.reverseObjectEnumerator.allObjects;
 			if (toolOffset != 0.0)
-				[contour.toolpath nestPolygonWithOptions: PolygonNestingOptionSortY];
+				[toolpath nestPolygonWithOptions: PolygonNestingOptionSortY];
 			else
 			{
 				
 			}
 
 			if (toolOffset < 0.0)
-				for (FixPolygonClosedSegment* cseg in contour.toolpath.segments)
+				for (FixPolygonClosedSegment* cseg in toolpath.segments)
 				{
 					if (cseg.isClosed)
 						[cseg reverse];
 				}
 			
-			self.toolpathPolygon = contour.toolpath;
+			if (toolOffset != 0.0)
+				[toolpath optimizeSegmentOrderFrom: v3iCreate(0, 0, 0, 16) timeBudget: 0.1];
+			
+			referenceToolpath = toolpath;
+			self.toolpathPolygon = [self toolpathForCurrentTransform];
 			[self asyncProcessStopped];
 			
 		});
 		
-	});
+	}];
 	
 	
 
@@ -268,22 +340,82 @@
 
 - (void) parametersForToolpathChanged
 {
+	referenceToolpath = nil;
 	self.toolpathPolygon = nil;
 	
 	dispatch_coalesce(editCoalesceSource, 3.0, ^{
 		[self cancelToolpathCreation];
-		toolpathInProgress = 1;
 		[self recreateToolpathAsync];
 	});
 
 }
 
+/*!
+ The motion taking polygons under one transform to the other, if that is a rotation and translation, otherwise nil.
+ */
+static NSAffineTransform* _rigidMotionBetweenTransforms(matrix_t from, matrix_t to)
+{
+	NSAffineTransform* motion = mToAffineTransform(from);
+	NSAffineTransformStruct f = motion.transformStruct;
+	if (fabs(f.m11*f.m22 - f.m12*f.m21) < 1e-12)
+		return nil;
+	
+	[motion invert];
+	[motion appendTransform: mToAffineTransform(to)];
+	
+	// a reflection is not good enough, as it turns the orientation of outlines and toolpaths
+	NSAffineTransformStruct t = motion.transformStruct;
+	double tolerance = 1e-9;
+	BOOL isRotation = (fabs(t.m11 - t.m22) < tolerance) && (fabs(t.m12 + t.m21) < tolerance) && (fabs(t.m11*t.m11 + t.m12*t.m12 - 1.0) < tolerance);
+	
+	return isRotation ? motion : nil;
+}
+
+- (void) updateReferencePolygon
+{
+	referenceTransform = self.objectTransform;
+	referenceSourcePolygon = [FixPolygon polygonFromBezierPath: self.sourceBezierPath withTransform: mToAffineTransform(referenceTransform) flatness: 0.1];
+	referenceToolpath = nil;
+	
+	self.sourcePolygon = referenceSourcePolygon;
+}
+
+- (FixPolygon*) toolpathForCurrentTransform
+{
+	NSAffineTransform* motion = _rigidMotionBetweenTransforms(referenceTransform, self.objectTransform);
+	assert(motion);
+	return [referenceToolpath polygonByApplyingAffineTransform: motion];
+}
+
+- (void) adoptToolpathPolygon: (FixPolygon*) toolpath
+{
+	[self cancelToolpathCreation];
+	
+	referenceTransform = self.objectTransform;
+	referenceSourcePolygon = self.sourcePolygon;
+	referenceToolpath = toolpath;
+	
+	self.toolpathPolygon = toolpath;
+}
+
 - (void) setObjectTransform: (matrix_t) m
 {
 	[super setObjectTransform: m];
 	
-	self.sourcePolygon = [FixPolygon polygonFromBezierPath: self.sourceBezierPath withTransform: mToAffineTransform(self.objectTransform) flatness: 0.1];
+	if (!self.sourceBezierPath)
+		return;
+	
+	// offsets commute with rotations and translations, so only other changes need the skeleton to be recomputed
+	NSAffineTransform* motion = referenceSourcePolygon ? _rigidMotionBetweenTransforms(referenceTransform, m) : nil;
+	if (motion)
+	{
+		self.sourcePolygon = [referenceSourcePolygon polygonByApplyingAffineTransform: motion];
+		if (referenceToolpath)
+			self.toolpathPolygon = [referenceToolpath polygonByApplyingAffineTransform: motion];
+		return;
+	}
 	
+	[self updateReferencePolygon];
 	[self parametersForToolpathChanged];
 }
 
@@ -712,12 +844,10 @@
 	
 	PolygonContour* contour = [[PolygonContour alloc] init];
 	contour.polygon = [self.object sourcePolygon];
-	[contour generateToolpathWithOffset: toolOffset cancellationCheck:^BOOL{
-		return NO;
-	}];
+	[contour generateToolpathWithOffset: toolOffset cancellationToken: nil];
 
 	ModelObject2D* obj = self.object;
-	obj.toolpathPolygon = contour.toolpath;
+	[obj adoptToolpathPolygon: contour.toolpath];
 		
 	[createContourSheet.sheetParent endSheet: createContourSheet returnCode: NSModalResponseOK];
 
@@ -890,58 +1020,38 @@
 }
 
 
-- (NSString*) generateGCode
+- (void) generateGCodeWithWriter: (RS274Writer*) writer toolpath: (FixPolygon*) toolpath cutDepth: (double) depth
 {
-	NSString* preamble = [NSString stringWithContentsOfFile: [[NSBundle mainBundle] pathForResource: @"preamble" ofType: @"gcode"] encoding: NSASCIIStringEncoding error: NULL];
+	NSData* preamble = [NSData dataWithContentsOfFile: [[NSBundle mainBundle] pathForResource: @"preamble" ofType: @"gcode"]];
 	
-	double cutDepth = -cutDepthField.doubleValue;
-	double safeDepth = 0.0;
+	vmintfix_t cutDepth = iFixCreateFromFloat(-depth, 16);
+	vmintfix_t safeDepth = iFixCreateFromFloat(0.0, 16);
 	
-	NSString* tool = @"T1";
-	
-	NSString* feedrate = @"G1 F1000.0";
-
-	NSString* spindleOn = @"M3";
-	NSString* spindleOff = @"M5";
-	
-	NSMutableArray* toolpathStrings = @[preamble, feedrate, @"S1000", tool, @"G0 Z0", spindleOn, @"G4 P3000"].mutableCopy;
-	
-	ModelObject2D* obj = self.object;
-	assert(obj);
+	if (preamble)
+		[writer writeData: preamble];
 	
+	[writer writeCString: "G1 F1000.0"];
+	[writer writeCString: "S1000"];
+	[writer writeCString: "T1"];
+	[writer writeCString: "G0 Z0"];
+	[writer writeCString: "M3"];
+	[writer writeCString: "G4 P3000"];
 	
-	for (FixPolygonSegment* segment in obj.toolpathPolygon.segments)
+	for (FixPolygonSegment* segment in toolpath.segments)
 	{
 		v3i_t* vertices = segment.vertices;
 		
-		vector_t start = v3iToFloat(vertices[0]);
+		v3i_t start = vertices[0];
 		
-		[toolpathStrings addObject: [NSString stringWithFormat: @"G0 X%.3f Y%.3f", start.farr[0], start.farr[1]]];
-		[toolpathStrings addObject: [NSString stringWithFormat: @"G0 Z%.3f", cutDepth]];
+		[writer rapidToXY: start];
+		[writer rapidToZ: cutDepth];
 
-		
-		for (size_t i = 0; i < segment.vertexCount; ++i)
-		{
-			vector_t v = v3iToFloat(vertices[i]);
-			{
-				[toolpathStrings addObject: [NSString stringWithFormat: @"G1 X%.3f Y%.3f", v.farr[0], v.farr[1]]];
-			}
-		}
-		
-		if (segment.isClosed)
-		{
-			[toolpathStrings addObject: [NSString stringWithFormat: @"G1 X%.3f Y%.3f", start.farr[0], start.farr[1]]];
-		
-		}
+		[writer cutPathXY: vertices count: segment.vertexCount closed: segment.isClosed];
 
-		[toolpathStrings addObject: [NSString stringWithFormat: @"G0 Z%.3f", safeDepth]];
+		[writer rapidToZ: safeDepth];
 	}
 	
-	
-	[toolpathStrings addObject: spindleOff];
-
-	
-	return [toolpathStrings componentsJoinedByString:@"\n"];
+	[writer writeCString: "M5"];
 }
 
 - (IBAction) exportGCodeAction: (id) sender
@@ -956,10 +1066,28 @@
 	result = [panel runModal];
 	if (result == NSOKButton)
 	{
-		NSString* gcode = [self generateGCode];
+		RS274Writer* writer = [[RS274Writer alloc] initWithURL: panel.URL];
+		ModelObject2D* obj = self.object;
+		assert(obj);
 		
-		[gcode writeToURL: panel.URL atomically: YES encoding: NSASCIIStringEncoding error: NULL];
+		writer.arcTolerance = obj.document.machine.autoArcTolerance;
 		
+		// UI state is read here, the writing runs on the plate's workers
+		FixPolygon* toolpath = obj.toolpathPolygon;
+		double cutDepth = cutDepthField.doubleValue;
+		NSURL* url = panel.URL;
+		
+		[[GMPlateScheduler sharedScheduler] addJobForStage: GMPlateStageGCode owner: obj z: NAN key: nil cancellationToken: nil work: ^id(GMCancellationToken* token) {
+			
+			[self generateGCodeWithWriter: writer toolpath: toolpath cutDepth: cutDepth];
+			
+			return [NSNumber numberWithBool: [writer close]];
+			
+		} completion: ^(NSNumber* success) {
+			
+			if (!success.boolValue)
+				NSLog(@"G-code export to %@ failed: %s", url.path, strerror(writer.errorNumber));
+		}];
 	}
 	
 
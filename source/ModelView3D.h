@@ -8,6 +8,8 @@
 
 #import "GLBaseView.h"
 
+@class GMachineMoveBuffer, MovePathMeshBuilder;
+
 
 @interface ModelView3D : GLBaseView
 
@@ -17,6 +19,11 @@
 
 @property(nonatomic,strong) IBOutlet NSSegmentedControl* modelViewScrollModeControl;
 
-- (void) generateMovePathWithMachineCommands:(NSArray *)commands;
+- (void) generateMovePathWithMoves: (GMachineMoveBuffer*) moves;
+
+/*!
+ Shows a move path that may still be growing, chunks appended to builder are picked up on the next redraw.
+ */
+- (void) showMovePath: (MovePathMeshBuilder*) builder;
 
 @end
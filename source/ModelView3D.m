@@ -16,13 +16,17 @@
 #import "GMDocument.h"
 #import "ModelObject.h"
 
-#import "RS274Interpreter.h"
+#import "MachineMoveBuffer.h"
+#import "MovePathMeshBuilder.h"
 
 #import "FoundationExtensions.h"
 
 #import <OpenGL/gl3.h>
 
 
+#define MODELVIEW_FOV (60.0*M_PI/180.0)
+
+
 @implementation ModelView3D
 {
 	GfxShader* modelShader;
@@ -35,58 +39,21 @@
 	
 	range3d_t	printableVolume;
 	GfxMesh*	grid;
-	GfxMesh*	movePaths;
+	MovePathMeshBuilder*	movePath;
 }
 
 @synthesize models, layers, contours;
 
-- (void) generateMovePathWithMachineCommands:(NSArray *)commands
+- (void) generateMovePathWithMoves: (GMachineMoveBuffer*) moves
 {
-	vector_t pathCursor = vCreatePos(0.0, 0.0, 0.0);
-	
-	vector_t maxp = vCreatePos(-INFINITY, -INFINITY, -INFINITY);
-	vector_t minp = vCreatePos(INFINITY, INFINITY, INFINITY);
-	
-	NSArray* moves = [commands select:^BOOL(id obj) {
-		return [obj isKindOfClass: [GMachineCommandMove class]];
-	}];
-	
-	size_t numVertices = moves.count+1;
-	
-	vector_t* vertices = calloc(sizeof(*vertices), numVertices);
-	vector_t* colors = calloc(sizeof(*colors), numVertices);
-	
-	size_t k = 0;
-	
-	for (size_t i = 0; i < numVertices; ++i)
-		colors[i] = vCreate(0.0, 0.5, 0.0, 0.5);
-	
-	vertices[k++] = pathCursor;
-	
-	for (id command in moves)
-	{
-		if ([command isKindOfClass: [GMachineCommandMove class]])
-		{
-
-			vector_t target = vCreatePos([command xTarget], [command yTarget], [command zTarget]);
-			vertices[k++] = target;
-			pathCursor = target;
-			minp = vMin(minp, pathCursor);
-			maxp = vMax(maxp, pathCursor);
-		}
-	}
-	
-	GfxMesh* mesh = [[GfxMesh alloc] init];
-	
-	[mesh addVertices: vertices count: numVertices];
-	[mesh addColors: colors count: numVertices];
-	[mesh addBatch: [GfxMesh_batch batchStarting: 0 count: numVertices mode: GL_LINE_STRIP]];
-	
-	free(colors);
-	free(vertices);
-	
-	//pathBounds = CGRectMake(minp.x, minp.y, maxp.x-minp.x, maxp.y-minp.y);
-	movePaths = mesh;
+	MovePathMeshBuilder* builder = [[MovePathMeshBuilder alloc] init];
+	[builder appendMovesFromBuffer: moves];
+	[self showMovePath: builder];
+}
+
+- (void) showMovePath: (MovePathMeshBuilder*) builder
+{
+	movePath = builder;
 	
 	[self setNeedsRendering];
 }
@@ -242,7 +209,9 @@
 	
 	[gfxState submitState];
 	
-	[movePaths drawHierarchyWithState: gfxState];
+	double pixelHeight = [self convertRectToBacking: [self bounds]].size.height;
+	
+	[movePath drawWithState: gfxState cameraPosition: camPos fieldOfView: MODELVIEW_FOV pixelHeight: pixelHeight];
 	
 	//	[statusString drawAtPoint: NSMakePoint(1.0,1.0)];
 	
@@ -254,7 +223,7 @@
 	gfxState.blendingSrcMode = GL_ONE;
 	gfxState.blendingDstMode = GL_ONE_MINUS_SRC_ALPHA;
 	NSSize size = [self bounds].size;
-	matrix_t projMatrix = mPerspective(60.0*M_PI/180.0, size.width/size.height, 1.0, 10000.0);
+	matrix_t projMatrix = mPerspective(MODELVIEW_FOV, size.width/size.height, 1.0, 10000.0);
 	
 	vector_t up = vCreateDir(0.0, 0.0, 1.0);
 
@@ -8,15 +8,83 @@
 
 #import <Foundation/Foundation.h>
 
+#import "MachineMoveBuffer.h"
+#import "StepGenerator.h"
+
+typedef enum {
+	GMotionLimitFeed = 0,		// cruising at the programmed feed
+	GMotionLimitAxisSpeed = 1,	// an axis speed limit is below the programmed feed
+} GMotionSpeedLimit;
+
+/*!
+ A planned move. The tool moves along the straight line from start to start+delta, first accelerating from entrySpeed to peakSpeed, cruising, then decelerating to exitSpeed. Speeds are along the path in units per second.
+ */
+typedef struct {
+	double		start[GMachineAxisCount];
+	double		delta[GMachineAxisCount];
+	int64_t		steps[GMachineAxisCount];			// signed, including backlash compensation
+	int32_t		backlashSteps[GMachineAxisCount];	// compensation included in steps
+	double		length;
+	double		entrySpeed, peakSpeed, exitSpeed, nominalSpeed;
+	double		acceleration, jerk;					// jerk is zero for trapezoidal profiles
+	double		accelerateTime, cruiseTime, decelerateTime;
+	uint32_t	line;
+	uint8_t		type;
+	uint8_t		speedLimit;
+} GMotionSegment;
+
+double GMotionSegmentDuration(const GMotionSegment* segment);
+/*!
+ Distance travelled along the segment t seconds after its start.
+ */
+double GMotionSegmentDistanceAtTime(const GMotionSegment* segment, double t);
+void GMotionSegmentPositionAtTime(const GMotionSegment* segment, double t, double* position);
+/*!
+ Converts to the rate profile of the step generator. S-curve ramps are approximated by linear ones of the same duration, which cover the same distance.
+ */
+void GMotionSegmentToStepperSegment(const GMotionSegment* segment, long ticksPerSecond, StepperSegment* stepperSegment);
+
+/*!
+ @description Look-ahead motion planner. Moves are added one at a time and kept in a window of lookAheadWindow moves, over which junction speeds are planned with a backward and a forward pass, assuming the machine has to stop after the last move in the window. Whenever the window is full the oldest move is final, and is passed to the segment handler, so memory use does not depend on program length.
+
+ Speed and acceleration along a move are limited so that no axis exceeds its limits. Junction speeds are limited by the junction deviation, the nominal speeds of both moves, and the distance available for acceleration. Axis direction reversals add the backlash of the axis as extra steps to the reversing move.
+
+ The limit tables list X, Y, Z, A, B, C, speeds are in units/s, accelerations in units/s², and backlash in units.
+ */
 @interface MotionPlanner : NSObject
 
 @property(nonatomic) double autoArcLimitSteps;
+/*!
+ Deviation allowed when replacing polylines by arcs in the XY plane, autoArcLimitSteps in units of the finer of the X and Y axes.
+ */
+@property(nonatomic, readonly) double autoArcTolerance;
 @property(nonatomic) long ticksPerSecond;
 @property(nonatomic,strong) NSArray* accelerationLimitTable;
 @property(nonatomic,strong) NSArray* stepsPerUnitTable;
 @property(nonatomic,strong) NSArray* backlashTable;
 @property(nonatomic,strong) NSArray* speedLimitTable;
 
-- (void) processMachineCommands: (NSArray*) commands;
+@property(nonatomic) double junctionDeviation;
+@property(nonatomic) double jerkLimit; // units/s³ along the path, zero for trapezoidal profiles
+@property(nonatomic) size_t lookAheadWindow;
+
+@property(nonatomic, copy) void (^segmentHandler)(const GMotionSegment* segment);
+
+/*!
+ Takes the settings found in settings, keyed by the names of the properties above, for example a speedLimitTable of six numbers, or a junctionDeviation number. Settings missing from the dictionary, and tables not listing all axes, are left as they are. Resets the planner.
+ */
+- (void) takeSettingsFromDictionary: (NSDictionary*) settings;
+
+/*!
+ Starts a new plan with the machine at rest at the origin, and takes the current limit tables.
+ */
+- (void) reset;
+- (void) addMove: (GMachineMove) move;
+/*!
+ Plans the remaining moves to come to a stop.
+ */
+- (void) flush;
+
+- (void) processMoves: (GMachineMoveBuffer*) moves;
 
 @end
@@ -8,12 +8,264 @@
 
 #import "MotionPlanner.h"
 
+#define MOTIONPLANNER_BISECTION_STEPS 48
+#define MOTIONPLANNER_MIN_STEP_RATE 10.0 // step events per second
+
+/*!
+ Duration of a velocity change by dv, with a symmetric S-curve if jerk is non-zero.
+ */
+static double _rampTime(double dv, double a, double jerk)
+{
+	if (dv <= 0.0)
+		return 0.0;
+	if (jerk <= 0.0)
+		return dv/a;
+	if (dv >= a*a/jerk)
+		return dv/a + a/jerk;
+	return 2.0*sqrt(dv/jerk);
+}
+
+static double _rampDistance(double va, double vb, double a, double jerk)
+{
+	return 0.5*(va + vb)*_rampTime(fabs(vb - va), a, jerk);
+}
+
+static double _rampDistanceAtTime(double va, double vb, double a, double jerk, double t)
+{
+	double s = (vb >= va) ? 1.0 : -1.0;
+	double dv = fabs(vb - va);
+
+	if (jerk <= 0.0)
+		return va*t + 0.5*s*a*t*t;
+
+	double t1 = 0.0, t2 = 0.0, ap = 0.0;
+	if (dv >= a*a/jerk)
+	{
+		t1 = a/jerk;
+		t2 = dv/a - a/jerk;
+		ap = a;
+	}
+	else
+	{
+		t1 = sqrt(dv/jerk);
+		ap = jerk*t1;
+	}
+	double T = 2.0*t1 + t2;
+
+	if (t <= t1)
+		return va*t + s*jerk*t*t*t/6.0;
+	else if (t <= t1 + t2)
+	{
+		double tau = t - t1;
+		double x1 = va*t1 + s*jerk*t1*t1*t1/6.0;
+		double v1 = va + 0.5*s*jerk*t1*t1;
+		return x1 + v1*tau + 0.5*s*ap*tau*tau;
+	}
+	else
+	{
+		// mirrored from the end of the ramp
+		double r = MAX(0.0, T - t);
+		return 0.5*(va + vb)*T - (vb*r - s*jerk*r*r*r/6.0);
+	}
+}
+
+/*!
+ Fits the velocity profile between the given entry and exit speeds. If an S-curve profile does not fit, a trapezoidal one is used for the segment, which the planner guarantees to fit.
+ */
+static void _computeProfile(GMotionSegment* segment, double v0, double v1, double jerk)
+{
+	double L = segment->length;
+	double a = segment->acceleration;
+	double vc = MAX(segment->nominalSpeed, MAX(v0, v1));
+	double peak = vc;
+
+	if (jerk > 0.0)
+	{
+		double lo = MAX(v0, v1);
+
+		if (_rampDistance(v0, vc, a, jerk) + _rampDistance(vc, v1, a, jerk) <= L)
+			peak = vc;
+		else if (_rampDistance(v0, lo, a, jerk) + _rampDistance(lo, v1, a, jerk) > L)
+			jerk = 0.0;
+		else
+		{
+			double hi = vc;
+			for (long i = 0; i < MOTIONPLANNER_BISECTION_STEPS; ++i)
+			{
+				double mid = 0.5*(lo + hi);
+				if (_rampDistance(v0, mid, a, jerk) + _rampDistance(mid, v1, a, jerk) <= L)
+					lo = mid;
+				else
+					hi = mid;
+			}
+			peak = lo;
+		}
+	}
+	if (jerk <= 0.0)
+	{
+		peak = MIN(vc, sqrt(MAX(0.0, a*L + 0.5*(v0*v0 + v1*v1))));
+		peak = MAX(peak, MAX(v0, v1));
+	}
+
+	double accelerateDistance = _rampDistance(v0, peak, a, jerk);
+	double decelerateDistance = _rampDistance(peak, v1, a, jerk);
+	double cruiseDistance = MAX(0.0, L - accelerateDistance - decelerateDistance);
+
+	segment->entrySpeed = v0;
+	segment->exitSpeed = v1;
+	segment->peakSpeed = peak;
+	segment->jerk = jerk;
+	segment->accelerateTime = _rampTime(peak - v0, a, jerk);
+	segment->decelerateTime = _rampTime(peak - v1, a, jerk);
+	segment->cruiseTime = (peak > 0.0) ? cruiseDistance/peak : 0.0;
+}
+
+double GMotionSegmentDuration(const GMotionSegment* segment)
+{
+	return segment->accelerateTime + segment->cruiseTime + segment->decelerateTime;
+}
+
+double GMotionSegmentDistanceAtTime(const GMotionSegment* segment, double t)
+{
+	double a = segment->acceleration, jerk = segment->jerk;
+	double v0 = segment->entrySpeed, vp = segment->peakSpeed, v1 = segment->exitSpeed;
+	double x = 0.0;
+
+	if (t <= 0.0)
+		return 0.0;
+	else if (t <= segment->accelerateTime)
+		x = _rampDistanceAtTime(v0, vp, a, jerk, t);
+	else if (t <= segment->accelerateTime + segment->cruiseTime)
+		x = _rampDistance(v0, vp, a, jerk) + vp*(t - segment->accelerateTime);
+	else
+	{
+		double td = MIN(t - segment->accelerateTime - segment->cruiseTime, segment->decelerateTime);
+		x = _rampDistance(v0, vp, a, jerk) + vp*segment->cruiseTime + _rampDistanceAtTime(vp, v1, a, jerk, td);
+	}
+
+	return MIN(MAX(x, 0.0), segment->length);
+}
+
+void GMotionSegmentPositionAtTime(const GMotionSegment* segment, double t, double* position)
+{
+	double f = (segment->length > 0.0) ? GMotionSegmentDistanceAtTime(segment, t)/segment->length : 1.0;
+
+	for (size_t i = 0; i < GMachineAxisCount; ++i)
+		position[i] = segment->start[i] + f*segment->delta[i];
+}
+
+void GMotionSegmentToStepperSegment(const GMotionSegment* segment, long ticksPerSecond, StepperSegment* stepperSegment)
+{
+	memset(stepperSegment, 0, sizeof(*stepperSegment));
+
+	uint32_t stepEventCount = 0;
+	for (size_t i = 0; i < GMachineAxisCount; ++i)
+	{
+		stepperSegment->steps[i] = (int32_t)segment->steps[i];
+		stepEventCount = MAX(stepEventCount, (uint32_t)llabs(segment->steps[i]));
+	}
+	stepperSegment->stepEventCount = stepEventCount;
+
+	if (!stepEventCount || (segment->length <= 0.0))
+		return;
+
+	// step events per tick at a speed of one unit per second, limited to one step event per tick
+	double rateScale = stepEventCount/segment->length/ticksPerSecond*STEPPER_RATE_ONE;
+	double maxRate = STEPPER_RATE_ONE;
+
+	stepperSegment->entryRate = MIN(maxRate, segment->entrySpeed*rateScale);
+	stepperSegment->peakRate = MIN(maxRate, segment->peakSpeed*rateScale);
+	stepperSegment->exitRate = MIN(maxRate, segment->exitSpeed*rateScale);
+	stepperSegment->minimumRate = MIN(stepperSegment->peakRate, MOTIONPLANNER_MIN_STEP_RATE/ticksPerSecond*STEPPER_RATE_ONE);
+
+	uint32_t accelerateTicks = (uint32_t)ceil(segment->accelerateTime*ticksPerSecond);
+	uint32_t decelerateTicks = (uint32_t)ceil(segment->decelerateTime*ticksPerSecond);
+
+	stepperSegment->accelerateTicks = accelerateTicks;
+	stepperSegment->cruiseTicks = (uint32_t)round(segment->cruiseTime*ticksPerSecond);
+	stepperSegment->accelerationPerTick = accelerateTicks ? (stepperSegment->peakRate - MIN(stepperSegment->entryRate, stepperSegment->peakRate))/accelerateTicks : 0;
+	stepperSegment->decelerationPerTick = decelerateTicks ? (stepperSegment->peakRate - MIN(stepperSegment->exitRate, stepperSegment->peakRate))/decelerateTicks : 0;
+}
+
+/*!
+ Highest speed through the corner between two moves that keeps the path within deviation of the corner, given the centripetal acceleration a.
+ */
+static double _junctionSpeed(const double* previousUnit, const double* unit, double a, double deviation)
+{
+	double cosTheta = 0.0;
+	for (size_t i = 0; i < GMachineAxisCount; ++i)
+		cosTheta -= previousUnit[i]*unit[i];
+
+	if (cosTheta > 0.999999)
+		return 0.0; // reversal
+	if (cosTheta < -0.999999)
+		return INFINITY; // straight
+
+	double sinHalfTheta = sqrt(0.5*(1.0 - cosTheta));
+
+	return sqrt(a*deviation*sinHalfTheta/(1.0 - sinHalfTheta));
+}
+
+typedef struct {
+	GMotionSegment	segment;
+	double			unit[GMachineAxisCount];
+	double			maxEntrySpeed;
+	double			entrySpeed;
+} _PlannerBlock;
+
+/*!
+ Plans entry speeds for the count blocks starting at start in the ring of capacity blocks. The entry speed of the first block is fixed, as the move before it is already final, and the last block ends at rest.
+ */
+static void _replan(_PlannerBlock* ring, size_t capacity, size_t start, size_t count, double fixedEntrySpeed)
+{
+	if (!count)
+		return;
+
+	// backward pass, each block must be able to slow down to the next block's entry speed
+	double nextEntrySpeed = 0.0;
+	for (size_t k = count; k > 1; --k)
+	{
+		_PlannerBlock* block = ring + (start + k - 1) % capacity;
+		double v = sqrt(nextEntrySpeed*nextEntrySpeed + 2.0*block->segment.acceleration*block->segment.length);
+		block->entrySpeed = MIN(block->maxEntrySpeed, v);
+		nextEntrySpeed = block->entrySpeed;
+	}
+
+	// forward pass, each block must be reachable by accelerating through the previous one
+	_PlannerBlock* previous = ring + start;
+	previous->entrySpeed = fixedEntrySpeed;
+	for (size_t k = 1; k < count; ++k)
+	{
+		_PlannerBlock* block = ring + (start + k) % capacity;
+		double v = sqrt(previous->entrySpeed*previous->entrySpeed + 2.0*previous->segment.acceleration*previous->segment.length);
+		block->entrySpeed = MIN(block->entrySpeed, v);
+		previous = block;
+	}
+}
+
+
 @implementation MotionPlanner
 {
-	
+	_PlannerBlock*	window;
+	size_t			windowCapacity, windowStart, windowCount;
+	double			fixedEntrySpeed;
+
+	double			position[GMachineAxisCount];
+	int64_t			stepPosition[GMachineAxisCount];
+	int8_t			lastDirection[GMachineAxisCount];
+
+	double			previousUnit[GMachineAxisCount];
+	double			previousNominalSpeed, previousAcceleration;
+	BOOL			hasPrevious;
+
+	double			speedLimits[GMachineAxisCount];
+	double			accelerationLimits[GMachineAxisCount];
+	double			stepsPerUnit[GMachineAxisCount];
+	int32_t			backlashSteps[GMachineAxisCount];
 }
 
 @synthesize accelerationLimitTable, stepsPerUnitTable, backlashTable, speedLimitTable, autoArcLimitSteps, ticksPerSecond;
+@synthesize junctionDeviation, jerkLimit, lookAheadWindow, segmentHandler;
 
 - (id) init
 {
@@ -21,10 +273,10 @@
 		return nil;
 	
 	accelerationLimitTable = [NSArray arrayWithObjects:
-						 @1.0,
-						 @1.0,
-						 @1.0,
-						 @1.0,
+						 @500.0,
+						 @500.0,
+						 @50.0,
+						 @1000.0,
 						 @1.0,
 						 @1.0,
 						 nil];
@@ -56,12 +308,193 @@
 	ticksPerSecond = 10000;
 	autoArcLimitSteps = 16;
 	
+	junctionDeviation = 0.05;
+	jerkLimit = 0.0;
+	lookAheadWindow = 32;
+	
+	[self reset];
+	
 	return self;
 }
 
-- (void) processMachineCommands: (NSArray*) commands
+- (void) dealloc
+{
+	free(window);
+}
+
+- (double) autoArcTolerance
+{
+	double stepsPerUnit = MAX([[stepsPerUnitTable objectAtIndex: 0] doubleValue], [[stepsPerUnitTable objectAtIndex: 1] doubleValue]);
+	
+	return autoArcLimitSteps/stepsPerUnit;
+}
+
+- (void) takeSettingsFromDictionary: (NSDictionary*) settings
 {
+	for (NSString* key in @[@"accelerationLimitTable", @"speedLimitTable", @"stepsPerUnitTable", @"backlashTable"])
+	{
+		NSArray* table = [settings objectForKey: key];
+		if ([table isKindOfClass: [NSArray class]] && (table.count == GMachineAxisCount))
+			[self setValue: table forKey: key];
+	}
+	for (NSString* key in @[@"autoArcLimitSteps", @"ticksPerSecond", @"junctionDeviation", @"jerkLimit", @"lookAheadWindow"])
+	{
+		NSNumber* value = [settings objectForKey: key];
+		if ([value isKindOfClass: [NSNumber class]])
+			[self setValue: value forKey: key];
+	}
 	
+	[self reset];
+}
+
+- (void) reset
+{
+	free(window);
+	windowCapacity = MAX(2, lookAheadWindow);
+	window = calloc(windowCapacity, sizeof(*window));
+	windowStart = 0;
+	windowCount = 0;
+	fixedEntrySpeed = 0.0;
+	hasPrevious = NO;
+
+	for (size_t i = 0; i < GMachineAxisCount; ++i)
+	{
+		position[i] = 0.0;
+		stepPosition[i] = 0;
+		lastDirection[i] = 0;
+
+		speedLimits[i] = [[speedLimitTable objectAtIndex: i] doubleValue];
+		accelerationLimits[i] = [[accelerationLimitTable objectAtIndex: i] doubleValue];
+		stepsPerUnit[i] = [[stepsPerUnitTable objectAtIndex: i] doubleValue];
+		backlashSteps[i] = (int32_t)lround([[backlashTable objectAtIndex: i] doubleValue]*stepsPerUnit[i]);
+	}
+}
+
+- (void) emitOldestBlock
+{
+	_PlannerBlock* block = window + windowStart;
+	double exitSpeed = (windowCount > 1) ? window[(windowStart + 1) % windowCapacity].entrySpeed : 0.0;
+
+	GMotionSegment* segment = &block->segment;
+	_computeProfile(segment, block->entrySpeed, exitSpeed, jerkLimit);
+
+	for (size_t i = 0; i < GMachineAxisCount; ++i)
+	{
+		int64_t target = llround((segment->start[i] + segment->delta[i])*stepsPerUnit[i]);
+		int64_t steps = target - stepPosition[i];
+		int32_t compensation = 0;
+
+		if (steps)
+		{
+			int8_t direction = (steps > 0) ? 1 : -1;
+			if (lastDirection[i] && (direction != lastDirection[i]))
+				compensation = direction*backlashSteps[i];
+			lastDirection[i] = direction;
+		}
+
+		stepPosition[i] = target;
+		segment->steps[i] = steps + compensation;
+		segment->backlashSteps[i] = compensation;
+	}
+
+	if (segmentHandler)
+		segmentHandler(segment);
+
+	fixedEntrySpeed = exitSpeed;
+	windowStart = (windowStart + 1) % windowCapacity;
+	windowCount--;
+}
+
+- (void) addMove: (GMachineMove) move
+{
+	double delta[GMachineAxisCount];
+	double length = 0.0;
+
+	for (size_t i = 0; i < GMachineAxisCount; ++i)
+	{
+		delta[i] = move.target[i] - position[i];
+		length += delta[i]*delta[i];
+	}
+	length = sqrt(length);
+
+	if (length < 1e-9)
+		return;
+
+	if (windowCount == windowCapacity)
+		[self emitOldestBlock];
+
+	_PlannerBlock* block = window + (windowStart + windowCount) % windowCapacity;
+	memset(block, 0, sizeof(*block));
+	GMotionSegment* segment = &block->segment;
+
+	double requestedSpeed = ((move.type == GMachineMoveRapid) || (move.feed <= 0.0)) ? INFINITY : move.feed/60.0;
+	double axisSpeed = INFINITY, acceleration = INFINITY;
+
+	for (size_t i = 0; i < GMachineAxisCount; ++i)
+	{
+		block->unit[i] = delta[i]/length;
+		double u = fabs(block->unit[i]);
+		if (u > 0.0)
+		{
+			axisSpeed = MIN(axisSpeed, speedLimits[i]/u);
+			acceleration = MIN(acceleration, accelerationLimits[i]/u);
+		}
+		segment->start[i] = position[i];
+		segment->delta[i] = delta[i];
+		position[i] = move.target[i];
+	}
+
+	segment->length = length;
+	segment->nominalSpeed = MIN(requestedSpeed, axisSpeed);
+	segment->speedLimit = (axisSpeed < requestedSpeed) ? GMotionLimitAxisSpeed : GMotionLimitFeed;
+	segment->acceleration = acceleration;
+	segment->line = move.line;
+	segment->type = move.type;
+
+	if (hasPrevious)
+	{
+		double junctionSpeed = _junctionSpeed(previousUnit, block->unit, MIN(acceleration, previousAcceleration), junctionDeviation);
+		block->maxEntrySpeed = MIN(junctionSpeed, MIN(segment->nominalSpeed, previousNominalSpeed));
+	}
+	else
+		block->maxEntrySpeed = 0.0;
+
+	memcpy(previousUnit, block->unit, sizeof(previousUnit));
+	previousNominalSpeed = segment->nominalSpeed;
+	previousAcceleration = acceleration;
+	hasPrevious = YES;
+
+	windowCount++;
+
+	_replan(window, windowCapacity, windowStart, windowCount, fixedEntrySpeed);
+}
+
+- (void) flush
+{
+	while (windowCount)
+		[self emitOldestBlock];
+
+	// the machine is at rest, the next move starts from standstill
+	fixedEntrySpeed = 0.0;
+	hasPrevious = NO;
+}
+
+- (void) processMoves: (GMachineMoveBuffer*) moves
+{
+	[self reset];
+
+	[moves enumerateRunsUsingBlock: ^(const GMachineMoveRun* run, size_t firstIndex, BOOL* stop) {
+		for (size_t k = 0; k < run->count; ++k)
+		{
+			GMachineMove move = {.feed = run->feed[k], .line = run->line[k], .type = run->type[k]};
+			for (size_t i = 0; i < GMachineAxisCount; ++i)
+				move.target[i] = run->axes[i][k];
+
+			[self addMove: move];
+		}
+	}];
+
+	[self flush];
 }
 
 @end
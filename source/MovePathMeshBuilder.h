@@ -0,0 +1,38 @@
+//
+//  MovePathMeshBuilder.h
+//  Giddy Machinist
+//
+//  Created by Dömötör Gulyás on 19.10.2026.
+//  Copyright (c) 2026 Dömötör Gulyás. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "VectorMath.h"
+
+@class GMachineMoveBuffer, GfxStateStack;
+
+/*!
+ @description Builds the 3D preview of a machine move path as a series of line strip chunks, split along Z bands, so that a growing program only ever touches its last chunk.
+
+ Each chunk carries decimated levels of detail, where consecutive vertices closer than the level's tolerance are merged, and the level drawn is picked per chunk from the size of a pixel at its distance from the camera.
+
+ Appending is meant for a background queue while parsing, and may overlap with drawing, the vertex data of chunks is immutable once published, and meshes are only created when first drawn.
+ */
+@interface MovePathMeshBuilder : NSObject
+
+/*!
+ Consumes the moves past the ones already seen, moves is expected to be a later snapshot of the same buffer.
+ */
+- (void) appendMovesFromBuffer: (GMachineMoveBuffer*) moves;
+
+@property(nonatomic, readonly) size_t moveCount;
+@property(nonatomic, readonly) size_t chunkCount;
+@property(nonatomic, readonly) range3d_t bounds;
+
+/*!
+ Draws all chunks, pixelHeight is the height of the viewport in pixels, and fovY the vertical field of view of the perspective projection, in radians.
+ */
+- (void) drawWithState: (GfxStateStack*) gfxState cameraPosition: (vector_t) camPos fieldOfView: (double) fovY pixelHeight: (double) pixelHeight;
+
+@end
@@ -0,0 +1,313 @@
+//
+//  MovePathMeshBuilder.m
+//  Giddy Machinist
+//
+//  Created by Dömötör Gulyás on 19.10.2026.
+//  Copyright (c) 2026 Dömötör Gulyás. All rights reserved.
+//
+
+#import "MovePathMeshBuilder.h"
+
+#import "MachineMoveBuffer.h"
+#import "GfxStateStack.h"
+#import "gfx.h"
+#import "GMMetrics.h"
+
+#import <OpenGL/gl3.h>
+
+
+#define MOVEPATH_LOD_LEVELS 5
+#define MOVEPATH_LOD_BASE_TOLERANCE 0.02	// mm, first decimated level, each further one is 4x coarser
+#define MOVEPATH_BAND_HEIGHT 2.0			// mm of Z per chunk
+#define MOVEPATH_MIN_CHUNK_VERTICES 1024	// keeps plunges and retracts from fragmenting chunks
+#define MOVEPATH_MAX_CHUNK_VERTICES 65536
+
+
+static double _lodTolerance(size_t level)
+{
+	return level ? MOVEPATH_LOD_BASE_TOLERANCE*(double)(1ULL << (2*(level-1))) : 0.0;
+}
+
+/*!
+ Merges vertices closer than tolerance to the last kept one, the first and last are always kept, so chunks stay connected.
+ */
+static size_t _decimatePolyline(const vector_t* src, size_t count, double tolerance, vector_t* dst)
+{
+	if (!count)
+		return 0;
+
+	double tolSqr = tolerance*tolerance;
+	size_t k = 0;
+
+	dst[k++] = src[0];
+
+	for (size_t i = 1; i+1 < count; ++i)
+	{
+		double dx = src[i].farr[0] - dst[k-1].farr[0];
+		double dy = src[i].farr[1] - dst[k-1].farr[1];
+		double dz = src[i].farr[2] - dst[k-1].farr[2];
+
+		if (dx*dx + dy*dy + dz*dz >= tolSqr)
+			dst[k++] = src[i];
+	}
+
+	if (count > 1)
+		dst[k++] = src[count-1];
+
+	return k;
+}
+
+
+@interface _MovePathChunk : NSObject
+{
+@public
+	vector_t*	vertices[MOVEPATH_LOD_LEVELS];
+	size_t		vertexCounts[MOVEPATH_LOD_LEVELS];
+	range3d_t	bounds;
+	GfxMesh*	meshes[MOVEPATH_LOD_LEVELS];	// drawing thread only, created on first draw
+}
+
+- (instancetype) initWithVertices: (const vector_t*) src count: (size_t) count bounds: (range3d_t) bounds;
+
+@end
+
+@implementation _MovePathChunk
+
+- (instancetype) initWithVertices: (const vector_t*) src count: (size_t) count bounds: (range3d_t) chunkBounds
+{
+	if (!(self = [super init]))
+		return nil;
+
+	bounds = chunkBounds;
+
+	vertices[0] = malloc(sizeof(*src)*count);
+	memcpy(vertices[0], src, sizeof(*src)*count);
+	vertexCounts[0] = count;
+
+	// each level decimates the previous one, which is cheaper than starting over, and the error still stays below 4/3 of the level's tolerance
+	for (size_t level = 1; level < MOVEPATH_LOD_LEVELS; ++level)
+	{
+		vertices[level] = malloc(sizeof(*src)*vertexCounts[level-1]);
+		vertexCounts[level] = _decimatePolyline(vertices[level-1], vertexCounts[level-1], _lodTolerance(level), vertices[level]);
+	}
+
+	return self;
+}
+
+- (void) dealloc
+{
+	for (size_t level = 0; level < MOVEPATH_LOD_LEVELS; ++level)
+		free(vertices[level]);
+}
+
+- (GfxMesh*) meshForLevel: (size_t) level
+{
+	if (!meshes[level])
+	{
+		size_t count = vertexCounts[level];
+		vector_t* colors = calloc(count, sizeof(*colors));
+
+		for (size_t i = 0; i < count; ++i)
+			colors[i] = vCreate(0.0, 0.5, 0.0, 0.5);
+
+		GfxMesh* mesh = [[GfxMesh alloc] init];
+		[mesh addVertices: vertices[level] count: count];
+		[mesh addColors: colors count: count];
+		[mesh addBatch: [GfxMesh_batch batchStarting: 0 count: count mode: GL_LINE_STRIP]];
+
+		free(colors);
+
+		meshes[level] = mesh;
+	}
+	return meshes[level];
+}
+
+@end
+
+
+@implementation MovePathMeshBuilder
+{
+	// open chunk, only touched while appending
+	vector_t*		openVertices;
+	size_t			openCount, openCapacity;
+	double			openMin[3], openMax[3];
+	long			openBand;
+	BOOL			openBandValid;
+
+	// published chunks, guarded by self
+	NSMutableArray*	sealedChunks;
+	_MovePathChunk*	tailChunk;
+	range3d_t		bounds;
+	size_t			moveCount;
+}
+
+@synthesize moveCount, bounds;
+
+- (instancetype) init
+{
+	if (!(self = [super init]))
+		return nil;
+
+	sealedChunks = [NSMutableArray array];
+
+	openCapacity = MOVEPATH_MIN_CHUNK_VERTICES;
+	openVertices = malloc(sizeof(*openVertices)*openCapacity);
+
+	// the path starts at the machine origin
+	[self resetOpenChunkAt: vCreatePos(0.0, 0.0, 0.0)];
+
+	bounds = rCreateFromMinMax(vCreatePos(0.0, 0.0, 0.0), vCreatePos(0.0, 0.0, 0.0));
+
+	return self;
+}
+
+- (void) dealloc
+{
+	free(openVertices);
+}
+
+- (size_t) chunkCount
+{
+	@synchronized(self) {
+		return sealedChunks.count + (tailChunk ? 1 : 0);
+	}
+}
+
+- (void) resetOpenChunkAt: (vector_t) v
+{
+	openVertices[0] = v;
+	openCount = 1;
+
+	for (int i = 0; i < 3; ++i)
+		openMin[i] = openMax[i] = v.farr[i];
+}
+
+- (_MovePathChunk*) chunkFromOpenVertices
+{
+	range3d_t r = rCreateFromMinMax(vCreatePos(openMin[0], openMin[1], openMin[2]), vCreatePos(openMax[0], openMax[1], openMax[2]));
+	return [[_MovePathChunk alloc] initWithVertices: openVertices count: openCount bounds: r];
+}
+
+- (void) sealOpenChunk
+{
+	_MovePathChunk* chunk = [self chunkFromOpenVertices];
+
+	@synchronized(self) {
+		[sealedChunks addObject: chunk];
+		bounds = rUnionRange(bounds, chunk->bounds);
+	}
+
+	GM_METRIC_COUNT("movePath.chunks", 1);
+	GM_METRIC_COUNT("movePath.vertices", chunk->vertexCounts[0]);
+	GM_METRIC_COUNT("movePath.lodVertices", chunk->vertexCounts[MOVEPATH_LOD_LEVELS-1]);
+
+	// the next chunk continues from where this one ends
+	[self resetOpenChunkAt: openVertices[openCount-1]];
+}
+
+- (void) appendVertex: (vector_t) v feed: (BOOL) isFeed
+{
+	// only feeds pick the band, so retracts don't split chunks
+	if (isFeed)
+	{
+		long band = (long)floor(v.farr[2]/MOVEPATH_BAND_HEIGHT);
+		if (!openBandValid)
+		{
+			openBand = band;
+			openBandValid = YES;
+		}
+		else if ((band != openBand) && (openCount >= MOVEPATH_MIN_CHUNK_VERTICES))
+		{
+			[self sealOpenChunk];
+			openBand = band;
+		}
+	}
+
+	if (openCount >= MOVEPATH_MAX_CHUNK_VERTICES)
+		[self sealOpenChunk];
+
+	if (openCount == openCapacity)
+	{
+		openCapacity *= 2;
+		openVertices = realloc(openVertices, sizeof(*openVertices)*openCapacity);
+	}
+
+	openVertices[openCount++] = v;
+
+	for (int i = 0; i < 3; ++i)
+	{
+		openMin[i] = fmin(openMin[i], v.farr[i]);
+		openMax[i] = fmax(openMax[i], v.farr[i]);
+	}
+}
+
+- (void) appendMovesFromBuffer: (GMachineMoveBuffer*) moves
+{
+	size_t start = moveCount;
+	size_t end = moves.count;
+
+	if (end <= start)
+		return;
+
+	uint64_t appendStart = GM_METRIC_TIMER_START();
+
+	[moves enumerateRunsUsingBlock: ^(const GMachineMoveRun* run, size_t firstIndex, BOOL* stop) {
+		if (firstIndex + run->count <= start)
+			return;
+
+		const double* xs = run->axes[GMachineAxisX];
+		const double* ys = run->axes[GMachineAxisY];
+		const double* zs = run->axes[GMachineAxisZ];
+		for (size_t i = (start > firstIndex) ? start - firstIndex : 0; i < run->count; ++i)
+			[self appendVertex: vCreatePos(xs[i], ys[i], zs[i]) feed: run->type[i] != GMachineMoveRapid];
+	}];
+
+	// the open chunk is published as a snapshot, it is rebuilt on the next append
+	_MovePathChunk* tail = (openCount > 1) ? [self chunkFromOpenVertices] : nil;
+
+	@synchronized(self) {
+		tailChunk = tail;
+		moveCount = end;
+		if (tail)
+			bounds = rUnionRange(bounds, tail->bounds);
+	}
+
+	GM_METRIC_COUNT("movePath.moves", end - start);
+	GM_METRIC_TIMER_STOP("movePath.append", appendStart);
+}
+
+static double _distanceToRange(vector_t p, range3d_t r)
+{
+	double dsqr = 0.0;
+	for (int i = 0; i < 3; ++i)
+	{
+		double d = fmax(0.0, fmax(r.minv.farr[i] - p.farr[i], p.farr[i] - r.maxv.farr[i]));
+		dsqr += d*d;
+	}
+	return sqrt(dsqr);
+}
+
+- (void) drawWithState: (GfxStateStack*) gfxState cameraPosition: (vector_t) camPos fieldOfView: (double) fovY pixelHeight: (double) pixelHeight
+{
+	NSArray* chunks = nil;
+	@synchronized(self) {
+		chunks = tailChunk ? [sealedChunks arrayByAddingObject: tailChunk] : [sealedChunks copy];
+	}
+
+	// world size of a pixel at unit distance
+	double pixelScale = 2.0*tan(0.5*fovY)/fmax(1.0, pixelHeight);
+
+	for (_MovePathChunk* chunk in chunks)
+	{
+		double pixelSize = pixelScale*_distanceToRange(camPos, chunk->bounds);
+
+		// coarsest level that merges only sub-pixel segments
+		size_t level = 0;
+		while ((level+1 < MOVEPATH_LOD_LEVELS) && (_lodTolerance(level+1) <= pixelSize))
+			++level;
+
+		[[chunk meshForLevel: level] drawHierarchyWithState: gfxState];
+	}
+}
+
+@end
@@ -13,6 +13,7 @@
 #import "MPVector2D.h"
 #import "MPInteger.h"
 #import "PriorityQueue.h"
+#import "GMMetrics.h"
 
 #define HASHX 73856093
 #define HASHY 19349663
@@ -425,6 +426,8 @@ static int _divToFloor(int a, int b)
 		dcells = v3iSub(posi, starti);
 	}
 	
+	GM_METRIC_HISTOGRAM("spatialHash.edgeQueryCells", visitedCells.count);
+	
 	if (crashes.count)
 		return crashes.firstObject;
 	
@@ -688,6 +691,8 @@ static MPVector2D* _crashLocationMM(PSMotorcycle* ma, PSMotorcycle* mb)
 		}
 	}
 
+	GM_METRIC_HISTOGRAM("spatialHash.motorcycleQueryCells", visitedCells.count);
+	
 	return crashes;
 }
 
@@ -0,0 +1,48 @@
+//
+//  PSThinWallExtractor.h
+//  Giddy Machinist
+//
+//  Created by Dömötör Gulyás on 19.10.2026.
+//  Copyright (c) 2026 Dömötör Gulyás. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "VectorMath_fixp.h"
+
+@class PolygonSkeletizer, FixPolygonOpenSegment, NSBezierPath;
+
+/*!
+ A centre-line toolpath with an extrusion width at each vertex, varying linearly in between.
+ */
+@interface PSThinWallToolpath : NSObject
+
+- (instancetype) initWithVertices: (const v3i_t*) vertices widths: (const double*) widths count: (size_t) count;
+
+@property(nonatomic, readonly) FixPolygonOpenSegment* centreLine;
+@property(nonatomic, readonly) const double* widths;
+
+/*!
+ The area covered by the extrusion, for display.
+ */
+- (NSBezierPath*) areaPath;
+
+@end
+
+
+/*!
+ @description Finds the regions of a finished skeleton that are narrower than the extrusion width, and not covered by the perimeters emitted at 0.5, 1.5, ... extrusion widths, and returns centre-line toolpaths for them.
+
+ The skeleton is walked once. Skeleton arcs between nearly opposing source edges lie on the centre line of the region between them, which at an arc point at time t is 2t wide. Past the perimeters that reach the point, the uncovered gap is 2t less the width they cover, and always narrower than the extrusion width, as otherwise another perimeter would reach it. Arcs past the last perimeter are left to infill.
+ */
+@interface PSThinWallExtractor : NSObject
+
+- (instancetype) initWithSkeleton: (PolygonSkeletizer*) skeleton;
+
+@property(nonatomic) double extrusionWidth;
+@property(nonatomic) long perimeterCount;
+@property(nonatomic) double minimumWidth; // narrower parts of a gap are not filled
+
+- (NSArray*) thinWallToolpaths;
+
+@end
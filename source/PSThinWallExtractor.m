@@ -0,0 +1,276 @@
+//
+//  PSThinWallExtractor.m
+//  Giddy Machinist
+//
+//  Created by Dömötör Gulyás on 19.10.2026.
+//  Copyright (c) 2026 Dömötör Gulyás. All rights reserved.
+//
+
+#import "PSThinWallExtractor.h"
+
+#import "PolygonSkeletizer.h"
+#import "PolygonSkeletizerObjects.h"
+#import "FixPolygon.h"
+#import "MPInteger.h"
+#import "FoundationExtensions.h"
+
+
+#define THINWALL_OPPOSING_EDGES_COS (-0.5) // source edges turning by more than 120° face each other
+
+
+typedef struct {
+	v3i_t	a, b;
+	double	widthA, widthB;
+} _ThinWallPiece;
+
+
+@implementation PSThinWallToolpath
+{
+	double* widths;
+}
+
+@synthesize centreLine;
+
+- (instancetype) initWithVertices: (const v3i_t*) vertices widths: (const double*) inWidths count: (size_t) count
+{
+	if (!(self = [super init]))
+		return nil;
+
+	centreLine = [[FixPolygonOpenSegment alloc] init];
+	[centreLine addVertices: (v3i_t*)vertices count: count];
+
+	widths = calloc(count, sizeof(*widths));
+	memcpy(widths, inWidths, count*sizeof(*widths));
+
+	return self;
+}
+
+- (void) dealloc
+{
+	free(widths);
+}
+
+- (const double*) widths
+{
+	return widths;
+}
+
+- (NSBezierPath*) areaPath
+{
+	NSBezierPath* bpath = [NSBezierPath bezierPath];
+	v3i_t* vertices = centreLine.vertices;
+
+	for (size_t i = 0; i+1 < centreLine.vertexCount; ++i)
+	{
+		vector_t a = v3iToFloat(vertices[i]);
+		vector_t b = v3iToFloat(vertices[i+1]);
+		double dx = b.farr[0] - a.farr[0], dy = b.farr[1] - a.farr[1];
+		double length = sqrt(dx*dx + dy*dy);
+		if (length == 0.0)
+			continue;
+		double nx = -dy/length, ny = dx/length;
+		double ra = 0.5*widths[i], rb = 0.5*widths[i+1];
+
+		[bpath moveToPoint: NSMakePoint(a.farr[0] + ra*nx, a.farr[1] + ra*ny)];
+		[bpath lineToPoint: NSMakePoint(b.farr[0] + rb*nx, b.farr[1] + rb*ny)];
+		[bpath lineToPoint: NSMakePoint(b.farr[0] - rb*nx, b.farr[1] - rb*ny)];
+		[bpath lineToPoint: NSMakePoint(a.farr[0] - ra*nx, a.farr[1] - ra*ny)];
+		[bpath closePath];
+	}
+
+	return bpath;
+}
+
+@end
+
+
+static v3i_t _interpolate(v3i_t a, v3i_t b, double f)
+{
+	if (f <= 0.0)
+		return a;
+	if (f >= 1.0)
+		return b;
+
+	v3i_t p = a;
+	p.x = a.x + (vmint_t)lround(f*(b.x - a.x));
+	p.y = a.y + (vmint_t)lround(f*(b.y - a.y));
+	p.z = a.z + (vmint_t)lround(f*(b.z - a.z));
+	return p;
+}
+
+static BOOL _edgesAreOpposing(PSSourceEdge* e0, PSSourceEdge* e1)
+{
+	if (!e0 || !e1 || (e0 == e1))
+		return NO;
+
+	vector_t a = v3iToFloat(e0.edge);
+	vector_t b = v3iToFloat(e1.edge);
+	double la = sqrt(a.farr[0]*a.farr[0] + a.farr[1]*a.farr[1]);
+	double lb = sqrt(b.farr[0]*b.farr[0] + b.farr[1]*b.farr[1]);
+	if ((la == 0.0) || (lb == 0.0))
+		return NO;
+
+	return (a.farr[0]*b.farr[0] + a.farr[1]*b.farr[1])/(la*lb) < THINWALL_OPPOSING_EDGES_COS;
+}
+
+
+@implementation PSThinWallExtractor
+{
+	PolygonSkeletizer* skeleton;
+}
+
+@synthesize extrusionWidth, perimeterCount, minimumWidth;
+
+- (instancetype) initWithSkeleton: (PolygonSkeletizer*) inSkeleton
+{
+	if (!(self = [super init]))
+		return nil;
+
+	skeleton = inSkeleton;
+	extrusionWidth = 0.4;
+	perimeterCount = 1;
+	minimumWidth = 0.1;
+
+	return self;
+}
+
+/*!
+ Splits the arc into the pieces that lie in the gaps past each perimeter.
+ */
+- (void) addPiecesOfSpoke: (PSSpoke*) spoke toData: (NSMutableData*) data
+{
+	v3i_t p0 = spoke.startLocation;
+	v3i_t p1 = spoke.terminalVertex.position;
+	if (v3iEqual(p0, p1))
+		return;
+
+	double t0 = sqrt(MAX(0.0, [spoke.startTimeSqr toDouble]));
+	double t1 = sqrt(MAX(0.0, [spoke.terminationTimeSqr toDouble]));
+	double w = extrusionWidth;
+
+	for (long m = 0; m < perimeterCount; ++m)
+	{
+		// past m perimeters, the gap is 2t - 2mw wide, until the next perimeter reaches the arc at (m + 0.5)w
+		double lo = MAX(t0, m*w + 0.5*minimumWidth);
+		double hi = MIN(t1, (m + 0.5)*w);
+		if ((lo > hi) || ((lo == hi) && (t0 != t1)))
+			continue;
+
+		double f0 = (t1 > t0) ? (lo - t0)/(t1 - t0) : 0.0;
+		double f1 = (t1 > t0) ? (hi - t0)/(t1 - t0) : 1.0;
+
+		_ThinWallPiece piece = {
+			.a = _interpolate(p0, p1, f0),
+			.b = _interpolate(p0, p1, f1),
+			.widthA = 2.0*(lo - m*w),
+			.widthB = 2.0*(hi - m*w),
+		};
+		if (!v3iEqual(piece.a, piece.b))
+			[data appendBytes: &piece length: sizeof(piece)];
+	}
+}
+
+static NSValue* _nodeKey(v3i_t v)
+{
+	return [NSValue valueWithBytes: &v objCType: @encode(v3i_t)];
+}
+
+- (NSArray*) thinWallToolpaths
+{
+	NSMutableData* pieceData = [NSMutableData data];
+
+	for (PSSpoke* spoke in [skeleton skeletonSpokes])
+	{
+		if (!spoke.startTimeSqr || !spoke.terminationTimeSqr || !spoke.terminalVertex)
+			continue;
+		if (!_edgesAreOpposing(spoke.leftEdge, spoke.rightEdge))
+			continue;
+
+		[self addPiecesOfSpoke: spoke toData: pieceData];
+	}
+
+	_ThinWallPiece* pieces = pieceData.mutableBytes;
+	size_t pieceCount = pieceData.length/sizeof(*pieces);
+
+	// piece ends, as 2*piece+end, by location
+	NSMutableDictionary* nodes = [NSMutableDictionary dictionary];
+	for (size_t i = 0; i < pieceCount; ++i)
+	{
+		for (size_t end = 0; end < 2; ++end)
+		{
+			NSValue* key = _nodeKey(end ? pieces[i].b : pieces[i].a);
+			NSMutableArray* ends = [nodes objectForKey: key];
+			if (!ends)
+			{
+				ends = [NSMutableArray array];
+				[nodes setObject: ends forKey: key];
+			}
+			[ends addObject: [NSNumber numberWithUnsignedLong: 2*i + end]];
+		}
+	}
+
+	BOOL* used = calloc(pieceCount+1, sizeof(*used));
+	NSMutableData* vertexData = [NSMutableData data];
+	NSMutableData* widthData = [NSMutableData data];
+	NSMutableArray* toolpaths = [NSMutableArray array];
+
+	// chains run through nodes joining exactly two pieces, first from the other nodes, then around what is left in loops
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		for (size_t i = 0; i < pieceCount; ++i)
+		{
+			if (used[i])
+				continue;
+
+			size_t startEnd = 0;
+			if (pass == 0)
+			{
+				if ([[nodes objectForKey: _nodeKey(pieces[i].a)] count] != 2)
+					startEnd = 0;
+				else if ([[nodes objectForKey: _nodeKey(pieces[i].b)] count] != 2)
+					startEnd = 1;
+				else
+					continue;
+			}
+
+			[vertexData setLength: 0];
+			[widthData setLength: 0];
+
+			size_t current = i, fromEnd = startEnd;
+			v3i_t first = fromEnd ? pieces[current].b : pieces[current].a;
+			double firstWidth = fromEnd ? pieces[current].widthB : pieces[current].widthA;
+			[vertexData appendBytes: &first length: sizeof(first)];
+			[widthData appendBytes: &firstWidth length: sizeof(firstWidth)];
+
+			while (1)
+			{
+				used[current] = YES;
+				v3i_t next = fromEnd ? pieces[current].a : pieces[current].b;
+				double nextWidth = fromEnd ? pieces[current].widthA : pieces[current].widthB;
+				[vertexData appendBytes: &next length: sizeof(next)];
+				[widthData appendBytes: &nextWidth length: sizeof(nextWidth)];
+
+				NSArray* ends = [nodes objectForKey: _nodeKey(next)];
+				if (ends.count != 2)
+					break;
+
+				size_t other = [[ends objectAtIndex: 0] unsignedLongValue];
+				if (other/2 == current)
+					other = [[ends objectAtIndex: 1] unsignedLongValue];
+				if ((other/2 == current) || used[other/2])
+					break;
+
+				current = other/2;
+				fromEnd = other % 2;
+			}
+
+			[toolpaths addObject: [[PSThinWallToolpath alloc] initWithVertices: vertexData.bytes widths: widthData.bytes count: vertexData.length/sizeof(v3i_t)]];
+		}
+	}
+
+	free(used);
+
+	return toolpaths;
+}
+
+@end
@@ -27,7 +27,6 @@
 
 @property(nonatomic, readonly) NSBezierPath* waveFrontPath;
 
-- (NSBezierPath*) thinWallAreaLessThanWidth: (double) width;
 
 @end
 
@@ -138,89 +138,6 @@
 	return bpath;
 }
 
-- (NSBezierPath*) thinWallAreaLessThanWidth: (double) _width
-{
-	MPDecimal* width = [[MPDecimal alloc] initWithDouble: _width];
-	NSBezierPath* bpath = [NSBezierPath bezierPath];
-	
-	MPDecimal* timeSqr = [self.time mul: self.time];
-	
-	for (NSArray* loop in loops)
-	{
-		NSMutableArray* thinWaveFronts = [NSMutableArray array];
-		
-		for (PSWaveFrontSegment* segment in loop)
-		{
-			if ([segment.finalTerminationTime compare: [self.time add: width]] < 0)
-			{
-				[thinWaveFronts addObject: segment];
-			}
-		}
-		
-		for (PSWaveFrontSegment* segment in thinWaveFronts)
-		{
-			NSMutableArray* vertices = [NSMutableArray arrayWithObject: segment.rightVertex];
-			
-			NSArray* leftSpokes = [[[segment.waveFronts objectAtIndex: 0] retiredLeftSpokes] arrayByAddingObject: [[segment.waveFronts objectAtIndex: 0] leftSpoke]];
-			NSArray* rightSpokes = [[[segment.waveFronts lastObject] retiredRightSpokes] arrayByAddingObject: [[segment.waveFronts lastObject] rightSpoke]];
-			
-			//asserts regarding issue #2
-			if (0) {
-				NSArray* spokes = leftSpokes;
-				for (size_t i = 0; i+1 < spokes.count; ++i)
-				{
-					PSSpoke* spoke0 = [spokes objectAtIndex: i];
-					PSSpoke* spoke1 = [spokes objectAtIndex: i+1];
-					assert(v3iEqual(spoke0.endLocation, spoke1.startLocation));
-				}
-			}
-			if (0) {
-				NSArray* spokes = rightSpokes;
-				for (size_t i = 0; i+1 < spokes.count; ++i)
-				{
-					PSSpoke* spoke0 = [spokes objectAtIndex: i];
-					PSSpoke* spoke1 = [spokes objectAtIndex: i+1];
-					assert(v3iEqual(spoke0.endLocation, spoke1.startLocation));
-				}
-			}
-			
-			
-			
-			for (PSSpoke* spoke in rightSpokes)
-			{
-				assert(spoke.terminationTimeSqr);
-				if ([spoke.terminationTimeSqr compare: timeSqr] > 0)
-					[vertices addObject: spoke.terminalVertex];
-			}
-			
-			[vertices addObject: [[leftSpokes lastObject] terminalVertex]];
-			
-			for (PSSpoke* spoke in [leftSpokes reverseObjectEnumerator])
-			{
-				assert(spoke.startTimeSqr);
-				if ([spoke.startTimeSqr compare: timeSqr] > 0)
-					[vertices addObject: [PSRealVertex vertexAtPosition: spoke.startLocation]];
-			}
-			[vertices addObject: segment.leftVertex];
-			
-			for (size_t i = 0; i < vertices.count; ++i)
-			{
-				v3i_t pos = [(PSRealVertex*)[vertices objectAtIndex: i] position];
-				if (i == 0)
-					[bpath moveToPoint: v3iToCGPoint(pos)];
-				else
-					[bpath lineToPoint: v3iToCGPoint(pos)];
-
-			}
-			
-			[bpath closePath];
-		}		
-
-	}
-	
-	return bpath;
-}
-
 @end
 
 
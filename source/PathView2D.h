@@ -8,9 +8,11 @@
 
 #import <Cocoa/Cocoa.h>
 
+@class GMachineMoveBuffer;
+
 @interface PathView2D : NSView
 
 - (void) resetPaths;
-- (void) generatePathsWithMachineCommands: (NSArray*) commands;
+- (void) generatePathsWithMoves: (GMachineMoveBuffer*) moves;
 
 @end
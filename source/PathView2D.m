@@ -8,7 +8,7 @@
 
 #import "PathView2D.h"
 
-#import "RS274Interpreter.h"
+#import "MachineMoveBuffer.h"
 
 #import "VectorMath.h"
 #import "CGGeometryExtensions.h"
@@ -61,26 +61,29 @@
 	[self setNeedsDisplay: YES];
 }
 
-- (void) generatePathsWithMachineCommands:(NSArray *)commands
+- (void) generatePathsWithMoves: (GMachineMoveBuffer*) moves
 {
 	
-	CGPoint maxp = _pathCursor;
-	CGPoint minp = _pathCursor;
+	__block CGPoint maxp = _pathCursor;
+	__block CGPoint minp = _pathCursor;
+	__block CGPoint cursor = _pathCursor;
 	
-	for (id command in commands)
-	{
-		if ([command isKindOfClass: [GMachineCommandMove class]])
+	[moves enumerateRunsUsingBlock: ^(const GMachineMoveRun* run, size_t firstIndex, BOOL* stop) {
+		const double* xs = run->axes[GMachineAxisX];
+		const double* ys = run->axes[GMachineAxisY];
+		for (size_t i = 0; i < run->count; ++i)
 		{
 			NSBezierPath* path = [NSBezierPath bezierPath];
-			[path moveToPoint: _pathCursor];
-			CGPoint target = CGPointMake([command xTarget], [command yTarget]);
-			_pathCursor = target;
-			minp = CGPointMin(minp, _pathCursor);
-			maxp = CGPointMax(maxp, _pathCursor);
-			[path lineToPoint: _pathCursor];
+			[path moveToPoint: cursor];
+			cursor = CGPointMake(xs[i], ys[i]);
+			minp = CGPointMin(minp, cursor);
+			maxp = CGPointMax(maxp, cursor);
+			[path lineToPoint: cursor];
 			[paths addObject: path];
 		}
-	}
+	}];
+	
+	_pathCursor = cursor;
 	
 	pathBounds = CGRectMake(minp.x, minp.y, maxp.x-minp.x, maxp.y-minp.y);
 	[self setNeedsDisplay: YES];
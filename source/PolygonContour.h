@@ -8,11 +8,14 @@
 
 #import <Foundation/Foundation.h>
 
-@class FixPolygon;
+@class FixPolygon, GMCancellationToken;
 
 @interface PolygonContour : NSObject
 
-- (void) generateToolpathWithOffset: (double) floatOffset cancellationCheck: (BOOL(^)(void)) checkBlock;
+/*!
+ The token may be nil. When cancelled, the toolpath is left nil.
+ */
+- (void) generateToolpathWithOffset: (double) floatOffset cancellationToken: (GMCancellationToken*) token;
 
 @property(strong, nonatomic) FixPolygon* polygon;
 @property(strong, nonatomic) FixPolygon* toolpath;
@@ -11,6 +11,7 @@
 #import "FixPolygon.h"
 #import "PolygonSkeletizer.h"
 #import "PSWaveFrontSnapshot.h"
+#import "GMCancellationToken.h"
 
 #import "FoundationExtensions.h"
 
@@ -27,7 +28,7 @@
 	return meshes;
 }
 
-- (void) generateToolpathWithOffset: (double) floatOffset cancellationCheck: (BOOL(^)(void)) checkBlock
+- (void) generateToolpathWithOffset: (double) floatOffset cancellationToken: (GMCancellationToken*) token
 {
 	r3i_t polyBounds = self.polygon.bounds;
 	
@@ -76,6 +77,7 @@
 	
 	PolygonSkeletizer* skeletizer = [[PolygonSkeletizer alloc] init];
 	
+	skeletizer.cancellationToken = token;
 	skeletizer.extensionLimit = 1.1*floatOffset;
 	
 	skeletizer.emissionTimes = @[[NSNumber numberWithDouble: floatOffset]];
@@ -106,6 +108,12 @@
 		return NO;
 	}];
 	
+	if (token.isCancelled)
+	{
+		self.toolpath = nil;
+		return;
+	}
+	
 	
 	if (insertExtendedBounds)
 	{
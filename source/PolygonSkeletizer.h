@@ -10,7 +10,7 @@
 
 #import "VectorMath_fixp.h"
 
-@class GfxMesh, PolygonSkeletizer, PSWaveFrontSnapshot, PSMotorcycle, PSEdge, PSVertex, MPDecimal, MPVector2D, PSSpoke;
+@class GfxMesh, GMCancellationToken, PolygonSkeletizer, PSWaveFrontSnapshot, PSMotorcycle, PSEdge, PSVertex, MPDecimal, MPVector2D, PSSpoke;
 
 
 MPVector2D* PSIntersectSpokes(PSSpoke* spoke0, PSSpoke* spoke1);
@@ -33,6 +33,11 @@ typedef void (^SkeletizerEmitCallback)(PolygonSkeletizer* skeletizer, PSWaveFron
 @property(nonatomic,strong) SkeletizerEventCallback eventCallback;
 @property(nonatomic,strong) SkeletizerEmitCallback emitCallback;
 
+/*!
+ Checked inside the motorcycle, crash and event loops, not only between steps, and receives the progress of the skeleton. A cancelled skeleton is incomplete and cannot be continued.
+ */
+@property(nonatomic,strong) GMCancellationToken* cancellationToken;
+
 - (void) addClosedPolygonWithVertices: (v3i_t*) vv count: (size_t) vcount;
 - (void) generateSkeletonWithCancellationCheck: (BOOL(^)(void)) checkBlock;
 
@@ -42,6 +47,11 @@ typedef void (^SkeletizerEmitCallback)(PolygonSkeletizer* skeletizer, PSWaveFron
 - (NSArray*) spokeDisplayPaths;
 - (NSArray*) outlineDisplayPaths;
 
+/*!
+ The arcs of the finished skeleton.
+ */
+- (NSArray*) skeletonSpokes;
+
 - (NSArray*) waveFrontOutlinesTerminatedAfter: (MPDecimal*) tBegin upTo: (MPDecimal*) tEnd;
 
 @end
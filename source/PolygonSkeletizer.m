@@ -18,6 +18,11 @@
 #import "PriorityQueue.h"
 #import "MPVector2D.h"
 #import "MPInteger.h"
+#import "GMMetrics.h"
+#import "GMCancellationToken.h"
+
+
+#define SKELETON_WAVE_PROGRESS_UNITS 1000 // the wave phase is reported by the fraction of its time horizon passed
 
 
 
@@ -59,9 +64,10 @@
 
 	NSMutableArray* doneSteps;
 	
+	int64_t reportedWaveUnits;
 }
 
-@synthesize extensionLimit, mergeThreshold, eventCallback, emitCallback, emissionTimes, doneSteps, debugLoggingEnabled;
+@synthesize extensionLimit, mergeThreshold, eventCallback, emitCallback, emissionTimes, doneSteps, debugLoggingEnabled, cancellationToken;
 
 - (id) init
 {
@@ -629,6 +635,11 @@ static double _lltodouble(vmlongerfix_t a)
 			}
 		}
 	
+	GM_METRIC_COUNT("skeleton.motorcycles", motorcycles.count);
+	
+	// one unit each for the edge query, the motorcycle query, and the crash terminating each motorcycle
+	[cancellationToken addUnitsOfWork: 3*motorcycles.count + SKELETON_WAVE_PROGRESS_UNITS];
+	
 	[motorcycles enumerateObjectsUsingBlock:^(PSMotorcycle* obj, NSUInteger idx, BOOL *stop) {
 		obj.leftNeighbour = [motorcycles objectAtIndex: (motorcycles.count + idx-1) % motorcycles.count];
 		obj.rightNeighbour = [motorcycles objectAtIndex: (idx+1) % motorcycles.count];
@@ -661,6 +672,9 @@ static double _lltodouble(vmlongerfix_t a)
 	
 	for (PSMotorcycle* motorcycle in motorcycles)
 	{
+		if (cancellationToken.isCancelled)
+			return;
+		
 		@autoreleasepool {
 			PSMotorcycleCrash* crash = [spaceHash crashMotorcycleIntoEdges: motorcycle withLimit: motorLimit];
 			
@@ -670,6 +684,8 @@ static double _lltodouble(vmlongerfix_t a)
 			
 			motorcycle.limitingEdgeCrashLocation = [MPVector2D vectorWith3i: crash.location];
 			
+			[cancellationToken completeUnitsOfWork: 1];
+			
 			//[self crashMotorcycle: motorcycle intoEdgesWithLimit: motorLimit];
 		}
 	}
@@ -679,10 +695,15 @@ static double _lltodouble(vmlongerfix_t a)
 
 	for (PSMotorcycle* motorcycle in motorcycles)
 	{
+		if (cancellationToken.isCancelled)
+			return;
+		
 		PriorityQueue* crashes = [spaceHash crashMotorcycleIntoMotorcycles: motorcycle];
 		
 		[motorcycleCrashes addObjectsFromArray: crashes.allObjects];
 		
+		[cancellationToken completeUnitsOfWork: 1];
+		
 		//[self crashMotorcycle: motorcycle intoMotorcycles: motorcycles withLimit: motorLimit.toDouble];
 	}
 	
@@ -694,6 +715,9 @@ static double _lltodouble(vmlongerfix_t a)
 	
 	while (motorcycleCrashes.count)
 	{
+		if (cancellationToken.isCancelled)
+			return;
+		
 		while (motorcycleCrashes.count)
 		{
 			PSMotorcycleCrash* crash = motorcycleCrashes.firstObject;
@@ -729,6 +753,7 @@ static double _lltodouble(vmlongerfix_t a)
 			
 		if ([crash isKindOfClass: [PSMotorcycleVertexCrash class]])
 		{
+			GM_METRIC_COUNT("skeleton.crashes.vertex", 1);
 			PSMotorcycleVertexCrash* vcrash = (id) crash;
 			PSMotorcycle* cycle = vcrash.cycle0;
 			PSRealVertex* vertex = vcrash.vertex;
@@ -742,6 +767,7 @@ static double _lltodouble(vmlongerfix_t a)
 		}
 		else if ([crash isKindOfClass: [PSMotorcycleEdgeCrash class]])
 		{
+			GM_METRIC_COUNT("skeleton.crashes.edge", 1);
 			PSMotorcycleEdgeCrash* ecrash = (id) crash;
 			PSMotorcycle* cycle = ecrash.cycle0;
 			PSRealVertex* vertex = [cycle getVertexOnMotorcycleAtLocation: crash.location];
@@ -767,6 +793,7 @@ static double _lltodouble(vmlongerfix_t a)
 		}
 		else if ([crash isKindOfClass: [PSMotorcycleMotorcycleCrash class]])
 		{
+			GM_METRIC_COUNT("skeleton.crashes.motorcycle", 1);
 			PSMotorcycleMotorcycleCrash* mcrash = (id) crash;
 			
 			PSMotorcycle* crasher = mcrash.cycle0;
@@ -800,6 +827,8 @@ static double _lltodouble(vmlongerfix_t a)
 		[motorcycles removeObject: crash.cycle0];
 		crash.cycle0.terminatingCrash = crash;
 		
+		[cancellationToken completeUnitsOfWork: 1];
+		
 		
 			
 	}
@@ -1586,6 +1615,8 @@ static PSSpoke* _continuedSpoke(PSSpoke* spoke, PSWaveFront* leftFront, PSWaveFr
 {
 	// FIXME: emit not just visual outline, but proper outline path
 	
+	uint64_t emissionStart = GM_METRIC_TIMER_START();
+	
 	MPDecimal* time = timeSqr.sqrt;
 	
 	PSWaveFrontSnapshot* snapshot = [self emitSnapshot: waveFronts atTime: time];
@@ -1692,6 +1723,8 @@ static PSSpoke* _continuedSpoke(PSSpoke* spoke, PSWaveFront* leftFront, PSWaveFr
 	
 	[outlineMeshes addObject: mesh];
 	
+	GM_METRIC_TIMER_STOP("skeleton.offsetEmission", emissionStart);
+	GM_METRIC_COUNT("skeleton.emittedWaveFronts", waveFronts.count);
 }
 
 - (NSArray*) resolveMotorcycleConnections: (NSArray*) motorcycleSpokes recursively: (BOOL) recursive
@@ -1863,6 +1896,7 @@ static PSSpoke* _continuedSpoke(PSSpoke* spoke, PSWaveFront* leftFront, PSWaveFr
 	{
 		phase.nextHandler = nil;
 		phase.isFinished = YES;
+		[self reportWaveProgressAtTimeSqr: nil];
 		return phase;
 	}
 	
@@ -2012,6 +2046,9 @@ static PSSpoke* _continuedSpoke(PSSpoke* spoke, PSWaveFront* leftFront, PSWaveFr
 	{
 		//if (spoke.upcomingEvent)
 		//	continue;
+		if (cancellationToken.isCancelled)
+			break;
+		
 		@autoreleasepool {
 			[self insertNextEventForSpoke: spoke intoList: phase.events atTime: t0];
 		}
@@ -2022,6 +2059,39 @@ static PSSpoke* _continuedSpoke(PSSpoke* spoke, PSWaveFront* leftFront, PSWaveFr
 	return phase;
 }
 
+- (void) reportWaveProgressAtTimeSqr: (MPDecimal*) timeSqr
+{
+	if (!cancellationToken)
+		return;
+	
+	// the last emission is where the work of interest ends, even if the skeleton extends further
+	double horizon = emissionTimes.count ? fmin(extensionLimit, [[emissionTimes valueForKeyPath: @"@max.doubleValue"] doubleValue]) : extensionLimit;
+	
+	int64_t units = SKELETON_WAVE_PROGRESS_UNITS;
+	if (timeSqr && (horizon > 0.0))
+		units = MIN(SKELETON_WAVE_PROGRESS_UNITS, (int64_t)(SKELETON_WAVE_PROGRESS_UNITS*sqrt(fmax(0.0, timeSqr.toDouble))/horizon));
+	
+	if (units > reportedWaveUnits)
+	{
+		[cancellationToken completeUnitsOfWork: units - reportedWaveUnits];
+		reportedWaveUnits = units;
+	}
+}
+
+static void _countEvent(PSEvent* event)
+{
+	if ([event isKindOfClass: [PSCollapseEvent class]])
+		GM_METRIC_COUNT("skeleton.events.collapse", 1);
+	else if ([event isKindOfClass: [PSSplitEvent class]])
+		GM_METRIC_COUNT("skeleton.events.split", 1);
+	else if ([event isKindOfClass: [PSEmitEvent class]])
+		GM_METRIC_COUNT("skeleton.events.emit", 1);
+	else if ([event isKindOfClass: [PSSwapEvent class]])
+		GM_METRIC_COUNT("skeleton.events.swap", 1);
+	else
+		GM_METRIC_COUNT("skeleton.events.other", 1);
+}
+
 - (PolySkelWavePhase*) wavePropagationStep: (PolySkelWavePhase*) prevPhase
 {
 	PolySkelWavePhase* phase = [[PolySkelWavePhase alloc] init];
@@ -2086,6 +2156,12 @@ static PSSpoke* _continuedSpoke(PSSpoke* spoke, PSWaveFront* leftFront, PSWaveFr
 		return phase;
 	}
 	
+	if (eventCallback)
+		eventCallback(self, firstEvent);
+	
+	_countEvent(firstEvent);
+	[self reportWaveProgressAtTimeSqr: firstEvent.timeSqr];
+	
 	
 	NSMutableSet* changedSpokes = [[NSMutableSet alloc] init];
 	NSMutableSet* terminationCandidateSpokes = [[NSMutableSet alloc] init];
@@ -2833,6 +2909,8 @@ static PSSpoke* _continuedSpoke(PSSpoke* spoke, PSWaveFront* leftFront, PSWaveFr
 	phase.activeWaveFronts = nil;
 	phase.activeSpokes = nil;
 	
+	[self reportWaveProgressAtTimeSqr: nil];
+	
 	return phase;
 }
 
@@ -2867,7 +2945,14 @@ static PSSpoke* _continuedSpoke(PSSpoke* spoke, PSWaveFront* leftFront, PSWaveFr
 	
 	if (!prevPhase)
 	{
+		uint64_t motorcycleStart = GM_METRIC_TIMER_START();
 		[self runMotorcycles];
+		GM_METRIC_TIMER_STOP("skeleton.motorcyclePhase", motorcycleStart);
+		
+		// a cancelled motorcycle phase is incomplete, and must not be continued
+		if (cancellationToken.isCancelled)
+			return;
+
 		PolySkelPhase* phase = [[PolySkelPhase alloc] init];
 		phase.timeSqr = [MPDecimal zero];
 		
@@ -2885,7 +2970,9 @@ static PSSpoke* _continuedSpoke(PSSpoke* spoke, PSWaveFront* leftFront, PSWaveFr
 	}
 	else if ([prevPhase nextHandler])
 	{
+		uint64_t stepStart = GM_METRIC_TIMER_START();
 		PolySkelWavePhase* phase = [prevPhase nextHandler](prevPhase);
+		GM_METRIC_TIMER_STOP("skeleton.waveStep", stepStart);
 		if (debugLoggingEnabled)
 		{
 			phase.activeSpokePaths = [self displayPathsForSpokes: phase.activeSpokes atTimeSqr: phase.timeSqr];
@@ -2905,13 +2992,15 @@ static PSSpoke* _continuedSpoke(PSSpoke* spoke, PSWaveFront* leftFront, PSWaveFr
 {
 	while (![doneSteps.lastObject isFinished])
 		@autoreleasepool {
-			if (checkBlock())
+			if (checkBlock() || cancellationToken.isCancelled)
 				break;
 			[self doSkeletizationStep];
 		}
 //	[self runMotorcycles];
 //	[self runSpokes];
 	self.emitCallback = nil;
+	
+	MPIntegerFlushMetrics();
 }
 
 
@@ -2988,6 +3077,11 @@ static PSSpoke* _continuedSpoke(PSSpoke* spoke, PSWaveFront* leftFront, PSWaveFr
 
 }
 
+- (NSArray*) skeletonSpokes
+{
+	return terminatedSpokes.allObjects;
+}
+
 - (NSArray*) spokeDisplayPaths
 {
 	NSBezierPath* bpath = [NSBezierPath bezierPath];
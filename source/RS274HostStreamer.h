@@ -0,0 +1,55 @@
+//
+//  RS274HostStreamer.h
+//  Giddy Machinist
+//
+//  Created by Dömötör Gulyás on 19.10.2026.
+//  Copyright (c) 2026 Dömötör Gulyás. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+extern NSString* const RS274HostStreamerErrorDomain;
+
+typedef struct {
+	size_t		linesSent, linesAcknowledged, linesResent;
+	size_t		bytesSent;
+	size_t		resendRequests, firmwareErrors;
+	double		elapsedTime;
+	double		meanLatency, maxLatency;	// seconds from sending a line to its ok
+	double		bytesPerSecond, linesPerSecond;
+} RS274HostStreamerCounters;
+
+/*!
+ @description Streams G-code to reprap style firmware over a serial connection. Lines are numbered and checksummed, and sent ahead of acknowledgement as long as the bytes of all unacknowledged lines fit into the receive buffer of the firmware, so that its planner does not run dry on short moves.
+
+ A resend request rewinds to the requested line, which is then sent on its own until acknowledged, before streaming resumes. Further requests for the same line while waiting are expected from lines rejected in the meantime, and ignored. The resent line is only sent again if the firmware reports "wait", meaning it is idle, or stays silent for resendTimeout. A firmware with a full planner withholds its ok, but keeps sending busy messages. Parenthesized and semicolon comments are stripped and whitespace collapsed before lines are numbered and checksummed.
+ */
+@interface RS274HostStreamer : NSObject
+
+/*!
+ Opens a serial port in raw mode at the given baud rate, returns -1 and sets errno on failure.
+ */
++ (int) openSerialPort: (NSString*) path baudRate: (long) baudRate;
+
+- (instancetype) initWithFileDescriptor: (int) fd closeWhenDone: (BOOL) closeWhenDone;
+
+@property(nonatomic) size_t receiveBufferSize;		// bytes, 127 for Marlin
+@property(nonatomic) size_t maxLinesInFlight;		// zero for no limit besides the receive buffer
+@property(nonatomic) BOOL waitForStart;				// wait for the firmware to report "start" after a reset
+@property(nonatomic) double startTimeout;
+@property(nonatomic) double resendTimeout;			// resend again if the firmware stays silent this long after a resend
+
+/*!
+ Streams on a background thread, the completion handler is called on the main queue, with nil on success.
+ */
+- (void) streamData: (NSData*) data completion: (void(^)(NSError* error)) completion;
+- (void) streamFileAtPath: (NSString*) path completion: (void(^)(NSError* error)) completion;
+
+- (void) cancel;
+
+/*!
+ Snapshot of the counters, can be called while streaming.
+ */
+- (RS274HostStreamerCounters) counters;
+
+@end
@@ -0,0 +1,662 @@
+//
+//  RS274HostStreamer.m
+//  Giddy Machinist
+//
+//  Created by Dömötör Gulyás on 19.10.2026.
+//  Copyright (c) 2026 Dömötör Gulyás. All rights reserved.
+//
+
+#import "RS274HostStreamer.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+
+#ifdef __APPLE__
+#include <IOKit/serial/ioss.h>
+#endif
+
+NSString* const RS274HostStreamerErrorDomain = @"RS274HostStreamerErrorDomain";
+
+#define RS274HOST_MAX_LINE_LENGTH 256
+#define RS274HOST_OUTPUT_BUFFER_SIZE 4096
+#define RS274HOST_POLL_INTERVAL_MS 50
+
+
+typedef struct {
+	const char*	text;
+	uint32_t	textLength;
+	uint32_t	number;
+	uint32_t	wireLength;
+	double		sentTime;
+} _RS274HostLine;
+
+typedef struct {
+	const char*	source;
+	size_t		sourceLength, sourceOffset;
+	BOOL		lineNumberReset;
+
+	// lines from the oldest unacknowledged one on, the first sentCount of which are in flight
+	_RS274HostLine*	lines;
+	size_t		capacity, first, count, sentCount;
+	size_t		bytesInFlight;
+	uint32_t	nextNumber;
+
+	size_t		receiveBufferSize, maxLinesInFlight;
+
+	BOOL		recovering;
+	size_t		oksToSwallow;
+	double		recoverySentTime;
+	double		lastResponseTime;
+
+	char		output[RS274HOST_OUTPUT_BUFFER_SIZE];
+	size_t		outputStart, outputEnd;
+
+	char		input[RS274HOST_MAX_LINE_LENGTH];
+	size_t		inputLength;
+	BOOL		started;
+
+	RS274HostStreamerCounters	counters;
+	double		latencySum;
+
+	const char*	fatalError;
+} _RS274HostState;
+
+static double _now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + 1e-6*tv.tv_usec;
+}
+
+static _RS274HostLine* _lineAt(_RS274HostState* state, size_t i)
+{
+	return state->lines + (state->first + i) % state->capacity;
+}
+
+static void _pushLine(_RS274HostState* state, _RS274HostLine line)
+{
+	if (state->count == state->capacity)
+	{
+		size_t capacity = MAX(16, 2*state->capacity);
+		_RS274HostLine* lines = calloc(capacity, sizeof(*lines));
+		for (size_t i = 0; i < state->count; ++i)
+			lines[i] = *_lineAt(state, i);
+		free(state->lines);
+		state->lines = lines;
+		state->capacity = capacity;
+		state->first = 0;
+	}
+	*_lineAt(state, state->count++) = line;
+}
+
+static _RS274HostLine _popLine(_RS274HostState* state)
+{
+	_RS274HostLine line = *_lineAt(state, 0);
+	state->first = (state->first + 1) % state->capacity;
+	state->count--;
+
+	if (state->sentCount)
+	{
+		state->sentCount--;
+		state->bytesInFlight -= line.wireLength;
+	}
+	return line;
+}
+
+/*!
+ Copies text without comments into buf, with runs of whitespace and comments collapsed to single spaces, and without leading or trailing ones. Returns the stripped length, which may exceed size, in which case only size bytes are written.
+ */
+static size_t _stripLine(const char* text, size_t length, char* buf, size_t size)
+{
+	size_t k = 0;
+	BOOL inComment = NO, separated = NO;
+
+	for (size_t i = 0; i < length; ++i)
+	{
+		char c = text[i];
+		if (inComment)
+		{
+			inComment = (c != ')');
+			continue;
+		}
+		if (c == ';')
+			break;
+		if ((c == '(') || isspace((unsigned char)c))
+		{
+			inComment = (c == '(');
+			separated = YES;
+			continue;
+		}
+
+		if (separated && k)
+		{
+			if (k < size)
+				buf[k] = ' ';
+			k++;
+		}
+		separated = NO;
+
+		if (k < size)
+			buf[k] = c;
+		k++;
+	}
+	return k;
+}
+
+/*!
+ Next line of the source that is not empty once stripped, skipping empty lines. The line is returned as it is in the source, and only stripped when formatted, so that it can be sent again from the source. Returns NO at the end of the source.
+ */
+static BOOL _nextSourceLine(_RS274HostState* state, const char** text, uint32_t* length)
+{
+	if (!state->lineNumberReset)
+	{
+		*text = "M110 N0";
+		*length = 7;
+		return YES;
+	}
+
+	while (state->sourceOffset < state->sourceLength)
+	{
+		const char* p = state->source + state->sourceOffset;
+		const char* end = state->source + state->sourceLength;
+		const char* lineEnd = memchr(p, '\n', end - p);
+		if (!lineEnd)
+			lineEnd = end;
+
+		if (_stripLine(p, lineEnd - p, NULL, 0))
+		{
+			*text = p;
+			*length = (uint32_t)(lineEnd - p);
+			return YES;
+		}
+		state->sourceOffset = (lineEnd - state->source) + 1;
+	}
+
+	return NO;
+}
+
+static void _consumeSourceLine(_RS274HostState* state)
+{
+	if (!state->lineNumberReset)
+	{
+		state->lineNumberReset = YES;
+		return;
+	}
+
+	const char* p = state->source + state->sourceOffset;
+	const char* lineEnd = memchr(p, '\n', state->sourceLength - state->sourceOffset);
+	state->sourceOffset = lineEnd ? (lineEnd - state->source) + 1 : state->sourceLength;
+}
+
+/*!
+ Formats "N<number> <stripped text>*<checksum>\n", the checksum is the XOR of all bytes before the '*'.
+ */
+static size_t _formatLine(char* buf, uint32_t number, const char* text, uint32_t length)
+{
+	int k = snprintf(buf, RS274HOST_MAX_LINE_LENGTH, "N%u ", number);
+	if (k < 0)
+		return 0;
+
+	size_t textLength = _stripLine(text, length, buf + k, RS274HOST_MAX_LINE_LENGTH - k);
+	if (k + textLength + 6 > RS274HOST_MAX_LINE_LENGTH)
+		return 0;
+	k += (int)textLength;
+
+	uint8_t checksum = 0;
+	for (int i = 0; i < k; ++i)
+		checksum ^= (uint8_t)buf[i];
+
+	k += snprintf(buf + k, RS274HOST_MAX_LINE_LENGTH - k, "*%u\n", checksum);
+	return k;
+}
+
+static BOOL _sendLine(_RS274HostState* state, _RS274HostLine* line, double now)
+{
+	char buf[RS274HOST_MAX_LINE_LENGTH];
+	size_t length = _formatLine(buf, line->number, line->text, line->textLength);
+
+	if (!length)
+	{
+		state->fatalError = "line too long";
+		return NO;
+	}
+	if (state->outputEnd + length > RS274HOST_OUTPUT_BUFFER_SIZE)
+		return NO;
+
+	memcpy(state->output + state->outputEnd, buf, length);
+	state->outputEnd += length;
+
+	line->wireLength = (uint32_t)length;
+	line->sentTime = now;
+
+	state->bytesInFlight += length;
+	state->counters.linesSent++;
+	state->counters.bytesSent += length;
+	return YES;
+}
+
+/*!
+ Sends lines as long as the firmware can buffer them, lines waiting to be resent go first.
+ */
+static void _fillOutput(_RS274HostState* state, double now)
+{
+	while (!state->recovering && !state->fatalError)
+	{
+		if (state->maxLinesInFlight && (state->sentCount >= state->maxLinesInFlight))
+			break;
+
+		_RS274HostLine line = {0};
+		BOOL isResend = state->sentCount < state->count;
+
+		if (isResend)
+			line = *_lineAt(state, state->sentCount);
+		else
+		{
+			if (!_nextSourceLine(state, &line.text, &line.textLength))
+				break;
+			line.number = state->nextNumber;
+		}
+
+		char buf[RS274HOST_MAX_LINE_LENGTH];
+		size_t length = _formatLine(buf, line.number, line.text, line.textLength);
+		if (!length || (length > state->receiveBufferSize))
+		{
+			state->fatalError = "line too long for receive buffer";
+			break;
+		}
+		if (state->bytesInFlight + length > state->receiveBufferSize)
+			break;
+
+		if (!_sendLine(state, &line, now))
+			break;
+
+		if (isResend)
+		{
+			*_lineAt(state, state->sentCount) = line;
+			state->counters.linesResent++;
+		}
+		else
+		{
+			_consumeSourceLine(state);
+			_pushLine(state, line);
+			state->nextNumber++;
+		}
+		state->sentCount++;
+	}
+}
+
+/*!
+ Sends the oldest line on its own, the firmware drops everything after a bad line.
+ */
+static void _resendFirstLine(_RS274HostState* state, double now)
+{
+	state->sentCount = 0;
+	state->bytesInFlight = 0;
+	state->recoverySentTime = now;
+
+	if (_sendLine(state, _lineAt(state, 0), now))
+	{
+		state->sentCount = 1;
+		state->counters.linesResent++;
+	}
+}
+
+static void _handleResend(_RS274HostState* state, uint32_t number, double now)
+{
+	state->counters.resendRequests++;
+	state->oksToSwallow++;
+
+	// lines rejected while waiting for the resent line ask for it again
+	if (state->recovering && state->count && (_lineAt(state, 0)->number == number))
+		return;
+
+	// everything before the requested line was received
+	while (state->count && (_lineAt(state, 0)->number < number))
+	{
+		_popLine(state);
+		state->counters.linesAcknowledged++;
+	}
+
+	if (!state->count || (_lineAt(state, 0)->number != number))
+	{
+		if (number != state->nextNumber)
+			state->fatalError = "resend requested for unknown line";
+		return;
+	}
+
+	state->recovering = YES;
+	_resendFirstLine(state, now);
+}
+
+static void _handleOk(_RS274HostState* state, double now)
+{
+	if (state->oksToSwallow)
+	{
+		state->oksToSwallow--;
+		return;
+	}
+	if (!state->sentCount)
+		return;
+
+	_RS274HostLine line = _popLine(state);
+	double latency = now - line.sentTime;
+
+	state->counters.linesAcknowledged++;
+	state->latencySum += latency;
+	state->counters.maxLatency = MAX(state->counters.maxLatency, latency);
+	state->counters.meanLatency = state->latencySum/state->counters.linesAcknowledged;
+
+	state->recovering = NO;
+}
+
+static BOOL _hasPrefix(const char* line, size_t length, const char* prefix)
+{
+	size_t n = strlen(prefix);
+	return (length >= n) && !strncasecmp(line, prefix, n);
+}
+
+/*!
+ Bounded substring search, responses are not NUL terminated.
+ */
+static BOOL _containsString(const char* line, size_t length, const char* needle)
+{
+	size_t n = strlen(needle);
+	for (size_t i = 0; i + n <= length; ++i)
+		if (!strncasecmp(line + i, needle, n))
+			return YES;
+	return NO;
+}
+
+static void _handleResponse(_RS274HostState* state, const char* line, size_t length, double now)
+{
+	// any response, including busy and echo messages, shows the firmware is still working on what it has
+	state->lastResponseTime = now;
+
+	if (_hasPrefix(line, length, "ok"))
+		_handleOk(state, now);
+	else if (_hasPrefix(line, length, "resend") || _hasPrefix(line, length, "rs "))
+	{
+		const char* p = line;
+		const char* end = line + length;
+		while ((p < end) && !isdigit((unsigned char)*p))
+			++p;
+		if (p < end)
+			_handleResend(state, (uint32_t)strtoul(p, NULL, 10), now);
+	}
+	else if (_hasPrefix(line, length, "start"))
+	{
+		if (state->lineNumberReset)
+			state->fatalError = "firmware was reset while streaming";
+		state->started = YES;
+	}
+	else if (_hasPrefix(line, length, "error"))
+	{
+		state->counters.firmwareErrors++;
+		if (_containsString(line, length, "halted") || _containsString(line, length, "kill"))
+			state->fatalError = "firmware halted";
+	}
+	else if (_hasPrefix(line, length, "!!"))
+		state->fatalError = "firmware halted";
+	else if (_hasPrefix(line, length, "wait"))
+	{
+		// the firmware is idle with an empty queue, so the resent line did not arrive
+		if (state->recovering)
+			_resendFirstLine(state, now);
+	}
+	// echo, busy and temperature reports are ignored
+}
+
+static void _receiveBytes(_RS274HostState* state, const char* bytes, size_t length, double now)
+{
+	for (size_t i = 0; i < length; ++i)
+	{
+		char c = bytes[i];
+		if ((c == '\n') || (c == '\r'))
+		{
+			if (state->inputLength)
+				_handleResponse(state, state->input, state->inputLength, now);
+			state->inputLength = 0;
+		}
+		else if (state->inputLength < RS274HOST_MAX_LINE_LENGTH)
+			state->input[state->inputLength++] = c;
+	}
+}
+
+static BOOL _isDone(_RS274HostState* state)
+{
+	const char* text = NULL;
+	uint32_t length = 0;
+	return !state->count && !_nextSourceLine(state, &text, &length);
+}
+
+
+@implementation RS274HostStreamer
+{
+	int		fd;
+	BOOL	closeWhenDone;
+	volatile int32_t	cancelled;
+
+	RS274HostStreamerCounters	counterSnapshot;
+}
+
+@synthesize receiveBufferSize, maxLinesInFlight, waitForStart, startTimeout, resendTimeout;
+
++ (int) openSerialPort: (NSString*) path baudRate: (long) baudRate
+{
+	int fd = open(path.fileSystemRepresentation, O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if (fd < 0)
+		return -1;
+
+	struct termios options;
+	if (tcgetattr(fd, &options) < 0)
+	{
+		int err = errno;
+		close(fd);
+		errno = err;
+		return -1;
+	}
+
+	cfmakeraw(&options);
+	options.c_cflag |= CLOCAL | CREAD;
+	options.c_cc[VMIN] = 0;
+	options.c_cc[VTIME] = 0;
+	cfsetspeed(&options, baudRate);
+
+	if (tcsetattr(fd, TCSANOW, &options) < 0)
+	{
+		int err = errno;
+		close(fd);
+		errno = err;
+		return -1;
+	}
+
+#ifdef __APPLE__
+	// non-standard rates such as 250000 need to be set separately
+	speed_t speed = baudRate;
+	ioctl(fd, IOSSIOSPEED, &speed);
+#endif
+
+	tcflush(fd, TCIOFLUSH);
+
+	return fd;
+}
+
+- (id) init
+{
+	[self doesNotRecognizeSelector: _cmd];
+	return nil;
+}
+
+- (instancetype) initWithFileDescriptor: (int) fileDescriptor closeWhenDone: (BOOL) closeFd
+{
+	if (!(self = [super init]))
+		return nil;
+
+	fd = fileDescriptor;
+	closeWhenDone = closeFd;
+
+	receiveBufferSize = 127;
+	maxLinesInFlight = 0;
+	waitForStart = YES;
+	startTimeout = 5.0;
+	resendTimeout = 5.0;
+
+	return self;
+}
+
+- (void) dealloc
+{
+	if (closeWhenDone && (fd >= 0))
+		close(fd);
+}
+
+- (void) cancel
+{
+	__atomic_store_n(&cancelled, 1, __ATOMIC_RELEASE);
+}
+
+- (RS274HostStreamerCounters) counters
+{
+	@synchronized(self)
+	{
+		return counterSnapshot;
+	}
+}
+
+- (void) publishCounters: (_RS274HostState*) state startTime: (double) startTime now: (double) now
+{
+	RS274HostStreamerCounters counters = state->counters;
+	counters.elapsedTime = now - startTime;
+	if (counters.elapsedTime > 0.0)
+	{
+		counters.bytesPerSecond = counters.bytesSent/counters.elapsedTime;
+		counters.linesPerSecond = counters.linesAcknowledged/counters.elapsedTime;
+	}
+
+	@synchronized(self)
+	{
+		counterSnapshot = counters;
+	}
+}
+
+- (NSError*) streamBytes: (const char*) bytes length: (size_t) length
+{
+	_RS274HostState* state = calloc(1, sizeof(*state));
+	state->source = bytes;
+	state->sourceLength = length;
+	state->receiveBufferSize = receiveBufferSize;
+	state->maxLinesInFlight = maxLinesInFlight;
+	state->started = !waitForStart;
+
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+	double startTime = _now();
+	NSError* error = nil;
+
+	while (!error)
+	{
+		double now = _now();
+
+		if (__atomic_load_n(&cancelled, __ATOMIC_ACQUIRE))
+		{
+			error = [NSError errorWithDomain: NSCocoaErrorDomain code: NSUserCancelledError userInfo: nil];
+			break;
+		}
+
+		if (!state->started && (now - startTime > startTimeout))
+			state->started = YES;
+
+		// the resent line may have been dropped as well, but a full planner holds back its ok, so only silence counts
+		if (state->recovering && (now - MAX(state->recoverySentTime, state->lastResponseTime) > resendTimeout))
+			_resendFirstLine(state, now);
+
+		if (state->started)
+			_fillOutput(state, now);
+
+		if (state->fatalError)
+		{
+			error = [NSError errorWithDomain: RS274HostStreamerErrorDomain code: 1 userInfo: @{NSLocalizedDescriptionKey : @(state->fatalError)}];
+			break;
+		}
+
+		if (state->started && (state->outputStart == state->outputEnd) && _isDone(state))
+			break;
+
+		struct pollfd pfd = {.fd = fd, .events = POLLIN | ((state->outputStart < state->outputEnd) ? POLLOUT : 0)};
+		int result = poll(&pfd, 1, RS274HOST_POLL_INTERVAL_MS);
+
+		if ((result < 0) && (errno != EINTR))
+			error = [NSError errorWithDomain: NSPOSIXErrorDomain code: errno userInfo: nil];
+		else if (result > 0)
+		{
+			if (pfd.revents & POLLOUT)
+			{
+				ssize_t written = write(fd, state->output + state->outputStart, state->outputEnd - state->outputStart);
+				if (written > 0)
+				{
+					state->outputStart += written;
+					if (state->outputStart == state->outputEnd)
+						state->outputStart = state->outputEnd = 0;
+				}
+				else if ((written < 0) && (errno != EAGAIN) && (errno != EINTR))
+					error = [NSError errorWithDomain: NSPOSIXErrorDomain code: errno userInfo: nil];
+			}
+			if (pfd.revents & (POLLIN | POLLHUP))
+			{
+				char buf[1024];
+				ssize_t numRead = read(fd, buf, sizeof(buf));
+				if (numRead > 0)
+					_receiveBytes(state, buf, numRead, _now());
+				else if (numRead == 0)
+					error = [NSError errorWithDomain: NSPOSIXErrorDomain code: EPIPE userInfo: nil];
+				else if ((errno != EAGAIN) && (errno != EINTR))
+					error = [NSError errorWithDomain: NSPOSIXErrorDomain code: errno userInfo: nil];
+			}
+		}
+
+		[self publishCounters: state startTime: startTime now: _now()];
+	}
+
+	[self publishCounters: state startTime: startTime now: _now()];
+
+	free(state->lines);
+	free(state);
+
+	return error;
+}
+
+- (void) streamData: (NSData*) data completion: (void(^)(NSError* error)) completion
+{
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^{
+		NSError* error = [self streamBytes: data.bytes length: data.length];
+		if (completion)
+			dispatch_async(dispatch_get_main_queue(), ^{
+				completion(error);
+			});
+	});
+}
+
+- (void) streamFileAtPath: (NSString*) path completion: (void(^)(NSError* error)) completion
+{
+	NSError* error = nil;
+	NSData* data = [NSData dataWithContentsOfFile: path options: NSDataReadingMappedAlways error: &error];
+
+	if (!data)
+	{
+		if (completion)
+			dispatch_async(dispatch_get_main_queue(), ^{
+				completion(error);
+			});
+		return;
+	}
+
+	[self streamData: data completion: completion];
+}
+
+@end
@@ -8,33 +8,29 @@
 
 #import <Foundation/Foundation.h>
 
+#import "RS274Parser.h"
+#import "MachineMoveBuffer.h"
+
 @interface RS274Interpreter : NSObject
 
-@property(nonatomic,readonly) NSArray* machineCommands;
+@property(nonatomic,readonly) GMachineMoveBuffer* moves;
+
+/*!
+ Largest deviation in mm of the feed moves G2 and G3 arcs are expanded into from the arcs, 0.01 by default. Arcs are in the XY plane, with their centers given by I and J relative to their start.
+ */
+@property(nonatomic) double arcTolerance;
 
 - (void) interpretCommandBlocks: (NSArray*) commandBlocks;
+/*!
+ Interprets the blocks parsed by parser.
+ */
+- (void) interpretParsedProgram: (RS274Parser*) parser;
+/*!
+ Interprets a single block, for feeding blocks as they are parsed. Blocks must be passed in program order, as modal state carries over between them. The words are interpreted in place, without creating command objects.
+ */
+- (void) interpretBlock: (const RS274Block*) block words: (const RS274Word*) words;
 
 - (id) interpretCommandBlock: (NSArray*) commands;
 
 @end
 
-
-@interface GMachineCommand : NSObject
-
-@end
-
-
-@interface GMachineCommandMove : GMachineCommand
-
-- (id) initWithSpeed: (double) speed x: (double) x y: (double) y z: (double) z a: (double) a b: (double) b c: (double) c;
-
-@property(nonatomic) double speed;
-@property(nonatomic) double xTarget;
-@property(nonatomic) double yTarget;
-@property(nonatomic) double zTarget;
-@property(nonatomic) double aTarget;
-@property(nonatomic) double bTarget;
-@property(nonatomic) double cTarget;
-
-@end
-
@@ -18,10 +18,15 @@ enum
 	kRS274InputUnitInch,
 	kRS274MotionModeRapid,
 	kRS274MotionModeFeed,
+	kRS274MotionModeArcClockwise,
+	kRS274MotionModeArcCounterClockwise,
 	kRS274DistanceModeAbsolute,
 	kRS274DistanceModeIncremental,
 };
 
+#define RS274_NUM_PARAMETERS 5400
+#define RS274_DEFAULT_ARC_TOLERANCE 0.01
+
 
 
 
@@ -29,15 +34,19 @@ enum
 {
 	long			modalInputUnit, modalMotionMode, modalDistanceMode;
 
-	NSMutableArray* machineParameters;
+	double* machineParameters;
 	
 	double xAxis, yAxis, zAxis, aAxis, bAxis, cAxis;
-	double feedRate;
+	double position[GMachineAxisCount];	// target of the last move
+	double arcOffsetI, arcOffsetJ;		// arc center relative to the position, in mm
+	double feedRate;		// modal, in mm/min
+	double blockFeedValue;	// F word of the block being interpreted, in input units, NAN if none
+	uint32_t currentLine;
 	
-	NSMutableArray* machineCommands;
+	GMachineMoveBuffer* moves;
 }
 
-@synthesize machineCommands;
+@synthesize moves, arcTolerance;
 
 - (id) init
 {
@@ -47,28 +56,112 @@ enum
 	modalInputUnit = kRS274InputUnitMilliMeter;
 	modalMotionMode = kRS274MotionModeRapid;
 	modalDistanceMode = kRS274DistanceModeAbsolute;
+	blockFeedValue = NAN;
+	arcTolerance = RS274_DEFAULT_ARC_TOLERANCE;
 	
-	machineParameters = [[NSMutableArray alloc] initWithCapacity: 5400];
-	
-	for (int i = 0; i < 5400; ++i)
-	{
-		[machineParameters addObject: @0.0];
-	}
+	machineParameters = calloc(RS274_NUM_PARAMETERS, sizeof(*machineParameters));
 	
-	[machineParameters replaceObjectAtIndex: 5220 withObject: @1.0];
+	machineParameters[5220] = 1.0;
 	
 	
-	machineCommands = [[NSMutableArray alloc] init];
+	moves = [[GMachineMoveBuffer alloc] init];
 
 	return self;
 }
 
+- (void) dealloc
+{
+	free(machineParameters);
+}
+
 - (void) interpretCommandBlocks: (NSArray*) commandBlocks;
 {
 	for (NSArray* commandBlock in commandBlocks)
 		[self interpretCommandBlock: commandBlock];
 }
 
+- (void) interpretParsedProgram: (RS274Parser*) parser
+{
+	[parser enumerateBlocksUsingBlock: ^(const RS274Block* block, const RS274Word* words, BOOL* stop) {
+		[self interpretBlock: block words: words];
+	}];
+}
+
+/*!
+ The same stages as interpretCommandBlock:, on the parsed records, so that interpreting a block creates no objects. Only the first unit and distance mode words of a block count, the last motion mode word wins, and axis, arc center and feed words are applied in the modes set by the block.
+ */
+- (void) interpretBlock: (const RS274Block*) block words: (const RS274Word*) words
+{
+	currentLine = block->line;
+	
+	size_t count = block->wordCount;
+	BOOL unitFound = NO, distanceFound = NO;
+	
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (words[i].letter != 'G')
+			continue;
+		
+		double code = words[i].value;
+		if (!unitFound && ((code == 20.0) || (code == 21.0)))
+		{
+			modalInputUnit = (code == 20.0) ? kRS274InputUnitInch : kRS274InputUnitMilliMeter;
+			unitFound = YES;
+		}
+		else if (!distanceFound && ((code == 90.0) || (code == 91.0)))
+		{
+			modalDistanceMode = (code == 90.0) ? kRS274DistanceModeAbsolute : kRS274DistanceModeIncremental;
+			distanceFound = YES;
+		}
+		else if (code == 0.0)
+			modalMotionMode = kRS274MotionModeRapid;
+		else if (code == 1.0)
+			modalMotionMode = kRS274MotionModeFeed;
+		else if (code == 2.0)
+			modalMotionMode = kRS274MotionModeArcClockwise;
+		else if (code == 3.0)
+			modalMotionMode = kRS274MotionModeArcCounterClockwise;
+	}
+	
+	double scale = (modalInputUnit == kRS274InputUnitInch) ? 25.4 : 1.0;
+	BOOL incremental = (modalDistanceMode == kRS274DistanceModeIncremental);
+	BOOL motionTargetFound = NO, arcOffsetFound = NO;
+	arcOffsetI = arcOffsetJ = 0.0;
+	
+	for (size_t i = 0; i < count; ++i)
+	{
+		double* axis = NULL;
+		switch (words[i].letter)
+		{
+			case 'F':
+				feedRate = scale*words[i].value;
+				continue;
+			case 'I':
+				arcOffsetI = scale*words[i].value;
+				arcOffsetFound = YES;
+				continue;
+			case 'J':
+				arcOffsetJ = scale*words[i].value;
+				arcOffsetFound = YES;
+				continue;
+			case 'A': axis = &aAxis; break;
+			case 'B': axis = &bAxis; break;
+			case 'C': axis = &cAxis; break;
+			case 'X': axis = &xAxis; break;
+			case 'Y': axis = &yAxis; break;
+			case 'Z': axis = &zAxis; break;
+			default: continue;
+		}
+		
+		double value = scale*words[i].value;
+		*axis = incremental ? *axis + value : value;
+		motionTargetFound = YES;
+	}
+	
+	if (motionTargetFound || (arcOffsetFound && [self isArcMotionMode]))
+		[self dispatchMotionCommand];
+}
+
 - (NSArray*) interpretComments: (NSArray*) commands
 {
 	return commands;
@@ -84,8 +177,25 @@ enum
 	return commands;
 }
 
+/*!
+ The F word is taken here, but only applied once the block's length unit is known, see interpretMotionCommands:.
+ */
 - (NSArray*) interpretFeedRateCommands: (NSArray*) commands
 {
+	blockFeedValue = NAN;
+	
+	long i = 0;
+	for (id obj in commands)
+	{
+		if ([obj isKindOfClass: [RS274Command class]] && ([obj commandLetter] == 'F'))
+		{
+			blockFeedValue = [[obj value] doubleValue];
+			break;
+		}
+		++i;
+	}
+	if (i != commands.count)
+		commands = [commands arrayByRemovingObjectsAtIndexes: [NSIndexSet indexSetWithIndexesInRange: NSMakeRange(i, 1)]];
 	return commands;
 }
 
@@ -232,7 +342,7 @@ enum
 			if ([obj isKindOfClass: [RS274Command class]])
 			{
 				RS274Command* cmd = obj;
-				if ((cmd.commandLetter == 'G') && ([cmd.value isEqual: @0] || [cmd.value isEqual: @1]))
+				if ((cmd.commandLetter == 'G') && ([cmd.value isEqual: @0] || [cmd.value isEqual: @1] || [cmd.value isEqual: @2] || [cmd.value isEqual: @3]))
 					break;
 			}
 			++i;
@@ -254,6 +364,12 @@ enum
 			case 1:
 				modalMotionMode = kRS274MotionModeFeed;
 				break;
+			case 2:
+				modalMotionMode = kRS274MotionModeArcClockwise;
+				break;
+			case 3:
+				modalMotionMode = kRS274MotionModeArcCounterClockwise;
+				break;
 				
 			default:
 				break;
@@ -267,33 +383,84 @@ enum
 
 }
 
+- (BOOL) isArcMotionMode
+{
+	return (modalMotionMode == kRS274MotionModeArcClockwise) || (modalMotionMode == kRS274MotionModeArcCounterClockwise);
+}
+
+/*!
+ Expands an arc in the XY plane, around the center at the I and J offsets from the current position, into feed moves whose chords deviate from the arc by at most arcTolerance. The other axes move linearly along the arc, for helices. An arc ending where it starts is a full circle.
+ */
+- (void) dispatchArcTo: (const double*) target clockwise: (BOOL) clockwise
+{
+	double cx = position[GMachineAxisX] + arcOffsetI;
+	double cy = position[GMachineAxisY] + arcOffsetJ;
+	double startRadius = hypot(arcOffsetI, arcOffsetJ);
+	double endRadius = hypot(target[GMachineAxisX] - cx, target[GMachineAxisY] - cy);
+	
+	if (startRadius < 1e-9)
+	{
+		[moves appendMove: GMachineMoveFeed target: target feed: feedRate line: currentLine];
+		return;
+	}
+	
+	double startAngle = atan2(position[GMachineAxisY] - cy, position[GMachineAxisX] - cx);
+	double endAngle = atan2(target[GMachineAxisY] - cy, target[GMachineAxisX] - cx);
+	double sweep = clockwise ? startAngle - endAngle : endAngle - startAngle;
+	while (sweep <= 1e-9)
+		sweep += 2.0*M_PI;
+	
+	double tolerance = MAX(arcTolerance, 1e-6);
+	double maxStep = (tolerance < startRadius) ? 2.0*acos(1.0 - tolerance/startRadius) : M_PI;
+	size_t count = MAX(1, (size_t)ceil(sweep/maxStep));
+	
+	// a slightly different end radius of an inexact program is blended in along the arc
+	for (size_t k = 1; k < count; ++k)
+	{
+		double t = (double)k/count;
+		double angle = startAngle + (clockwise ? -t : t)*sweep;
+		double radius = startRadius + t*(endRadius - startRadius);
+		
+		double point[GMachineAxisCount];
+		for (size_t i = 0; i < GMachineAxisCount; ++i)
+			point[i] = position[i] + t*(target[i] - position[i]);
+		point[GMachineAxisX] = cx + radius*cos(angle);
+		point[GMachineAxisY] = cy + radius*sin(angle);
+		
+		[moves appendMove: GMachineMoveFeed target: point feed: feedRate line: currentLine];
+	}
+	[moves appendMove: GMachineMoveFeed target: target feed: feedRate line: currentLine];
+}
+
 - (void) dispatchMotionCommand
 {
-	double speed = 0.0;
+	double target[GMachineAxisCount] = {xAxis, yAxis, zAxis, aAxis, bAxis, cAxis};
 	
 	switch (modalMotionMode) {
 		case kRS274MotionModeRapid:
-			speed = -1;
+			[moves appendMove: GMachineMoveRapid target: target feed: feedRate line: currentLine];
 			break;
 		case kRS274MotionModeFeed:
-			speed = feedRate;
+			[moves appendMove: GMachineMoveFeed target: target feed: feedRate line: currentLine];
+			break;
+		case kRS274MotionModeArcClockwise:
+		case kRS274MotionModeArcCounterClockwise:
+			[self dispatchArcTo: target clockwise: (modalMotionMode == kRS274MotionModeArcClockwise)];
 			break;
 			
 		default:
 			break;
 	}
 	
-	GMachineCommandMove* cmd = [[GMachineCommandMove alloc] initWithSpeed: speed x: xAxis y: yAxis z: zAxis a: aAxis b: bAxis c: cAxis];
-	[machineCommands addObject: cmd];
-	
-
+	memcpy(position, target, sizeof(position));
 }
 
 
 - (NSArray*) interpretMotionTargetCommands: (NSArray*) commands
 {
 	long i = 0;
-	BOOL motionTargetFound = NO;
+	BOOL motionTargetFound = NO, arcOffsetFound = NO;
+	arcOffsetI = arcOffsetJ = 0.0;
 	while (i < [commands count])
 	{
 		BOOL removeCommand = YES;
@@ -310,7 +477,18 @@ enum
 			
 			int cmdLetter = [obj commandLetter];
 			double value = scale*[[obj value] doubleValue];
-			if (modalDistanceMode == kRS274DistanceModeAbsolute)
+			if ((cmdLetter == 'I') || (cmdLetter == 'J'))
+			{
+				// arc centers are relative to the current position in either distance mode
+				if (cmdLetter == 'I')
+					arcOffsetI = value;
+				else
+					arcOffsetJ = value;
+				arcOffsetFound = YES;
+				commands = [commands arrayByRemovingObjectsAtIndexes: [NSIndexSet indexSetWithIndexesInRange: NSMakeRange(i, 1)]];
+				continue;
+			}
+			else if (modalDistanceMode == kRS274DistanceModeAbsolute)
 			{
 				switch (cmdLetter)
 				{
@@ -380,7 +558,7 @@ enum
 			++i;
 	}
 	
-	if (motionTargetFound)
+	if (motionTargetFound || (arcOffsetFound && [self isArcMotionMode]))
 		[self dispatchMotionCommand];
 	
 
@@ -391,6 +569,12 @@ enum
 
 - (NSArray*) interpretMotionCommands: (NSArray*) commands
 {
+	if (!isnan(blockFeedValue))
+	{
+		feedRate = ((modalInputUnit == kRS274InputUnitInch) ? 25.4 : 1.0)*blockFeedValue;
+		blockFeedValue = NAN;
+	}
+	
 	commands = [self interpretModalMotionCommands: commands];
 	commands = [self interpretMotionTargetCommands: commands];
 	return commands;
@@ -436,32 +620,3 @@ enum
 
 @end
 
-
-
-@implementation GMachineCommand
-
-@end
-
-@implementation GMachineCommandMove
-
-@synthesize xTarget,yTarget,zTarget,aTarget,bTarget,cTarget,speed;
-
-- (id) initWithSpeed:(double)s x:(double)x y:(double)y z:(double)z a:(double)a b:(double)b c:(double)c
-{
-	if (!(self = [super init]))
-		return nil;
-	
-	speed = s;
-	xTarget = x;
-	yTarget = y;
-	zTarget = z;
-	aTarget = a;
-	bTarget = b;
-	cTarget = c;
-	
-	
-	return self;
-}
-
-@end
-
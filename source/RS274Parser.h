@@ -8,12 +8,63 @@
 
 #import <Cocoa/Cocoa.h>
 
+/*!
+ A single command word, eg. "X12.5". Parameter assignments "#n=value" are stored with letter '#' and the parameter number.
+ */
+typedef struct {
+	double		value;
+	uint32_t	parameter;
+	char		letter;
+} RS274Word;
+
+/*!
+ A line with at least one word. Lines are counted from 1.
+ */
+typedef struct {
+	uint64_t	byteOffset;
+	uint32_t	line;
+	uint32_t	wordCount;
+} RS274Block;
+
+extern NSString* const RS274ParserErrorDomain;
+extern NSString* const RS274ParserErrorByteOffsetKey;
+extern NSString* const RS274ParserErrorLineKey;
+
+/*!
+ @description Single pass RS274 parser working directly on bytes. Comments, words and bracketed expressions are handled while scanning, and words are stored as compact records in chunked arrays, without per line objects. Words of a block are always contiguous.
+
+ Each parse replaces the results of the previous one. Lines with errors are dropped, and the errors reported by byte offset and line.
+ */
 @interface RS274Parser : NSObject
 
-@property(nonatomic,strong) NSMutableArray* commandBlocks;
+- (BOOL) parseBytes: (const char*) bytes length: (size_t) length named: (NSString*) name;
+- (BOOL) parseData: (NSData*) data named: (NSString*) name;
+/*!
+ Maps the file into memory instead of reading it.
+ */
+- (BOOL) parseFileAtPath: (NSString*) path error: (NSError**) error;
+
+/*!
+ Large inputs are split at line ends and the pieces parsed concurrently. The handler is called on the calling thread with the blocks in file order, as soon as all blocks before them are parsed, so that interpretation can proceed while parsing is still in progress. Setting stop ends the calls to the handler, but not the parse.
+ */
+- (BOOL) parseBytes: (const char*) bytes length: (size_t) length named: (NSString*) name blockHandler: (void(^)(const RS274Block* block, const RS274Word* words, BOOL* stop)) handler;
+- (BOOL) parseFileAtPath: (NSString*) path error: (NSError**) error blockHandler: (void(^)(const RS274Block* block, const RS274Word* words, BOOL* stop)) handler;
 
 - (NSArray*) parseString: (NSString*) text named: (NSString*) name;
 
+@property(nonatomic, readonly) size_t blockCount;
+@property(nonatomic, readonly) size_t wordCount;
+
+- (void) enumerateBlocksUsingBlock: (void(^)(const RS274Block* block, const RS274Word* words, BOOL* stop)) callback;
+
+@property(nonatomic, readonly) NSArray* errors;
+@property(nonatomic, readonly) size_t errorCount;
+
+/*!
+ Command blocks as arrays of RS274Command objects, created on first access.
+ */
+@property(nonatomic, readonly) NSArray* commandBlocks;
+
 @end
 
 
@@ -34,4 +85,3 @@
 @property(nonatomic,strong) NSArray* operands;
 
 @end
-
@@ -9,532 +9,756 @@
 #import "RS274Parser.h"
 
 #import "FoundationExtensions.h"
+#import "GMMetrics.h"
 
 
-@interface RS274TextLine : NSObject
-@property(nonatomic) ssize_t lineCount;
-@property(nonatomic,strong) NSString* string;
-@end
+NSString* const RS274ParserErrorDomain = @"RS274ParserError";
+NSString* const RS274ParserErrorByteOffsetKey = @"RS274ParserErrorByteOffset";
+NSString* const RS274ParserErrorLineKey = @"RS274ParserErrorLine";
 
 
-@implementation RS274Parser
+#define RS274_WORDS_PER_CHUNK 4096
+#define RS274_BLOCKS_PER_CHUNK 4096
+#define RS274_MAX_REPORTED_ERRORS 1000
+#define RS274_MAX_EXPRESSION_DEPTH 64
+#define RS274_MIN_PARALLEL_CHUNK_SIZE (1024*1024)
+
+typedef struct _RS274WordChunk {
+	struct _RS274WordChunk*	next;
+	size_t		count;
+	RS274Word	words[RS274_WORDS_PER_CHUNK];
+} _RS274WordChunk;
+
+typedef struct _RS274BlockChunk {
+	struct _RS274BlockChunk*	next;
+	size_t		count;
+	RS274Block	blocks[RS274_BLOCKS_PER_CHUNK];
+} _RS274BlockChunk;
+
+typedef struct {
+	uint64_t	byteOffset;
+	uint32_t	line;
+	const char*	message;
+} _RS274ParseError;
+
+typedef struct {
+	const char*	bytes;
+	uint32_t	line;
+
+	_RS274WordChunk*	firstWordChunk;
+	_RS274WordChunk*	lastWordChunk;
+	_RS274BlockChunk*	firstBlockChunk;
+	_RS274BlockChunk*	lastBlockChunk;
+
+	size_t		numWords, numBlocks;
+	size_t		blockWordCount; // words of the block being parsed, at the end of lastWordChunk
+
+	_RS274ParseError*	errors;
+	size_t		numErrors, numReportedErrors;
+} _RS274ParseState;
+
+
+static const double _powersOfTen[19] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18};
+
+
+static void _freeParseState(_RS274ParseState* state)
 {
-	NSMutableArray* _currentCommandBlock;
+	for (_RS274WordChunk* chunk = state->firstWordChunk; chunk; )
+	{
+		_RS274WordChunk* next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+	for (_RS274BlockChunk* chunk = state->firstBlockChunk; chunk; )
+	{
+		_RS274BlockChunk* next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+	free(state->errors);
+	memset(state, 0, sizeof(*state));
+}
+
+static void _reportError(_RS274ParseState* state, const char* at, const char* message)
+{
+	state->numErrors++;
+
+	if (state->numReportedErrors >= RS274_MAX_REPORTED_ERRORS)
+		return;
+
+	if (!state->errors)
+		state->errors = calloc(RS274_MAX_REPORTED_ERRORS, sizeof(*state->errors));
+
+	state->errors[state->numReportedErrors++] = (_RS274ParseError){at - state->bytes, state->line, message};
 }
 
-static NSString* _removeComments(NSString* inText)
+static BOOL _pushWord(_RS274ParseState* state, const char* at, char letter, double value, uint32_t parameter)
 {
-	long length = [inText length];
-	NSMutableString* outText = [[NSMutableString alloc] initWithCapacity: length];
-	
-	
-	for (long i = 0; i < length; ++i)
+	_RS274WordChunk* chunk = state->lastWordChunk;
+
+	if (!chunk || (chunk->count == RS274_WORDS_PER_CHUNK))
 	{
-		int c = [inText characterAtIndex: i];
-		switch (c)
+		if (state->blockWordCount == RS274_WORDS_PER_CHUNK)
 		{
-			case '(':
-			{
-				NSRange commentEnd = [inText rangeOfString: @")" options: NSBackwardsSearch range:NSMakeRange(i, length-i)];
-				
-				if (commentEnd.location == NSNotFound)
-					[NSException raise: @"RS274ParserError" format: @"Missing closing brace in comment"];
-								
-				i = commentEnd.location;
+			_reportError(state, at, "Too many words in block");
+			return NO;
+		}
 
-				break;
-			}
-			case ';':
-				i = LONG_MAX-1;
-				break;
-			default:
-				[outText appendFormat: @"%c", c];
-				break;
+		_RS274WordChunk* newChunk = malloc(sizeof(*newChunk));
+		newChunk->next = NULL;
+		newChunk->count = 0;
+
+		// keep the words of a block contiguous by moving the partial block along
+		if (chunk)
+		{
+			memcpy(newChunk->words, chunk->words + chunk->count - state->blockWordCount, state->blockWordCount*sizeof(RS274Word));
+			newChunk->count = state->blockWordCount;
+			chunk->count -= state->blockWordCount;
+			chunk->next = newChunk;
 		}
+		else
+			state->firstWordChunk = newChunk;
+
+		state->lastWordChunk = chunk = newChunk;
 	}
-	return outText;
+
+	chunk->words[chunk->count++] = (RS274Word){value, parameter, letter};
+	state->blockWordCount++;
+
+	return YES;
 }
 
-- (void) prepareCommandBlock
+static void _discardBlock(_RS274ParseState* state)
 {
-	_currentCommandBlock = [[NSMutableArray alloc] init];
+	if (state->lastWordChunk)
+		state->lastWordChunk->count -= state->blockWordCount;
+	state->blockWordCount = 0;
 }
 
-- (void) finishCommandBlock
+static void _finishBlock(_RS274ParseState* state, const char* lineStart)
 {
-	if ([_currentCommandBlock count])
+	if (!state->blockWordCount)
+		return;
+
+	_RS274BlockChunk* chunk = state->lastBlockChunk;
+
+	if (!chunk || (chunk->count == RS274_BLOCKS_PER_CHUNK))
 	{
-		if (!self.commandBlocks)
-			self.commandBlocks = [NSMutableArray arrayWithObject: _currentCommandBlock];
+		_RS274BlockChunk* newChunk = malloc(sizeof(*newChunk));
+		newChunk->next = NULL;
+		newChunk->count = 0;
+
+		if (chunk)
+			chunk->next = newChunk;
 		else
-			[self.commandBlocks addObject: _currentCommandBlock];
+			state->firstBlockChunk = newChunk;
+
+		state->lastBlockChunk = chunk = newChunk;
 	}
-	
-	_currentCommandBlock = nil;
+
+	chunk->blocks[chunk->count++] = (RS274Block){lineStart - state->bytes, state->line, (uint32_t)state->blockWordCount};
+
+	state->numBlocks++;
+	state->numWords += state->blockWordCount;
+	state->blockWordCount = 0;
 }
 
-- (NSArray*) parseString: (NSString*) inText named: (NSString*) name
+#pragma mark - Values and Expressions
+
+static const char* _skipSpace(const char* p, const char* end)
 {
-	/*
-	 Parse steps, per line:
-	 1. evaluate numeric expressions in square brackets
-	 2. remove comments
-	 */
-	NSArray* lines = [inText componentsSeparatedByCharactersInSet: [NSCharacterSet newlineCharacterSet]];
-	
-	lines = [lines indexedMap: ^id(id obj, NSInteger index) {
-		RS274TextLine* line = [[RS274TextLine alloc] init];
-		line.string = obj;
-		line.lineCount = index;
-		return line;
-	}];
-	
-	
-	NSMutableArray* commandLines = [NSMutableArray array];
-	
-	
-	// parameter parsing & expression evaluation should occur before the command words are evaluated...
-	// we'll just ignore this for now
-	
-	for ( RS274TextLine* rawLine in lines)
+	while ((p < end) && ((*p == ' ') || (*p == '\t') || (*p == '\r')))
+		++p;
+	return p;
+}
+
+static const char* _parseNumber(const char* p, const char* end, double* value)
+{
+	// up to 18 significant digits are exact in the 64 bit mantissa, further integer digits only scale it
+	int64_t mantissa = 0;
+	long numSignificant = 0, numFractionDigits = 0, droppedDigits = 0;
+	BOOL hasPoint = NO;
+
+	for (; p < end; ++p)
 	{
-		@autoreleasepool {
-		NSString* text = _removeComments(rawLine.string);
-		[self prepareCommandBlock];
-		[self parseCString: [text UTF8String] length: strlen([text UTF8String])];
-		[self finishCommandBlock];
-		
-		/*
-		NSArray* commands = TokenizeTextLine(rawLine, 0, [rawLine.string length]);
-		
-		if ([commands count])
-			[commandLines addObject: commands];
-		 */
+		char c = *p;
+		if ((c >= '0') && (c <= '9'))
+		{
+			if (numSignificant < 18)
+			{
+				mantissa = 10*mantissa + (c - '0');
+				if (mantissa)
+					++numSignificant;
+				if (hasPoint)
+					++numFractionDigits;
+			}
+			else if (!hasPoint)
+				++droppedDigits;
 		}
+		else if ((c == '.') && !hasPoint)
+			hasPoint = YES;
+		else
+			break;
 	}
 
-	return commandLines;
-	
-}
+	if (numFractionDigits <= 18)
+		*value = (double)mantissa/_powersOfTen[numFractionDigits];
+	else
+		*value = (double)mantissa*pow(10.0, -numFractionDigits);
 
-- (long) logError: (NSString*) format, ...
-{
-	va_list args;	
-	va_start(args,format);
-	NSLogv(format, args);
-	va_end(args);
-	
-	return 0;
+	if (droppedDigits)
+		*value *= pow(10.0, droppedDigits);
+
+	return p;
 }
 
-- (long) parseNumericOperatorString: (const char*) inText length: (long) length object: (id*) objPtr
+static const char* _parseExpression(const char* p, const char* end, double* value, long depth, const char** error);
+
+static const char* _parseRealValue(const char* p, const char* end, double* value, long depth, const char** error)
 {
-	if (!length)
-		return [self logError: @"Zero Length String"];
-	
-	long i = 0;
-	switch (*inText)
+	p = _skipSpace(p, end);
+
+	if (p >= end)
+	{
+		*error = "Missing value";
+		return NULL;
+	}
+
+	char c = *p;
+
+	if ((c == '-') || (c == '+'))
+	{
+		p = _parseRealValue(p+1, end, value, depth, error);
+		if (p && (c == '-'))
+			*value = -*value;
+		return p;
+	}
+	else if (c == '[')
 	{
-		case '+':
-		case '-':
+		if (depth >= RS274_MAX_EXPRESSION_DEPTH)
 		{
-			RS274Operator* op = [[RS274Operator alloc] init];
-			op.precedenceLevel = 1;
-			op.name = [NSString stringWithFormat: @"%c", *inText];
-			if (objPtr)
-				*objPtr = op;
-			
-			i += 1;
-			break;
+			*error = "Expression nested too deeply";
+			return NULL;
 		}
-		default:
-			return [self logError: @"unknown operator"];
 
+		p = _parseExpression(p+1, end, value, depth+1, error);
+		if (!p)
+			return NULL;
+
+		p = _skipSpace(p, end);
+		if ((p >= end) || (*p != ']'))
+		{
+			*error = "Missing closing bracket in expression";
+			return NULL;
+		}
+		return p+1;
 	}
+	else if (((c >= '0') && (c <= '9')) || (c == '.'))
+	{
+		const char* start = p;
+		p = _parseNumber(p, end, value);
+		if ((p - start == 1) && (*start == '.'))
+		{
+			*error = "Missing digits in number";
+			return NULL;
+		}
+		return p;
+	}
+	else if (c == '#')
+	{
+		*error = "Parameter references are not supported";
+		return NULL;
+	}
+	else if (isalpha((unsigned char)c))
+	{
+		// unary functions, eg. ABS[x]
+		static const struct { const char* name; double (*func)(double); } functions[] = {
+			{"ABS", fabs}, {"SQRT", sqrt}, {"EXP", exp}, {"LN", log}, {"ROUND", round}, {"FIX", floor}, {"FUP", ceil},
+		};
 
-	return i;
+		const char* nameStart = p;
+		while ((p < end) && isalpha((unsigned char)*p))
+			++p;
+		size_t nameLength = p - nameStart;
 
-}
-- (long) parseNumericConstantString: (const char*) inText length: (long) length object: (id*) objPtr
-{
-	if (!length)
-		return [self logError: @"Zero Length String"];
-	
-	long i = 0;
-	
-	
-	long lastDigitIndex = 0;
-	while (isdigit(inText[lastDigitIndex]) || (inText[lastDigitIndex] == '.'))
-		lastDigitIndex++;
-	
-	i = lastDigitIndex;
-	
-	NSString* string = [[NSString alloc] initWithBytes: inText length: lastDigitIndex encoding: NSASCIIStringEncoding];
-	
-	double val = [string doubleValue];
-	
-	if (objPtr)
-		*objPtr = [NSNumber numberWithDouble: val];
-	
-	return i;
+		for (size_t i = 0; i < sizeof(functions)/sizeof(*functions); ++i)
+		{
+			if ((strlen(functions[i].name) != nameLength) || (strncasecmp(functions[i].name, nameStart, nameLength) != 0))
+				continue;
+
+			p = _skipSpace(p, end);
+			if ((p >= end) || (*p != '['))
+			{
+				*error = "Missing bracket after function name";
+				return NULL;
+			}
+
+			p = _parseRealValue(p, end, value, depth, error);
+			if (p)
+				*value = functions[i].func(*value);
+			return p;
+		}
+
+		*error = "Unknown function in expression";
+		return NULL;
+	}
+
+	*error = "Invalid character in value";
+	return NULL;
 }
 
-- (long) parseNumericObjectString: (const char*) inText length: (long) length object: (id*) objPtr
+static const char* _parseTerm(const char* p, const char* end, double* value, long depth, const char** error)
 {
-	if (!length)
-		return [self logError: @"Zero Length String"];
+	p = _parseRealValue(p, end, value, depth, error);
 
-	long i = 0;
-	long k = 0;
-	
-	switch (*inText)
+	while (p)
 	{
-		case ' ':
-		case '\t':
-			i += 1;
-			k = [self parseNumericString: inText+1 length: length-1 object: objPtr];
-			break;
-			
-		case '.':
-		case '0':
-		case '1':
-		case '2':
-		case '3':
-		case '4':
-		case '5':
-		case '6':
-		case '7':
-		case '8':
-		case '9':
-		{
-			k = [self parseNumericConstantString: inText length: length object: objPtr];
-			break;
-		}
-		case '+':
-		case '-':
-		case '*':
-		case '/':
+		p = _skipSpace(p, end);
+		if ((p < end) && ((*p == '*') || (*p == '/')))
 		{
-			k = [self parseNumericOperatorString: inText length: length object: objPtr];
-			break;
+			char op = *p;
+			BOOL power = (op == '*') && (p+1 < end) && (p[1] == '*');
+
+			double rhs = 0.0;
+			p = _parseRealValue(p + (power ? 2 : 1), end, &rhs, depth, error);
+			if (!p)
+				return NULL;
+
+			if (power)
+				*value = pow(*value, rhs);
+			else if (op == '*')
+				*value *= rhs;
+			else
+				*value /= rhs;
 		}
-
-		default:
-			return [self logError: @"Invalid Character '%c' in numeric object", *inText];
+		else
 			break;
 	}
-	
-	i += k;
 
-	return i;
+	return p;
 }
 
-- (id) buildExpressionTree: (NSArray*) flatTokens
+static const char* _parseExpression(const char* p, const char* end, double* value, long depth, const char** error)
 {
-	long opIndex = 0;
-	
-	// operators and numbers are at this point just a flat list, when no parenthesis were used
-	// so operators need to be assigned operands
-	// this happens by repetitevly finding the highest precedence operator and assigning it its operands
-	while ((opIndex != NSNotFound) && ([flatTokens count] > 1) )
+	p = _parseTerm(p, end, value, depth, error);
+
+	while (p)
 	{
-		long highestPrecedence = 0;
-		for (long i = 0; i < [flatTokens count]; ++i)
+		p = _skipSpace(p, end);
+		if ((p < end) && ((*p == '+') || (*p == '-')))
 		{
-			id obj = [flatTokens objectAtIndex: i];
-			if ([obj isKindOfClass: [RS274Operator class]])
-				highestPrecedence = MAX(highestPrecedence, [obj precedenceLevel]);
+			char op = *p;
+			double rhs = 0.0;
+			p = _parseTerm(p+1, end, &rhs, depth, error);
+			if (!p)
+				return NULL;
+
+			*value = (op == '+') ? *value + rhs : *value - rhs;
 		}
-		opIndex = NSNotFound;
+		else
+			break;
+	}
+
+	return p;
+}
 
-		for (long i = 0; i < [flatTokens count]; ++i)
+#pragma mark - Lines
+
+static void _parseLine(_RS274ParseState* state, const char* p, const char* end)
+{
+	const char* lineStart = p;
+	const char* error = NULL;
+	const char* errorAt = NULL;
+
+	while (p < end)
+	{
+		char c = *p;
+
+		switch (c)
 		{
-			id obj = [flatTokens objectAtIndex: i];
-			if ([obj isKindOfClass: [RS274Operator class]] && ([obj precedenceLevel] == highestPrecedence))
+			case ' ':
+			case '\t':
+			case '\r':
+			case '%': // program start and end markers
+				++p;
+				break;
+			case '/': // block delete is not switchable, so blocks are always executed
 			{
-				opIndex = i;
+				if (p == _skipSpace(lineStart, end))
+					++p;
+				else
+				{
+					error = "Unexpected '/' in block";
+					errorAt = p;
+				}
 				break;
 			}
-		}
-		
-		if (opIndex != NSNotFound)
-		{
-			RS274Operator* op = [flatTokens objectAtIndex: opIndex];
-			if ([op.name isEqual: @"-"])
+			case ';':
+				p = end;
+				break;
+			case '(':
 			{
-				if (opIndex+1 >= [flatTokens count])
+				const char* commentEnd = memchr(p, ')', end - p);
+				if (!commentEnd)
 				{
-					[self logError: @"Missing right operand"];
+					error = "Missing closing parenthesis in comment";
+					errorAt = p;
 				}
-				else if (opIndex > 0)
+				else
+					p = commentEnd + 1;
+				break;
+			}
+			case '#':
+			{
+				double index = 0.0, value = 0.0;
+				const char* q = _parseRealValue(p+1, end, &index, 0, &error);
+				if (q)
+				{
+					q = _skipSpace(q, end);
+					if ((q < end) && (*q == '='))
+						q = _parseRealValue(q+1, end, &value, 0, &error);
+					else
+					{
+						error = "Missing '=' in parameter assignment";
+						q = NULL;
+					}
+				}
+				if (q && ((index < 1.0) || (index > UINT32_MAX) || (index != floor(index))))
+				{
+					error = "Invalid parameter number";
+					q = NULL;
+				}
+
+				if (!q)
+					errorAt = p;
+				else if (!_pushWord(state, p, '#', value, (uint32_t)index))
 				{
-					op.operands = [NSArray arrayWithObjects: [flatTokens objectAtIndex: opIndex-1],[flatTokens objectAtIndex: opIndex+1], nil];
-					flatTokens = [flatTokens arrayByRemovingObjectsAtIndexes: [NSIndexSet indexSetWithIndex: opIndex+1]];
-					flatTokens = [flatTokens arrayByRemovingObjectsAtIndexes: [NSIndexSet indexSetWithIndex: opIndex-1]];
+					_discardBlock(state);
+					return;
 				}
 				else
+					p = q;
+				break;
+			}
+			default:
+			{
+				if (!isalpha((unsigned char)c))
+				{
+					error = "Unexpected character";
+					errorAt = p;
+					break;
+				}
+
+				double value = 0.0;
+				const char* q = _parseRealValue(p+1, end, &value, 0, &error);
+				if (!q)
+					errorAt = p;
+				else if (!_pushWord(state, p, toupper((unsigned char)c), value, 0))
 				{
-					op.operands = [NSArray arrayWithObjects: [flatTokens objectAtIndex: opIndex+1], nil];
-					flatTokens = [flatTokens arrayByRemovingObjectsAtIndexes: [NSIndexSet indexSetWithIndex: opIndex+1]];
+					_discardBlock(state);
+					return;
 				}
+				else
+					p = q;
+				break;
 			}
-			else
-				[self logError: @"Unsopported Operator: %@", op.name];
 		}
 
+		if (error)
+		{
+			_reportError(state, errorAt, error);
+			_discardBlock(state);
+			return;
+		}
 	}
-	
-	if ([flatTokens count] != 1)
-		[self logError: @"Invalid expression tree, more than one root token remaining"];
-	
-	return [flatTokens objectAtIndex: 0];
+
+	_finishBlock(state, lineStart);
 }
 
-- (id) foldConstantsInExpression: (id) inExpr
+/*!
+ Parses the lines in start...end of bytes. Byte offsets are relative to bytes, lines are counted from the start of the range.
+ */
+static void _parseRange(_RS274ParseState* state, const char* bytes, size_t start, size_t end)
 {
-	if ([inExpr isKindOfClass: [RS274Operator class]])
+	const char* p = bytes + start;
+	const char* rangeEnd = bytes + end;
+
+	state->bytes = bytes;
+	state->line = 1;
+
+	while (p < rangeEnd)
 	{
-		RS274Operator* op = inExpr;
-		if ([op.name isEqual: @"-"])
+		const char* lineEnd = memchr(p, '\n', rangeEnd - p);
+		if (!lineEnd)
+			lineEnd = rangeEnd;
+
+		_parseLine(state, p, lineEnd);
+
+		p = lineEnd + 1;
+		state->line++;
+	}
+}
+
+static void _enumerateBlocks(_RS274ParseState* state, void(^callback)(const RS274Block* block, const RS274Word* words, BOOL* stop), BOOL* stop)
+{
+	_RS274WordChunk* wordChunk = state->firstWordChunk;
+	size_t wordIndex = 0;
+
+	for (_RS274BlockChunk* blockChunk = state->firstBlockChunk; blockChunk && !*stop; blockChunk = blockChunk->next)
+	{
+		for (size_t i = 0; (i < blockChunk->count) && !*stop; ++i)
 		{
-			if ([op.operands count] == 1)
-			{
-				id operand = [self foldConstantsInExpression: [op.operands objectAtIndex: 0]];
-				if ([operand isKindOfClass: [NSNumber class]])
-					return [NSNumber numberWithDouble: -[operand doubleValue]];
-			}
-			else if ([op.operands count] == 2)
+			RS274Block* block = blockChunk->blocks + i;
+
+			// blocks never straddle word chunks, but chunks can end early
+			while (wordIndex == wordChunk->count)
 			{
-				id operand0 = [self foldConstantsInExpression: [op.operands objectAtIndex: 0]];
-				id operand1 = [self foldConstantsInExpression: [op.operands objectAtIndex: 1]];
-				if ([operand0 isKindOfClass: [NSNumber class]] && [operand1 isKindOfClass: [NSNumber class]])
-					return [NSNumber numberWithDouble: [operand0 doubleValue]-[operand1 doubleValue]];
-				
+				wordChunk = wordChunk->next;
+				wordIndex = 0;
 			}
+			assert(wordIndex + block->wordCount <= wordChunk->count);
+
+			callback(block, wordChunk->words + wordIndex, stop);
+
+			wordIndex += block->wordCount;
 		}
 	}
-	else if (([inExpr isKindOfClass: [NSNumber class]]))
-	{
-		return inExpr;
-	}
-	return inExpr;
 }
 
-- (long) parseNumericString: (const char*) inText length: (long) length object: (id*) objectPtr
+static void _offsetLines(_RS274ParseState* state, uint32_t lineOffset)
 {
-	if (!length)
-		return [self logError: @"Zero Length String"];
-	
-	long i = 0;
-	long k = 0;
-	
-	NSMutableArray* numericObjects = [[NSMutableArray alloc] init];
-	
-	while (i < length)
+	for (_RS274BlockChunk* chunk = state->firstBlockChunk; chunk; chunk = chunk->next)
+		for (size_t i = 0; i < chunk->count; ++i)
+			chunk->blocks[i].line += lineOffset;
+
+	for (size_t i = 0; i < state->numReportedErrors; ++i)
+		state->errors[i].line += lineOffset;
+}
+
+/*!
+ Moves the parse results of src to the end of dst, src is left empty.
+ */
+static void _appendParseState(_RS274ParseState* dst, _RS274ParseState* src)
+{
+	if (src->firstWordChunk)
+	{
+		if (dst->lastWordChunk)
+			dst->lastWordChunk->next = src->firstWordChunk;
+		else
+			dst->firstWordChunk = src->firstWordChunk;
+		dst->lastWordChunk = src->lastWordChunk;
+	}
+	if (src->firstBlockChunk)
+	{
+		if (dst->lastBlockChunk)
+			dst->lastBlockChunk->next = src->firstBlockChunk;
+		else
+			dst->firstBlockChunk = src->firstBlockChunk;
+		dst->lastBlockChunk = src->lastBlockChunk;
+	}
+
+	dst->numWords += src->numWords;
+	dst->numBlocks += src->numBlocks;
+
+	for (size_t i = 0; i < src->numReportedErrors; ++i)
 	{
-		id obj = nil;
-		k = [self parseNumericObjectString: inText+i length: length-i object: &obj];
-		
-		if (!k)
-			return [self logError: @"Unknown error parsing numeric string"];
-		[numericObjects addObject: obj];
-		
-		i += k;
-		if (![obj isKindOfClass: [RS274Operator class]])
+		if (dst->numReportedErrors >= RS274_MAX_REPORTED_ERRORS)
 			break;
+		if (!dst->errors)
+			dst->errors = calloc(RS274_MAX_REPORTED_ERRORS, sizeof(*dst->errors));
+		dst->errors[dst->numReportedErrors++] = src->errors[i];
 	}
-	
-	id expressionTree = [self buildExpressionTree: numericObjects];
-	
-	id foldedExpression = [self foldConstantsInExpression: expressionTree];
-	
-	if (objectPtr)
-		*objectPtr = foldedExpression;
-	
-
-	
-	return i;
+	dst->numErrors += src->numErrors;
+
+	src->firstWordChunk = src->lastWordChunk = NULL;
+	src->firstBlockChunk = src->lastBlockChunk = NULL;
+	_freeParseState(src);
+}
+
+
+@implementation RS274Parser
+{
+	_RS274ParseState state;
+	NSString* sourceName;
+	NSArray* commandBlocks;
+}
+
+@synthesize commandBlocks;
+
+- (void) dealloc
+{
+	_freeParseState(&state);
+}
+
+- (BOOL) parseBytes: (const char*) bytes length: (size_t) length named: (NSString*) name
+{
+	return [self parseBytes: bytes length: length named: name blockHandler: nil];
 }
 
+- (BOOL) parseBytes: (const char*) bytes length: (size_t) length named: (NSString*) name blockHandler: (void(^)(const RS274Block* block, const RS274Word* words, BOOL* stop)) handler
+{
+	uint64_t parseStart = GM_METRIC_TIMER_START();
+
+	_freeParseState(&state);
+	commandBlocks = nil;
+	sourceName = name;
+
+	// split at line ends into a few chunks per core, but not into tiny ones
+	size_t numChunks = MAX(1, MIN(length/RS274_MIN_PARALLEL_CHUNK_SIZE, 4*[[NSProcessInfo processInfo] activeProcessorCount]));
+
+	size_t* boundaries = calloc(numChunks+1, sizeof(*boundaries));
+	boundaries[numChunks] = length;
+	for (size_t i = 1; i < numChunks; ++i)
+	{
+		size_t target = MAX(boundaries[i-1], (length/numChunks)*i);
+		const char* lineEnd = memchr(bytes + target, '\n', length - target);
+		boundaries[i] = lineEnd ? (lineEnd - bytes) + 1 : length;
+	}
+
+	_RS274ParseState* chunkStates = calloc(numChunks, sizeof(*chunkStates));
+	dispatch_semaphore_t* chunkDone = calloc(numChunks, sizeof(*chunkDone));
+	dispatch_group_t group = dispatch_group_create();
+
+	for (size_t i = 0; i < numChunks; ++i)
+	{
+		chunkDone[i] = dispatch_semaphore_create(0);
+		dispatch_semaphore_t done = chunkDone[i];
+
+		dispatch_group_async(group, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+			_parseRange(chunkStates + i, bytes, boundaries[i], boundaries[i+1]);
+			dispatch_semaphore_signal(done);
+		});
+	}
 
+	// chunks are handed on strictly in file order, as soon as they and all before them are done
+	uint32_t lineOffset = 0;
+	BOOL stop = NO;
 
-- (void) attachCommand: (id) command
+	for (size_t i = 0; i < numChunks; ++i)
+	{
+		dispatch_semaphore_wait(chunkDone[i], DISPATCH_TIME_FOREVER);
+
+		_RS274ParseState* chunkState = chunkStates + i;
+		uint32_t numLines = chunkState->line - 1;
+
+		_offsetLines(chunkState, lineOffset);
+		lineOffset += numLines;
+
+		if (handler && !stop)
+			_enumerateBlocks(chunkState, handler, &stop);
+
+		_appendParseState(&state, chunkState);
+	}
+
+	dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+
+	free(boundaries);
+	free(chunkStates);
+	free(chunkDone);
+
+	GM_METRIC_TIMER_STOP("rs274.parse", parseStart);
+	GM_METRIC_COUNT("rs274.parse.bytes", length);
+	GM_METRIC_COUNT("rs274.parse.blocks", state.numBlocks);
+	GM_METRIC_COUNT("rs274.parse.words", state.numWords);
+	GM_METRIC_COUNT("rs274.parse.errors", state.numErrors);
+	GM_METRIC_HISTOGRAM("rs274.parse.chunks", numChunks);
+
+	return !state.numErrors;
+}
+
+- (BOOL) parseData: (NSData*) data named: (NSString*) name
 {
-//	NSLog(@"Command Received: %@", command);
-	
-	[_currentCommandBlock addObject: command];
-	
+	return [self parseBytes: data.bytes length: data.length named: name];
 }
 
-- (long) parseCommandString: (const char*) inText length: (long) length
+- (BOOL) parseFileAtPath: (NSString*) path error: (NSError**) error
 {
-	if (!length)
-		return [self logError: @"Zero Length String"];
-	
-	long i = 1;
-	long k = 0;
-	
-	int cmdChar = *inText;
-	
-	id cmdValue = nil;
-	
-	k = [self parseNumericString: inText+i length: length-i object: &cmdValue];
-	
-	if (!k)
-		return [self logError: @"Invalid command number"];
-	i += k;
-	
-	RS274Command* command = [[RS274Command alloc] init];
-	command.commandLetter = cmdChar;
-	command.value = cmdValue;
-	
-	[self attachCommand: command];
-	
-	
-	return i;
-	
-	
-	
+	return [self parseFileAtPath: path error: error blockHandler: nil];
 }
 
-- (long) parseAssignmentString: (const char*) inText length: (long) length
+- (BOOL) parseFileAtPath: (NSString*) path error: (NSError**) error blockHandler: (void(^)(const RS274Block* block, const RS274Word* words, BOOL* stop)) handler
 {
-	if (!length)
-		return [self logError: @"Zero Length String"];
-	return 0;
+	NSData* data = [NSData dataWithContentsOfFile: path options: NSDataReadingMappedAlways error: error];
+	if (!data)
+		return NO;
+
+	BOOL success = [self parseBytes: data.bytes length: data.length named: path.lastPathComponent blockHandler: handler];
+
+	if (!success && error)
+		*error = self.errors.firstObject;
+
+	return success;
 }
 
-/*
-static long _ignoreWhitespace(const char* txt, long length)
+- (NSArray*) parseString: (NSString*) inText named: (NSString*) name
 {
-	for (long i = 0; i < length; ++i)
-		if ((txt[i] != ' ') && (txt[i] != '\t'))
-			return i;
-	return length;
+	[self parseData: [inText dataUsingEncoding: NSASCIIStringEncoding allowLossyConversion: YES] named: name];
+
+	return self.commandBlocks;
 }
- */
-- (long) parseParameterSetString: (const char*) inText length: (long) length
+
+- (size_t) blockCount
 {
-	if (!length)
-		return [self logError: @"Zero Length Parameter Set String"];
-
-	id parameterIndex = nil;
-	id parameterValue = nil;
-	
-	if (*inText == '#')
-		return [self logError: @"Parameter Assignment not starting with '#'"];
-	
-	long i = 1;
-	long k = 0;
-	
-	k = [self parseNumericString: inText+i length: length-i object: &parameterIndex];
-	
-	if (!k)
-		return [self logError: @"Invalid parameter index"];
-	
-	i += k;
-	
-	k = [self parseAssignmentString: inText+i length: length-i];
-	
-	if (!k)
-		return [self logError: @"Missing assignment operator"];
-	
-	i += k;
-	
-	k = [self parseNumericString: inText+i length: length-i object: &parameterValue];
-	
-	if (!k)
-		return [self logError: @"Invalid parameter value"];
-	
-	i += k;
-	
-	return i;
+	return state.numBlocks;
 }
 
-- (long) parseWordString: (const char*) inText length: (long) length
+- (size_t) wordCount
 {
-	if (!length)
-		return 0;
-	
-	switch (toupper(*inText))
-	{
-		case ' ':
-		case '\t':
-		{
-			return 1;
-		}
-		case '#':
-		{
-			long k = [self parseParameterSetString: inText length: length];
-			if (!k)
-				return [self logError: @"Unexpected error in parsing parameter set"];
-			else
-				return k;
-		}
-		case 'A':
-		case 'B':
-		case 'C':
-		case 'D':
-		case 'E':
-		case 'F':
-		case 'G':
-		case 'H':
-		case 'I':
-		case 'J':
-		case 'K':
-		case 'L':
-		case 'M':
-		case 'N':
-		case 'P':
-		case 'Q':
-		case 'R':
-		case 'S':
-		case 'T':
-		case 'X':
-		case 'Y':
-		case 'Z':
-		{
-			long k = [self parseCommandString: inText length: length];
-			if (!k)
-				return 0;
-			else
-				return k;
-		}
-		default:
-			return [self logError: @"Unexpected Character '%c'", *inText];
-	}
+	return state.numWords;
 }
 
-- (void) parseCString: (const char*) inText length: (long) length
+- (size_t) errorCount
 {
-	if (!length)
-		return;
-	long i = 0;
-	
-	while (i < length)
+	return state.numErrors;
+}
+
+- (NSArray*) errors
+{
+	NSMutableArray* errors = [NSMutableArray arrayWithCapacity: state.numReportedErrors];
+
+	for (size_t i = 0; i < state.numReportedErrors; ++i)
 	{
-		long k = [self parseWordString: inText+i length: length-i];
-		if (!k)
-			break;
-		i+= k;
+		_RS274ParseError err = state.errors[i];
+		NSString* desc = [NSString stringWithFormat: @"%@:%u: %s (byte %llu)", sourceName, err.line, err.message, err.byteOffset];
+
+		[errors addObject: [NSError errorWithDomain: RS274ParserErrorDomain code: 1 userInfo: @{
+			NSLocalizedDescriptionKey : desc,
+			RS274ParserErrorByteOffsetKey : @(err.byteOffset),
+			RS274ParserErrorLineKey : @(err.line),
+		}]];
 	}
-	
+
+	return errors;
 }
 
-- (void) parseString: (NSString*) inText
+- (void) enumerateBlocksUsingBlock: (void(^)(const RS274Block* block, const RS274Word* words, BOOL* stop)) callback
 {
-	const char* inBuf = [inText UTF8String];
-	size_t inSize = strlen(inBuf);
-	
-	
-	[self parseCString: inBuf length: inSize];
+	BOOL stop = NO;
+	_enumerateBlocks(&state, callback, &stop);
 }
 
-@end
+- (NSArray*) commandBlocks
+{
+	if (commandBlocks)
+		return commandBlocks;
 
-@implementation RS274TextLine
+	NSMutableArray* blocks = [NSMutableArray arrayWithCapacity: state.numBlocks];
 
-@synthesize lineCount, string;
+	[self enumerateBlocksUsingBlock: ^(const RS274Block* block, const RS274Word* words, BOOL* stop) {
+		NSMutableArray* commands = [NSMutableArray arrayWithCapacity: block->wordCount];
+		for (size_t i = 0; i < block->wordCount; ++i)
+		{
+			RS274Command* command = [[RS274Command alloc] init];
+			command.commandLetter = words[i].letter;
+			command.value = @(words[i].value);
+			[commands addObject: command];
+		}
+		[blocks addObject: commands];
+	}];
+
+	commandBlocks = blocks;
+	return commandBlocks;
+}
 
 @end
 
@@ -560,5 +784,3 @@ static long _ignoreWhitespace(const char* txt, long length)
 }
 
 @end
-
-
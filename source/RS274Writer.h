@@ -0,0 +1,82 @@
+//
+//  RS274Writer.h
+//  Giddy Machinist
+//
+//  Created by Dömötör Gulyás on 19.10.2026.
+//  Copyright (c) 2026 Dömötör Gulyás. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "VectorMath_fixp.h"
+
+typedef enum {
+	RS274AxisNone = 0,
+	RS274AxisX = 1,
+	RS274AxisY = 2,
+	RS274AxisZ = 4,
+	RS274AxisXY = RS274AxisX | RS274AxisY,
+	RS274AxisXYZ = RS274AxisX | RS274AxisY | RS274AxisZ,
+} RS274AxisMask;
+
+/*!
+ Formats a fixed point value as a decimal number with at most `decimals` fractional digits, rounding half away from zero, and trailing zeros removed. Only integer arithmetic is used. Returns the number of characters written, buf needs at least 24 bytes.
+ */
+size_t RS274FormatFixedPoint(char* buf, vmlong_t value, long shift, long decimals);
+
+/*!
+ @description Streaming G-code emitter. Lines are formatted into a reusable byte buffer that is flushed to a file descriptor whenever it fills up, so memory use does not depend on the length of the program.
+
+ Coordinates are formatted directly from fixed point. With suppressRedundantAxisWords, axis words that would repeat the last emitted value are dropped, and motion commands with no remaining axis words are dropped entirely. Raw lines reset the known position, as they may move the machine.
+ */
+@interface RS274Writer : NSObject
+
+- (instancetype) initWithFileDescriptor: (int) fd closeWhenDone: (BOOL) closeWhenDone;
+
+/*!
+ Writes to a temporary file next to url, which replaces url when the writer is closed without errors. A writer deallocated without being closed removes the temporary file, and leaves url as it was.
+ */
+- (instancetype) initWithURL: (NSURL*) url;
+
+@property(nonatomic) long decimals;
+@property(nonatomic) BOOL suppressRedundantAxisWords;
+/*!
+ Maximum deviation of fitted G2/G3 arcs from the polylines passed to cutPathXY:count:closed:, arc fitting is disabled if zero.
+ */
+@property(nonatomic) double arcTolerance;
+
+@property(nonatomic, readonly) size_t bytesWritten;
+@property(nonatomic, readonly) size_t linesWritten;
+@property(nonatomic, readonly) size_t arcsWritten;
+@property(nonatomic, readonly) int errorNumber;
+
+/*!
+ Characters that are not ASCII are replaced.
+ */
+- (void) writeLine: (NSString*) line;
+- (void) writeCString: (const char*) line;
+- (void) writeData: (NSData*) data;
+
+- (void) writeMotion: (int) gNumber axes: (RS274AxisMask) axes position: (v3i_t) p;
+
+- (void) writeArc: (BOOL) ccw toXY: (v3i_t) p centerOffsetX: (double) i y: (double) j;
+
+/*!
+ Cuts along a polyline starting at vertices[0], replacing runs of vertices by arcs where they stay within arcTolerance.
+ */
+- (void) cutPathXY: (const v3i_t*) vertices count: (size_t) count closed: (BOOL) closed;
+
+- (void) rapidToXY: (v3i_t) p;
+- (void) linearToXY: (v3i_t) p;
+- (void) rapidToZ: (vmintfix_t) z;
+- (void) linearToZ: (vmintfix_t) z;
+
+- (void) invalidatePosition;
+
+- (BOOL) flush;
+/*!
+ Flushes and closes the output. Returns NO if any write failed, in which case a temporary output file is removed instead of replacing the destination.
+ */
+- (BOOL) close;
+
+@end
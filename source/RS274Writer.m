@@ -0,0 +1,560 @@
+//
+//  RS274Writer.m
+//  Giddy Machinist
+//
+//  Created by Dömötör Gulyás on 19.10.2026.
+//  Copyright (c) 2026 Dömötör Gulyás. All rights reserved.
+//
+
+#import "RS274Writer.h"
+
+#import "GMMetrics.h"
+
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <math.h>
+
+
+#define RS274WRITER_BUFFER_SIZE (64*1024)
+#define RS274WRITER_MAX_LINE_LENGTH 256
+#define RS274WRITER_MAX_DECIMALS 6
+#define RS274WRITER_ARC_MIN_SEGMENTS 3
+#define RS274WRITER_ARC_MAX_SWEEP (1.5*M_PI)
+#define RS274WRITER_ARC_MAX_RADIUS 1000.0
+
+static const vmlong_t _powersOfTen[RS274WRITER_MAX_DECIMALS+1] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+
+
+static vmlong_t _roundToDecimals(vmlong_t value, long shift, long decimals)
+{
+	vmlong_t p = _powersOfTen[decimals];
+	BOOL negative = value < 0;
+	vmlong_t a = (negative ? -value : value)*p;
+
+	if (shift > 0)
+		a = (a + (1LL << (shift-1))) >> shift;
+	else if (shift < 0)
+		a = a << -shift;
+
+	return negative ? -a : a;
+}
+
+static size_t _formatDecimal(char* buf, vmlong_t q, long decimals)
+{
+	size_t k = 0;
+
+	if (q < 0)
+	{
+		buf[k++] = '-';
+		q = -q;
+	}
+
+	vmlong_t p = _powersOfTen[decimals];
+	vmlong_t ipart = q / p;
+	vmlong_t fpart = q % p;
+
+	char digits[24];
+	size_t numDigits = 0;
+	do
+	{
+		digits[numDigits++] = '0' + (char)(ipart % 10);
+		ipart /= 10;
+	} while (ipart);
+
+	while (numDigits)
+		buf[k++] = digits[--numDigits];
+
+	if (fpart)
+	{
+		long numFrac = decimals;
+		while (fpart % 10 == 0)
+		{
+			fpart /= 10;
+			--numFrac;
+		}
+
+		buf[k++] = '.';
+		for (long i = numFrac-1; i >= 0; --i)
+		{
+			buf[k+i] = '0' + (char)(fpart % 10);
+			fpart /= 10;
+		}
+		k += numFrac;
+	}
+
+	return k;
+}
+
+
+/*!
+ Checks if the vertices start...end lie on a common arc within tolerance, that is, all vertices are within tolerance of the circle through the first, middle and last vertex, they advance monotonically around it in one direction, and no chord bulges out by more than tolerance.
+ */
+static BOOL _fitArc(const double* xy, size_t start, size_t end, double tolerance, double* outCx, double* outCy, BOOL* outCCW)
+{
+	size_t mid = (start + end)/2;
+
+	double ax = xy[2*start], ay = xy[2*start+1];
+	double bx = xy[2*mid] - ax, by = xy[2*mid+1] - ay;
+	double cx = xy[2*end] - ax, cy = xy[2*end+1] - ay;
+
+	double d = 2.0*(bx*cy - by*cx);
+	if (fabs(d) < 1e-12)
+		return NO;
+
+	double b2 = bx*bx + by*by, c2 = cx*cx + cy*cy;
+	double ux = (cy*b2 - by*c2)/d;
+	double uy = (bx*c2 - cx*b2)/d;
+
+	double r = sqrt(ux*ux + uy*uy);
+	if (r > RS274WRITER_ARC_MAX_RADIUS)
+		return NO;
+
+	ux += ax;
+	uy += ay;
+
+	BOOL ccw = d > 0.0;
+	double sweep = 0.0;
+	double maxStep = 2.0*acos(MAX(-1.0, 1.0 - tolerance/r)); // sagitta limit
+
+	for (size_t k = start; k <= end; ++k)
+	{
+		double px = xy[2*k] - ux, py = xy[2*k+1] - uy;
+
+		if (fabs(sqrt(px*px + py*py) - r) > tolerance)
+			return NO;
+
+		if (k == end)
+			break;
+
+		double qx = xy[2*k+2] - ux, qy = xy[2*k+3] - uy;
+		double step = atan2(px*qy - py*qx, px*qx + py*qy);
+
+		if (!ccw)
+			step = -step;
+		if ((step <= 0.0) || (step > maxStep))
+			return NO;
+
+		sweep += step;
+		if (sweep > RS274WRITER_ARC_MAX_SWEEP)
+			return NO;
+	}
+
+	*outCx = ux;
+	*outCy = uy;
+	*outCCW = ccw;
+	return YES;
+}
+
+/*!
+ Finds the longest arc starting at start, by growing the run exponentially and then bisecting back. Returns start if there is none.
+ */
+static size_t _longestArc(const double* xy, size_t start, size_t count, double tolerance, double* cx, double* cy, BOOL* ccw)
+{
+	size_t good = start;
+	size_t bad = count;
+	size_t stride = RS274WRITER_ARC_MIN_SEGMENTS;
+
+	while (start + stride < count)
+	{
+		if (_fitArc(xy, start, start + stride, tolerance, cx, cy, ccw))
+		{
+			good = start + stride;
+			stride *= 2;
+		}
+		else
+		{
+			bad = start + stride;
+			break;
+		}
+	}
+
+	if (good == start)
+		return start;
+
+	while (bad - good > 1)
+	{
+		size_t mid = (good + bad)/2;
+		double mx, my;
+		BOOL mccw;
+		if (_fitArc(xy, start, mid, tolerance, &mx, &my, &mccw))
+			good = mid;
+		else
+			bad = mid;
+	}
+
+	// refit, as the last probe may have been a failed one
+	_fitArc(xy, start, good, tolerance, cx, cy, ccw);
+
+	return good;
+}
+
+static size_t _writeAll(int fd, const char* bytes, size_t length, int* error)
+{
+	size_t k = 0;
+
+	while (!*error && (k < length))
+	{
+		ssize_t n = write(fd, bytes + k, length - k);
+		if (n < 0)
+		{
+			if (errno != EINTR)
+				*error = errno;
+		}
+		else
+			k += n;
+	}
+
+	return k;
+}
+
+size_t RS274FormatFixedPoint(char* buf, vmlong_t value, long shift, long decimals)
+{
+	assert((decimals >= 0) && (decimals <= RS274WRITER_MAX_DECIMALS));
+	return _formatDecimal(buf, _roundToDecimals(value, shift, decimals), decimals);
+}
+
+
+@implementation RS274Writer
+{
+	int		fileDescriptor;
+	BOOL	closeWhenDone;
+
+	char*	buffer;
+	size_t	bufferFill;
+
+	NSString* destinationPath;
+	NSString* temporaryPath;
+
+	vmlong_t	lastAxisValues[3];
+	RS274AxisMask	knownAxes;
+}
+
+@synthesize decimals, suppressRedundantAxisWords, arcTolerance, bytesWritten, linesWritten, arcsWritten, errorNumber;
+
+- (id) init
+{
+	[self doesNotRecognizeSelector: _cmd];
+	return nil;
+}
+
+- (instancetype) initWithFileDescriptor: (int) fd closeWhenDone: (BOOL) closeFd
+{
+	if (!(self = [super init]))
+		return nil;
+
+	fileDescriptor = fd;
+	closeWhenDone = closeFd;
+
+	decimals = 3;
+	suppressRedundantAxisWords = YES;
+
+	buffer = malloc(RS274WRITER_BUFFER_SIZE);
+
+	return self;
+}
+
+- (instancetype) initWithURL: (NSURL*) url
+{
+	NSString* path = url.path;
+	NSString* template = [[path stringByDeletingLastPathComponent] stringByAppendingPathComponent: [NSString stringWithFormat: @".%@.XXXXXX", path.lastPathComponent]];
+
+	char* tmpPath = strdup(template.fileSystemRepresentation);
+	int fd = mkstemp(tmpPath);
+
+	if (!(self = [self initWithFileDescriptor: fd closeWhenDone: YES]))
+	{
+		free(tmpPath);
+		return nil;
+	}
+
+	if (fd < 0)
+		errorNumber = errno;
+	else
+	{
+		// mkstemp creates the file private to the user
+		fchmod(fd, 0644);
+		destinationPath = path;
+		temporaryPath = [[NSFileManager defaultManager] stringWithFileSystemRepresentation: tmpPath length: strlen(tmpPath)];
+	}
+
+	free(tmpPath);
+
+	return self;
+}
+
+- (void) dealloc
+{
+	// a file never closed explicitly was abandoned, perhaps halfway, and must not replace the destination
+	if (buffer && temporaryPath && !errorNumber)
+		errorNumber = ECANCELED;
+	if (buffer)
+		[self close];
+}
+
+- (void) setDecimals: (long) d
+{
+	assert((d >= 0) && (d <= RS274WRITER_MAX_DECIMALS));
+	decimals = d;
+	[self invalidatePosition];
+}
+
+- (BOOL) flush
+{
+	uint64_t writeStart = GM_METRIC_TIMER_START();
+	size_t n = _writeAll(fileDescriptor, buffer, bufferFill, &errorNumber);
+	GM_METRIC_TIMER_STOP("rs274.write.flush", writeStart);
+	GM_METRIC_COUNT("rs274.write.bytes", n);
+
+	bytesWritten += n;
+	bufferFill = 0;
+
+	return !errorNumber;
+}
+
+- (void) reserve: (size_t) length
+{
+	if (bufferFill + length > RS274WRITER_BUFFER_SIZE)
+		[self flush];
+}
+
+- (void) appendBytes: (const char*) bytes length: (size_t) length
+{
+	if (length > RS274WRITER_BUFFER_SIZE/2)
+	{
+		// large blobs bypass the buffer
+		[self flush];
+		size_t n = _writeAll(fileDescriptor, bytes, length, &errorNumber);
+		GM_METRIC_COUNT("rs274.write.bytes", n);
+		bytesWritten += n;
+		return;
+	}
+
+	[self reserve: length];
+	memcpy(buffer + bufferFill, bytes, length);
+	bufferFill += length;
+}
+
+- (void) writeLineBytes: (const char*) bytes length: (size_t) length
+{
+	[self appendBytes: bytes length: length];
+	[self appendBytes: "\n" length: 1];
+	++linesWritten;
+	[self invalidatePosition];
+}
+
+- (void) writeCString: (const char*) line
+{
+	[self writeLineBytes: line length: strlen(line)];
+}
+
+- (void) writeLine: (NSString*) line
+{
+	// controllers only take ASCII, characters outside of it, eg. in comments, are replaced instead of failing the line
+	NSData* data = [line dataUsingEncoding: NSASCIIStringEncoding allowLossyConversion: YES];
+	[self writeLineBytes: data.bytes length: data.length];
+}
+
+- (void) writeData: (NSData*) data
+{
+	[self appendBytes: data.bytes length: data.length];
+	if (data.length && (((const char*)data.bytes)[data.length-1] != '\n'))
+		[self appendBytes: "\n" length: 1];
+	[self invalidatePosition];
+}
+
+- (void) invalidatePosition
+{
+	knownAxes = RS274AxisNone;
+}
+
+- (void) writeMotion: (int) gNumber axes: (RS274AxisMask) axes position: (v3i_t) p
+{
+	static const char axisLetters[3] = {'X', 'Y', 'Z'};
+	vmint_t coords[3] = {p.x, p.y, p.z};
+
+	vmlong_t values[3];
+	RS274AxisMask emit = RS274AxisNone;
+
+	for (int i = 0; i < 3; ++i)
+	{
+		RS274AxisMask axis = 1 << i;
+		if (!(axes & axis))
+			continue;
+
+		values[i] = _roundToDecimals(coords[i], p.shift, decimals);
+
+		if (!suppressRedundantAxisWords || !(knownAxes & axis) || (lastAxisValues[i] != values[i]))
+			emit |= axis;
+	}
+
+	if (!emit)
+		return;
+
+	[self reserve: RS274WRITER_MAX_LINE_LENGTH];
+
+	char* line = buffer + bufferFill;
+	size_t k = 0;
+
+	line[k++] = 'G';
+	k += _formatDecimal(line + k, gNumber, 0);
+
+	for (int i = 0; i < 3; ++i)
+	{
+		RS274AxisMask axis = 1 << i;
+		if (!(emit & axis))
+			continue;
+
+		line[k++] = ' ';
+		line[k++] = axisLetters[i];
+		k += _formatDecimal(line + k, values[i], decimals);
+
+		lastAxisValues[i] = values[i];
+		knownAxes |= axis;
+	}
+
+	line[k++] = '\n';
+
+	bufferFill += k;
+	++linesWritten;
+}
+
+- (void) writeArc: (BOOL) ccw toXY: (v3i_t) p centerOffsetX: (double) i y: (double) j
+{
+	[self reserve: RS274WRITER_MAX_LINE_LENGTH];
+
+	char* line = buffer + bufferFill;
+	size_t k = 0;
+
+	line[k++] = 'G';
+	line[k++] = ccw ? '3' : '2';
+
+	vmlong_t x = _roundToDecimals(p.x, p.shift, decimals);
+	vmlong_t y = _roundToDecimals(p.y, p.shift, decimals);
+
+	line[k++] = ' ';
+	line[k++] = 'X';
+	k += _formatDecimal(line + k, x, decimals);
+	line[k++] = ' ';
+	line[k++] = 'Y';
+	k += _formatDecimal(line + k, y, decimals);
+	line[k++] = ' ';
+	line[k++] = 'I';
+	k += _formatDecimal(line + k, llround(i*_powersOfTen[decimals]), decimals);
+	line[k++] = ' ';
+	line[k++] = 'J';
+	k += _formatDecimal(line + k, llround(j*_powersOfTen[decimals]), decimals);
+
+	line[k++] = '\n';
+
+	bufferFill += k;
+	++linesWritten;
+	++arcsWritten;
+
+	lastAxisValues[0] = x;
+	lastAxisValues[1] = y;
+	knownAxes |= RS274AxisXY;
+}
+
+- (void) cutPathXY: (const v3i_t*) vertices count: (size_t) count closed: (BOOL) closed
+{
+	if (!count)
+		return;
+
+	size_t n = count + (closed ? 1 : 0);
+
+	[self linearToXY: vertices[0]];
+
+	if (arcTolerance <= 0.0)
+	{
+		for (size_t i = 1; i < n; ++i)
+			[self linearToXY: vertices[i % count]];
+		return;
+	}
+
+	double* xy = calloc(2*n, sizeof(*xy));
+	for (size_t i = 0; i < n; ++i)
+	{
+		vector_t v = v3iToFloat(vertices[i % count]);
+		xy[2*i] = v.farr[0];
+		xy[2*i+1] = v.farr[1];
+	}
+
+	size_t i = 0;
+	while (i+1 < n)
+	{
+		double cx, cy;
+		BOOL ccw = NO;
+		size_t end = _longestArc(xy, i, n, arcTolerance, &cx, &cy, &ccw);
+
+		if (end > i)
+		{
+			[self writeArc: ccw toXY: vertices[end % count] centerOffsetX: cx - xy[2*i] y: cy - xy[2*i+1]];
+			i = end;
+		}
+		else
+		{
+			[self linearToXY: vertices[(i+1) % count]];
+			++i;
+		}
+	}
+
+	free(xy);
+}
+
+- (void) rapidToXY: (v3i_t) p
+{
+	[self writeMotion: 0 axes: RS274AxisXY position: p];
+}
+
+- (void) linearToXY: (v3i_t) p
+{
+	[self writeMotion: 1 axes: RS274AxisXY position: p];
+}
+
+- (void) rapidToZ: (vmintfix_t) z
+{
+	[self writeMotion: 0 axes: RS274AxisZ position: v3iCreate(0, 0, z.x, z.shift)];
+}
+
+- (void) linearToZ: (vmintfix_t) z
+{
+	[self writeMotion: 1 axes: RS274AxisZ position: v3iCreate(0, 0, z.x, z.shift)];
+}
+
+- (BOOL) close
+{
+	if (!buffer)
+		return !errorNumber;
+
+	[self flush];
+
+	free(buffer);
+	buffer = NULL;
+
+	// per line counts are kept by the writer, and only added up when done
+	GM_METRIC_COUNT("rs274.write.lines", linesWritten);
+	GM_METRIC_COUNT("rs274.write.arcs", arcsWritten);
+
+	if (closeWhenDone && (fileDescriptor >= 0))
+	{
+		if ((close(fileDescriptor) != 0) && !errorNumber)
+			errorNumber = errno;
+		fileDescriptor = -1;
+	}
+
+	if (temporaryPath)
+	{
+		if (!errorNumber && (rename(temporaryPath.fileSystemRepresentation, destinationPath.fileSystemRepresentation) != 0))
+			errorNumber = errno;
+		if (errorNumber)
+			unlink(temporaryPath.fileSystemRepresentation);
+		temporaryPath = nil;
+	}
+
+	return !errorNumber;
+}
+
+@end
@@ -25,8 +25,18 @@ GfxMesh* LoadSTLFileFromData(NSData* data);
 
 @property(nonatomic, readonly) int scaleShift;
 
+/*!
+ Digest of the file data, scale and transform, equal for instances that slice identically.
+ */
+@property(nonatomic, readonly) NSData* contentDigest;
+
 - (instancetype) initWithData: (NSData*) data scale: (int) scaleBits transform: (matrix_t) M;
 
 - (NSArray*) lineSegmentsIntersectingZLayer: (v3i_t) zOffset;
 
+/*!
+ Bounds of the transformed vertices, unscaled.
+ */
+- (range3d_t) vertexBounds;
+
 @end
@@ -14,6 +14,8 @@
 #import "PriorityQueue.h"
 #import "FoundationExtensions.h"
 
+#import <CommonCrypto/CommonDigest.h>
+
 
 void LoadSTLFileFromDataRaw(NSData* data, size_t* outNumVertices, vector_t** outVertices, vector_t** outNormals, vector_t** outColors, size_t* outNumIndices, uint32_t** outIndices);
 
@@ -30,9 +32,10 @@ void LoadSTLFileFromDataRaw(NSData* data, size_t* outNumVertices, vector_t** out
 	NSArray*	vertices;
 
 	int			scaleShift;
+	NSData*		contentDigest;
 }
 
-@synthesize scaleShift;
+@synthesize scaleShift, contentDigest;
 
 /*
 static NSArray* _coalesceVertices(NSArray* vertices, uint32_t* indices, size_t numIndices)
@@ -127,6 +130,17 @@ static NSArray* _coalesceVertices(NSArray* vertices, uint32_t* indices, size_t n
 		
 	scaleShift = scaleBits;
 	
+	{
+		CC_SHA256_CTX ctx;
+		unsigned char digest[CC_SHA256_DIGEST_LENGTH];
+		CC_SHA256_Init(&ctx);
+		CC_SHA256_Update(&ctx, data.bytes, (CC_LONG)data.length);
+		CC_SHA256_Update(&ctx, &scaleBits, sizeof(scaleBits));
+		CC_SHA256_Update(&ctx, &M, sizeof(M));
+		CC_SHA256_Final(digest, &ctx);
+		contentDigest = [NSData dataWithBytes: digest length: sizeof(digest)];
+	}
+	
 	double scale = 1 << scaleShift;
 	
 	NSMutableArray* vArray = [NSMutableArray arrayWithCapacity: numVertices];
@@ -191,6 +205,23 @@ static NSArray* _coalesceVertices(NSArray* vertices, uint32_t* indices, size_t n
 	}];
 }
 
+- (range3d_t) vertexBounds
+{
+	if (!vertices.count)
+		return rCreateFromMinMax(vCreatePos(0.0, 0.0, 0.0), vCreatePos(0.0, 0.0, 0.0));
+
+	v3i_t minp = [(STLVertex*)[vertices objectAtIndex: 0] position];
+	v3i_t maxp = minp;
+	for (STLVertex* v in vertices)
+	{
+		minp = v3iMin(minp, v.position);
+		maxp = v3iMax(maxp, v.position);
+	}
+
+	double scale = 1.0/(1 << scaleShift);
+	return rCreateFromMinMax(vCreatePos(minp.x*scale, minp.y*scale, minp.z*scale), vCreatePos(maxp.x*scale, maxp.y*scale, maxp.z*scale));
+}
+
 - (NSArray*) lineSegmentsIntersectingZLayer: (v3i_t) zOffset
 {
 	NSMutableArray* segments = [NSMutableArray array];
@@ -0,0 +1,35 @@
+//
+//  ScanlineInfill.h
+//  Giddy Machinist
+//
+//  Created by Dömötör Gulyás on 19.10.2026.
+//  Copyright (c) 2026 Dömötör Gulyás. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class FixPolygon;
+
+/*!
+ @description Rectilinear infill of the area enclosed by the closed segments of a polygon, usually the innermost wavefront after the perimeters, by the even-odd rule. Works in the fixed point coordinates of the polygon: lines run along an integer direction vector, exact for multiples of 90°, and their crossings with the polygon are rounded to the nearest fixed point position.
+
+ Edges are kept in a table sorted by their start along the scan direction, and moved into and out of an active edge list line by line, so a layer of n edges costs O((n + lines) log n). Neighbouring lines are joined along the polygon into zig-zags wherever the polygon between their ends does not cross another line.
+ */
+@interface ScanlineInfill : NSObject
+
+@property(nonatomic) double spacing;		// between lines, in polygon units
+@property(nonatomic) double angle;			// of the lines in degrees, counterclockwise from the X axis
+@property(nonatomic) double layerAngle;		// added to angle for each layer, 90 for alternating layers
+@property(nonatomic) BOOL connectLines;		// YES by default
+
+/*!
+ Returns a polygon of open segments.
+ */
+- (FixPolygon*) infillPolygon: (FixPolygon*) polygon layerIndex: (long) layerIndex;
+
+/*!
+ Fills each polygon as its layer, in parallel. Entries may be NSNull for layers without infill, and are NSNull in the result, too.
+ */
+- (NSArray*) infillLayerPolygons: (NSArray*) polygons;
+
+@end
@@ -0,0 +1,515 @@
+//
+//  ScanlineInfill.m
+//  Giddy Machinist
+//
+//  Created by Dömötör Gulyás on 19.10.2026.
+//  Copyright (c) 2026 Dömötör Gulyás. All rights reserved.
+//
+
+#import "ScanlineInfill.h"
+
+#import "FixPolygon.h"
+#import "FoundationExtensions.h"
+
+
+#define INFILL_DIRECTION_SCALE 1024
+
+typedef struct {
+	int64_t x, y;
+} _InfillPoint;
+
+typedef struct {
+	const _InfillPoint*	points;
+	size_t				count;
+} _InfillLoop;
+
+typedef struct {
+	_InfillPoint*	points;
+	size_t			pointCount, pointCapacity;
+	size_t*			pathEnds;		// one past the last point of each path
+	size_t			pathCount, pathCapacity;
+} _InfillPaths;
+
+typedef struct {
+	int64_t	sLow, sHigh;
+	size_t	low, high;		// vertex indices at sLow and sHigh
+	size_t	loop, index;	// an edge has the index of its first vertex in loop order
+} _InfillEdge;
+
+typedef struct {
+	int64_t	x, y, t;
+	int64_t	line;
+	size_t	loop, index;
+	int64_t	order;			// position along the edge in loop order
+	size_t	link;			// index into the links, or SIZE_MAX
+} _InfillCrossing;
+
+typedef struct {
+	size_t	loop, index;
+	int64_t	order;
+	size_t	crossing;
+} _InfillLoopKey;
+
+typedef struct {
+	size_t	from, to;		// crossings, in loop order
+	int64_t	line;			// the lower of the two lines
+} _InfillLink;
+
+static int _compareEdges(const void* a, const void* b)
+{
+	const _InfillEdge* ea = a;
+	const _InfillEdge* eb = b;
+	return (ea->sLow > eb->sLow) - (ea->sLow < eb->sLow);
+}
+
+static int _compareCrossings(const void* a, const void* b)
+{
+	const _InfillCrossing* ca = a;
+	const _InfillCrossing* cb = b;
+	return (ca->t > cb->t) - (ca->t < cb->t);
+}
+
+static int _compareLoopKeys(const void* a, const void* b)
+{
+	const _InfillLoopKey* ka = a;
+	const _InfillLoopKey* kb = b;
+	if (ka->loop != kb->loop)
+		return (ka->loop > kb->loop) - (ka->loop < kb->loop);
+	if (ka->index != kb->index)
+		return (ka->index > kb->index) - (ka->index < kb->index);
+	return (ka->order > kb->order) - (ka->order < kb->order);
+}
+
+static int _compareLinks(const void* a, const void* b)
+{
+	const _InfillLink* la = a;
+	const _InfillLink* lb = b;
+	return (la->line > lb->line) - (la->line < lb->line);
+}
+
+static int64_t _floorDiv(int64_t a, int64_t b)
+{
+	int64_t q = a / b;
+	if ((a % b) && ((a < 0) != (b < 0)))
+		--q;
+	return q;
+}
+
+static int64_t _roundedDiv(__int128 num, __int128 den)
+{
+	assert(den > 0);
+	if (num >= 0)
+		return (int64_t)((num + den/2)/den);
+	else
+		return -(int64_t)((-num + den/2)/den);
+}
+
+static size_t _findSet(size_t* sets, size_t i)
+{
+	while (sets[i] != i)
+	{
+		sets[i] = sets[sets[i]];
+		i = sets[i];
+	}
+	return i;
+}
+
+static void _appendPoint(_InfillPaths* paths, int64_t x, int64_t y)
+{
+	size_t pathStart = paths->pathCount ? paths->pathEnds[paths->pathCount-1] : 0;
+	if (paths->pointCount > pathStart)
+	{
+		_InfillPoint last = paths->points[paths->pointCount-1];
+		if ((last.x == x) && (last.y == y))
+			return;
+	}
+	if (paths->pointCount == paths->pointCapacity)
+	{
+		paths->pointCapacity = paths->pointCapacity ? 2*paths->pointCapacity : 64;
+		paths->points = realloc(paths->points, paths->pointCapacity*sizeof(*paths->points));
+	}
+	paths->points[paths->pointCount++] = (_InfillPoint){x, y};
+}
+
+static void _endPath(_InfillPaths* paths)
+{
+	if (paths->pathCount == paths->pathCapacity)
+	{
+		paths->pathCapacity = paths->pathCapacity ? 2*paths->pathCapacity : 16;
+		paths->pathEnds = realloc(paths->pathEnds, paths->pathCapacity*sizeof(*paths->pathEnds));
+	}
+	paths->pathEnds[paths->pathCount++] = paths->pointCount;
+}
+
+/*!
+ Appends the loop vertices between the crossings of a link, in the direction of travel.
+ */
+static void _appendLinkVertices(_InfillPaths* paths, const _InfillLoop* loops, const _InfillCrossing* crossings, const _InfillLink* link, int reverse)
+{
+	const _InfillCrossing* from = crossings + link->from;
+	const _InfillCrossing* to = crossings + link->to;
+	const _InfillLoop* loop = loops + from->loop;
+	size_t n = loop->count;
+	size_t count = (to->index + n - from->index) % n;
+	if ((count == 0) && (from->order >= to->order))
+		count = n;
+
+	for (size_t k = 0; k < count; ++k)
+	{
+		size_t offset = reverse ? count - k : k + 1;
+		_InfillPoint p = loop->points[(from->index + offset) % n];
+		_appendPoint(paths, p.x, p.y);
+	}
+}
+
+/*!
+ Fills the area inside the loops, by the even-odd rule, with lines in direction (a, b), spacing apart along the normal (-b, a), in units of s = a*y - b*x. Lines are on multiples of spacing, so the pattern lines up between layers.
+ */
+static void _scanlineInfill(const _InfillLoop* loops, size_t loopCount, int64_t a, int64_t b, int64_t spacing, int connect, _InfillPaths* paths)
+{
+	size_t edgeCapacity = 0;
+	for (size_t i = 0; i < loopCount; ++i)
+		edgeCapacity += loops[i].count;
+
+	_InfillEdge* edges = calloc(edgeCapacity+1, sizeof(*edges));
+	size_t edgeCount = 0;
+
+	for (size_t l = 0; l < loopCount; ++l)
+	{
+		size_t n = loops[l].count;
+		if (n < 3)
+			continue;
+		for (size_t i = 0; i < n; ++i)
+		{
+			size_t j = (i+1) % n;
+			_InfillPoint p0 = loops[l].points[i], p1 = loops[l].points[j];
+			int64_t s0 = a*p0.y - b*p0.x;
+			int64_t s1 = a*p1.y - b*p1.x;
+			if (s0 == s1)
+				continue;
+			_InfillEdge edge = {.loop = l, .index = i};
+			if (s0 < s1)
+			{
+				edge.sLow = s0; edge.sHigh = s1; edge.low = i; edge.high = j;
+			}
+			else
+			{
+				edge.sLow = s1; edge.sHigh = s0; edge.low = j; edge.high = i;
+			}
+			edges[edgeCount++] = edge;
+		}
+	}
+
+	if (!edgeCount)
+	{
+		free(edges);
+		return;
+	}
+
+	// sorted edge table
+	qsort(edges, edgeCount, sizeof(*edges), _compareEdges);
+
+	int64_t sMax = edges[0].sHigh;
+	for (size_t i = 1; i < edgeCount; ++i)
+		sMax = edges[i].sHigh > sMax ? edges[i].sHigh : sMax;
+
+	// an edge crosses line S if sLow <= S < sHigh, so vertices on a line are counted once
+	int64_t firstLine = -_floorDiv(-edges[0].sLow, spacing);
+	int64_t lastLine = _floorDiv(sMax - 1, spacing);
+
+	size_t* active = calloc(edgeCount, sizeof(*active));
+	size_t activeCount = 0, nextEdge = 0;
+
+	_InfillCrossing* lineCrossings = calloc(edgeCount, sizeof(*lineCrossings));
+
+	// crossings are kept in pairs, crossings 2i and 2i+1 bound interval i
+	_InfillCrossing* crossings = NULL;
+	size_t crossingCount = 0, crossingCapacity = 0;
+
+	for (int64_t line = firstLine; line <= lastLine; ++line)
+	{
+		int64_t S = line*spacing;
+
+		size_t keep = 0;
+		for (size_t i = 0; i < activeCount; ++i)
+			if (edges[active[i]].sHigh > S)
+				active[keep++] = active[i];
+		activeCount = keep;
+
+		while ((nextEdge < edgeCount) && (edges[nextEdge].sLow <= S))
+		{
+			if (edges[nextEdge].sHigh > S)
+				active[activeCount++] = nextEdge;
+			++nextEdge;
+		}
+
+		for (size_t i = 0; i < activeCount; ++i)
+		{
+			const _InfillEdge* edge = edges + active[i];
+			const _InfillLoop* loop = loops + edge->loop;
+			_InfillPoint pl = loop->points[edge->low], ph = loop->points[edge->high];
+			__int128 ds = S - edge->sLow;
+			__int128 den = edge->sHigh - edge->sLow;
+			int64_t x = pl.x + _roundedDiv(ds*(ph.x - pl.x), den);
+			int64_t y = pl.y + _roundedDiv(ds*(ph.y - pl.y), den);
+			lineCrossings[i] = (_InfillCrossing){
+				.x = x, .y = y, .t = a*x + b*y,
+				.line = line,
+				.loop = edge->loop, .index = edge->index,
+				.order = (edge->low == edge->index) ? line : -line,
+				.link = SIZE_MAX,
+			};
+		}
+
+		qsort(lineCrossings, activeCount, sizeof(*lineCrossings), _compareCrossings);
+
+		for (size_t i = 0; i+1 < activeCount; i += 2)
+		{
+			if (lineCrossings[i].t == lineCrossings[i+1].t)
+				continue;
+			if (crossingCount + 2 > crossingCapacity)
+			{
+				crossingCapacity = crossingCapacity ? 2*crossingCapacity : 64;
+				crossings = realloc(crossings, crossingCapacity*sizeof(*crossings));
+			}
+			crossings[crossingCount++] = lineCrossings[i];
+			crossings[crossingCount++] = lineCrossings[i+1];
+		}
+	}
+
+	free(lineCrossings);
+	free(active);
+	free(edges);
+
+	size_t intervalCount = crossingCount/2;
+
+	_InfillLink* links = NULL;
+	size_t linkCount = 0;
+
+	if (connect && crossingCount)
+	{
+		// consecutive crossings along a loop on neighbouring lines are joined by the loop between them, which does not cross any other line
+		_InfillLoopKey* keys = calloc(crossingCount, sizeof(*keys));
+		for (size_t i = 0; i < crossingCount; ++i)
+			keys[i] = (_InfillLoopKey){crossings[i].loop, crossings[i].index, crossings[i].order, i};
+		qsort(keys, crossingCount, sizeof(*keys), _compareLoopKeys);
+
+		links = calloc(crossingCount, sizeof(*links));
+
+		size_t loopStart = 0;
+		while (loopStart < crossingCount)
+		{
+			size_t loopEnd = loopStart+1;
+			while ((loopEnd < crossingCount) && (keys[loopEnd].loop == keys[loopStart].loop))
+				++loopEnd;
+
+			size_t n = loopEnd - loopStart;
+			for (size_t i = 0; (n > 1) && (i < n); ++i)
+			{
+				size_t from = keys[loopStart + i].crossing;
+				size_t to = keys[loopStart + (i+1) % n].crossing;
+				int64_t dl = crossings[to].line - crossings[from].line;
+				if ((dl == 1) || (dl == -1))
+					links[linkCount++] = (_InfillLink){from, to, dl > 0 ? crossings[from].line : crossings[to].line};
+			}
+			loopStart = loopEnd;
+		}
+		free(keys);
+
+		// greedily from the bottom, never closing a cycle, so every connected set of intervals forms one path
+		qsort(links, linkCount, sizeof(*links), _compareLinks);
+
+		size_t* sets = calloc(intervalCount, sizeof(*sets));
+		for (size_t i = 0; i < intervalCount; ++i)
+			sets[i] = i;
+
+		for (size_t i = 0; i < linkCount; ++i)
+		{
+			_InfillCrossing* from = crossings + links[i].from;
+			_InfillCrossing* to = crossings + links[i].to;
+			if ((from->link != SIZE_MAX) || (to->link != SIZE_MAX))
+				continue;
+			size_t setFrom = _findSet(sets, links[i].from/2);
+			size_t setTo = _findSet(sets, links[i].to/2);
+			if (setFrom == setTo)
+				continue;
+			sets[setFrom] = setTo;
+			from->link = i;
+			to->link = i;
+		}
+		free(sets);
+	}
+
+	uint8_t* visited = calloc(intervalCount+1, 1);
+
+	for (size_t i = 0; i < intervalCount; ++i)
+	{
+		if (visited[i])
+			continue;
+
+		size_t start = SIZE_MAX;
+		if (crossings[2*i].link == SIZE_MAX)
+			start = 2*i;
+		else if (crossings[2*i+1].link == SIZE_MAX)
+			start = 2*i+1;
+		else
+			continue; // in the middle of a path, reached from one of its ends
+
+		if (!connect && (crossings[start].line & 1))
+			start ^= 1; // alternate direction on unconnected lines
+
+		size_t current = start;
+		while (1)
+		{
+			size_t other = current ^ 1;
+			visited[current/2] = 1;
+			_appendPoint(paths, crossings[current].x, crossings[current].y);
+			_appendPoint(paths, crossings[other].x, crossings[other].y);
+
+			size_t linkIndex = crossings[other].link;
+			if (linkIndex == SIZE_MAX)
+				break;
+			const _InfillLink* link = links + linkIndex;
+			int reverse = (link->to == other);
+			_appendLinkVertices(paths, loops, crossings, link, reverse);
+			current = reverse ? link->from : link->to;
+		}
+		_endPath(paths);
+	}
+
+	free(visited);
+	free(links);
+	free(crossings);
+}
+
+static int64_t _gcd(int64_t a, int64_t b)
+{
+	a = llabs(a);
+	b = llabs(b);
+	while (b)
+	{
+		int64_t r = a % b;
+		a = b;
+		b = r;
+	}
+	return a;
+}
+
+static void _directionForAngle(double degrees, int64_t* a, int64_t* b)
+{
+	double quarters = degrees/90.0;
+	if (quarters == floor(quarters))
+	{
+		static const int64_t directions[4][2] = {{1, 0}, {0, 1}, {-1, 0}, {0, -1}};
+		long q = (((long)quarters % 4) + 4) % 4;
+		*a = directions[q][0];
+		*b = directions[q][1];
+		return;
+	}
+
+	double radians = degrees*M_PI/180.0;
+	int64_t x = llround(cos(radians)*INFILL_DIRECTION_SCALE);
+	int64_t y = llround(sin(radians)*INFILL_DIRECTION_SCALE);
+	int64_t d = _gcd(x, y);
+	*a = x/d;
+	*b = y/d;
+}
+
+
+@implementation ScanlineInfill
+
+@synthesize spacing, angle, layerAngle, connectLines;
+
+- (id) init
+{
+	if (!(self = [super init]))
+		return nil;
+
+	spacing = 1.0;
+	angle = 45.0;
+	layerAngle = 90.0;
+	connectLines = YES;
+
+	return self;
+}
+
+- (FixPolygon*) infillPolygon: (FixPolygon*) polygon layerIndex: (long) layerIndex
+{
+	NSArray* closedSegments = [polygon.segments select: ^BOOL(FixPolygonSegment* segment) {
+		return [segment isClosed] && (segment.vertexCount > 2);
+	}];
+
+	FixPolygon* infill = [[FixPolygon alloc] init];
+	infill.segments = @[];
+
+	if (!closedSegments.count)
+		return infill;
+
+	v3i_t origin = [[closedSegments objectAtIndex: 0] vertices][0];
+
+	size_t loopCount = closedSegments.count;
+	_InfillLoop* loops = calloc(loopCount, sizeof(*loops));
+	for (size_t i = 0; i < loopCount; ++i)
+	{
+		FixPolygonSegment* segment = [closedSegments objectAtIndex: i];
+		v3i_t* vertices = segment.vertices;
+		_InfillPoint* points = calloc(segment.vertexCount, sizeof(*points));
+		for (size_t j = 0; j < segment.vertexCount; ++j)
+			points[j] = (_InfillPoint){vertices[j].x, vertices[j].y};
+		loops[i] = (_InfillLoop){points, segment.vertexCount};
+	}
+
+	int64_t a = 0, b = 0;
+	_directionForAngle(angle + layerIndex*layerAngle, &a, &b);
+
+	// the normal (-b, a) is not of unit length, so neither is the spacing along it
+	int64_t lineSpacing = MAX(1, llround(ldexp(spacing, origin.shift)*sqrt((double)(a*a + b*b))));
+
+	_InfillPaths paths = {0};
+	_scanlineInfill(loops, loopCount, a, b, lineSpacing, connectLines, &paths);
+
+	NSMutableArray* segments = [NSMutableArray arrayWithCapacity: paths.pathCount];
+	size_t start = 0;
+	for (size_t i = 0; i < paths.pathCount; ++i)
+	{
+		size_t end = paths.pathEnds[i];
+		FixPolygonOpenSegment* segment = [[FixPolygonOpenSegment alloc] init];
+		for (size_t j = start; j < end; ++j)
+			[segment insertVertexAtEnd: v3iCreate((vmint_t)paths.points[j].x, (vmint_t)paths.points[j].y, origin.z, origin.shift)];
+		[segments addObject: segment];
+		start = end;
+	}
+	infill.segments = segments;
+
+	free(paths.points);
+	free(paths.pathEnds);
+	for (size_t i = 0; i < loopCount; ++i)
+		free((void*)loops[i].points);
+	free(loops);
+
+	return infill;
+}
+
+- (NSArray*) infillLayerPolygons: (NSArray*) polygons
+{
+	NSMutableArray* results = [NSMutableArray arrayWithCapacity: polygons.count];
+	for (size_t i = 0; i < polygons.count; ++i)
+		[results addObject: [NSNull null]];
+
+	dispatch_apply(polygons.count, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+		FixPolygon* polygon = [polygons objectAtIndex: i];
+		if ([polygon isEqual: [NSNull null]])
+			return;
+
+		FixPolygon* infill = [self infillPolygon: polygon layerIndex: i];
+
+		@synchronized(results)
+		{
+			[results replaceObjectAtIndex: i withObject: infill];
+		}
+	});
+
+	return results;
+}
+
+@end
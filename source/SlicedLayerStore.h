@@ -0,0 +1,46 @@
+//
+//  SlicedLayerStore.h
+//  Giddy Machinist
+//
+//  Created by Dömötör Gulyás on 19.10.2026.
+//  Copyright (c) 2026 Dömötör Gulyás. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class SlicedLayer;
+
+/*!
+ @description Keeps the sliced layers of a document in an unlinked scratch file, with only a working set of recently used layers in memory, so that memory use depends on the layers being worked on and not on the height of the part.
+
+ Layers are written through when added, in their compacted binary form, and are kept sorted by Z. Evicting a layer drops the reference and the layer's materialized outlines, asking for it again reads it back. The size of a layer is measured again whenever it is used, as its outlines and preview mesh are created on demand. Adding does not change the layer, and writes to the file, so it belongs on a background queue. Layers whose outlines carry a skeleton cannot be serialized, and stay resident. Layers handed out are treated as read-only, changes to them are lost when they are evicted.
+ */
+@interface SlicedLayerStore : NSObject
+
+/*!
+ The scratch file is created in the temporary directory, and is gone once the store is deallocated or the process exits.
+ */
+- (instancetype) init;
+
+/*!
+ Bytes of layer data kept in memory, the most recently used layer is kept regardless.
+ */
+@property(nonatomic) size_t residentByteLimit;
+
+@property(nonatomic, readonly) size_t residentBytes;
+@property(nonatomic, readonly) size_t scratchFileBytes;
+
+- (void) addLayer: (SlicedLayer*) layer;
+
+@property(nonatomic, readonly) size_t layerCount;
+- (double) layerZAtIndex: (size_t) index;
+- (SlicedLayer*) layerAtIndex: (size_t) index;
+
+/*!
+ Index of the layer closest to z, or NSNotFound if the store is empty.
+ */
+- (size_t) indexOfLayerNearestZ: (double) z;
+
+- (void) removeAllLayers;
+
+@end
@@ -0,0 +1,288 @@
+//
+//  SlicedLayerStore.m
+//  Giddy Machinist
+//
+//  Created by Dömötör Gulyás on 19.10.2026.
+//  Copyright (c) 2026 Dömötör Gulyás. All rights reserved.
+//
+
+#import "SlicedLayerStore.h"
+
+#import "Slicer.h"
+#import "GMMetrics.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+
+#define LAYERSTORE_DEFAULT_RESIDENT_BYTES (64*1024*1024)
+
+
+@interface _SlicedLayerStoreEntry : NSObject
+{
+@public
+	double		z;
+	off_t		offset;		// -1 while only in memory
+	size_t		length;
+	size_t		byteSize;	// memory held while resident, as last measured
+	SlicedLayer*	layer;	// nil when evicted
+}
+@end
+
+@implementation _SlicedLayerStoreEntry
+@end
+
+
+static BOOL _writeAll(int fd, const void* bytes, size_t length, off_t offset)
+{
+	size_t k = 0;
+	while (k < length)
+	{
+		ssize_t n = pwrite(fd, (const char*)bytes + k, length - k, offset + k);
+		if (n < 0)
+		{
+			if (errno != EINTR)
+				return NO;
+		}
+		else
+			k += n;
+	}
+	return YES;
+}
+
+static BOOL _readAll(int fd, void* bytes, size_t length, off_t offset)
+{
+	size_t k = 0;
+	while (k < length)
+	{
+		ssize_t n = pread(fd, (char*)bytes + k, length - k, offset + k);
+		if (n < 0)
+		{
+			if (errno != EINTR)
+				return NO;
+		}
+		else if (n == 0)
+			return NO;
+		else
+			k += n;
+	}
+	return YES;
+}
+
+
+@implementation SlicedLayerStore
+{
+	int				fileDescriptor;
+	off_t			fileEnd;
+
+	NSMutableArray*	entries;		// sorted by z
+	NSMutableArray*	recentlyUsed;	// evictable resident entries, least recent first
+}
+
+@synthesize residentByteLimit, residentBytes;
+
+- (instancetype) init
+{
+	if (!(self = [super init]))
+		return nil;
+
+	residentByteLimit = LAYERSTORE_DEFAULT_RESIDENT_BYTES;
+
+	entries = [NSMutableArray array];
+	recentlyUsed = [NSMutableArray array];
+
+	NSString* template = [NSTemporaryDirectory() stringByAppendingPathComponent: @"GiddyMachinistLayers.XXXXXX"];
+	char* path = strdup(template.fileSystemRepresentation);
+
+	fileDescriptor = mkstemp(path);
+	if (fileDescriptor >= 0)
+		unlink(path); // the open descriptor keeps it alive, and nothing is left behind on a crash
+	else
+		NSLog(@"failed to create layer scratch file, keeping all layers in memory: %s", strerror(errno));
+
+	free(path);
+
+	return self;
+}
+
+- (void) dealloc
+{
+	if (fileDescriptor >= 0)
+		close(fileDescriptor);
+}
+
+- (size_t) scratchFileBytes
+{
+	@synchronized(self) {
+		return fileEnd;
+	}
+}
+
+- (size_t) layerCount
+{
+	@synchronized(self) {
+		return entries.count;
+	}
+}
+
+/*!
+ Layers grow after they are added, as outlines are materialized and meshes cached, so their size is taken again whenever they are touched or evicted.
+ */
+- (void) measureEntry: (_SlicedLayerStoreEntry*) entry
+{
+	size_t bytes = entry->layer.byteSize;
+	residentBytes = residentBytes - entry->byteSize + bytes;
+	entry->byteSize = bytes;
+}
+
+- (void) evictToLimit
+{
+	while ((residentBytes > residentByteLimit) && (recentlyUsed.count > 1))
+	{
+		_SlicedLayerStoreEntry* entry = [recentlyUsed objectAtIndex: 0];
+		[recentlyUsed removeObjectAtIndex: 0];
+
+		[self measureEntry: entry];
+		residentBytes -= entry->byteSize;
+		entry->byteSize = 0;
+		
+		// the layer may still be held elsewhere, but need not keep its outlines twice
+		[entry->layer compactOutlines];
+		entry->layer = nil;
+
+		GM_METRIC_COUNT("layerStore.evictions", 1);
+	}
+
+	GM_METRIC_GAUGE("layerStore.residentBytes", residentBytes);
+}
+
+- (void) touchEntry: (_SlicedLayerStoreEntry*) entry
+{
+	[self measureEntry: entry];
+
+	if (entry->offset < 0)
+		return; // pinned, not in the LRU list
+
+	[recentlyUsed removeObjectIdenticalTo: entry];
+	[recentlyUsed addObject: entry];
+}
+
+- (void) setResidentByteLimit: (size_t) limit
+{
+	@synchronized(self) {
+		residentByteLimit = limit;
+		[self evictToLimit];
+	}
+}
+
+- (void) addLayer: (SlicedLayer*) layer
+{
+	NSData* data = (fileDescriptor >= 0) ? [layer serializedData] : nil;
+
+	@synchronized(self) {
+		_SlicedLayerStoreEntry* entry = [[_SlicedLayerStoreEntry alloc] init];
+		entry->z = layer.layerZ;
+		entry->offset = -1;
+		entry->layer = layer;
+
+		if (data && _writeAll(fileDescriptor, data.bytes, data.length, fileEnd))
+		{
+			entry->offset = fileEnd;
+			entry->length = data.length;
+			fileEnd += data.length;
+
+			GM_METRIC_COUNT("layerStore.bytesWritten", data.length);
+		}
+		else if (data)
+			NSLog(@"failed to write layer at z = %f to scratch file, keeping it in memory: %s", layer.layerZ, strerror(errno));
+
+		// layers mostly arrive in order, so search from the top
+		NSUInteger index = entries.count;
+		while (index && (((_SlicedLayerStoreEntry*)[entries objectAtIndex: index-1])->z > entry->z))
+			--index;
+		[entries insertObject: entry atIndex: index];
+
+		[self touchEntry: entry];
+		[self evictToLimit];
+	}
+}
+
+- (double) layerZAtIndex: (size_t) index
+{
+	@synchronized(self) {
+		_SlicedLayerStoreEntry* entry = [entries objectAtIndex: index];
+		return entry->z;
+	}
+}
+
+- (SlicedLayer*) layerAtIndex: (size_t) index
+{
+	@synchronized(self) {
+		_SlicedLayerStoreEntry* entry = [entries objectAtIndex: index];
+
+		if (!entry->layer)
+		{
+			void* bytes = malloc(entry->length);
+			if (_readAll(fileDescriptor, bytes, entry->length, entry->offset))
+				entry->layer = [[SlicedLayer alloc] initWithSerializedBytes: bytes length: entry->length];
+			free(bytes);
+
+			if (!entry->layer)
+			{
+				NSLog(@"failed to read layer at z = %f from scratch file", entry->z);
+				return nil;
+			}
+
+			GM_METRIC_COUNT("layerStore.loads", 1);
+			GM_METRIC_COUNT("layerStore.bytesRead", entry->length);
+		}
+
+		SlicedLayer* layer = entry->layer;
+
+		[self touchEntry: entry];
+		[self evictToLimit];
+
+		return layer;
+	}
+}
+
+- (size_t) indexOfLayerNearestZ: (double) z
+{
+	@synchronized(self) {
+		size_t count = entries.count;
+		if (!count)
+			return NSNotFound;
+
+		// first entry at or above z
+		size_t lo = 0, hi = count;
+		while (lo < hi)
+		{
+			size_t mid = (lo + hi)/2;
+			if (((_SlicedLayerStoreEntry*)[entries objectAtIndex: mid])->z < z)
+				lo = mid+1;
+			else
+				hi = mid;
+		}
+
+		if (lo == count)
+			return count-1;
+		if ((lo > 0) && (z - ((_SlicedLayerStoreEntry*)[entries objectAtIndex: lo-1])->z < ((_SlicedLayerStoreEntry*)[entries objectAtIndex: lo])->z - z))
+			return lo-1;
+		return lo;
+	}
+}
+
+- (void) removeAllLayers
+{
+	@synchronized(self) {
+		[entries removeAllObjects];
+		[recentlyUsed removeAllObjects];
+		residentBytes = 0;
+
+		if (fileDescriptor >= 0)
+			ftruncate(fileDescriptor, 0);
+		fileEnd = 0;
+	}
+}
+
+@end
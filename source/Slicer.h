@@ -10,19 +10,48 @@
 
 #import "VectorMath.h"
 
-@class GfxMesh, STLFile;
+@class GfxMesh, STLFile, FixContourStore, GMCancellationToken;
 
 
-@interface SlicedLayer : NSObject
+@interface SlicedLayer : NSObject <NSCopying>
 
 @property(nonatomic, strong) NSArray* outlinePaths;
 @property(nonatomic, strong) NSArray* openPaths;
 @property(nonatomic) double layerZ;
 
+/*!
+ When compacted, the outlines are kept only in the contour store, and outlinePaths is recreated from it on first access, which is safe from any thread.
+ */
+@property(nonatomic, strong, readonly) FixContourStore* contourStore;
+
+/*!
+ Moves the outlines into a compact contour store, or drops the outlines recreated from it. Does nothing if any outline already carries a skeleton, as that would be lost.
+ */
+- (void) compactOutlines;
+
+/*!
+ The preview mesh of the outlines and open paths is built once and cached, until either is replaced. Offset outlines and finished skeletons of the outlines are appended to it as they arrive, so the same, possibly grown, mesh is returned on later calls.
+ */
 - (GfxMesh*) gfxMesh;
 
 @property(nonatomic) double mergeThreshold;
 
+/*!
+ Copies are compacted, and share the contour store of a compacted layer, as it is never changed. Cached meshes and skeletons are not copied.
+ */
+- (instancetype) copyWithZone: (NSZone*) zone;
+
+/*!
+ Binary form of the compacted layer and its open paths, for spilling to a scratch file. Layers whose outlines carry a skeleton cannot be compacted, and return nil.
+ */
+- (NSData*) serializedData;
+- (instancetype) initWithSerializedBytes: (const void*) bytes length: (size_t) length;
+
+/*!
+ Estimate of the memory held by the outlines and open paths.
+ */
+@property(nonatomic, readonly) size_t byteSize;
+
 @end
 
 
@@ -36,5 +65,17 @@
 - (void) asyncSliceSTL: (STLFile*) model intoLayers: (NSArray*) layers layersWithCallbackOnQueue: (dispatch_queue_t) queue block: (void (^)(id)) callback;
 
 @property(nonatomic) double mergeThreshold;
+@property(nonatomic) double simplificationTolerance;
+
+/*!
+ Checked before and during the work on each layer, cancelled layers are not passed to the callback. Receives one unit of progress per layer. Layers are sliced on the shared plate scheduler, in no particular order, and layers of identical models are shared.
+ */
+@property(nonatomic, strong) GMCancellationToken* cancellationToken;
+
+/*!
+ The stages of slicing a layer, run by asyncSliceSTL:... for each layer. Segments are joined into outlines, which are then nested into outlines with holes.
+ */
+- (SlicedLayer*) connectSegments: (NSArray*) segments;
+- (SlicedLayer*) nestPaths: (SlicedLayer*) inLayer;
 
 @end
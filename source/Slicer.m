@@ -14,6 +14,10 @@
 #import "FixPolygon.h"
 #import "PolygonSkeletizer.h"
 #import "STLFile.h"
+#import "FixContourStore.h"
+#import "GMMetrics.h"
+#import "GMCancellationToken.h"
+#import "GMPlateScheduler.h"
 
 /*
 static void _sliceZLayer(OctreeNode* node, vector_t* vertices, double zh, NSMutableArray* outSegments)
@@ -60,7 +64,7 @@ static void _sliceZLayer(OctreeNode* node, vector_t* vertices, double zh, NSMuta
 */
 @implementation Slicer
 
-@synthesize mergeThreshold;
+@synthesize mergeThreshold, simplificationTolerance, cancellationToken;
 
 - (id) init
 {
@@ -68,6 +72,7 @@ static void _sliceZLayer(OctreeNode* node, vector_t* vertices, double zh, NSMuta
 		return nil;
 
 	mergeThreshold = 0.01;
+	simplificationTolerance = 0.01;
 	
 	return self;
 }
@@ -115,8 +120,10 @@ static void _sliceZLayer(OctreeNode* node, vector_t* vertices, double zh, NSMuta
 */
 - (void) asyncSliceSTL: (STLFile*) model intoLayers: (NSArray*) layers layersWithCallbackOnQueue: (dispatch_queue_t) queue block: (void (^)(id)) callback;
 {
-	//	dispatch_queue_t workQueue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
-	dispatch_queue_t workQueue = dispatch_queue_create("com.elmonkey.giddy-machinist.slicing", 0);
+	GMPlateScheduler* scheduler = [GMPlateScheduler sharedScheduler];
+	
+	GMCancellationToken* token = cancellationToken;
+	[token addUnitsOfWork: layers.count];
 	
 	for (NSNumber* layerZ in layers)
 	{
@@ -125,38 +132,59 @@ static void _sliceZLayer(OctreeNode* node, vector_t* vertices, double zh, NSMuta
 		vmint_t fixheight = height*(1 << model.scaleShift);
 		v3i_t zOffset = v3iCreate(0, 0, fixheight, model.scaleShift);
 		
-		dispatch_async(workQueue, ^{
-			@autoreleasepool {
-				
-				NSArray* segments = [model lineSegmentsIntersectingZLayer: zOffset];
-				
-				segments = [segments map: ^id(NSArray* obj) {
-					assert(obj.count == 2);
-					STLVertex* v0 = [obj objectAtIndex: 0];
-					STLVertex* v1 = [obj objectAtIndex: 1];
-					v3i_t v[2] = {v0.position, v1.position};
-					
-					FixPolygonOpenSegment* segment = [[FixPolygonOpenSegment alloc] init];
-					[segment addVertices: v count: 2];
-					return segment;
-				}];
-				
-				SlicedLayer* layer = [self connectSegments: segments];
-				layer.layerZ = height;
-				layer.mergeThreshold = mergeThreshold;
-				layer = [self nestPaths: layer];
-				
-				
-				dispatch_async(queue, ^{
-					@autoreleasepool {
-						callback(layer);
-					}
-				});
-			}
-		});
-		
-		
+		// identical models on the plate slice to identical layers, which are only computed once
+		double parameters[3] = {height, mergeThreshold, simplificationTolerance};
+		NSData* key = GMPlateJobKey(model.contentDigest, parameters, 3);
 		
+		[scheduler addJobForStage: GMPlateStageSlice owner: model z: height key: key cancellationToken: token work: ^id(GMCancellationToken* jobToken) {
+			
+			uint64_t sliceStart = GM_METRIC_TIMER_START();
+			NSArray* segments = [model lineSegmentsIntersectingZLayer: zOffset];
+			GM_METRIC_TIMER_STOP("slicer.layerSlicing", sliceStart);
+			GM_METRIC_COUNT("slicer.layers", 1);
+			GM_METRIC_COUNT("slicer.segments", segments.count);
+			
+			segments = [segments map: ^id(NSArray* obj) {
+				assert(obj.count == 2);
+				STLVertex* v0 = [obj objectAtIndex: 0];
+				STLVertex* v1 = [obj objectAtIndex: 1];
+				v3i_t v[2] = {v0.position, v1.position};
+				
+				FixPolygonOpenSegment* segment = [[FixPolygonOpenSegment alloc] init];
+				[segment addVertices: v count: 2];
+				return segment;
+			}];
+			
+			// the job may be run for the submission of another slicer, so it checks the token it is run with
+			Slicer* jobSlicer = [[Slicer alloc] init];
+			jobSlicer.mergeThreshold = mergeThreshold;
+			jobSlicer.simplificationTolerance = simplificationTolerance;
+			jobSlicer.cancellationToken = jobToken;
+			
+			SlicedLayer* layer = [jobSlicer connectSegments: segments];
+			layer.layerZ = height;
+			layer.mergeThreshold = mergeThreshold;
+			if (!jobToken.isCancelled)
+				layer = [jobSlicer nestPaths: layer];
+			
+			// the result is shared, its outlines are kept in the immutable contour store, which its copies share
+			[layer compactOutlines];
+			
+			return layer;
+			
+		} completion: ^(SlicedLayer* sharedLayer) {
+			
+			[token completeUnitsOfWork: 1];
+			
+			// receivers cache meshes on and attach skeletons to the layer, so each gets its own
+			SlicedLayer* layer = [sharedLayer copy];
+			
+			dispatch_async(queue, ^{
+				@autoreleasepool {
+					callback(layer);
+				}
+			});
+		}];
 	}
 	
 }
@@ -164,6 +192,7 @@ static void _sliceZLayer(OctreeNode* node, vector_t* vertices, double zh, NSMuta
 
 - (SlicedLayer*) nestPaths: (SlicedLayer* ) inLayer
 {
+	uint64_t nestingStart = GM_METRIC_TIMER_START();
 	NSMutableArray* inPaths = [inLayer.outlinePaths mutableCopy];
 	NSMutableArray* outerPaths = [NSMutableArray array];
 	while ([inPaths count])
@@ -203,6 +232,8 @@ static void _sliceZLayer(OctreeNode* node, vector_t* vertices, double zh, NSMuta
 	
 	inLayer.outlinePaths = outerPaths;
 	
+	GM_METRIC_TIMER_STOP("slicer.nesting", nestingStart);
+	
 	return inLayer;
 
 }
@@ -251,6 +282,8 @@ static vector_t _lineSegmentDistanceScore(SlicedLineSegment* segment0, SlicedLin
 	if (![segments count])
 		return layer;
 	
+	uint64_t joiningStart = GM_METRIC_TIMER_START();
+	
 	NSMutableArray* openPaths = [NSMutableArray array];
 	
 	NSMutableArray* closedPaths = [NSMutableArray array];
@@ -259,6 +292,10 @@ static vector_t _lineSegmentDistanceScore(SlicedLineSegment* segment0, SlicedLin
 	
 	while ([unprocessedSegments count])
 	{
+		// joining is quadratic in the segment count, a cancelled layer is thrown away anyway
+		if (cancellationToken.isCancelled)
+			break;
+		
 		BOOL foundMerge = NO;
 		FixPolygonOpenSegment* referenceSegment = [unprocessedSegments lastObject];
 		[unprocessedSegments removeLastObject];
@@ -364,6 +401,16 @@ static vector_t _lineSegmentDistanceScore(SlicedLineSegment* segment0, SlicedLin
 		return outline;
 	}];
 	
+	// remove vertices within tolerance, so that the skeletizer doesn't see near colinear vertices, checking against all outlines in the layer to preserve nesting
+	if (simplificationTolerance > 0.0)
+	{
+		FixPolygon* outlines = [[FixPolygon alloc] init];
+		outlines.segments = [layer.outlinePaths map: ^id(SlicedOutline* obj) {
+			return obj.outline;
+		}];
+		[outlines simplifyWithTolerance: simplificationTolerance];
+	}
+	
 	layer.outlinePaths = [layer.outlinePaths select: ^BOOL(SlicedOutline* obj) {
 		size_t vc = obj.outline.vertexCount;
 		return vc;
@@ -371,6 +418,10 @@ static vector_t _lineSegmentDistanceScore(SlicedLineSegment* segment0, SlicedLin
 	
 	layer.openPaths = openPaths;
 	
+	GM_METRIC_TIMER_STOP("slicer.segmentJoining", joiningStart);
+	GM_METRIC_COUNT("slicer.closedOutlines", layer.outlinePaths.count);
+	GM_METRIC_COUNT("slicer.openPaths", openPaths.count);
+	
 	return layer;
 }
 
@@ -393,96 +444,381 @@ static vector_t _lineSegmentDistanceScore(SlicedLineSegment* segment0, SlicedLin
 
 
 
+/*!
+ What has been appended to a cached layer mesh for the skeleton of one outline.
+ */
+@interface _SlicedLayerSkeletonMeshState : NSObject
+{
+@public
+	PolygonSkeletizer*	skeleton;
+	size_t				offsetMeshCount;
+	BOOL				skeletonMeshAppended;
+}
+@end
+
+@implementation _SlicedLayerSkeletonMeshState
+@end
+
+
 @implementation SlicedLayer
+{
+	GfxMesh*		meshCache;
+	NSMutableArray*	meshSkeletonStates; // one per outline
+	size_t			meshBytes;			// of the outline mesh, appended skeleton meshes are held by their skeletons
+}
 
-@synthesize outlinePaths, openPaths;
+@synthesize outlinePaths, openPaths, contourStore;
 
-- (GfxMesh*) gfxMesh
+- (NSArray*) outlinePaths
+{
+	// layers are read from the main queue and workers alike, and must not materialize twice
+	@synchronized(self) {
+		if (!outlinePaths && contourStore)
+			outlinePaths = [contourStore outlines];
+		return outlinePaths;
+	}
+}
+
+- (void) setOutlinePaths: (NSArray*) paths
+{
+	@synchronized(self) {
+		outlinePaths = paths;
+		contourStore = nil;
+	}
+	[self invalidateMesh];
+}
+
+- (void) setOpenPaths: (NSArray*) paths
+{
+	openPaths = paths;
+	[self invalidateMesh];
+}
+
+- (void) compactOutlines
+{
+	@synchronized(self) {
+		if (!outlinePaths)
+			return;
+
+		for (SlicedOutline* outline in outlinePaths)
+			if (outline.skeleton)
+				return;
+
+		// outlines materialized from the store are only dropped again
+		if (!contourStore)
+			contourStore = [[FixContourStore alloc] initWithOutlines: outlinePaths];
+		outlinePaths = nil;
+	}
+}
+
+typedef struct {
+	uint32_t	magic;
+	uint32_t	openPathCount;
+	double		layerZ, mergeThreshold;
+	uint64_t	storeLength;
+} _SlicedLayerHeader;
+
+#define SLICEDLAYER_MAGIC 0x534c4131 // 'SLA1'
+
+- (NSData*) serializedData
+{
+	FixContourStore* store = nil;
+	
+	// the layer itself is left as it is, it may be in use elsewhere
+	@synchronized(self) {
+		store = contourStore;
+		if (!store)
+		{
+			for (SlicedOutline* outline in outlinePaths)
+				if (outline.skeleton)
+					return nil;
+			store = [[FixContourStore alloc] initWithOutlines: outlinePaths ? outlinePaths : @[]];
+		}
+	}
+
+	NSData* storeData = [store serializedData];
+
+	_SlicedLayerHeader header = {SLICEDLAYER_MAGIC, (uint32_t)openPaths.count, self.layerZ, self.mergeThreshold, storeData.length};
+
+	NSMutableData* data = [NSMutableData dataWithCapacity: sizeof(header) + storeData.length];
+	[data appendBytes: &header length: sizeof(header)];
+	[data appendData: storeData];
+
+	for (FixPolygonOpenSegment* segment in openPaths)
+	{
+		uint32_t count = (uint32_t)segment.vertexCount;
+		[data appendBytes: &count length: sizeof(count)];
+		[data appendBytes: segment.vertices length: count*sizeof(v3i_t)];
+	}
+
+	return data;
+}
+
+- (instancetype) copyWithZone: (NSZone*) zone
+{
+	SlicedLayer* layer = [[SlicedLayer allocWithZone: zone] init];
+	
+	// the store is never changed after creation, so it can be shared, otherwise a store is a deep copy of the outlines' geometry
+	FixContourStore* store = contourStore;
+	layer->contourStore = store ? store : [[FixContourStore alloc] initWithOutlines: outlinePaths ? outlinePaths : @[]];
+	
+	layer->openPaths = [openPaths map: ^id(FixPolygonOpenSegment* segment) {
+		return [segment copy];
+	}];
+	layer.layerZ = self.layerZ;
+	layer.mergeThreshold = self.mergeThreshold;
+	
+	return layer;
+}
+
+- (instancetype) initWithSerializedBytes: (const void*) bytes length: (size_t) length
+{
+	if (!(self = [super init]))
+		return nil;
+
+	_SlicedLayerHeader header;
+	if (length < sizeof(header))
+		return nil;
+	memcpy(&header, bytes, sizeof(header));
+
+	if ((header.magic != SLICEDLAYER_MAGIC) || (header.storeLength > length - sizeof(header)))
+		return nil;
+
+	const char* p = (const char*)bytes + sizeof(header);
+	const char* end = (const char*)bytes + length;
+
+	contourStore = [[FixContourStore alloc] initWithSerializedBytes: p length: header.storeLength];
+	if (!contourStore)
+		return nil;
+	p += header.storeLength;
+
+	NSMutableArray* paths = [NSMutableArray arrayWithCapacity: header.openPathCount];
+	for (uint32_t i = 0; i < header.openPathCount; ++i)
+	{
+		uint32_t count = 0;
+		if (end - p < (ptrdiff_t)sizeof(count))
+			return nil;
+		memcpy(&count, p, sizeof(count));
+		p += sizeof(count);
+
+		if ((size_t)(end - p) < count*sizeof(v3i_t))
+			return nil;
+		v3i_t* vs = calloc(count, sizeof(*vs));
+		memcpy(vs, p, count*sizeof(*vs));
+		p += count*sizeof(*vs);
+
+		FixPolygonOpenSegment* segment = [[FixPolygonOpenSegment alloc] init];
+		[segment addVertices: vs count: count];
+		free(vs);
+
+		[paths addObject: segment];
+	}
+
+	openPaths = paths;
+	self.layerZ = header.layerZ;
+	self.mergeThreshold = header.mergeThreshold;
+
+	return self;
+}
+
+- (size_t) byteSize
+{
+	size_t bytes = 0;
+
+	@synchronized(self) {
+		if (contourStore)
+			bytes += contourStore.byteSize;
+		
+		// materialized outlines are held in addition to the store
+		for (SlicedOutline* outline in outlinePaths)
+			for (FixPolygonSegment* segment in [outline allNestedPaths])
+				bytes += segment.vertexCount*sizeof(v3i_t);
+
+		bytes += meshBytes;
+	}
+
+	for (FixPolygonOpenSegment* segment in openPaths)
+		bytes += segment.vertexCount*sizeof(v3i_t);
+
+	return bytes;
+}
+
+- (void) invalidateMesh
+{
+	@synchronized(self) {
+		meshCache = nil;
+		meshSkeletonStates = nil;
+		meshBytes = 0;
+	}
+}
+
+/*!
+ Closed segments get their first vertex repeated at the end, so that the color gradient along them does not wrap around, otherwise all vertices are shared between the two lines meeting there.
+ */
+- (GfxMesh*) outlineMeshWithOutlines: (NSArray*) outlines byteSize: (size_t*) byteSize
 {
 	GfxMesh* layerMesh = [[GfxMesh alloc] init];
 	
-	size_t vertexCount = 0;
+	NSMutableArray* segments = [NSMutableArray array];
+	for (SlicedOutline* outline in outlines)
+		[segments addObjectsFromArray: [outline allNestedPaths]];
 	
-	for (SlicedOutline* path in outlinePaths)
+	size_t vertexCount = 0, indexCount = 0;
+	
+	for (FixPolygonClosedSegment* segment in segments)
 	{
-		NSArray* segments = [path allNestedPaths];
-		for (FixPolygonClosedSegment* segment in segments)
-			vertexCount += (segment.vertexCount)*2;
+		if (!segment.vertexCount)
+			continue;
+		vertexCount += segment.vertexCount+1;
+		indexCount += segment.vertexCount*2;
 	}
 	for (FixPolygonOpenSegment* line in openPaths)
-		vertexCount += (line.vertexCount-1)*2;
+	{
+		if (line.vertexCount < 2)
+			continue;
+		vertexCount += line.vertexCount;
+		indexCount += (line.vertexCount-1)*2;
+	}
 	
+	*byteSize = 0;
 	if (!vertexCount)
 		return layerMesh;
 	
+	*byteSize = 2*vertexCount*sizeof(vector_t) + indexCount*sizeof(uint32_t);
+	
 	vector_t* vertices = calloc(vertexCount, sizeof(*vertices));
 	vector_t* colors = calloc(vertexCount, sizeof(*colors));
-	uint32_t* indices = calloc(vertexCount, sizeof(*indices));
-	
-	for (size_t i = 0; i < vertexCount; ++i)
-		indices[i] = i;
-	for (size_t i = 0; i < vertexCount; ++i)
-		colors[i] = vCreate(1.0, 1.0, 0.0, 1.0);
+	uint32_t* indices = calloc(indexCount, sizeof(*indices));
 	
-	size_t k = 0;
+	size_t k = 0, ki = 0;
 	
-	for (SlicedOutline* outline in outlinePaths)
+	for (FixPolygonClosedSegment* segment in segments)
 	{
-		NSArray* segments = [outline allNestedPaths];
-		for (FixPolygonClosedSegment* segment in segments)
+		size_t n = segment.vertexCount;
+		if (!n)
+			continue;
+		
+		v3i_t* vs = segment.vertices;
+		for (size_t i = 0; i <= n; ++i)
 		{
-			//vector_t color = vCreate(0.0, 0.5+0.5*(segment.isCCW), segment.isSelfIntersecting, 1.0);
-			for (size_t i = 0; i < segment.vertexCount; ++i)
+			if (i < n)
 			{
-				double fa = (double)i/segment.vertexCount;
-				double fb = (double)(i+1)/segment.vertexCount;
-				
-				colors[k] = (vCreate(fa, 1.0, 0.0, 1.0));
-				vertices[k++] = v3iToFloat(segment.vertices[i]);
-				colors[k] = (vCreate(fb, 1.0, 0.0, 1.0));
-				vertices[k++] = v3iToFloat(segment.vertices[(i+1)%segment.vertexCount]);
+				indices[ki++] = k;
+				indices[ki++] = k+1;
 			}
+			colors[k] = vCreate((double)i/n, 1.0, 0.0, 1.0);
+			vertices[k++] = v3iToFloat(vs[i % n]);
 		}
 	}
 	for (FixPolygonOpenSegment* segment in openPaths)
 	{
-		for (size_t i = 0; i+1 < segment.vertexCount; ++i)
+		size_t n = segment.vertexCount;
+		if (n < 2)
+			continue;
+		
+		v3i_t* vs = segment.vertices;
+		for (size_t i = 0; i < n; ++i)
 		{
+			if (i+1 < n)
+			{
+				indices[ki++] = k;
+				indices[ki++] = k+1;
+			}
 			colors[k] = vCreate(1.0, 0.0, 0.0, 1.0);
-			vertices[k++] = v3iToFloat(segment.vertices[i]);
-			colors[k] = vCreate(1.0, 0.0, 0.0, 1.0);
-			vertices[k++] = v3iToFloat(segment.vertices[i+1]);
+			vertices[k++] = v3iToFloat(vs[i]);
 		}
 	}
 	
-	assert(k==vertexCount);
-	
+	assert(k == vertexCount);
+	assert(ki == indexCount);
 	
 	[layerMesh setVertices: vertices count: vertexCount copy: NO];
 	[layerMesh setColors: colors count: vertexCount copy: NO];
-	[layerMesh addDrawArrayIndices: indices count: vertexCount withMode: GL_LINES];
+	[layerMesh addDrawArrayIndices: indices count: indexCount withMode: GL_LINES];
 	
 	free(indices);
 	
-	for (SlicedOutline* outline in outlinePaths)
-	{
-		NSArray* outlines = [outline.skeleton offsetMeshes];
-		for (GfxMesh* mesh in outlines)
-			[layerMesh appendMesh: mesh];
-		id skMesh = [outline.skeleton skeletonMesh];
-		if (skMesh)
-			[layerMesh appendMesh: skMesh];
+	GM_METRIC_COUNT("layer.meshBuilds", 1);
+	
+	return layerMesh;
+}
+
+/*!
+ Offset outlines are only ever added to a skeleton, so only the new ones are appended. The skeleton itself is appended once it is finished, as it does not change after that.
+ */
+- (void) appendSkeletonMeshesForOutlines: (NSArray*) outlines
+{
+	[outlines enumerateObjectsUsingBlock: ^(SlicedOutline* outline, NSUInteger i, BOOL* stop) {
+		_SlicedLayerSkeletonMeshState* state = [meshSkeletonStates objectAtIndex: i];
+		PolygonSkeletizer* skeleton = outline.skeleton;
+		
+		if (!skeleton)
+			return;
+		
+		state->skeleton = skeleton;
+		
+		NSArray* offsetMeshes = [skeleton offsetMeshes];
+		for (size_t j = state->offsetMeshCount; j < offsetMeshes.count; ++j)
+		{
+			[meshCache appendMesh: [offsetMeshes objectAtIndex: j]];
+			GM_METRIC_COUNT("layer.meshAppends", 1);
+		}
+		state->offsetMeshCount = offsetMeshes.count;
+		
+		if (!state->skeletonMeshAppended && [skeleton.doneSteps.lastObject isFinished])
+		{
+			GfxMesh* skMesh = [skeleton skeletonMesh];
+			if (skMesh)
+				[meshCache appendMesh: skMesh];
+			state->skeletonMeshAppended = YES;
+			GM_METRIC_COUNT("layer.meshAppends", 1);
+		}
+	}];
+}
 
+- (GfxMesh*) gfxMesh
+{
+	NSArray* outlines = self.outlinePaths;
+	
+	// a skeleton replaced since the mesh was built cannot be taken out of it again
+	if (meshCache && (meshSkeletonStates.count == outlines.count))
+	{
+		for (size_t i = 0; i < outlines.count; ++i)
+		{
+			_SlicedLayerSkeletonMeshState* state = [meshSkeletonStates objectAtIndex: i];
+			if (state->skeleton && (state->skeleton != [[outlines objectAtIndex: i] skeleton]))
+			{
+				[self invalidateMesh];
+				break;
+			}
+		}
 	}
+	else
+		[self invalidateMesh];
 	
-	return layerMesh;
+	if (!meshCache)
+	{
+		size_t bytes = 0;
+		GfxMesh* mesh = [self outlineMeshWithOutlines: outlines byteSize: &bytes];
+		@synchronized(self) {
+			meshCache = mesh;
+			meshBytes = bytes;
+		}
+		meshSkeletonStates = [NSMutableArray arrayWithCapacity: outlines.count];
+		for (size_t i = 0; i < outlines.count; ++i)
+			[meshSkeletonStates addObject: [[_SlicedLayerSkeletonMeshState alloc] init]];
+	}
+	
+	[self appendSkeletonMeshesForOutlines: outlines];
+	
+	return meshCache;
 }
 
 - (id) description
 {
 	NSMutableArray* descs = [NSMutableArray array];
 	
-	for (SlicedOutline* path in outlinePaths)
+	for (SlicedOutline* path in self.outlinePaths)
 		[descs addObject: path];
 	
 	return [NSString stringWithFormat: @"Outlines: %@", descs];
@@ -0,0 +1,155 @@
+//
+//  StepGenerator.c
+//  Giddy Machinist
+//
+//  Created by Dömötör Gulyás on 19.10.2026.
+//  Copyright (c) 2026 Dömötör Gulyás. All rights reserved.
+//
+
+#include "StepGenerator.h"
+
+#include <string.h>
+
+#define STEPPER_QUEUE_MASK (STEPPER_QUEUE_CAPACITY - 1)
+
+void StepperQueueInit(StepperQueue* queue)
+{
+	memset(queue, 0, sizeof(*queue));
+}
+
+size_t StepperQueueCount(StepperQueue* queue)
+{
+	uint32_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+	uint32_t tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+	return head - tail;
+}
+
+int StepperQueuePush(StepperQueue* queue, const StepperSegment* segment)
+{
+	uint32_t head = queue->head;
+	uint32_t tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+
+	if (head - tail >= STEPPER_QUEUE_CAPACITY)
+		return 0;
+
+	queue->slots[head & STEPPER_QUEUE_MASK] = *segment;
+
+	// publishes the slot contents along with the new head
+	__atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE);
+
+	return 1;
+}
+
+StepperSegment* StepperQueuePeek(StepperQueue* queue)
+{
+	uint32_t tail = queue->tail;
+	uint32_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+
+	if (head == tail)
+		return NULL;
+
+	return queue->slots + (tail & STEPPER_QUEUE_MASK);
+}
+
+void StepperQueuePop(StepperQueue* queue)
+{
+	// the slot may be overwritten as soon as the new tail is visible
+	__atomic_store_n(&queue->tail, queue->tail + 1, __ATOMIC_RELEASE);
+}
+
+void StepGeneratorInit(StepGenerator* generator)
+{
+	memset(generator, 0, sizeof(*generator));
+}
+
+int StepGeneratorIsIdle(const StepGenerator* generator)
+{
+	return !generator->segment;
+}
+
+static void _startSegment(StepGenerator* generator, StepperSegment* segment)
+{
+	generator->segment = segment;
+	generator->rate = segment->entryRate;
+	generator->phase = 0;
+	generator->tick = 0;
+	generator->stepEventsDone = 0;
+	generator->directionBits = 0;
+
+	for (size_t i = 0; i < STEPPER_AXIS_COUNT; ++i)
+	{
+		generator->counters[i] = segment->stepEventCount/2;
+		if (segment->steps[i] < 0)
+			generator->directionBits |= 1u << i;
+	}
+}
+
+static void _updateRate(StepGenerator* generator)
+{
+	StepperSegment* segment = generator->segment;
+	uint32_t tick = generator->tick;
+
+	if (tick < segment->accelerateTicks)
+	{
+		generator->rate += segment->accelerationPerTick;
+		if (generator->rate > segment->peakRate)
+			generator->rate = segment->peakRate;
+	}
+	else if (tick - segment->accelerateTicks < segment->cruiseTicks)
+		generator->rate = segment->peakRate;
+	else if (generator->rate > segment->exitRate + segment->decelerationPerTick)
+		generator->rate -= segment->decelerationPerTick;
+	else
+		generator->rate = segment->exitRate;
+
+	if (generator->rate < segment->minimumRate)
+		generator->rate = segment->minimumRate;
+}
+
+uint16_t StepGeneratorTick(StepGenerator* generator, StepperQueue* queue)
+{
+	// segments without steps take no ticks
+	while (!generator->segment)
+	{
+		StepperSegment* segment = StepperQueuePeek(queue);
+		if (!segment)
+			return (uint16_t)(generator->directionBits << 8);
+
+		if (segment->stepEventCount)
+			_startSegment(generator, segment);
+		else
+			StepperQueuePop(queue);
+	}
+
+	StepperSegment* segment = generator->segment;
+	uint32_t stepBits = 0;
+
+	_updateRate(generator);
+	generator->tick++;
+
+	generator->phase += generator->rate;
+	if (generator->phase >= STEPPER_RATE_ONE)
+	{
+		generator->phase -= STEPPER_RATE_ONE;
+
+		for (size_t i = 0; i < STEPPER_AXIS_COUNT; ++i)
+		{
+			int32_t steps = segment->steps[i];
+			generator->counters[i] += (uint32_t)((steps < 0) ? -steps : steps);
+			if (generator->counters[i] >= segment->stepEventCount)
+			{
+				generator->counters[i] -= segment->stepEventCount;
+				generator->position[i] += (steps < 0) ? -1 : 1;
+				stepBits |= 1u << i;
+			}
+		}
+
+		if (++generator->stepEventsDone == segment->stepEventCount)
+		{
+			generator->segment = NULL;
+			StepperQueuePop(queue);
+		}
+	}
+
+	return (uint16_t)((generator->directionBits << 8) | stepBits);
+}
@@ -0,0 +1,86 @@
+//
+//  StepGenerator.h
+//  Giddy Machinist
+//
+//  Created by Dömötör Gulyás on 19.10.2026.
+//  Copyright (c) 2026 Dömötör Gulyás. All rights reserved.
+//
+
+/*!
+ Step generation between the motion planner and a timer interrupt running at ticksPerSecond. Plain C without allocations or locks, so it can be used as is in firmware.
+
+ The planner thread pushes segments into a single producer, single consumer ring buffer, the interrupt pops them and generates step pulses with a DDA. Neither side ever waits for the other, a full queue is reported to the producer, an empty queue makes the generator idle.
+ */
+
+#ifndef STEPGENERATOR_H
+#define STEPGENERATOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define STEPPER_AXIS_COUNT 6
+#define STEPPER_QUEUE_CAPACITY 64 // power of two
+#define STEPPER_RATE_ONE (1ull << 32) // rates are step events per tick in 32.32 fixed point
+
+/*!
+ Step words carry one step bit per axis in the low byte, and the direction bits, set for negative, in the high byte.
+ */
+#define STEPPER_STEP_BITS(word) ((word) & 0xFF)
+#define STEPPER_DIRECTION_BITS(word) (((word) >> 8) & 0xFF)
+
+/*!
+ A straight move in steps, with a trapezoidal rate profile. Rates are of step events, each of which steps the axis with the most steps, and the others as needed by Bresenham. The segment ends when all step events are done, regardless of the tick counts, so rates never drop below minimumRate.
+ */
+typedef struct {
+	int32_t		steps[STEPPER_AXIS_COUNT];
+	uint32_t	stepEventCount;
+	uint64_t	entryRate, peakRate, exitRate, minimumRate;
+	uint64_t	accelerationPerTick, decelerationPerTick;
+	uint32_t	accelerateTicks, cruiseTicks;
+} StepperSegment;
+
+typedef struct {
+	StepperSegment	slots[STEPPER_QUEUE_CAPACITY];
+	uint32_t		head;		// written by the producer only
+	uint8_t			padding[60];	// keeps head and tail on separate cache lines
+	uint32_t		tail;		// written by the consumer only
+} StepperQueue;
+
+void StepperQueueInit(StepperQueue* queue);
+size_t StepperQueueCount(StepperQueue* queue);
+
+/*!
+ Producer side, returns 0 if the queue is full.
+ */
+int StepperQueuePush(StepperQueue* queue, const StepperSegment* segment);
+
+/*!
+ Consumer side, the segment stays valid until popped.
+ */
+StepperSegment* StepperQueuePeek(StepperQueue* queue);
+void StepperQueuePop(StepperQueue* queue);
+
+typedef struct {
+	StepperSegment*	segment;
+	uint64_t		rate, phase;
+	uint32_t		tick, stepEventsDone;
+	uint32_t		counters[STEPPER_AXIS_COUNT];
+	uint32_t		directionBits;
+	int64_t			position[STEPPER_AXIS_COUNT];
+} StepGenerator;
+
+void StepGeneratorInit(StepGenerator* generator);
+int StepGeneratorIsIdle(const StepGenerator* generator);
+
+/*!
+ Called once per timer tick, returns the step word for the tick.
+ */
+uint16_t StepGeneratorTick(StepGenerator* generator, StepperQueue* queue);
+
+/*!
+ Provided by the platform, the stepper interrupt suspends itself when it runs out of segments, and the producer resumes it after pushing more.
+ */
+void ResumeStepperInterrupt(void);
+void SuspendStepperInterrupt(void);
+
+#endif
@@ -0,0 +1,32 @@
+//
+//  ToolpathOrderOptimizer.h
+//  Giddy Machinist
+//
+//  Created by Dömötör Gulyás on 19.10.2026.
+//  Copyright (c) 2026 Dömötör Gulyás. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "VectorMath_fixp.h"
+
+/*!
+ @description Orders toolpath segments to reduce rapid travel between them. Segments nested inside a closed segment are always cut before it, so that parts are not cut loose before their inner features. Closed segments may start at any vertex, open segments may be reversed. The winding of closed segments is kept, as it determines climb or conventional milling.
+
+ A nearest neighbour tour is built first using a uniform grid over the candidate entry points, then improved by 2-opt and Or-opt moves until no move helps or the time budget runs out.
+ */
+@interface ToolpathOrderOptimizer : NSObject
+
+- (instancetype) initWithSegments: (NSArray*) segments;
+
+@property(nonatomic) v3i_t startPosition;
+@property(nonatomic) double timeBudget; // seconds to spend on local improvement
+
+/*!
+ Returns the segments in travel order, closed segments are rotated and open segments reversed in place as needed.
+ */
+- (NSArray*) optimizedSegments;
+
+@property(nonatomic, readonly) double initialTravelLength, optimizedTravelLength;
+
+@end
@@ -0,0 +1,683 @@
+//
+//  ToolpathOrderOptimizer.m
+//  Giddy Machinist
+//
+//  Created by Dömötör Gulyás on 19.10.2026.
+//  Copyright (c) 2026 Dömötör Gulyás. All rights reserved.
+//
+
+#import "ToolpathOrderOptimizer.h"
+
+#import "FixPolygon.h"
+#import "FoundationExtensions.h"
+
+
+#define TRAVEL_EPSILON 1.0e-6
+#define TRAVEL_OROPT_MAX_CHAIN 3
+
+typedef struct {
+	double		x, y;
+	uint32_t	item, vertex;
+} _TravelEntryPoint;
+
+typedef struct {
+	size_t		numItems;
+
+	double**	xy;			// interleaved vertex coordinates of each item
+	size_t*		counts;
+	BOOL*		closed;
+	long*		parents;	// innermost enclosing closed item, or -1
+	size_t*		childStarts;
+	size_t*		children;
+
+	size_t*		order;
+	size_t*		position;
+	size_t*		entry;		// entry vertex of closed items
+	BOOL*		reversed;	// open items entered at their last vertex
+
+	double		startX, startY;
+} _TravelTour;
+
+
+static double _distance(double ax, double ay, double bx, double by)
+{
+	return sqrt((bx-ax)*(bx-ax) + (by-ay)*(by-ay));
+}
+
+static void _entryOfItem(_TravelTour* t, size_t item, double* x, double* y)
+{
+	size_t v = t->closed[item] ? t->entry[item] : (t->reversed[item] ? t->counts[item]-1 : 0);
+	*x = t->xy[item][2*v];
+	*y = t->xy[item][2*v+1];
+}
+
+static void _exitOfItem(_TravelTour* t, size_t item, double* x, double* y)
+{
+	size_t v = t->closed[item] ? t->entry[item] : (t->reversed[item] ? 0 : t->counts[item]-1);
+	*x = t->xy[item][2*v];
+	*y = t->xy[item][2*v+1];
+}
+
+/*!
+ Travel from the exit of the item at position a to the entry of the item at position b. Position -1 is the start position, and there is no travel to positions past the end.
+ */
+static double _linkCost(_TravelTour* t, long a, long b)
+{
+	if (b >= (long)t->numItems)
+		return 0.0;
+
+	double ax = t->startX, ay = t->startY, bx, by;
+	if (a >= 0)
+		_exitOfItem(t, t->order[a], &ax, &ay);
+	_entryOfItem(t, t->order[b], &bx, &by);
+
+	return _distance(ax, ay, bx, by);
+}
+
+static double _tourLength(_TravelTour* t)
+{
+	double length = 0.0;
+	for (long i = 0; i < (long)t->numItems; ++i)
+		length += _linkCost(t, i-1, i);
+	return length;
+}
+
+static void _updatePositions(_TravelTour* t, size_t from, size_t to)
+{
+	for (size_t i = from; i < to; ++i)
+		t->position[t->order[i]] = i;
+}
+
+#pragma mark - Nearest Neighbour Construction
+
+static long _gridCell(double x, double minX, double cellSize, long numCells)
+{
+	return MAX(0, MIN(numCells-1, (long)floor((x - minX)/cellSize)));
+}
+
+static void _buildNearestNeighbourTour(_TravelTour* t)
+{
+	size_t n = t->numItems;
+
+	size_t numPoints = 0;
+	for (size_t i = 0; i < n; ++i)
+		numPoints += t->closed[i] ? t->counts[i] : MIN(t->counts[i], 2);
+
+	_TravelEntryPoint* points = calloc(numPoints, sizeof(*points));
+
+	double minX = INFINITY, minY = INFINITY, maxX = -INFINITY, maxY = -INFINITY;
+
+	size_t k = 0;
+	for (size_t i = 0; i < n; ++i)
+	{
+		size_t count = t->counts[i];
+		for (size_t j = 0; j < count; ++j)
+		{
+			if (!t->closed[i] && (j != 0) && (j != count-1))
+				continue;
+
+			double x = t->xy[i][2*j], y = t->xy[i][2*j+1];
+			points[k++] = (_TravelEntryPoint){x, y, (uint32_t)i, (uint32_t)j};
+
+			minX = MIN(minX, x); maxX = MAX(maxX, x);
+			minY = MIN(minY, y); maxY = MAX(maxY, y);
+		}
+	}
+	assert(k == numPoints);
+
+	// uniform grid with about two entry points per cell, bucketed CSR style
+	size_t side = MAX(1, (size_t)ceil(sqrt(0.5*numPoints)));
+	double cellSize = MAX(MAX(maxX - minX, maxY - minY)/side, TRAVEL_EPSILON);
+	long nx = (long)floor((maxX - minX)/cellSize) + 1;
+	long ny = (long)floor((maxY - minY)/cellSize) + 1;
+
+	size_t* cellStarts = calloc(nx*ny+1, sizeof(*cellStarts));
+	size_t* cellCounts = calloc(nx*ny, sizeof(*cellCounts));
+	uint32_t* cellPoints = calloc(numPoints, sizeof(*cellPoints));
+
+	for (size_t i = 0; i < numPoints; ++i)
+		cellCounts[_gridCell(points[i].y, minY, cellSize, ny)*nx + _gridCell(points[i].x, minX, cellSize, nx)]++;
+	for (long c = 0; c < nx*ny; ++c)
+		cellStarts[c+1] = cellStarts[c] + cellCounts[c];
+	memset(cellCounts, 0, nx*ny*sizeof(*cellCounts));
+	for (size_t i = 0; i < numPoints; ++i)
+	{
+		long c = _gridCell(points[i].y, minY, cellSize, ny)*nx + _gridCell(points[i].x, minX, cellSize, nx);
+		cellPoints[cellStarts[c] + cellCounts[c]++] = (uint32_t)i;
+	}
+
+	size_t* remainingChildren = calloc(n, sizeof(*remainingChildren));
+	BOOL* visited = calloc(n, sizeof(*visited));
+
+	for (size_t i = 0; i < n; ++i)
+		remainingChildren[i] = t->childStarts[i+1] - t->childStarts[i];
+
+	double px = t->startX, py = t->startY;
+
+	for (size_t step = 0; step < n; ++step)
+	{
+		long best = -1;
+		double bestD2 = INFINITY;
+
+		BOOL insideGrid = (px >= minX) && (px <= maxX) && (py >= minY) && (py <= maxY);
+
+		if (insideGrid)
+		{
+			long cx = _gridCell(px, minX, cellSize, nx), cy = _gridCell(py, minY, cellSize, ny);
+
+			for (long r = 0; ; ++r)
+			{
+				for (long j = cy-r; j <= cy+r; ++j)
+				{
+					if ((j < 0) || (j >= ny))
+						continue;
+
+					BOOL edgeRow = (j == cy-r) || (j == cy+r);
+					for (long i = cx-r; i <= cx+r; i += (edgeRow ? 1 : MAX(1, 2*r)))
+					{
+						if ((i < 0) || (i >= nx))
+							continue;
+
+						long c = j*nx + i;
+						uint32_t* cell = cellPoints + cellStarts[c];
+
+						for (size_t m = 0; m < cellCounts[c]; )
+						{
+							_TravelEntryPoint* p = points + cell[m];
+							if (visited[p->item])
+							{
+								// drop entry points of finished items, so later queries don't scan them again
+								cell[m] = cell[--cellCounts[c]];
+								continue;
+							}
+							if (!remainingChildren[p->item])
+							{
+								double d2 = (p->x-px)*(p->x-px) + (p->y-py)*(p->y-py);
+								if (d2 < bestD2)
+								{
+									bestD2 = d2;
+									best = cell[m];
+								}
+							}
+							++m;
+						}
+					}
+				}
+
+				// anything not yet scanned is at least as far away as the closest open side of the scanned box
+				double bound = INFINITY;
+				if (cx-r > 0)
+					bound = MIN(bound, px - (minX + (cx-r)*cellSize));
+				if (cx+r < nx-1)
+					bound = MIN(bound, (minX + (cx+r+1)*cellSize) - px);
+				if (cy-r > 0)
+					bound = MIN(bound, py - (minY + (cy-r)*cellSize));
+				if (cy+r < ny-1)
+					bound = MIN(bound, (minY + (cy+r+1)*cellSize) - py);
+
+				if (bound == INFINITY)
+					break;
+				if ((best >= 0) && (bestD2 <= bound*bound))
+					break;
+			}
+		}
+		else
+		{
+			for (size_t i = 0; i < numPoints; ++i)
+			{
+				_TravelEntryPoint* p = points + i;
+				if (visited[p->item] || remainingChildren[p->item])
+					continue;
+				double d2 = (p->x-px)*(p->x-px) + (p->y-py)*(p->y-py);
+				if (d2 < bestD2)
+				{
+					bestD2 = d2;
+					best = i;
+				}
+			}
+		}
+
+		size_t item = 0;
+
+		if (best >= 0)
+		{
+			item = points[best].item;
+			if (t->closed[item])
+				t->entry[item] = points[best].vertex;
+			else
+				t->reversed[item] = (points[best].vertex != 0);
+		}
+		else
+		{
+			// only reachable with inconsistent nesting, fall back to ignoring it
+			while (visited[item])
+				++item;
+		}
+
+		t->order[step] = item;
+		t->position[item] = step;
+		visited[item] = YES;
+
+		if (t->parents[item] >= 0)
+			remainingChildren[t->parents[item]]--;
+
+		_exitOfItem(t, item, &px, &py);
+	}
+
+	free(points);
+	free(cellStarts);
+	free(cellCounts);
+	free(cellPoints);
+	free(remainingChildren);
+	free(visited);
+}
+
+#pragma mark - Local Improvement
+
+static BOOL _optimizeEntries(_TravelTour* t)
+{
+	BOOL improved = NO;
+	long n = t->numItems;
+
+	for (long k = 0; k < n; ++k)
+	{
+		size_t item = t->order[k];
+
+		double before = _linkCost(t, k-1, k) + _linkCost(t, k, k+1);
+
+		if (t->closed[item])
+		{
+			size_t oldEntry = t->entry[item];
+			size_t bestEntry = oldEntry;
+			double bestCost = before;
+
+			for (size_t v = 0; v < t->counts[item]; ++v)
+			{
+				t->entry[item] = v;
+				double cost = _linkCost(t, k-1, k) + _linkCost(t, k, k+1);
+				if (cost < bestCost - TRAVEL_EPSILON)
+				{
+					bestCost = cost;
+					bestEntry = v;
+				}
+			}
+
+			t->entry[item] = bestEntry;
+			improved = improved || (bestEntry != oldEntry);
+		}
+		else if (t->counts[item] > 1)
+		{
+			t->reversed[item] = !t->reversed[item];
+			double after = _linkCost(t, k-1, k) + _linkCost(t, k, k+1);
+			if (after < before - TRAVEL_EPSILON)
+				improved = YES;
+			else
+				t->reversed[item] = !t->reversed[item];
+		}
+	}
+
+	return improved;
+}
+
+/*!
+ Reversing the run of positions i...j keeps nesting order only if no item in the run has its parent in the run as well.
+ */
+static BOOL _canReverse(_TravelTour* t, size_t i, size_t j)
+{
+	for (size_t k = i; k <= j; ++k)
+	{
+		long parent = t->parents[t->order[k]];
+		if ((parent >= 0) && (t->position[parent] >= i) && (t->position[parent] <= j))
+			return NO;
+	}
+	return YES;
+}
+
+static void _reverse(_TravelTour* t, size_t i, size_t j)
+{
+	for (size_t k = i; k <= j; ++k)
+		if (!t->closed[t->order[k]])
+			t->reversed[t->order[k]] = !t->reversed[t->order[k]];
+
+	for (size_t a = i, b = j; a < b; ++a, --b)
+	{
+		size_t tmp = t->order[a];
+		t->order[a] = t->order[b];
+		t->order[b] = tmp;
+	}
+
+	_updatePositions(t, i, j+1);
+}
+
+static BOOL _twoOptPass(_TravelTour* t, NSTimeInterval deadline)
+{
+	BOOL improved = NO;
+	long n = t->numItems;
+
+	for (long i = 0; i < n-1; ++i)
+	{
+		if ([NSDate timeIntervalSinceReferenceDate] > deadline)
+			break;
+
+		double px = t->startX, py = t->startY;
+		if (i > 0)
+			_exitOfItem(t, t->order[i-1], &px, &py);
+
+		double before0 = _linkCost(t, i-1, i);
+
+		for (long j = i+1; j < n; ++j)
+		{
+			size_t first = t->order[i], last = t->order[j];
+
+			// after reversal, the run is entered where the last item was left, and left where the first item was entered
+			double lx, ly, fx, fy;
+			_exitOfItem(t, last, &lx, &ly);
+			_entryOfItem(t, first, &fx, &fy);
+
+			double before = before0 + _linkCost(t, j, j+1);
+			double after = _distance(px, py, lx, ly);
+			if (j+1 < n)
+			{
+				double nx, ny;
+				_entryOfItem(t, t->order[j+1], &nx, &ny);
+				after += _distance(fx, fy, nx, ny);
+			}
+
+			if ((after < before - TRAVEL_EPSILON) && _canReverse(t, i, j))
+			{
+				_reverse(t, i, j);
+				before0 = _linkCost(t, i-1, i);
+				improved = YES;
+			}
+		}
+	}
+
+	return improved;
+}
+
+/*!
+ Moving the chain at positions i...i+len-1 so that it starts at position g (counted before removal) must not move an item in front of one of its children, or behind its parent.
+ */
+static BOOL _canMoveChain(_TravelTour* t, size_t i, size_t len, size_t g)
+{
+	for (size_t k = i; k < i+len; ++k)
+	{
+		size_t item = t->order[k];
+
+		if (g < i)
+		{
+			for (size_t c = t->childStarts[item]; c < t->childStarts[item+1]; ++c)
+			{
+				size_t pos = t->position[t->children[c]];
+				if ((pos >= g) && (pos < i))
+					return NO;
+			}
+		}
+		else
+		{
+			long parent = t->parents[item];
+			if ((parent >= 0) && (t->position[parent] >= i+len) && (t->position[parent] < g))
+				return NO;
+		}
+	}
+	return YES;
+}
+
+static void _moveChain(_TravelTour* t, size_t i, size_t len, size_t g)
+{
+	size_t chain[TRAVEL_OROPT_MAX_CHAIN];
+	memcpy(chain, t->order + i, len*sizeof(*chain));
+
+	if (g < i)
+	{
+		memmove(t->order + g + len, t->order + g, (i - g)*sizeof(*t->order));
+		memcpy(t->order + g, chain, len*sizeof(*chain));
+		_updatePositions(t, g, i+len);
+	}
+	else
+	{
+		memmove(t->order + i, t->order + i + len, (g - i - len)*sizeof(*t->order));
+		memcpy(t->order + g - len, chain, len*sizeof(*chain));
+		_updatePositions(t, i, g);
+	}
+}
+
+static BOOL _orOptPass(_TravelTour* t, NSTimeInterval deadline)
+{
+	BOOL improved = NO;
+	long n = t->numItems;
+
+	for (long len = 1; len <= TRAVEL_OROPT_MAX_CHAIN; ++len)
+	{
+		for (long i = 0; i + len <= n; ++i)
+		{
+			if ([NSDate timeIntervalSinceReferenceDate] > deadline)
+				return improved;
+
+			double sx, sy, ex, ey;
+			_entryOfItem(t, t->order[i], &sx, &sy);
+			_exitOfItem(t, t->order[i+len-1], &ex, &ey);
+
+			// travel saved by taking the chain out
+			double px = t->startX, py = t->startY;
+			if (i > 0)
+				_exitOfItem(t, t->order[i-1], &px, &py);
+
+			double removed = _linkCost(t, i-1, i) + _linkCost(t, i+len-1, i+len);
+			if (i+len < n)
+			{
+				double nx, ny;
+				_entryOfItem(t, t->order[i+len], &nx, &ny);
+				removed -= _distance(px, py, nx, ny);
+			}
+
+			// insert between positions g-1 and g
+			for (long g = 0; g <= n; ++g)
+			{
+				if ((g >= i) && (g <= i+len))
+					continue;
+
+				double ax = t->startX, ay = t->startY;
+				if (g > 0)
+					_exitOfItem(t, t->order[g-1], &ax, &ay);
+
+				double added = _distance(ax, ay, sx, sy) - _linkCost(t, g-1, g);
+				if (g < n)
+				{
+					double bx, by;
+					_entryOfItem(t, t->order[g], &bx, &by);
+					added += _distance(ex, ey, bx, by);
+				}
+
+				if ((added < removed - TRAVEL_EPSILON) && _canMoveChain(t, i, len, g))
+				{
+					_moveChain(t, i, len, g);
+					improved = YES;
+					break;
+				}
+			}
+		}
+	}
+
+	return improved;
+}
+
+
+@implementation ToolpathOrderOptimizer
+{
+	NSArray* segments;
+	NSArray* orderedSegments;
+	_TravelTour tour;
+}
+
+@synthesize startPosition, timeBudget, initialTravelLength, optimizedTravelLength;
+
+- (id) init
+{
+	[self doesNotRecognizeSelector: _cmd];
+	return nil;
+}
+
+- (instancetype) initWithSegments: (NSArray*) inSegments
+{
+	if (!(self = [super init]))
+		return nil;
+
+	segments = [inSegments select: ^BOOL(FixPolygonSegment* obj) {
+		return obj.vertexCount > 0;
+	}];
+
+	timeBudget = 0.25;
+	startPosition = v3iCreate(0, 0, 0, 16);
+
+	size_t n = segments.count;
+	tour.numItems = n;
+	tour.xy = calloc(n, sizeof(*tour.xy));
+	tour.counts = calloc(n, sizeof(*tour.counts));
+	tour.closed = calloc(n, sizeof(*tour.closed));
+	tour.parents = calloc(n, sizeof(*tour.parents));
+	tour.childStarts = calloc(n+1, sizeof(*tour.childStarts));
+	tour.children = calloc(n, sizeof(*tour.children));
+	tour.order = calloc(n, sizeof(*tour.order));
+	tour.position = calloc(n, sizeof(*tour.position));
+	tour.entry = calloc(n, sizeof(*tour.entry));
+	tour.reversed = calloc(n, sizeof(*tour.reversed));
+
+	r3i_t* bounds = calloc(n, sizeof(*bounds));
+
+	for (size_t i = 0; i < n; ++i)
+	{
+		FixPolygonSegment* segment = segments[i];
+		size_t count = segment.vertexCount;
+		v3i_t* vertices = segment.vertices;
+
+		tour.counts[i] = count;
+		tour.closed[i] = segment.isClosed;
+		tour.xy[i] = calloc(2*count, sizeof(**tour.xy));
+		for (size_t j = 0; j < count; ++j)
+		{
+			vector_t v = v3iToFloat(vertices[j]);
+			tour.xy[i][2*j] = v.farr[0];
+			tour.xy[i][2*j+1] = v.farr[1];
+		}
+
+		bounds[i] = segment.bounds;
+		tour.order[i] = i;
+		tour.position[i] = i;
+	}
+
+	// the innermost closed segment containing a segment is its parent, nested bounds mean the smallest box is innermost
+	for (size_t i = 0; i < n; ++i)
+	{
+		tour.parents[i] = -1;
+		double parentArea = INFINITY;
+
+		for (size_t j = 0; j < n; ++j)
+		{
+			if ((i == j) || !tour.closed[j])
+				continue;
+
+			r3i_t a = bounds[i], b = bounds[j];
+			if ((a.min.x < b.min.x) || (a.min.y < b.min.y) || (a.max.x > b.max.x) || (a.max.y > b.max.y))
+				continue;
+
+			vector_t bmin = v3iToFloat(b.min), bmax = v3iToFloat(b.max);
+			double area = (bmax.farr[0] - bmin.farr[0])*(bmax.farr[1] - bmin.farr[1]);
+			if (area >= parentArea)
+				continue;
+
+			if ([(FixPolygonClosedSegment*)segments[j] containsPath: segments[i]])
+			{
+				tour.parents[i] = j;
+				parentArea = area;
+			}
+		}
+	}
+
+	free(bounds);
+
+	for (size_t i = 0; i < n; ++i)
+		if (tour.parents[i] >= 0)
+			tour.childStarts[tour.parents[i]+1]++;
+	for (size_t i = 0; i < n; ++i)
+		tour.childStarts[i+1] += tour.childStarts[i];
+	{
+		size_t* fill = calloc(n, sizeof(*fill));
+		for (size_t i = 0; i < n; ++i)
+			if (tour.parents[i] >= 0)
+			{
+				long p = tour.parents[i];
+				tour.children[tour.childStarts[p] + fill[p]++] = i;
+			}
+		free(fill);
+	}
+
+	return self;
+}
+
+- (void) dealloc
+{
+	for (size_t i = 0; i < tour.numItems; ++i)
+		free(tour.xy[i]);
+	free(tour.xy);
+	free(tour.counts);
+	free(tour.closed);
+	free(tour.parents);
+	free(tour.childStarts);
+	free(tour.children);
+	free(tour.order);
+	free(tour.position);
+	free(tour.entry);
+	free(tour.reversed);
+}
+
+- (NSArray*) optimizedSegments
+{
+	// the segments are modified in place, so the ordering is computed only once
+	if (orderedSegments)
+		return orderedSegments;
+	if (!tour.numItems)
+		return segments;
+
+	vector_t start = v3iToFloat(startPosition);
+	tour.startX = start.farr[0];
+	tour.startY = start.farr[1];
+
+	initialTravelLength = _tourLength(&tour);
+
+	NSTimeInterval deadline = [NSDate timeIntervalSinceReferenceDate] + timeBudget;
+
+	_buildNearestNeighbourTour(&tour);
+
+	BOOL improved = YES;
+	while (improved && ([NSDate timeIntervalSinceReferenceDate] < deadline))
+	{
+		improved = _optimizeEntries(&tour);
+		improved = _twoOptPass(&tour, deadline) || improved;
+		improved = _orOptPass(&tour, deadline) || improved;
+	}
+	_optimizeEntries(&tour);
+
+	optimizedTravelLength = _tourLength(&tour);
+
+	NSMutableArray* ordered = [NSMutableArray arrayWithCapacity: tour.numItems];
+
+	for (size_t k = 0; k < tour.numItems; ++k)
+	{
+		size_t item = tour.order[k];
+		FixPolygonSegment* segment = segments[item];
+
+		if (tour.closed[item] && tour.entry[item])
+			[(FixPolygonClosedSegment*)segment rotateToStartAtVertex: tour.entry[item]];
+		else if (!tour.closed[item] && tour.reversed[item])
+			[segment reverse];
+
+		[ordered addObject: segment];
+	}
+
+	orderedSegments = ordered;
+
+	return ordered;
+}
+
+@end
@@ -8,7 +8,23 @@
 
 #import <Cocoa/Cocoa.h>
 
+#import "GMBenchmark.h"
+#import "GMMetrics.h"
+
 int main(int argc, char *argv[])
 {
+	GMMetricsInstallExportHandlers();
+	
+	if ((argc > 1) && (strncmp(argv[1], "--benchmark", strlen("--benchmark")) == 0))
+	{
+		@autoreleasepool {
+			NSArray* arguments = [[[NSProcessInfo processInfo] arguments] subarrayWithRange: NSMakeRange(2, argc-2)];
+			if (strcmp(argv[1], "--benchmark-scaling") == 0)
+				return [GMBenchmark runScalingWithArguments: arguments];
+			else
+				return [GMBenchmark runWithArguments: arguments];
+		}
+	}
+	
 	return NSApplicationMain(argc, (const char **)argv);
 }
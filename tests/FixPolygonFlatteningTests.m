@@ -0,0 +1,140 @@
+//
+//  FixPolygonFlatteningTests.m
+//  Giddy Machinist
+//
+//  Created by Dömötör Gulyás on 19.10.2026.
+//  Copyright (c) 2026 Dömötör Gulyás. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <AppKit/AppKit.h>
+
+#import "FixPolygon.h"
+
+
+// cubic approximations of circles bulge outward by up to 2.7e-4 of the radius
+#define CIRCLE_BULGE 2.8e-4
+// fixed point midpoints round down by less than a unit per subdivision level
+#define FIXED_POINT_SLACK (16.0/65536.0)
+
+
+/*!
+ Largest distance of the chords of a flattened circle inside the circle, and the range of vertex distances from the center.
+ */
+static double _chordDeviation(FixPolygonSegment* segment, NSPoint center, double radius, double* minRadius, double* maxRadius)
+{
+	double deviation = 0.0;
+	*minRadius = INFINITY;
+	*maxRadius = 0.0;
+
+	size_t count = segment.vertexCount;
+	for (size_t i = 0; i < count; ++i)
+	{
+		vector_t a = v3iToFloat(segment.vertices[i]);
+		vector_t b = v3iToFloat(segment.vertices[(i+1) % count]);
+
+		double r = hypot(a.farr[0] - center.x, a.farr[1] - center.y);
+		*minRadius = MIN(*minRadius, r);
+		*maxRadius = MAX(*maxRadius, r);
+
+		double mx = 0.5*(a.farr[0] + b.farr[0]) - center.x;
+		double my = 0.5*(a.farr[1] + b.farr[1]) - center.y;
+		deviation = MAX(deviation, radius - hypot(mx, my));
+	}
+	return deviation;
+}
+
+
+@interface FixPolygonFlatteningTests : XCTestCase
+@end
+
+@implementation FixPolygonFlatteningTests
+
+- (void) checkCircleWithRadius: (double) radius flatness: (double) flatness
+{
+	NSPoint center = NSMakePoint(100.0, 50.0);
+	NSBezierPath* bpath = [NSBezierPath bezierPathWithOvalInRect: NSMakeRect(-radius, -radius, 2.0*radius, 2.0*radius)];
+
+	NSAffineTransform* transform = [NSAffineTransform transform];
+	[transform translateXBy: center.x yBy: center.y];
+
+	FixPolygon* polygon = [FixPolygon polygonFromBezierPath: bpath withTransform: transform flatness: flatness];
+	XCTAssertEqual(polygon.segments.count, (NSUInteger)1);
+
+	FixPolygonSegment* segment = polygon.segments[0];
+	XCTAssertTrue(segment.isClosed);
+
+	double minRadius = 0.0, maxRadius = 0.0;
+	double deviation = _chordDeviation(segment, center, radius, &minRadius, &maxRadius);
+
+	XCTAssertTrue(deviation <= flatness + FIXED_POINT_SLACK, @"chords deviate by %f for flatness %f", deviation, flatness);
+	XCTAssertTrue(minRadius >= radius - FIXED_POINT_SLACK);
+	XCTAssertTrue(maxRadius <= radius*(1.0 + CIRCLE_BULGE) + FIXED_POINT_SLACK);
+
+	// halving may overshoot the ideal chord length, but not by much
+	double idealCount = M_PI/acos(1.0 - flatness/radius);
+	XCTAssertTrue(segment.vertexCount <= 4.0*idealCount, @"%zu vertices for about %.0f needed", segment.vertexCount, idealCount);
+}
+
+- (void) testCircleStaysWithinFlatness
+{
+	[self checkCircleWithRadius: 10.0 flatness: 0.1];
+	[self checkCircleWithRadius: 10.0 flatness: 0.01];
+	[self checkCircleWithRadius: 0.5 flatness: 0.01];
+	[self checkCircleWithRadius: 200.0 flatness: 0.005];
+}
+
+- (void) testFinerFlatnessGivesMoreVertices
+{
+	NSBezierPath* bpath = [NSBezierPath bezierPathWithOvalInRect: NSMakeRect(0.0, 0.0, 20.0, 20.0)];
+
+	FixPolygon* coarse = [FixPolygon polygonFromBezierPath: bpath withTransform: nil flatness: 0.1];
+	FixPolygon* fine = [FixPolygon polygonFromBezierPath: bpath withTransform: nil flatness: 0.001];
+
+	FixPolygonSegment* fineSegment = fine.segments[0];
+	FixPolygonSegment* coarseSegment = coarse.segments[0];
+	XCTAssertTrue(fineSegment.vertexCount > coarseSegment.vertexCount);
+}
+
+- (void) testLinesAreNotSubdivided
+{
+	NSBezierPath* bpath = [NSBezierPath bezierPath];
+	[bpath moveToPoint: NSMakePoint(0.0, 0.0)];
+	[bpath lineToPoint: NSMakePoint(10.0, 0.0)];
+	[bpath lineToPoint: NSMakePoint(10.0, 10.0)];
+	[bpath lineToPoint: NSMakePoint(0.0, 10.0)];
+	[bpath closePath];
+
+	FixPolygon* polygon = [FixPolygon polygonFromBezierPath: bpath withTransform: nil flatness: 0.001];
+	XCTAssertEqual(polygon.segments.count, (NSUInteger)1);
+	FixPolygonSegment* segment = polygon.segments[0];
+	XCTAssertEqual(segment.vertexCount, (size_t)4);
+}
+
+- (void) testSubpathsAreFlattenedSeparately
+{
+	NSPoint centers[2] = {NSMakePoint(10.0, 10.0), NSMakePoint(40.0, 10.0)};
+	double radius = 5.0, flatness = 0.01;
+
+	NSBezierPath* bpath = [NSBezierPath bezierPath];
+	for (int i = 0; i < 2; ++i)
+		[bpath appendBezierPathWithOvalInRect: NSMakeRect(centers[i].x - radius, centers[i].y - radius, 2.0*radius, 2.0*radius)];
+
+	FixPolygon* polygon = [FixPolygon polygonFromBezierPath: bpath withTransform: nil flatness: flatness];
+	XCTAssertEqual(polygon.segments.count, (NSUInteger)2);
+
+	for (FixPolygonSegment* segment in polygon.segments)
+	{
+		vector_t v = v3iToFloat(segment.vertices[0]);
+		NSPoint center = (v.farr[0] < 25.0) ? centers[0] : centers[1];
+
+		double minRadius = 0.0, maxRadius = 0.0;
+		double deviation = _chordDeviation(segment, center, radius, &minRadius, &maxRadius);
+
+		XCTAssertTrue(deviation <= flatness + FIXED_POINT_SLACK);
+		XCTAssertTrue(minRadius >= radius - FIXED_POINT_SLACK);
+		XCTAssertTrue(maxRadius <= radius*(1.0 + CIRCLE_BULGE) + FIXED_POINT_SLACK);
+	}
+}
+
+@end
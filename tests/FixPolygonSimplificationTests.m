@@ -0,0 +1,140 @@
+//
+//  FixPolygonSimplificationTests.m
+//  Giddy Machinist
+//
+//  Created by Dömötör Gulyás on 19.10.2026.
+//  Copyright (c) 2026 Dömötör Gulyás. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "FixPolygon.h"
+
+
+#define TOLERANCE 0.05
+#define NOTCH_WIDTH 0.04	// narrower than the tolerance
+#define NOTCH_WIGGLE 0.015	// walls zig-zag by this much, within the tolerance
+#define NOTCH_STEPS 10
+#define FIXED_POINT_SLACK (4.0/65536.0)
+
+
+/*!
+ A 20 mm square with a 10 mm deep notch down from the middle of its top edge. The bottom edge and the notch walls are jagged within the tolerance, so that Douglas-Peucker wants to straighten both walls into chords only a few hundredths apart.
+ */
+static FixPolygonClosedSegment* _notchedSquare(void)
+{
+	v3i_t vertices[2*NOTCH_STEPS + 25];
+	size_t count = 0;
+
+	for (int k = 0; k <= 20; ++k)
+		vertices[count++] = v3iCreateFromFloat(k, 0.01*(k % 2), 0.0, 16);
+
+	vertices[count++] = v3iCreateFromFloat(20.0, 20.0, 0.0, 16);
+
+	for (int k = 0; k <= NOTCH_STEPS; ++k)
+		vertices[count++] = v3iCreateFromFloat(10.0 + 0.5*NOTCH_WIDTH + ((k % 2) ? NOTCH_WIGGLE : -NOTCH_WIGGLE), 20.0 - 10.0*k/NOTCH_STEPS, 0.0, 16);
+	for (int k = NOTCH_STEPS; k >= 0; --k)
+		vertices[count++] = v3iCreateFromFloat(10.0 - 0.5*NOTCH_WIDTH - ((k % 2) ? NOTCH_WIGGLE : -NOTCH_WIGGLE), 20.0 - 10.0*k/NOTCH_STEPS, 0.0, 16);
+
+	vertices[count++] = v3iCreateFromFloat(0.0, 20.0, 0.0, 16);
+
+	FixPolygonClosedSegment* segment = [[FixPolygonClosedSegment alloc] init];
+	[segment addVertices: vertices count: count];
+	return segment;
+}
+
+static int _orientation(v3i_t a, v3i_t b, v3i_t c)
+{
+	int64_t cross = ((int64_t)b.x - a.x)*((int64_t)c.y - a.y) - ((int64_t)b.y - a.y)*((int64_t)c.x - a.x);
+	return (cross > 0) - (cross < 0);
+}
+
+static BOOL _onSegment(v3i_t a, v3i_t b, v3i_t x)
+{
+	return (x.x >= MIN(a.x, b.x)) && (x.x <= MAX(a.x, b.x)) && (x.y >= MIN(a.y, b.y)) && (x.y <= MAX(a.y, b.y));
+}
+
+/*!
+ Exact intersection test of two edges, touching counts.
+ */
+static BOOL _edgesIntersect(v3i_t p0, v3i_t p1, v3i_t q0, v3i_t q1)
+{
+	int d0 = _orientation(p0, p1, q0), d1 = _orientation(p0, p1, q1);
+	int d2 = _orientation(q0, q1, p0), d3 = _orientation(q0, q1, p1);
+
+	if ((d0*d1 < 0) && (d2*d3 < 0))
+		return YES;
+
+	return (!d0 && _onSegment(p0, p1, q0)) || (!d1 && _onSegment(p0, p1, q1)) || (!d2 && _onSegment(q0, q1, p0)) || (!d3 && _onSegment(q0, q1, p1));
+}
+
+static double _pointEdgeDistance(v3i_t p, v3i_t a, v3i_t b)
+{
+	vector_t x = v3iToFloat(p), u = v3iToFloat(a), v = v3iToFloat(b);
+	double ex = v.farr[0] - u.farr[0], ey = v.farr[1] - u.farr[1];
+	double dx = x.farr[0] - u.farr[0], dy = x.farr[1] - u.farr[1];
+	double lengthSqr = ex*ex + ey*ey;
+	double t = (lengthSqr > 0.0) ? MAX(0.0, MIN(1.0, (dx*ex + dy*ey)/lengthSqr)) : 0.0;
+	return hypot(dx - t*ex, dy - t*ey);
+}
+
+
+@interface FixPolygonSimplificationTests : XCTestCase
+@end
+
+@implementation FixPolygonSimplificationTests
+
+- (void) testThinNotchDoesNotSelfIntersect
+{
+	FixPolygonClosedSegment* segment = _notchedSquare();
+	size_t originalCount = segment.vertexCount;
+	v3i_t* original = calloc(originalCount, sizeof(*original));
+	memcpy(original, segment.vertices, originalCount*sizeof(*original));
+
+	FixPolygon* polygon = [[FixPolygon alloc] init];
+	polygon.segments = @[segment];
+	[polygon simplifyWithTolerance: TOLERANCE];
+
+	size_t count = segment.vertexCount;
+	v3i_t* vertices = segment.vertices;
+	XCTAssertTrue(count >= 3);
+	XCTAssertTrue(count < originalCount, @"%zu of %zu vertices left", count, originalCount);
+
+	// edges further apart must not touch, neighbouring edges must not fold back onto each other
+	for (size_t i = 0; i < count; ++i)
+	{
+		v3i_t a = vertices[i], b = vertices[(i+1) % count], c = vertices[(i+2) % count];
+
+		BOOL foldsBack = !_orientation(a, b, c) && (((int64_t)a.x - b.x)*((int64_t)c.x - b.x) + ((int64_t)a.y - b.y)*((int64_t)c.y - b.y) > 0);
+		XCTAssertFalse(foldsBack, @"edges fold back at vertex %zu", (i+1) % count);
+
+		for (size_t j = i+2; j < count; ++j)
+		{
+			if ((j+1) % count == i)
+				continue;
+			XCTAssertFalse(_edgesIntersect(a, b, vertices[j], vertices[(j+1) % count]), @"edges %zu and %zu intersect", i, j);
+		}
+	}
+
+	// the simplified ring stays within tolerance of every original vertex
+	for (size_t k = 0; k < originalCount; ++k)
+	{
+		double distance = INFINITY;
+		for (size_t i = 0; i < count; ++i)
+			distance = MIN(distance, _pointEdgeDistance(original[k], vertices[i], vertices[(i+1) % count]));
+		XCTAssertTrue(distance <= TOLERANCE + FIXED_POINT_SLACK, @"vertex %zu is %f away", k, distance);
+	}
+
+	// the notch keeps its depth
+	BOOL reachesBottom = NO;
+	for (size_t i = 0; i < count; ++i)
+	{
+		vector_t v = v3iToFloat(vertices[i]);
+		reachesBottom = reachesBottom || ((fabs(v.farr[0] - 10.0) < TOLERANCE) && (v.farr[1] < 10.0 + TOLERANCE));
+	}
+	XCTAssertTrue(reachesBottom);
+
+	free(original);
+}
+
+@end
@@ -0,0 +1,180 @@
+//
+//  GMPlateSchedulerTests.m
+//  Giddy Machinist
+//
+//  Created by Dömötör Gulyás on 19.10.2026.
+//  Copyright (c) 2026 Dömötör Gulyás. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "GMPlateScheduler.h"
+#import "GMCancellationToken.h"
+
+
+#define TEST_TIMEOUT_NS (5*NSEC_PER_SEC)
+
+static BOOL _wait(dispatch_semaphore_t semaphore)
+{
+	return !dispatch_semaphore_wait(semaphore, dispatch_time(DISPATCH_TIME_NOW, TEST_TIMEOUT_NS));
+}
+
+
+@interface GMPlateSchedulerTests : XCTestCase
+@end
+
+@implementation GMPlateSchedulerTests
+{
+	GMPlateScheduler*	scheduler;
+}
+
+- (void) setUp
+{
+	[super setUp];
+
+	// a single worker, so that a blocked job holds back everything submitted after it
+	scheduler = [[GMPlateScheduler alloc] init];
+	scheduler.maxConcurrentJobs = 1;
+}
+
+- (void) testEqualKeysShareOneRun
+{
+	dispatch_semaphore_t started = dispatch_semaphore_create(0);
+	dispatch_semaphore_t gate = dispatch_semaphore_create(0);
+	__block long runs = 0;
+	NSMutableArray* results = [NSMutableArray array];
+
+	id (^work)(GMCancellationToken*) = ^id(GMCancellationToken* token) {
+		__atomic_add_fetch(&runs, 1, __ATOMIC_RELAXED);
+		dispatch_semaphore_signal(started);
+		dispatch_semaphore_wait(gate, DISPATCH_TIME_FOREVER);
+		return [[NSObject alloc] init];
+	};
+	void (^completion)(id) = ^(id result) {
+		@synchronized(results) {
+			[results addObject: result];
+		}
+	};
+
+	GMCancellationToken* first = [[GMCancellationToken alloc] init];
+	GMCancellationToken* second = [[GMCancellationToken alloc] init];
+	GMCancellationToken* third = [[GMCancellationToken alloc] init];
+
+	[scheduler addJobForStage: GMPlateStageSlice owner: nil z: 1.0 key: @"part" cancellationToken: first work: work completion: completion];
+	XCTAssertTrue(_wait(started));
+
+	// joins the running job
+	[scheduler addJobForStage: GMPlateStageSlice owner: nil z: 1.0 key: @"part" cancellationToken: second work: work completion: completion];
+	XCTAssertEqual(scheduler.pendingJobCount, (NSUInteger)0);
+
+	dispatch_semaphore_signal(gate);
+	[first waitUntilIdle];
+	[second waitUntilIdle];
+
+	// answered from the cache
+	[scheduler addJobForStage: GMPlateStageSlice owner: nil z: 1.0 key: @"part" cancellationToken: third work: work completion: completion];
+	[third waitUntilIdle];
+
+	XCTAssertEqual(runs, 1L);
+	XCTAssertEqual(results.count, (NSUInteger)3);
+	XCTAssertTrue((results[0] == results[1]) && (results[1] == results[2]));
+}
+
+- (void) testJobKeysHashTheirContent
+{
+	uint8_t bytes[32] = {1, 2, 3};
+	NSData* digest = [NSData dataWithBytes: bytes length: sizeof(bytes)];
+	bytes[0] = 4;
+	NSData* otherDigest = [NSData dataWithBytes: bytes length: sizeof(bytes)];
+
+	double parameters[2] = {0.2, 0.01};
+	double otherParameters[2] = {0.4, 0.01};
+
+	NSData* key = GMPlateJobKey(digest, parameters, 2);
+	XCTAssertEqualObjects(key, GMPlateJobKey([digest copy], parameters, 2));
+	XCTAssertEqual(key.hash, GMPlateJobKey([digest copy], parameters, 2).hash);
+
+	XCTAssertNotEqualObjects(key, GMPlateJobKey(digest, otherParameters, 2));
+	XCTAssertNotEqualObjects(key, GMPlateJobKey(otherDigest, parameters, 2));
+	XCTAssertNotEqual(key.hash, GMPlateJobKey(otherDigest, parameters, 2).hash);
+}
+
+- (void) testCancelledPendingJobIsDropped
+{
+	dispatch_semaphore_t started = dispatch_semaphore_create(0);
+	dispatch_semaphore_t gate = dispatch_semaphore_create(0);
+	__block long runs = 0;
+	__block BOOL completed = NO;
+
+	GMCancellationToken* blocker = [[GMCancellationToken alloc] init];
+	GMCancellationToken* token = [[GMCancellationToken alloc] init];
+
+	[scheduler addJobForStage: GMPlateStageSlice owner: nil z: NAN key: nil cancellationToken: blocker work: ^id(GMCancellationToken* t) {
+		dispatch_semaphore_signal(started);
+		dispatch_semaphore_wait(gate, DISPATCH_TIME_FOREVER);
+		return nil;
+	} completion: nil];
+	XCTAssertTrue(_wait(started));
+
+	[scheduler addJobForStage: GMPlateStageSkeleton owner: nil z: 1.0 key: @"dropped" cancellationToken: token work: ^id(GMCancellationToken* t) {
+		__atomic_add_fetch(&runs, 1, __ATOMIC_RELAXED);
+		return @YES;
+	} completion: ^(id result) {
+		completed = YES;
+	}];
+	XCTAssertEqual(scheduler.pendingJobCount, (NSUInteger)1);
+
+	// dropped right away, so waiting for the token does not wait for the blocked worker
+	[scheduler cancelJobsWithToken: token];
+	XCTAssertEqual(scheduler.pendingJobCount, (NSUInteger)0);
+	[token waitUntilIdle];
+
+	dispatch_semaphore_signal(gate);
+	[blocker waitUntilIdle];
+
+	XCTAssertEqual(runs, 0L);
+	XCTAssertFalse(completed);
+}
+
+- (void) testCancelledRunningJobIsRunAgain
+{
+	dispatch_semaphore_t started = dispatch_semaphore_create(0);
+	dispatch_semaphore_t gate = dispatch_semaphore_create(0);
+	__block long runs = 0;
+	__block id cancelledResult = nil, keptResult = nil;
+
+	id (^work)(GMCancellationToken*) = ^id(GMCancellationToken* token) {
+		long run = __atomic_add_fetch(&runs, 1, __ATOMIC_RELAXED);
+		if (run == 1)
+		{
+			dispatch_semaphore_signal(started);
+			dispatch_semaphore_wait(gate, DISPATCH_TIME_FOREVER);
+		}
+		return @(run);
+	};
+
+	GMCancellationToken* cancelled = [[GMCancellationToken alloc] init];
+	GMCancellationToken* kept = [[GMCancellationToken alloc] init];
+
+	[scheduler addJobForStage: GMPlateStageSlice owner: nil z: 1.0 key: @"rerun" cancellationToken: cancelled work: work completion: ^(id result) {
+		cancelledResult = result;
+	}];
+	XCTAssertTrue(_wait(started));
+
+	[scheduler addJobForStage: GMPlateStageSlice owner: nil z: 1.0 key: @"rerun" cancellationToken: kept work: work completion: ^(id result) {
+		keptResult = result;
+	}];
+
+	// the running job was started for the cancelled submission, its partial result is thrown away
+	[scheduler cancelJobsWithToken: cancelled];
+	dispatch_semaphore_signal(gate);
+
+	[cancelled waitUntilIdle];
+	[kept waitUntilIdle];
+
+	XCTAssertEqual(runs, 2L);
+	XCTAssertNil(cancelledResult);
+	XCTAssertEqualObjects(keptResult, @2);
+}
+
+@end
@@ -0,0 +1,96 @@
+//
+//  MachineSimulatorTests.m
+//  Giddy Machinist
+//
+//  Created by Dömötör Gulyás on 19.10.2026.
+//  Copyright (c) 2026 Dömötör Gulyás. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "MachineSimulator.h"
+#import "RS274Interpreter.h"
+#import "RS274Parser.h"
+
+
+#define ACCELERATION 100.0	// mm/s² on every axis
+#define SPEED_LIMIT 50.0	// mm/s on every axis
+#define TIME_TOLERANCE 1e-6
+
+/*!
+ Moves along single axes, each starting and ending at rest, as no junction deviation is allowed. A trapezoid from rest to speed v and back over length L takes L/v + v/a, v/a of it ramping.
+ */
+static NSString* const _program =
+	@"G21 G90\n"
+	@"G1 X60 F1800\n"	// 30 mm/s over 60 mm
+	@"G1 Y30 F600\n"	// 10 mm/s over 30 mm
+	@"G0 X0\n"			// the axis speed limit over 60 mm
+	@"G20 G1 Y0 F12\n";	// 12 in/min, 5.08 mm/s, over 30 mm
+
+
+@interface MachineSimulatorTests : XCTestCase
+@end
+
+@implementation MachineSimulatorTests
+{
+	MotionPlanner*	machine;
+}
+
+- (void) setUp
+{
+	[super setUp];
+
+	machine = [[MotionPlanner alloc] init];
+	machine.accelerationLimitTable = @[@ACCELERATION, @ACCELERATION, @ACCELERATION, @ACCELERATION, @ACCELERATION, @ACCELERATION];
+	machine.speedLimitTable = @[@SPEED_LIMIT, @SPEED_LIMIT, @SPEED_LIMIT, @SPEED_LIMIT, @SPEED_LIMIT, @SPEED_LIMIT];
+	machine.backlashTable = @[@0.0, @0.0, @0.0, @0.0, @0.0, @0.0];
+	machine.junctionDeviation = 0.0;
+	machine.jerkLimit = 0.0;
+}
+
+- (void) checkReport: (GMachineSimulationReport*) report
+{
+	double speeds[4] = {30.0, 10.0, SPEED_LIMIT, 12.0*25.4/60.0};
+	double lengths[4] = {60.0, 30.0, 60.0, 30.0};
+
+	double cruiseTimes[4], rampTimes[4];
+	for (int i = 0; i < 4; ++i)
+	{
+		rampTimes[i] = speeds[i]/ACCELERATION;
+		cruiseTimes[i] = lengths[i]/speeds[i] - rampTimes[i];
+	}
+
+	XCTAssertEqual(report.segmentCount, (size_t)4);
+	XCTAssertEqualWithAccuracy(report.totalDistance, 180.0, TIME_TOLERANCE);
+	XCTAssertEqualWithAccuracy(report.totalTime, 2.3 + 3.1 + 1.7 + 30.0/speeds[3] + rampTimes[3], TIME_TOLERANCE);
+	XCTAssertEqualWithAccuracy(report.accelerationLimitedTime, rampTimes[0] + rampTimes[1] + rampTimes[2] + rampTimes[3], TIME_TOLERANCE);
+	XCTAssertEqualWithAccuracy(report.feedLimitedTime, cruiseTimes[0] + cruiseTimes[1] + cruiseTimes[3], TIME_TOLERANCE);
+	XCTAssertEqualWithAccuracy(report.axisSpeedLimitedTime, cruiseTimes[2], TIME_TOLERANCE);
+	XCTAssertEqualWithAccuracy(report.rapidTime, 1.7, TIME_TOLERANCE);
+}
+
+- (void) testFeedsFromBlockInterpretation
+{
+	RS274Parser* parser = [[RS274Parser alloc] init];
+	XCTAssertTrue([parser parseData: [_program dataUsingEncoding: NSASCIIStringEncoding] named: @"feeds"]);
+
+	RS274Interpreter* interpreter = [[RS274Interpreter alloc] init];
+	[interpreter interpretParsedProgram: parser];
+
+	MachineSimulator* simulator = [[MachineSimulator alloc] initWithMachine: machine];
+	[self checkReport: [simulator simulateMoves: interpreter.moves]];
+}
+
+- (void) testFeedsFromCommandInterpretation
+{
+	RS274Parser* parser = [[RS274Parser alloc] init];
+	XCTAssertTrue([parser parseData: [_program dataUsingEncoding: NSASCIIStringEncoding] named: @"feeds"]);
+
+	RS274Interpreter* interpreter = [[RS274Interpreter alloc] init];
+	[interpreter interpretCommandBlocks: parser.commandBlocks];
+
+	MachineSimulator* simulator = [[MachineSimulator alloc] initWithMachine: machine];
+	[self checkReport: [simulator simulateMoves: interpreter.moves]];
+}
+
+@end
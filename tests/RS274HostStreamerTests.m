@@ -0,0 +1,380 @@
+//
+//  RS274HostStreamerTests.m
+//  Giddy Machinist
+//
+//  Created by Dömötör Gulyás on 19.10.2026.
+//  Copyright (c) 2026 Dömötör Gulyás. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "RS274HostStreamer.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <util.h>
+
+
+#define TEST_TIMEOUT 10.0
+
+
+/*!
+ Answers on the master side of a pty like Marlin does on its serial port: lines are checked for their number and checksum, and each is answered with ok, or an error and a resend request for the line expected next. Faults are injected by line number.
+ */
+@interface _RS274FirmwareEmulator : NSObject
+{
+@public
+	int					fd;
+	volatile int32_t	stopped;
+	dispatch_semaphore_t	finished;
+
+	uint32_t			lastNumber;
+	NSMutableArray*		commands;			// accepted lines, without number and checksum
+	NSCountedSet*		receivedNumbers;	// every numbered line received, including rejected ones
+
+	NSMutableIndexSet*	corruptLines;		// rejected with a checksum error when first received
+	NSMutableIndexSet*	lostResends;		// not answered when received a second time, as if lost on the wire
+	BOOL				reportWait;			// an idle firmware reports "wait" after a lost line
+	uint32_t			busyLine;			// the planner is full after accepting this line
+	double				busyTime;
+	uint32_t			haltLine;
+	BOOL				halted;
+}
+@end
+
+@implementation _RS274FirmwareEmulator
+
+- (instancetype) initWithFileDescriptor: (int) fileDescriptor
+{
+	if (!(self = [super init]))
+		return nil;
+
+	fd = fileDescriptor;
+	finished = dispatch_semaphore_create(0);
+	commands = [NSMutableArray array];
+	receivedNumbers = [NSCountedSet set];
+	corruptLines = [NSMutableIndexSet indexSet];
+	lostResends = [NSMutableIndexSet indexSet];
+
+	return self;
+}
+
+- (void) respond: (NSString*) response
+{
+	NSData* data = [[response stringByAppendingString: @"\n"] dataUsingEncoding: NSASCIIStringEncoding];
+	const char* bytes = data.bytes;
+	size_t k = 0;
+	while (k < data.length)
+	{
+		ssize_t n = write(fd, bytes + k, data.length - k);
+		if (n > 0)
+			k += n;
+		else if (errno != EINTR)
+			return;
+	}
+}
+
+- (void) requestResend: (NSString*) error
+{
+	[self respond: [NSString stringWithFormat: @"Error:%@, Last Line: %u", error, lastNumber]];
+	[self respond: [NSString stringWithFormat: @"Resend: %u", lastNumber+1]];
+	[self respond: @"ok"];
+}
+
+- (void) handleLine: (const char*) line
+{
+	if (halted || (line[0] != 'N'))
+		return;
+
+	char* text = NULL;
+	uint32_t number = (uint32_t)strtoul(line+1, &text, 10);
+	const char* star = strrchr(line, '*');
+	if (!star || (*text != ' '))
+	{
+		[self requestResend: @"No Checksum with line number"];
+		return;
+	}
+	text++;
+
+	[receivedNumbers addObject: @(number)];
+	NSUInteger timesReceived = [receivedNumbers countForObject: @(number)];
+
+	if ([corruptLines containsIndex: number] && (timesReceived == 1))
+	{
+		[self requestResend: @"checksum mismatch"];
+		return;
+	}
+	if ([lostResends containsIndex: number] && (timesReceived == 2))
+	{
+		if (reportWait)
+			[self respond: @"wait"];
+		return;
+	}
+
+	uint8_t checksum = 0;
+	for (const char* c = line; c < star; ++c)
+		checksum ^= (uint8_t)*c;
+	if (checksum != strtoul(star+1, NULL, 10))
+	{
+		[self requestResend: @"checksum mismatch"];
+		return;
+	}
+
+	NSString* command = [[NSString alloc] initWithBytes: text length: star - text encoding: NSASCIIStringEncoding];
+
+	if ([command hasPrefix: @"M110"])
+	{
+		lastNumber = number;
+		[self respond: @"ok"];
+		return;
+	}
+	if (number != lastNumber+1)
+	{
+		[self requestResend: @"Line Number is not Last Line Number+1"];
+		return;
+	}
+
+	lastNumber = number;
+	[commands addObject: command];
+
+	if (number == haltLine)
+	{
+		halted = YES;
+		[self respond: @"Error:Printer halted. kill() called!"];
+		return;
+	}
+
+	// the ok is held back until the planner has room again, busy messages keep the host informed
+	if (number == busyLine)
+		for (double t = 0.0; t < busyTime; t += 0.2)
+		{
+			[self respond: @"echo:busy: processing"];
+			usleep(200000);
+		}
+
+	[self respond: @"ok"];
+}
+
+- (void) run
+{
+	[self respond: @"start"];
+
+	char line[256];
+	size_t length = 0;
+
+	while (!__atomic_load_n(&stopped, __ATOMIC_ACQUIRE))
+	{
+		struct pollfd pfd = {.fd = fd, .events = POLLIN};
+		if (poll(&pfd, 1, 20) <= 0)
+			continue;
+
+		char buf[256];
+		ssize_t n = read(fd, buf, sizeof(buf));
+		if (n <= 0)
+			break;
+
+		for (ssize_t i = 0; i < n; ++i)
+		{
+			if (buf[i] == '\n')
+			{
+				line[length] = 0;
+				@autoreleasepool {
+					[self handleLine: line];
+				}
+				length = 0;
+			}
+			else if (length + 1 < sizeof(line))
+				line[length++] = buf[i];
+		}
+	}
+
+	dispatch_semaphore_signal(finished);
+}
+
+@end
+
+
+@interface RS274HostStreamerTests : XCTestCase
+@end
+
+@implementation RS274HostStreamerTests
+{
+	int						masterFd, slaveFd;
+	_RS274FirmwareEmulator*	firmware;
+	NSArray*				program;
+}
+
+- (void) setUp
+{
+	[super setUp];
+
+	XCTAssertEqual(openpty(&masterFd, &slaveFd, NULL, NULL, NULL), 0);
+
+	// no echo or newline translation, like a serial port
+	struct termios options;
+	tcgetattr(slaveFd, &options);
+	cfmakeraw(&options);
+	tcsetattr(slaveFd, TCSANOW, &options);
+
+	firmware = [[_RS274FirmwareEmulator alloc] initWithFileDescriptor: masterFd];
+
+	NSMutableArray* lines = [NSMutableArray array];
+	for (int i = 0; i < 200; ++i)
+		[lines addObject: [NSString stringWithFormat: @"G1 X%d.5 Y%d", i, 2*i]];
+	program = lines;
+}
+
+- (void) tearDown
+{
+	__atomic_store_n(&firmware->stopped, 1, __ATOMIC_RELEASE);
+	dispatch_semaphore_wait(firmware->finished, dispatch_time(DISPATCH_TIME_NOW, TEST_TIMEOUT*NSEC_PER_SEC));
+	close(masterFd);
+
+	[super tearDown];
+}
+
+/*!
+ Streams source, returns the completion error, or a timeout error.
+ */
+- (NSError*) streamSource: (NSString*) source withStreamer: (RS274HostStreamer*) streamer
+{
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		[firmware run];
+	});
+
+	__block BOOL done = NO;
+	__block NSError* result = nil;
+	[streamer streamData: [source dataUsingEncoding: NSASCIIStringEncoding] completion: ^(NSError* error) {
+		result = error;
+		done = YES;
+	}];
+
+	// the completion is called on the main queue
+	NSDate* deadline = [NSDate dateWithTimeIntervalSinceNow: TEST_TIMEOUT];
+	while (!done && ([deadline timeIntervalSinceNow] > 0.0))
+		[[NSRunLoop currentRunLoop] runMode: NSDefaultRunLoopMode beforeDate: [NSDate dateWithTimeIntervalSinceNow: 0.05]];
+
+	if (!done)
+	{
+		[streamer cancel];
+		return [NSError errorWithDomain: NSPOSIXErrorDomain code: ETIMEDOUT userInfo: nil];
+	}
+	return result;
+}
+
+/*!
+ Streams the program with comments added, which are to be stripped.
+ */
+- (NSError*) streamWithStreamer: (RS274HostStreamer*) streamer
+{
+	NSMutableString* source = [NSMutableString stringWithString: @"; header comment\n\n"];
+	for (NSString* line in program)
+		[source appendFormat: @"  %@ ; comment\n", line];
+
+	return [self streamSource: source withStreamer: streamer];
+}
+
+- (RS274HostStreamer*) streamer
+{
+	return [[RS274HostStreamer alloc] initWithFileDescriptor: slaveFd closeWhenDone: YES];
+}
+
+- (void) testStreamsAllLines
+{
+	RS274HostStreamer* streamer = [self streamer];
+	XCTAssertNil([self streamWithStreamer: streamer]);
+
+	XCTAssertEqualObjects(firmware->commands, program);
+
+	RS274HostStreamerCounters counters = streamer.counters;
+	XCTAssertEqual(counters.linesResent, (size_t)0);
+	XCTAssertEqual(counters.linesAcknowledged, program.count + 1); // and the line number reset
+}
+
+- (void) testStripsParenthesizedComments
+{
+	NSMutableString* source = [NSMutableString stringWithString: @"(header comment)\n(another one) ; and more\n"];
+	for (int i = 0; i < 200; ++i)
+	{
+		if (i % 2)
+			[source appendFormat: @"(leading) G1\tX%d.5  (inline)Y%d (trailing)\n", i, 2*i];
+		else
+			[source appendFormat: @"G1 X%d.5(no space) Y%d;comment (not closed\n", i, 2*i];
+	}
+
+	// a resent line is stripped the same way
+	[firmware->corruptLines addIndex: 51];
+
+	XCTAssertNil([self streamSource: source withStreamer: [self streamer]]);
+	XCTAssertEqualObjects(firmware->commands, program);
+}
+
+- (void) testResendsRejectedLine
+{
+	[firmware->corruptLines addIndex: 50];
+	[firmware->corruptLines addIndex: 120];
+
+	RS274HostStreamer* streamer = [self streamer];
+	XCTAssertNil([self streamWithStreamer: streamer]);
+
+	XCTAssertEqualObjects(firmware->commands, program);
+	XCTAssertEqual([firmware->receivedNumbers countForObject: @50], (NSUInteger)2);
+	XCTAssertEqual([firmware->receivedNumbers countForObject: @120], (NSUInteger)2);
+	XCTAssertTrue(streamer.counters.resendRequests >= 2);
+}
+
+- (void) testBusyFirmwareIsNotResentTo
+{
+	// the resent line fills the planner, its ok takes longer than the resend timeout
+	[firmware->corruptLines addIndex: 20];
+	firmware->busyLine = 20;
+	firmware->busyTime = 1.5;
+
+	RS274HostStreamer* streamer = [self streamer];
+	streamer.resendTimeout = 0.5;
+	XCTAssertNil([self streamWithStreamer: streamer]);
+
+	XCTAssertEqualObjects(firmware->commands, program);
+	XCTAssertEqual([firmware->receivedNumbers countForObject: @20], (NSUInteger)2);
+}
+
+- (void) testResendsAgainAfterSilence
+{
+	[firmware->corruptLines addIndex: 30];
+	[firmware->lostResends addIndex: 30];
+
+	RS274HostStreamer* streamer = [self streamer];
+	streamer.resendTimeout = 0.3;
+	XCTAssertNil([self streamWithStreamer: streamer]);
+
+	XCTAssertEqualObjects(firmware->commands, program);
+	XCTAssertEqual([firmware->receivedNumbers countForObject: @30], (NSUInteger)3);
+}
+
+- (void) testResendsAgainWhenFirmwareWaits
+{
+	[firmware->corruptLines addIndex: 30];
+	[firmware->lostResends addIndex: 30];
+	firmware->reportWait = YES;
+
+	// far beyond the test timeout, only the wait can trigger the resend
+	RS274HostStreamer* streamer = [self streamer];
+	streamer.resendTimeout = 1000.0;
+	XCTAssertNil([self streamWithStreamer: streamer]);
+
+	XCTAssertEqualObjects(firmware->commands, program);
+	XCTAssertEqual([firmware->receivedNumbers countForObject: @30], (NSUInteger)3);
+}
+
+- (void) testHaltedFirmwareFails
+{
+	firmware->haltLine = 10;
+
+	NSError* error = [self streamWithStreamer: [self streamer]];
+	XCTAssertEqualObjects(error.domain, RS274HostStreamerErrorDomain);
+	XCTAssertEqual(firmware->commands.count, (NSUInteger)10);
+}
+
+@end
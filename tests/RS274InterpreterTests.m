@@ -0,0 +1,120 @@
+//
+//  RS274InterpreterTests.m
+//  Giddy Machinist
+//
+//  Created by Dömötör Gulyás on 19.10.2026.
+//  Copyright (c) 2026 Dömötör Gulyás. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "RS274Interpreter.h"
+#import "RS274Parser.h"
+
+
+#define ARC_TOLERANCE 0.01
+#define POSITION_TOLERANCE 1e-6
+
+
+@interface RS274InterpreterTests : XCTestCase
+@end
+
+@implementation RS274InterpreterTests
+
+/*!
+ The moves of program, interpreted block by block and from command objects, which have to agree.
+ */
+- (GMachineMoveBuffer*) movesForProgram: (NSString*) program
+{
+	RS274Parser* parser = [[RS274Parser alloc] init];
+	XCTAssertTrue([parser parseData: [program dataUsingEncoding: NSASCIIStringEncoding] named: @"arcs"]);
+
+	RS274Interpreter* blockInterpreter = [[RS274Interpreter alloc] init];
+	blockInterpreter.arcTolerance = ARC_TOLERANCE;
+	[blockInterpreter interpretParsedProgram: parser];
+
+	RS274Interpreter* commandInterpreter = [[RS274Interpreter alloc] init];
+	commandInterpreter.arcTolerance = ARC_TOLERANCE;
+	[commandInterpreter interpretCommandBlocks: parser.commandBlocks];
+
+	GMachineMoveBuffer* moves = blockInterpreter.moves;
+	XCTAssertEqual(moves.count, commandInterpreter.moves.count);
+	for (size_t k = 0; k < MIN(moves.count, commandInterpreter.moves.count); ++k)
+	{
+		GMachineMove a = [moves moveAtIndex: k];
+		GMachineMove b = [commandInterpreter.moves moveAtIndex: k];
+		XCTAssertEqual(a.type, b.type);
+		XCTAssertEqual(a.feed, b.feed);
+		for (size_t i = 0; i < GMachineAxisCount; ++i)
+			XCTAssertEqualWithAccuracy(a.target[i], b.target[i], POSITION_TOLERANCE);
+	}
+	return moves;
+}
+
+/*!
+ Checks that the moves from firstIndex on are chords of the circle around the origin with the given radius, that end at the given point, and returns the swept angle, positive counter-clockwise.
+ */
+- (double) checkArcMoves: (GMachineMoveBuffer*) moves from: (size_t) firstIndex radius: (double) radius endX: (double) x endY: (double) y
+{
+	GMachineMove previous = [moves moveAtIndex: firstIndex-1];
+	double sweep = 0.0;
+
+	for (size_t k = firstIndex; k < moves.count; ++k)
+	{
+		GMachineMove move = [moves moveAtIndex: k];
+		XCTAssertEqual(move.type, (uint8_t)GMachineMoveFeed);
+
+		double x0 = previous.target[GMachineAxisX], y0 = previous.target[GMachineAxisY];
+		double x1 = move.target[GMachineAxisX], y1 = move.target[GMachineAxisY];
+		XCTAssertEqualWithAccuracy(hypot(x1, y1), radius, POSITION_TOLERANCE);
+
+		double midRadius = hypot(0.5*(x0 + x1), 0.5*(y0 + y1));
+		XCTAssertTrue(radius - midRadius <= ARC_TOLERANCE + POSITION_TOLERANCE, @"chord deviates by %f", radius - midRadius);
+
+		sweep += atan2(x0*y1 - y0*x1, x0*x1 + y0*y1);
+		previous = move;
+	}
+
+	XCTAssertEqualWithAccuracy(previous.target[GMachineAxisX], x, POSITION_TOLERANCE);
+	XCTAssertEqualWithAccuracy(previous.target[GMachineAxisY], y, POSITION_TOLERANCE);
+	return sweep;
+}
+
+- (void) testCounterClockwiseArc
+{
+	GMachineMoveBuffer* moves = [self movesForProgram: @"G1 X10 Y0 F600\nG3 X0 Y10 I-10 J0\n"];
+	XCTAssertTrue(moves.count > 2);
+
+	double sweep = [self checkArcMoves: moves from: 1 radius: 10.0 endX: 0.0 endY: 10.0];
+	XCTAssertEqualWithAccuracy(sweep, 0.5*M_PI, POSITION_TOLERANCE);
+	XCTAssertEqual([moves moveAtIndex: moves.count-1].feed, 600.0);
+}
+
+- (void) testClockwiseArcTakesTheLongWay
+{
+	GMachineMoveBuffer* moves = [self movesForProgram: @"G1 X10 Y0 F600\nG2 X0 Y10 I-10 J0\n"];
+
+	double sweep = [self checkArcMoves: moves from: 1 radius: 10.0 endX: 0.0 endY: 10.0];
+	XCTAssertEqualWithAccuracy(sweep, -1.5*M_PI, POSITION_TOLERANCE);
+}
+
+- (void) testFullCircleInInchesWithHelix
+{
+	// the arc is in the modes of its block, and the center offset is relative even in incremental mode
+	GMachineMoveBuffer* moves = [self movesForProgram: @"G1 X10 Y0 F600\nG20 G91 G2 Z-0.1 I-0.39370078740157477\n"];
+
+	double sweep = [self checkArcMoves: moves from: 1 radius: 10.0 endX: 10.0 endY: 0.0];
+	XCTAssertEqualWithAccuracy(sweep, -2.0*M_PI, POSITION_TOLERANCE);
+
+	// Z descends steadily along the helix
+	double z = 0.0;
+	for (size_t k = 1; k < moves.count; ++k)
+	{
+		double nextZ = [moves moveAtIndex: k].target[GMachineAxisZ];
+		XCTAssertTrue(nextZ < z);
+		z = nextZ;
+	}
+	XCTAssertEqualWithAccuracy(z, -2.54, POSITION_TOLERANCE);
+}
+
+@end
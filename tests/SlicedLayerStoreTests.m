@@ -0,0 +1,127 @@
+//
+//  SlicedLayerStoreTests.m
+//  Giddy Machinist
+//
+//  Created by Dömötör Gulyás on 19.10.2026.
+//  Copyright (c) 2026 Dömötör Gulyás. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "SlicedLayerStore.h"
+#import "Slicer.h"
+#import "SlicedOutline.h"
+#import "FixPolygon.h"
+
+
+static SlicedLayer* _squareLayer(double z, double size)
+{
+	v3i_t vertices[4] = {
+		v3iCreateFromFloat(0.0, 0.0, z, 16),
+		v3iCreateFromFloat(size, 0.0, z, 16),
+		v3iCreateFromFloat(size, size, z, 16),
+		v3iCreateFromFloat(0.0, size, z, 16),
+	};
+
+	FixPolygonClosedSegment* segment = [[FixPolygonClosedSegment alloc] init];
+	[segment addVertices: vertices count: 4];
+
+	SlicedOutline* outline = [[SlicedOutline alloc] init];
+	outline.outline = segment;
+
+	SlicedLayer* layer = [[SlicedLayer alloc] init];
+	layer.outlinePaths = @[outline];
+	layer.layerZ = z;
+	return layer;
+}
+
+
+@interface SlicedLayerStoreTests : XCTestCase
+@end
+
+@implementation SlicedLayerStoreTests
+
+- (void) testLayersAreSortedByZ
+{
+	SlicedLayerStore* store = [[SlicedLayerStore alloc] init];
+	XCTAssertEqual([store indexOfLayerNearestZ: 1.0], (size_t)NSNotFound);
+
+	[store addLayer: _squareLayer(0.4, 10.0)];
+	[store addLayer: _squareLayer(0.2, 10.0)];
+	[store addLayer: _squareLayer(0.6, 10.0)];
+
+	XCTAssertEqual(store.layerCount, (size_t)3);
+	XCTAssertEqual([store layerZAtIndex: 0], 0.2);
+	XCTAssertEqual([store layerZAtIndex: 1], 0.4);
+	XCTAssertEqual([store layerZAtIndex: 2], 0.6);
+
+	XCTAssertEqual([store indexOfLayerNearestZ: -1.0], (size_t)0);
+	XCTAssertEqual([store indexOfLayerNearestZ: 0.29], (size_t)0);
+	XCTAssertEqual([store indexOfLayerNearestZ: 0.33], (size_t)1);
+	XCTAssertEqual([store indexOfLayerNearestZ: 10.0], (size_t)2);
+}
+
+- (void) testEvictsLeastRecentlyUsed
+{
+	SlicedLayerStore* store = [[SlicedLayerStore alloc] init];
+	store.residentByteLimit = SIZE_MAX;
+
+	NSArray* layers = @[_squareLayer(0.2, 10.0), _squareLayer(0.4, 10.0), _squareLayer(0.6, 10.0)];
+	for (SlicedLayer* layer in layers)
+		[store addLayer: layer];
+
+	XCTAssertEqual(store.residentBytes, [layers[0] byteSize] + [layers[1] byteSize] + [layers[2] byteSize]);
+	XCTAssertTrue(store.scratchFileBytes > 0);
+
+	// using the first layer leaves the second as the least recently used
+	XCTAssertTrue([store layerAtIndex: 0] == layers[0]);
+	store.residentByteLimit = store.residentBytes - 1;
+
+	XCTAssertEqual(store.residentBytes, [layers[0] byteSize] + [layers[2] byteSize]);
+	XCTAssertTrue([store layerAtIndex: 0] == layers[0]);
+	XCTAssertTrue([store layerAtIndex: 2] == layers[2]);
+
+	// read back from the scratch file
+	SlicedLayer* reloaded = [store layerAtIndex: 1];
+	XCTAssertNotNil(reloaded);
+	XCTAssertFalse(reloaded == layers[1]);
+	XCTAssertEqual(reloaded.layerZ, 0.4);
+	XCTAssertEqual(reloaded.outlinePaths.count, (NSUInteger)1);
+	SlicedOutline* outline = reloaded.outlinePaths[0];
+	XCTAssertEqual(outline.outline.vertexCount, (size_t)4);
+
+	// the most recently used layer stays regardless of the limit
+	store.residentByteLimit = 0;
+	XCTAssertTrue([store layerAtIndex: 1] == reloaded);
+	XCTAssertEqual(store.residentBytes, reloaded.byteSize);
+}
+
+- (void) testGrownLayersAreMeasuredAgain
+{
+	SlicedLayerStore* store = [[SlicedLayerStore alloc] init];
+	store.residentByteLimit = SIZE_MAX;
+
+	SlicedLayer* layer = _squareLayer(0.2, 10.0);
+	[layer compactOutlines];
+	size_t compactSize = layer.byteSize;
+
+	[store addLayer: layer];
+	XCTAssertEqual(store.residentBytes, compactSize);
+
+	// materializing the outlines grows the layer, which the store notices once the layer is used
+	XCTAssertEqual(layer.outlinePaths.count, (NSUInteger)1);
+	XCTAssertTrue(layer.byteSize > compactSize);
+
+	XCTAssertTrue([store layerAtIndex: 0] == layer);
+	XCTAssertEqual(store.residentBytes, layer.byteSize);
+
+	// evicting drops the materialized outlines of a layer still held elsewhere
+	store.residentByteLimit = 0;
+	SlicedLayer* next = _squareLayer(0.4, 10.0);
+	[store addLayer: next];
+
+	XCTAssertEqual(layer.byteSize, compactSize);
+	XCTAssertEqual(store.residentBytes, next.byteSize);
+}
+
+@end
@@ -0,0 +1,212 @@
+//
+//  StepGeneratorTests.m
+//  Giddy Machinist
+//
+//  Created by Dömötör Gulyás on 19.10.2026.
+//  Copyright (c) 2026 Dömötör Gulyás. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#include "StepGenerator.h"
+
+#include <sched.h>
+#include <unistd.h>
+
+
+#define TEST_TIMEOUT_NS (10*NSEC_PER_SEC)
+#define SEGMENT_COUNT (20*STEPPER_QUEUE_CAPACITY + 7)
+#define PRODUCER_PAUSE_INTERVAL 300 // segments between pauses, which let the generator run dry
+
+
+/*!
+ Steps from -20 to 20 per axis, varying from segment to segment, and every 17th segment without any steps.
+ */
+static StepperSegment _segment(uint32_t index)
+{
+	StepperSegment segment;
+	memset(&segment, 0, sizeof(segment));
+
+	for (size_t i = 0; i < STEPPER_AXIS_COUNT; ++i)
+	{
+		int32_t steps = (index % 17) ? (int32_t)((index*7 + i*13) % 41) - 20 : 0;
+		segment.steps[i] = steps;
+		segment.stepEventCount = MAX(segment.stepEventCount, (uint32_t)abs(steps));
+	}
+
+	segment.entryRate = STEPPER_RATE_ONE/4;
+	segment.peakRate = STEPPER_RATE_ONE;
+	segment.exitRate = STEPPER_RATE_ONE/4;
+	segment.minimumRate = STEPPER_RATE_ONE/8;
+	segment.accelerationPerTick = STEPPER_RATE_ONE/8;
+	segment.decelerationPerTick = STEPPER_RATE_ONE/8;
+	segment.accelerateTicks = 6;
+	segment.cruiseTicks = segment.stepEventCount;
+	return segment;
+}
+
+static uint32_t _directionBits(const StepperSegment* segment)
+{
+	uint32_t bits = 0;
+	for (size_t i = 0; i < STEPPER_AXIS_COUNT; ++i)
+		if (segment->steps[i] < 0)
+			bits |= 1u << i;
+	return bits;
+}
+
+
+@interface StepGeneratorTests : XCTestCase
+@end
+
+@implementation StepGeneratorTests
+
+/*!
+ A producer thread pushes segments without ever waiting, while a tick thread runs the generator as fast as it can, as the stepper interrupt would. Every step word is checked against the segment expected to produce it, so a segment that is lost, repeated, or read before it was completely written shows up as wrong step bits, direction bits, or step counts.
+ */
+- (void) testConcurrentProducerAndTicks
+{
+	StepperQueue* queue = calloc(1, sizeof(*queue));
+	StepperQueueInit(queue);
+
+	// the free running indices wrap around along with the slots
+	queue->head = queue->tail = UINT32_MAX - 3*STEPPER_QUEUE_CAPACITY/2;
+
+	StepGenerator* generator = calloc(1, sizeof(*generator));
+	StepGeneratorInit(generator);
+
+	__block int32_t stop = 0, producerDone = 0;
+	__block size_t pushedCount = 0, fullCount = 0;
+	dispatch_semaphore_t queueFilled = dispatch_semaphore_create(0);
+	dispatch_semaphore_t producerFinished = dispatch_semaphore_create(0);
+	dispatch_semaphore_t tickerFinished = dispatch_semaphore_create(0);
+
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		for (uint32_t i = 0; (i < SEGMENT_COUNT) && !__atomic_load_n(&stop, __ATOMIC_ACQUIRE); )
+		{
+			StepperSegment segment = _segment(i);
+			if (!StepperQueuePush(queue, &segment))
+			{
+				// the generator starts once the queue was full, so that the producer certainly runs into it
+				if (!fullCount++)
+					dispatch_semaphore_signal(queueFilled);
+				sched_yield();
+				continue;
+			}
+			pushedCount++;
+			if (!(++i % PRODUCER_PAUSE_INTERVAL))
+				usleep(2000);
+		}
+		if (!fullCount)
+			dispatch_semaphore_signal(queueFilled);
+		__atomic_store_n(&producerDone, 1, __ATOMIC_RELEASE);
+		dispatch_semaphore_signal(producerFinished);
+	});
+
+	__block uint32_t segmentIndex = 0, eventsLeft = 0;
+	__block size_t wrongStepBits = 0, wrongDirectionBits = 0, wrongStepCounts = 0, idleTicks = 0;
+
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^{
+		StepperSegment expected = _segment(0);
+		uint32_t segmentSteps[STEPPER_AXIS_COUNT] = {0};
+
+		dispatch_semaphore_wait(queueFilled, DISPATCH_TIME_FOREVER);
+
+		while (!__atomic_load_n(&stop, __ATOMIC_ACQUIRE))
+		{
+			// checked before the queue, a segment pushed in between is still seen below
+			BOOL done = __atomic_load_n(&producerDone, __ATOMIC_ACQUIRE);
+
+			uint16_t word = StepGeneratorTick(generator, queue);
+			uint32_t stepBits = STEPPER_STEP_BITS(word);
+
+			if (!stepBits)
+			{
+				if (StepGeneratorIsIdle(generator) && !StepperQueueCount(queue))
+				{
+					if (done)
+						break;
+					idleTicks++;
+				}
+				continue;
+			}
+
+			// each step word is a step event of the next segment with steps
+			if (!eventsLeft)
+			{
+				while ((segmentIndex < SEGMENT_COUNT) && !_segment(segmentIndex).stepEventCount)
+					segmentIndex++;
+				if (segmentIndex == SEGMENT_COUNT)
+				{
+					wrongStepBits++;
+					continue;
+				}
+				expected = _segment(segmentIndex);
+				eventsLeft = expected.stepEventCount;
+				memset(segmentSteps, 0, sizeof(segmentSteps));
+			}
+
+			if (STEPPER_DIRECTION_BITS(word) != _directionBits(&expected))
+				wrongDirectionBits++;
+
+			for (size_t i = 0; i < STEPPER_AXIS_COUNT; ++i)
+				if (stepBits & (1u << i))
+				{
+					if (!expected.steps[i])
+						wrongStepBits++;
+					segmentSteps[i]++;
+				}
+
+			if (!--eventsLeft)
+			{
+				for (size_t i = 0; i < STEPPER_AXIS_COUNT; ++i)
+					if (segmentSteps[i] != (uint32_t)abs(expected.steps[i]))
+						wrongStepCounts++;
+				segmentIndex++;
+			}
+		}
+		dispatch_semaphore_signal(tickerFinished);
+	});
+
+	BOOL finished = !dispatch_semaphore_wait(producerFinished, dispatch_time(DISPATCH_TIME_NOW, TEST_TIMEOUT_NS));
+	finished = finished && !dispatch_semaphore_wait(tickerFinished, dispatch_time(DISPATCH_TIME_NOW, TEST_TIMEOUT_NS));
+	if (!finished)
+	{
+		__atomic_store_n(&stop, 1, __ATOMIC_RELEASE);
+		dispatch_semaphore_wait(producerFinished, DISPATCH_TIME_FOREVER);
+		dispatch_semaphore_wait(tickerFinished, DISPATCH_TIME_FOREVER);
+	}
+	XCTAssertTrue(finished, @"producer or generator blocked");
+
+	XCTAssertEqual(pushedCount, (size_t)SEGMENT_COUNT);
+	XCTAssertEqual(StepperQueueCount(queue), (size_t)0);
+	XCTAssertTrue(StepGeneratorIsIdle(generator));
+
+	// the last segment with steps was completed, trailing segments without steps are popped without ticks
+	while ((segmentIndex < SEGMENT_COUNT) && !_segment(segmentIndex).stepEventCount)
+		segmentIndex++;
+	XCTAssertEqual(segmentIndex, (uint32_t)SEGMENT_COUNT);
+	XCTAssertEqual(eventsLeft, (uint32_t)0);
+
+	XCTAssertEqual(wrongStepBits, (size_t)0);
+	XCTAssertEqual(wrongDirectionBits, (size_t)0);
+	XCTAssertEqual(wrongStepCounts, (size_t)0);
+
+	int64_t positions[STEPPER_AXIS_COUNT] = {0};
+	for (uint32_t k = 0; k < SEGMENT_COUNT; ++k)
+	{
+		StepperSegment segment = _segment(k);
+		for (size_t i = 0; i < STEPPER_AXIS_COUNT; ++i)
+			positions[i] += segment.steps[i];
+	}
+	for (size_t i = 0; i < STEPPER_AXIS_COUNT; ++i)
+		XCTAssertEqual(generator->position[i], positions[i]);
+
+	// both a full and an empty queue were handled without waiting
+	XCTAssertTrue(fullCount > 0);
+	XCTAssertTrue(idleTicks > 0);
+
+	free(generator);
+	free(queue);
+}
+
+@end